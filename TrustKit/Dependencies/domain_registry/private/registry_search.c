@@ -22,20 +22,12 @@
 #include "string_util.h"
 #include "trie_search.h"
 
-/* RFCs 1035 and 1123 specify a max hostname length of 255 bytes. */
-static const size_t kMaxHostnameLen = 255;
-
-/* strdup() is not part of ANSI C89 so we define our own. */
-static char* StrDup(const char* s) {
-  const size_t len = strlen(s);
-  char* s2 = malloc(len + 1);
-  if (s2 == NULL) {
-    return NULL;
-  }
-  memcpy(s2, s, len);
-  s2[len] = 0;
-  return s2;
-}
+/*
+ * RFCs 1035 and 1123 specify a max hostname length of 255 bytes. An
+ * enum rather than a const so that it can size the stack buffers
+ * hostnames are copied to.
+ */
+enum { kMaxHostnameLen = 255 };
 
 /* strnlen() is not part of ANSI C89 so we define our own. */
 static size_t StrnLen(const char* s, size_t max) {
@@ -259,7 +251,7 @@ static size_t GetRegistryLengthImpl(
 
 size_t GetRegistryLength(const char* hostname) {
   const char* buf_end;
-  char* buf;
+  char buf[kMaxHostnameLen + 1];
   size_t registry_length;
 
   if (hostname == NULL) {
@@ -272,12 +264,11 @@ size_t GetRegistryLength(const char* hostname) {
   /*
    * Replace dots between hostname parts with the null byte. This
    * allows us to index directly into the string and refer to each
-   * hostname-part as if it were its own null-terminated string.
+   * hostname-part as if it were its own null-terminated string. The
+   * copy is on the stack, as IsValidHostname() bounds its length, so
+   * that lookups do not allocate.
    */
-  buf = StrDup(hostname);
-  if (buf == NULL) {
-    return 0;
-  }
+  memcpy(buf, hostname, strlen(hostname) + 1);
   ReplaceChar(buf, '.', '\0');
 
   buf_end = buf + strlen(hostname);
@@ -286,13 +277,12 @@ size_t GetRegistryLength(const char* hostname) {
   /* Normalize the input by converting all characters to lowercase. */
   ToLowerASCII(buf, buf_end);
   registry_length = GetRegistryLengthImpl(buf, buf_end, '\0', 0);
-  free(buf);
   return registry_length;
 }
 
 size_t GetRegistryLengthAllowUnknownRegistries(const char* hostname) {
   const char* buf_end;
-  char* buf;
+  char buf[kMaxHostnameLen + 1];
   size_t registry_length;
 
   if (hostname == NULL) {
@@ -305,12 +295,11 @@ size_t GetRegistryLengthAllowUnknownRegistries(const char* hostname) {
   /*
    * Replace dots between hostname parts with the null byte. This
    * allows us to index directly into the string and refer to each
-   * hostname-part as if it were its own null-terminated string.
+   * hostname-part as if it were its own null-terminated string. The
+   * copy is on the stack, as IsValidHostname() bounds its length, so
+   * that lookups do not allocate.
    */
-  buf = StrDup(hostname);
-  if (buf == NULL) {
-    return 0;
-  }
+  memcpy(buf, hostname, strlen(hostname) + 1);
   ReplaceChar(buf, '.', '\0');
 
   buf_end = buf + strlen(hostname);
@@ -319,6 +308,5 @@ size_t GetRegistryLengthAllowUnknownRegistries(const char* hostname) {
   /* Normalize the input by converting all characters to lowercase. */
   ToLowerASCII(buf, buf_end);
   registry_length = GetRegistryLengthImpl(buf, buf_end, '\0', 1);
-  free(buf);
   return registry_length;
 }
@@ -38,25 +38,27 @@ static const REGISTRY_U16* g_leaf_node_table = NULL;
 static size_t g_leaf_node_table_offset = 0;
 
 /*
- * Create an "exception" version of the given component. For instance
- * if component is "foo", will return "!foo". The caller is
- * responsible for freeing the returned memory.
+ * The longest component an exception version can be created for; the
+ * components of valid hostnames are at most 255 bytes long.
  */
-static char* StrDupExceptionComponent(const char* component) {
-  /*
-   * TODO(bmcquade): could use thread-local storage of sufficient size
-   * to avoid this allocation. This should be invoked infrequently
-   * enough that it's probably fine for us to perform the allocation.
-   */
+enum { kMaxComponentLen = 255 };
+
+/*
+ * Write an "exception" version of the given component to
+ * exception_component, which must hold kMaxComponentLen + 2 bytes. For
+ * instance if component is "foo", writes "!foo". Returns 0 if the
+ * component is too long.
+ */
+static int MakeExceptionComponent(const char* component,
+                                  char* exception_component) {
   const size_t component_len = strlen(component);
-  char* exception_component = malloc(component_len + 2);
-  if (exception_component == NULL) {
-    return NULL;
+  if (component_len > kMaxComponentLen) {
+    return 0;
   }
   memcpy(exception_component + 1, component, component_len);
   exception_component[0] = '!';
   exception_component[component_len + 1] = 0;
-  return exception_component;
+  return 1;
 }
 
 /*
@@ -187,14 +189,13 @@ const struct TrieNode* FindRegistryNode(const char* component,
      * rule. An exception rule takes priority over any other matching
      * rule.".
      */
-    char* exception_component = StrDupExceptionComponent(component);
-    if (exception_component == NULL) {
+    char exception_component[kMaxComponentLen + 2];
+    if (MakeExceptionComponent(component, exception_component) == 0) {
       return NULL;
     }
     exception = FindNodeInRange(exception_component,
                                 start,
                                 end);
-    free(exception_component);
     if (exception != NULL) {
       current = exception;
     }
@@ -256,14 +257,13 @@ const char* FindRegistryLeafNode(const char* component,
      * rule. An exception rule takes priority over any other matching
      * rule.".
      */
-    char* exception_component = StrDupExceptionComponent(component);
-    if (exception_component == NULL) {
+    char exception_component[kMaxComponentLen + 2];
+    if (MakeExceptionComponent(component, exception_component) == 0) {
       return NULL;
     }
     exception = FindLeafNodeInRange(exception_component,
                                     leaf_start,
                                     leaf_end);
-    free(exception_component);
     if (exception != NULL) {
       match = exception;
     }
@@ -27,7 +27,7 @@ NS_ASSUME_NONNULL_BEGIN
 // in the TSKSPKIHashCache constructor to use the shared cache.
 static NSString * const kTSKSPKISharedHashCacheIdentifier = @"spki-hash.cache";
 
-// Each key is a raw certificate data (for easy lookup) and each value is the certificate's raw SPKI data
+// Each key is the SHA-256 digest of a certificate's raw data and each value is the hash of the certificate's SPKI data
 typedef NSMutableDictionary<NSData *, NSData *> SPKICacheDictionnary;
 
 @interface TSKSPKIHashCache : NSObject
@@ -53,6 +53,59 @@ typedef NSMutableDictionary<NSData *, NSData *> SPKICacheDictionnary;
  */
 - (NSData * _Nullable)hashSubjectPublicKeyInfoFromCertificate:(SecCertificateRef)certificate;
 
+/**
+ Same as hashSubjectPublicKeyInfoFromCertificate: but with the certificate's digest, as returned by
+ digestsForCertificates:, when the caller already has it.
+
+ @param certificate The certificate containing the public key that will be hashed
+ @param certificateDigest The SHA-256 digest of the certificate's data, or nil to compute it
+ @return The hash of the public key or nil if the hash could not be generated
+ */
+- (NSData * _Nullable)hashSubjectPublicKeyInfoFromCertificate:(SecCertificateRef)certificate
+                                            certificateDigest:(NSData * _Nullable)certificateDigest;
+
+/**
+ Get the pin caches for several certificates, such as a whole certificate chain. The hashes that
+ are not cached are generated concurrently, but the block is always invoked on the calling thread and
+ in the order of the certificates, so the outcome is the same as calling
+ hashSubjectPublicKeyInfoFromCertificate: for each certificate in turn.
+
+ @param certificates The SecCertificateRef of the certificates containing the public keys that will be hashed
+ @param block Invoked with the index of each certificate and the hash of its public key, or nil if the hash
+ could not be generated. Setting stop to YES ends the enumeration and cancels the generation of the
+ hashes that have not been started yet.
+ */
+- (void)enumerateSubjectPublicKeyInfoHashesFromCertificates:(NSArray *)certificates
+                                                 usingBlock:(void (^)(NSUInteger index, NSData * _Nullable hash, BOOL *stop))block;
+
+/**
+ Same as enumerateSubjectPublicKeyInfoHashesFromCertificates:usingBlock: but reusing the digests that the
+ caller already computed; only the certificates that are not keys of certificateDigests get digested.
+
+ @param certificateDigests The digests returned by digestsForCertificates:, keyed by the certificate
+ objects themselves (with NSPointerFunctionsObjectPointerPersonality), or nil
+ */
+- (void)enumerateSubjectPublicKeyInfoHashesFromCertificates:(NSArray *)certificates
+                                         certificateDigests:(NSMapTable * _Nullable)certificateDigests
+                                                 usingBlock:(void (^)(NSUInteger index, NSData * _Nullable hash, BOOL *stop))block;
+
+/**
+ Whether the hashes of the public keys of several certificates are all cached, which means that these keys are
+ supported; nothing gets hashed.
+ @param certificateDigests The digests of the certificates, as returned by digestsForCertificates:
+ @return YES if every hash is cached
+ */
+- (BOOL)hasSubjectPublicKeyInfoHashesForCertificateDigests:(NSArray<NSData *> *)certificateDigests;
+
+/**
+ Compute the SHA-256 digests of the data of several certificates at once; these digests are the keys
+ of the cache.
+
+ @param certificates The SecCertificateRef of the certificates to digest
+ @return The digest of each certificate, in the same order.
+ */
++ (NSArray<NSData *> *)digestsForCertificates:(NSArray *)certificates;
+
 @end
 
 NS_ASSUME_NONNULL_END
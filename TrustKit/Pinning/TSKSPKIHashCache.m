@@ -12,8 +12,11 @@
 #import <objc/message.h>
 #import "TSKSPKIHashCache.h"
 #import "../TSKLog.h"
-#import <CommonCrypto/CommonDigest.h>
 #import "pinning_utils.h"
+#import "../metrics_registry.h"
+#include "sha256_engine.h"
+#include "spki_cache_file.h"
+#include <errno.h>
 
 #pragma mark Missing ASN1 SPKI Headers
 
@@ -77,6 +80,11 @@ static BOOL isKeySupported(NSString *publicKeyType, NSNumber *publicKeySize)
 }
 
 
+// Large enough for the subject public key info of all the supported keys; the largest one, of an RSA 4096 key,
+// is a 24-byte header followed by the 526 bytes of its external representation
+enum { kTSKMaxSubjectPublicKeyInfoLength = 1024 };
+
+
 static char *getAsn1HeaderBytes(NSString *publicKeyType, NSNumber *publicKeySize)
 {
     if (([publicKeyType isEqualToString:(NSString *)kSecAttrKeyTypeRSA]) && ([publicKeySize integerValue] == 2048))
@@ -130,16 +138,192 @@ static unsigned int getAsn1HeaderSize(NSString *publicKeyType, NSNumber *publicK
 }
 
 
+#pragma mark SPKI Cache Persistence
+
+// How long to wait after a cache miss before persisting the new entries, so that a burst of misses
+// (such as the first connections after launch) results in a single write
+static const NSTimeInterval kTSKSPKICacheFlushDelay = 1.0;
+
+// Number of records the journal can hold before it gets folded back into the cache snapshot
+static const NSUInteger kTSKSPKICacheCompactionThreshold = 32;
+
+// Appended to the cache's filename to get the journal of the entries that are not in the snapshot yet
+static NSString * const kTSKSPKICacheJournalExtension = @"journal";
+
+
+static NSData *digestCertificateData(NSData *certificateData)
+{
+    NSMutableData *digest = [NSMutableData dataWithLength:TSK_SPKI_CACHE_DIGEST_LENGTH];
+    TSKSHA256Hash(certificateData.bytes, certificateData.length, digest.mutableBytes);
+    return digest;
+}
+
+
+// Digest the certificates that are not keys of knownDigests in one go, which lets the SHA-256 engine use
+// its multi-buffer backend, and return the digests of all the certificates in order
+static NSArray<NSData *> *digestCertificates(NSArray *certificates, NSMapTable *knownDigests)
+{
+    NSUInteger certificateCount = certificates.count;
+    NSMutableArray *certificateDigests = [NSMutableArray arrayWithCapacity:certificateCount];
+    NSMutableArray<NSData *> *certificatesData = [NSMutableArray arrayWithCapacity:certificateCount];
+    TSKSHA256Message *messages = calloc(certificateCount > 0 ? certificateCount : 1, sizeof(TSKSHA256Message));
+    NSUInteger *messageIndexes = calloc(certificateCount > 0 ? certificateCount : 1, sizeof(NSUInteger));
+    NSUInteger messageCount = 0;
+    for (NSUInteger i = 0; i < certificateCount; i++)
+    {
+        NSData *knownDigest = [knownDigests objectForKey:certificates[i]];
+        [certificateDigests addObject:knownDigest ?: [NSNull null]];
+        if (knownDigest != nil)
+        {
+            continue;
+        }
+        NSData *certificateData = (__bridge_transfer NSData *)(SecCertificateCopyData((__bridge SecCertificateRef)certificates[i]));
+        [certificatesData addObject:certificateData];
+        messages[messageCount].data = certificateData.bytes;
+        messages[messageCount].length = certificateData.length;
+        messageIndexes[messageCount] = i;
+        messageCount += 1;
+    }
+    
+    if (messageCount > 0)
+    {
+        uint8_t (*digests)[TSK_SHA256_DIGEST_LENGTH] = calloc(messageCount, TSK_SHA256_DIGEST_LENGTH);
+        TSKSHA256HashMany(messages, messageCount, digests);
+        for (NSUInteger i = 0; i < messageCount; i++)
+        {
+            certificateDigests[messageIndexes[i]] = [NSData dataWithBytes:digests[i] length:TSK_SHA256_DIGEST_LENGTH];
+        }
+        free(digests);
+    }
+    free(messages);
+    free(messageIndexes);
+    return certificateDigests;
+}
+
+
+static void addRecordsToEntries(const TSKSPKICacheRecord *records, size_t recordCount, SPKICacheDictionnary *entries)
+{
+    for (size_t i = 0; i < recordCount; i++)
+    {
+        NSData *certificateDigest = [NSData dataWithBytes:records[i].certificateDigest length:TSK_SPKI_CACHE_DIGEST_LENGTH];
+        entries[certificateDigest] = [NSData dataWithBytes:records[i].spkiHash length:TSK_SPKI_CACHE_DIGEST_LENGTH];
+    }
+}
+
+
+static void addSnapshotToEntries(const TSKSPKICacheFile *snapshotFile, SPKICacheDictionnary *entries)
+{
+    for (size_t i = 0; i < TSKSPKICacheFileGetRecordCount(snapshotFile); i++)
+    {
+        const TSKSPKICacheRecord *record = TSKSPKICacheFileGetRecord(snapshotFile, i);
+        if (record != NULL)
+        {
+            addRecordsToEntries(record, 1, entries);
+        }
+    }
+}
+
+
+#pragma mark Batch Hashing
+
+// The state shared between the thread enumerating the hashes of a certificate chain and the worker
+// threads computing the missing ones; workers can outlive the enumeration once it gets cancelled
+@interface TSKSPKIHashBatch : NSObject
+
+@property (atomic) BOOL isCancelled;
+
+- (instancetype)initWithHashes:(NSArray *)hashes;
+- (void)setHash:(NSData * _Nullable)hash atIndex:(NSUInteger)index;
+- (void)signalIndex:(NSUInteger)index;
+- (NSData * _Nullable)waitForHashAtIndex:(NSUInteger)index;
+
+@end
+
+
+@implementation TSKSPKIHashBatch
+{
+    // Cached hashes, or NSNull for the ones that are missing or could not be computed
+    NSMutableArray *_hashes;
+    NSArray<dispatch_semaphore_t> *_semaphores;
+}
+
+- (instancetype)initWithHashes:(NSArray *)hashes
+{
+    self = [super init];
+    if (self)
+    {
+        _hashes = [hashes mutableCopy];
+        NSMutableArray<dispatch_semaphore_t> *semaphores = [NSMutableArray arrayWithCapacity:hashes.count];
+        for (NSUInteger i = 0; i < hashes.count; i++)
+        {
+            [semaphores addObject:dispatch_semaphore_create(0)];
+        }
+        _semaphores = semaphores;
+    }
+    return self;
+}
+
+- (void)setHash:(NSData *)hash atIndex:(NSUInteger)index
+{
+    @synchronized(self)
+    {
+        _hashes[index] = hash ?: [NSNull null];
+    }
+}
+
+- (void)signalIndex:(NSUInteger)index
+{
+    dispatch_semaphore_signal(_semaphores[index]);
+}
+
+- (NSData *)waitForHashAtIndex:(NSUInteger)index
+{
+    id hash;
+    @synchronized(self)
+    {
+        hash = _hashes[index];
+    }
+    if (hash == [NSNull null])
+    {
+        // The hash was missing from the cache; wait for the worker computing it
+        dispatch_semaphore_wait(_semaphores[index], DISPATCH_TIME_FOREVER);
+        @synchronized(self)
+        {
+            hash = _hashes[index];
+        }
+    }
+    return (hash == [NSNull null]) ? nil : hash;
+}
+
+@end
+
+
 @interface TSKSPKIHashCache ()
 
-// Dictionnary to cache SPKI hashes instead of having to compute them on every connection
+// Dictionnary to cache SPKI hashes instead of having to compute them on every connection; it only
+// holds the entries that were computed or journaled since the snapshot was written, as the ones that
+// get folded into a new snapshot are removed from it by the compaction
 @property (nonatomic) SPKICacheDictionnary *spkiCache;
+
+// The memory-mapped snapshot of the cache, or NULL if there is none; only accessed on the lockQueue
+@property (nonatomic) TSKSPKICacheFile *snapshotFile;
 @property (nonatomic) dispatch_queue_t lockQueue;
 @property (nonatomic) NSString *spkiCacheFilename;
 
+// Entries added to the cache since the journal was last written; only accessed on the lockQueue
+@property (nonatomic) SPKICacheDictionnary *pendingEntries;
+@property (nonatomic) BOOL isFlushScheduled;
+
+// Serial queue on which all the file I/O happens, away from the lockQueue and the handshake path
+@property (nonatomic) dispatch_queue_t persistenceQueue;
+
+// Number of records currently in the journal; only accessed on the persistenceQueue
+@property (nonatomic) NSUInteger journalRecordCount;
+
 
 /**
- Load the SPKI cache from the filesystem. This triggers blocking file I/O.
+ Load the whole SPKI cache from the filesystem by reading every record of the snapshot and replaying the
+ journal on top of it. This triggers blocking file I/O and is only meant for inspecting the cache.
  */
 - (SPKICacheDictionnary *)loadSPKICacheFromFileSystem;
 
@@ -148,21 +332,7 @@ static unsigned int getAsn1HeaderSize(NSString *publicKeyType, NSNumber *publicK
 
 @implementation TSKSPKIHashCache
 
-/// Blocks to call out to the main thread if necessary
-static BOOL isProtectedDataAvailable(void)
-{
-    if (NSThread.isMainThread) {
-        return _isProtectedDataAvailable();
-    } else {
-        __block BOOL ret = NO;
-        dispatch_sync(dispatch_get_main_queue(), ^{
-            ret = _isProtectedDataAvailable();
-        });
-        
-        return ret;
-    }
-}
-
+/// Calls out to the main thread if necessary, then invokes the callback on the supplied queue
 static void isProtectedDataAvailableAsync(dispatch_queue_t callbackQueue, void (^callback)(BOOL available))
 {
     NSCParameterAssert(callbackQueue);
@@ -207,48 +377,222 @@ static BOOL _isProtectedDataAvailable(void) {
         // Ensure a non-nil identifier was provided
         NSAssert(uniqueIdentifier, @"TSKSPKIHashCache initializer must be passed a unique identifier");
         _spkiCacheFilename = uniqueIdentifier;
+        _pendingEntries = [NSMutableDictionary new];
+        _persistenceQueue = dispatch_queue_create("TSKSPKIHashPersistence",
+                                                  dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0));
         
-        // First try to load a cached version from the filesystem
-        _spkiCache = [self loadSPKICacheFromFileSystem];
-        TSKLog(@"Loaded %lu SPKI cache entries from the filesystem", (unsigned long)_spkiCache.count);
-        if (_spkiCache == nil)
-        {
-            _spkiCache = [NSMutableDictionary new];
-        }
+        // Map the snapshot instead of decoding it so that startup does not depend on the size of the cache;
+        // only the journal, which is bounded by the compaction threshold, gets read into memory
+        _spkiCache = [NSMutableDictionary new];
+        [self openSPKICacheFromFileSystem];
+        TSKLogInfo(@"Loaded %lu SPKI cache entries from the filesystem",
+               (unsigned long)(TSKSPKICacheFileGetRecordCount(_snapshotFile) + _spkiCache.count));
     }
     return self;
 }
 
+- (void)dealloc
+{
+    TSKSPKICacheFileClose(_snapshotFile);
+}
+
++ (NSArray<NSData *> *)digestsForCertificates:(NSArray *)certificates
+{
+    return digestCertificates(certificates, nil);
+}
+
 - (NSData *)hashSubjectPublicKeyInfoFromCertificate:(SecCertificateRef)certificate {
+    return [self hashSubjectPublicKeyInfoFromCertificate:certificate certificateDigest:nil];
+}
+
+- (NSData *)hashSubjectPublicKeyInfoFromCertificate:(SecCertificateRef)certificate certificateDigest:(NSData *)certificateDigest
+{
     __block NSData *hash = nil;
     
+    // The cache is keyed by the certificate's digest so that its records have a fixed size
+    if (certificateDigest == nil)
+    {
+        NSData *certificateData = (__bridge_transfer NSData *)(SecCertificateCopyData(certificate));
+        certificateDigest = digestCertificateData(certificateData);
+    }
+    
     dispatch_sync(self.lockQueue, ^{
-        hash = [self _hashSubjectPublicKeyInfoFromCertificate:certificate];
+        hash = [self _hashSubjectPublicKeyInfoFromCertificate:certificate certificateDigest:certificateDigest];
     });
     
     return hash;
 }
 
-- (NSData *)_hashSubjectPublicKeyInfoFromCertificate:(SecCertificateRef)certificate
+- (NSData *)_hashSubjectPublicKeyInfoFromCertificate:(SecCertificateRef)certificate certificateDigest:(NSData *)certificateDigest
 {
     // Have we seen this certificate before? Look for the SPKI in the cache
-    NSData *certificateData = (__bridge_transfer NSData *)(SecCertificateCopyData(certificate));
-    NSData *cachedSubjectPublicKeyInfo = self->_spkiCache[certificateData];
-    
+    NSData *cachedSubjectPublicKeyInfo = [self cachedSubjectPublicKeyInfoHashForCertificateDigest:certificateDigest];
     if (cachedSubjectPublicKeyInfo)
     {
-        TSKLog(@"Subject Public Key Info hash was found in the cache");
+        TSKLogDebug(@"Subject Public Key Info hash was found in the cache");
         return cachedSubjectPublicKeyInfo;
     }
     
     // We didn't this certificate in the cache so we need to generate its SPKI hash
-    TSKLog(@"Generating Subject Public Key Info hash...");
+    NSData *subjectPublicKeyInfoHash = [self computeSubjectPublicKeyInfoHashFromCertificate:certificate];
+    if (subjectPublicKeyInfoHash)
+    {
+        [self storeSubjectPublicKeyInfoHash:subjectPublicKeyInfoHash forCertificateDigest:certificateDigest];
+    }
+    return subjectPublicKeyInfoHash;
+}
+
+
+- (BOOL)hasSubjectPublicKeyInfoHashesForCertificateDigests:(NSArray<NSData *> *)certificateDigests
+{
+    __block BOOL hasHashes = YES;
+    dispatch_sync(self.lockQueue, ^{
+        for (NSData *certificateDigest in certificateDigests)
+        {
+            if ([self cachedSubjectPublicKeyInfoHashForCertificateDigest:certificateDigest] == nil)
+            {
+                hasHashes = NO;
+                return;
+            }
+        }
+    });
+    return hasHashes;
+}
+
+
+- (void)enumerateSubjectPublicKeyInfoHashesFromCertificates:(NSArray *)certificates
+                                                 usingBlock:(void (^)(NSUInteger index, NSData * _Nullable hash, BOOL *stop))block
+{
+    [self enumerateSubjectPublicKeyInfoHashesFromCertificates:certificates certificateDigests:nil usingBlock:block];
+}
+
+
+- (void)enumerateSubjectPublicKeyInfoHashesFromCertificates:(NSArray *)certificates
+                                         certificateDigests:(NSMapTable *)knownDigests
+                                                 usingBlock:(void (^)(NSUInteger index, NSData * _Nullable hash, BOOL *stop))block
+{
+    NSUInteger certificateCount = certificates.count;
+    if (certificateCount == 0)
+    {
+        return;
+    }
+    
+    // Only the certificates that the caller did not already digest, if any, get digested
+    NSArray<NSData *> *certificateDigests = digestCertificates(certificates, knownDigests);
+    
+    // Look up all the hashes at once
+    NSMutableArray *hashes = [NSMutableArray arrayWithCapacity:certificateCount];
+    NSMutableIndexSet *missingIndexes = [NSMutableIndexSet indexSet];
+    dispatch_sync(self.lockQueue, ^{
+        for (NSUInteger i = 0; i < certificateCount; i++)
+        {
+            NSData *hash = [self cachedSubjectPublicKeyInfoHashForCertificateDigest:certificateDigests[i]];
+            if (hash == nil)
+            {
+                [missingIndexes addIndex:i];
+            }
+            [hashes addObject:hash ?: [NSNull null]];
+        }
+    });
+    
+    // Extract the public keys of the certificates that were not in the cache concurrently; the first one
+    // that is needed gets computed on the calling thread while the others are handed to worker threads
+    TSKSPKIHashBatch *batch = [[TSKSPKIHashBatch alloc] initWithHashes:hashes];
+    NSUInteger firstMissingIndex = missingIndexes.firstIndex;
+    __weak typeof(self) weakSelf = self;
+    [missingIndexes enumerateIndexesUsingBlock:^(NSUInteger i, BOOL *stop) {
+        if (i == firstMissingIndex)
+        {
+            return;
+        }
+        SecCertificateRef certificate = (__bridge SecCertificateRef)certificates[i];
+        CFRetain(certificate);
+        dispatch_async(dispatch_get_global_queue(qos_class_self(), 0), ^{
+            // Skip the certificates that are not needed anymore because a decision was already made
+            if (!batch.isCancelled)
+            {
+                [batch setHash:[weakSelf hashMissingCertificate:certificate certificateDigest:certificateDigests[i]] atIndex:i];
+            }
+            [batch signalIndex:i];
+            CFRelease(certificate);
+        });
+    }];
+    
+    // Hand over the hashes in order, waiting for the ones that are still being computed
+    for (NSUInteger i = 0; i < certificateCount; i++)
+    {
+        NSData *hash = nil;
+        if (i == firstMissingIndex)
+        {
+            hash = [self hashMissingCertificate:(__bridge SecCertificateRef)certificates[i] certificateDigest:certificateDigests[i]];
+        }
+        else
+        {
+            hash = [batch waitForHashAtIndex:i];
+        }
+        
+        BOOL stop = NO;
+        block(i, hash, &stop);
+        if (stop)
+        {
+            batch.isCancelled = YES;
+            return;
+        }
+    }
+}
+
+// Can be called from any thread
+- (NSData *)hashMissingCertificate:(SecCertificateRef)certificate certificateDigest:(NSData *)certificateDigest
+{
+    NSData *subjectPublicKeyInfoHash = [self computeSubjectPublicKeyInfoHashFromCertificate:certificate];
+    if (subjectPublicKeyInfoHash)
+    {
+        dispatch_sync(self.lockQueue, ^{
+            [self storeSubjectPublicKeyInfoHash:subjectPublicKeyInfoHash forCertificateDigest:certificateDigest];
+        });
+    }
+    return subjectPublicKeyInfoHash;
+}
+
+
+// Must be called on the lockQueue
+- (NSData *)cachedSubjectPublicKeyInfoHashForCertificateDigest:(NSData *)certificateDigest
+{
+    NSData *cachedSubjectPublicKeyInfo = self->_spkiCache[certificateDigest];
+    if (cachedSubjectPublicKeyInfo == nil)
+    {
+        uint8_t spkiHash[TSK_SPKI_CACHE_DIGEST_LENGTH];
+        if (TSKSPKICacheFileLookup(self->_snapshotFile, certificateDigest.bytes, spkiHash))
+        {
+            cachedSubjectPublicKeyInfo = [NSData dataWithBytes:spkiHash length:sizeof(spkiHash)];
+        }
+    }
+    TSKMetricsIncrement((cachedSubjectPublicKeyInfo != nil) ? TSKMetricSPKICacheHits : TSKMetricSPKICacheMisses);
+    return cachedSubjectPublicKeyInfo;
+}
+
+// Must be called on the lockQueue
+- (void)storeSubjectPublicKeyInfoHash:(NSData *)subjectPublicKeyInfoHash forCertificateDigest:(NSData *)certificateDigest
+{
+    // Store the hash in our memory cache; it gets written to the filesystem in the background
+    self->_spkiCache[certificateDigest] = subjectPublicKeyInfoHash;
+    if (self.spkiCacheFilename.length)
+    {
+        self->_pendingEntries[certificateDigest] = subjectPublicKeyInfoHash;
+        [self schedulePendingEntriesFlush];
+    }
+}
+
+// Does not access the cache's state so it can be called from any thread
+- (NSData *)computeSubjectPublicKeyInfoHashFromCertificate:(SecCertificateRef)certificate
+{
+    TSKLogDebug(@"Generating Subject Public Key Info hash...");
     
     // First extract the public key
     SecKeyRef publicKey = [self copyPublicKeyFromCertificate:certificate];
     if (publicKey == nil)
     {
-        TSKLog(@"Error - could not copy the public key from the certificate");
+        TSKLogError(@"Error - could not copy the public key from the certificate");
         return nil;
     }
     
@@ -256,7 +600,7 @@ static BOOL _isProtectedDataAvailable(void) {
     NSData *publicKeyData = (__bridge_transfer NSData *)SecKeyCopyExternalRepresentation(publicKey, NULL);
     if (publicKeyData == nil)
     {
-        TSKLog(@"Error - could not extract the public key bytes");
+        TSKLogError(@"Error - could not extract the public key bytes");
         CFRelease(publicKey);
         return nil;
     }
@@ -269,7 +613,7 @@ static BOOL _isProtectedDataAvailable(void) {
     
     if (!isKeySupported(publicKeyType, publicKeysize))
     {
-        TSKLog(@"Error - public key algorithm or length is not supported");
+        TSKLogError(@"Error - public key algorithm or length is not supported");
         CFRelease(publicKey);
         return nil;
     }
@@ -279,53 +623,214 @@ static BOOL _isProtectedDataAvailable(void) {
     
     CFRelease(publicKey);
     
+    // Re-create the subject public key info by adding the missing ASN1 header to the public key
+    uint8_t subjectPublicKeyInfo[kTSKMaxSubjectPublicKeyInfoLength];
+    size_t subjectPublicKeyInfoLength = asn1HeaderSize + publicKeyData.length;
+    if (subjectPublicKeyInfoLength > sizeof(subjectPublicKeyInfo))
+    {
+        TSKLogError(@"Error - public key is larger than expected for its algorithm");
+        return nil;
+    }
+    memcpy(subjectPublicKeyInfo, asn1HeaderBytes, asn1HeaderSize);
+    memcpy(subjectPublicKeyInfo + asn1HeaderSize, publicKeyData.bytes, publicKeyData.length);
+    
     // Generate a hash of the subject public key info
-    NSMutableData *subjectPublicKeyInfoHash = [NSMutableData dataWithLength:CC_SHA256_DIGEST_LENGTH];
-    CC_SHA256_CTX shaCtx;
-    CC_SHA256_Init(&shaCtx);
+    NSMutableData *subjectPublicKeyInfoHash = [NSMutableData dataWithLength:TSK_SHA256_DIGEST_LENGTH];
+    TSKSHA256Hash(subjectPublicKeyInfo, subjectPublicKeyInfoLength, subjectPublicKeyInfoHash.mutableBytes);
+    return subjectPublicKeyInfoHash;
+}
+
+
+#pragma mark Write-Behind Persistence
+
+// Must be called on the lockQueue
+- (void)schedulePendingEntriesFlush
+{
+    if (self.isFlushScheduled)
+    {
+        // The flush that is already scheduled will pick up the new entries too
+        return;
+    }
+    self.isFlushScheduled = YES;
     
-    // Add the missing ASN1 header for public keys to re-create the subject public key info
-    CC_SHA256_Update(&shaCtx, asn1HeaderBytes, asn1HeaderSize);
+    __weak typeof(self) weakSelf = self;
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(kTSKSPKICacheFlushDelay * NSEC_PER_SEC)), self.persistenceQueue, ^{
+        typeof(self) strongSelf = weakSelf;
+        if (strongSelf == nil)
+        {
+            return;
+        }
+        isProtectedDataAvailableAsync(strongSelf.persistenceQueue, ^(BOOL available) {
+            [weakSelf flushPendingEntriesIfProtectedDataAvailable:available];
+        });
+    });
+}
+
+// Must be called on the persistenceQueue
+- (void)flushPendingEntriesIfProtectedDataAvailable:(BOOL)isProtectedDataAvailable
+{
+    __block SPKICacheDictionnary *entriesToWrite = nil;
+    dispatch_sync(self.lockQueue, ^{
+        self.isFlushScheduled = NO;
+        if (isProtectedDataAvailable && (self.pendingEntries.count > 0))
+        {
+            entriesToWrite = self.pendingEntries;
+            self.pendingEntries = [NSMutableDictionary new];
+        }
+    });
     
+    if (!isProtectedDataAvailable)
+    {
+        // The entries stay pending and will be written along with the next cache miss
+        TSKLogWarning(@"Protected data not available, skipping SPKI cache persistence");
+        return;
+    }
+    if (entriesToWrite == nil)
+    {
+        return;
+    }
+    
+    if (![self appendEntriesToJournal:entriesToWrite])
+    {
+        TSKLogError(@"Could not persist SPKI cache to the filesystem");
+        return;
+    }
     
-    // Add the public key
-    CC_SHA256_Update(&shaCtx, [publicKeyData bytes], (unsigned int)[publicKeyData length]);
-    CC_SHA256_Final((unsigned char *)[subjectPublicKeyInfoHash bytes], &shaCtx);
+    if (self.journalRecordCount >= kTSKSPKICacheCompactionThreshold)
+    {
+        [self compactJournal];
+    }
+}
+
+static NSMutableData *recordsFromEntries(SPKICacheDictionnary *entries)
+{
+    NSMutableData *records = [NSMutableData dataWithCapacity:entries.count * sizeof(TSKSPKICacheRecord)];
+    [entries enumerateKeysAndObjectsUsingBlock:^(NSData *certificateDigest, NSData *spkiHash, BOOL *stop) {
+        TSKSPKICacheRecord record;
+        TSKSPKICacheRecordInit(&record, certificateDigest.bytes, spkiHash.bytes);
+        [records appendBytes:&record length:sizeof(record)];
+    }];
+    return records;
+}
+
+// Must be called on the persistenceQueue
+- (BOOL)appendEntriesToJournal:(SPKICacheDictionnary *)entries
+{
+    NSURL *journalPath = [self SPKICacheJournalPath];
+    if (journalPath == nil)
+    {
+        return NO;
+    }
     
+    // Append-only writes keep the records that are already in the journal intact if we get interrupted
+    NSData *records = recordsFromEntries(entries);
+    if (!TSKSPKICacheJournalAppend(journalPath.fileSystemRepresentation, records.bytes, entries.count))
+    {
+        TSKLogError(@"Could not write to the SPKI cache journal: %s", strerror(errno));
+        return NO;
+    }
     
-    // Store the hash in our memory cache
-    self->_spkiCache[certificateData] = subjectPublicKeyInfoHash;
+    self.journalRecordCount += entries.count;
+    TSKMetricsAdd(TSKMetricSPKICachePersistedBytes, records.length);
+    return YES;
+}
+
+// Must be called on the persistenceQueue
+- (void)compactJournal
+{
+    NSURL *cachePath = [self SPKICachePath];
+    if (cachePath == nil)
+    {
+        return;
+    }
     
-    // Update the cache on the filesystem
-    if (self.spkiCacheFilename.length && isProtectedDataAvailable()) {
-        NSData *serializedSpkiCache = [NSKeyedArchiver archivedDataWithRootObject:self.spkiCache
-                                                            requiringSecureCoding:YES
-                                                                            error:nil];
-        NSURL *cachePath = [self SPKICachePath];
-        if (!cachePath || ![serializedSpkiCache writeToURL:cachePath atomically:YES]) {
-            NSAssert(false, @"Failed to write cache");
-            TSKLog(@"Could not persist SPKI cache to the filesystem");
+    // Merge the records of the current snapshot with the entries that were added since it was written;
+    // the snapshot is only replaced on the persistenceQueue so it cannot get unmapped while we read it
+    __block NSMutableData *records = nil;
+    __block NSArray<NSData *> *compactedDigests = nil;
+    __block TSKSPKICacheFile *currentSnapshot = NULL;
+    dispatch_sync(self.lockQueue, ^{
+        records = recordsFromEntries(self.spkiCache);
+        compactedDigests = self.spkiCache.allKeys;
+        currentSnapshot = self.snapshotFile;
+    });
+    for (size_t i = 0; i < TSKSPKICacheFileGetRecordCount(currentSnapshot); i++)
+    {
+        const TSKSPKICacheRecord *record = TSKSPKICacheFileGetRecord(currentSnapshot, i);
+        if (record != NULL)
+        {
+            [records appendBytes:record length:sizeof(TSKSPKICacheRecord)];
         }
     }
-    else if (self.spkiCacheFilename.length) {
-        TSKLog(@"Protected data not available, skipping SPKI cache persistence");
+    
+    NSUInteger recordCount = records.length / sizeof(TSKSPKICacheRecord);
+    if (!TSKSPKICacheFileWrite(cachePath.fileSystemRepresentation, records.mutableBytes, recordCount))
+    {
+        // Keep the journal around as it still has the entries that are missing from the snapshot
+        TSKLogError(@"Could not compact the SPKI cache on the filesystem");
+        return;
     }
     
-    return subjectPublicKeyInfoHash;
+    [NSFileManager.defaultManager removeItemAtURL:[self SPKICacheJournalPath] error:nil];
+    self.journalRecordCount = 0;
+    TSKMetricsAdd(TSKMetricSPKICachePersistedBytes, records.length);
+    
+    TSKSPKICacheFile *newSnapshot = TSKSPKICacheFileOpen(cachePath.fileSystemRepresentation);
+    if (newSnapshot == NULL)
+    {
+        // Keep using the previous mapping and the entries in memory, which still hold everything
+        TSKLogError(@"Could not map the compacted SPKI cache");
+        return;
+    }
+    
+    // Swap in the new snapshot, which readers only use on the lockQueue, and drop the entries it now holds
+    // from memory; the ones that were added while it was being written are kept for the next compaction
+    dispatch_sync(self.lockQueue, ^{
+        TSKSPKICacheFileClose(self.snapshotFile);
+        self.snapshotFile = newSnapshot;
+        [self.spkiCache removeObjectsForKeys:compactedDigests];
+    });
+    TSKLogInfo(@"Compacted %lu SPKI cache entries on the filesystem", (unsigned long)TSKSPKICacheFileGetRecordCount(newSnapshot));
 }
 
-- (SPKICacheDictionnary *)loadSPKICacheFromFileSystem
+
+// Must be called from the initializer
+- (void)openSPKICacheFromFileSystem
 {
-    NSMutableDictionary *spkiCache = nil;
-    NSData *serializedSpkiCache = [NSData dataWithContentsOfURL:[self SPKICachePath]];
-    if (serializedSpkiCache) {
-        NSError *decodingError = nil;
-        spkiCache = [NSKeyedUnarchiver unarchivedObjectOfClasses:[NSSet setWithArray:@[[SPKICacheDictionnary class], [NSData class]]] fromData:serializedSpkiCache error:&decodingError];
-        if (decodingError)
-        {
-            TSKLog(@"Could not retrieve SPKI cache from the filesystem: %@", decodingError);
-        }
+    if (self.spkiCacheFilename.length == 0)
+    {
+        // The cache is not persisted
+        return;
+    }
+    
+    NSURL *cachePath = [self SPKICachePath];
+    _snapshotFile = TSKSPKICacheFileOpen(cachePath.fileSystemRepresentation);
+    if ((_snapshotFile == NULL) && [NSFileManager.defaultManager fileExistsAtPath:cachePath.path])
+    {
+        // Likely a cache written by a previous version of TrustKit; it gets replaced on the next compaction
+        TSKLogWarning(@"Ignoring SPKI cache file in an unsupported format or corrupt");
     }
+    
+    // Replay the entries that were journaled after the snapshot was written
+    TSKSPKICacheRecord *records = NULL;
+    size_t recordCount = TSKSPKICacheJournalRead([self SPKICacheJournalPath].fileSystemRepresentation, &records);
+    addRecordsToEntries(records, recordCount, _spkiCache);
+    free(records);
+    _journalRecordCount = recordCount;
+}
+
+
+- (SPKICacheDictionnary *)loadSPKICacheFromFileSystem
+{
+    SPKICacheDictionnary *spkiCache = [NSMutableDictionary new];
+    TSKSPKICacheFile *snapshotFile = TSKSPKICacheFileOpen([self SPKICachePath].fileSystemRepresentation);
+    addSnapshotToEntries(snapshotFile, spkiCache);
+    TSKSPKICacheFileClose(snapshotFile);
+    
+    TSKSPKICacheRecord *records = NULL;
+    size_t recordCount = TSKSPKICacheJournalRead([self SPKICacheJournalPath].fileSystemRepresentation, &records);
+    addRecordsToEntries(records, recordCount, spkiCache);
+    free(records);
     return spkiCache;
 }
 
@@ -344,7 +849,7 @@ static BOOL _isProtectedDataAvailable(void) {
     
     if (status != errSecSuccess)
     {
-        TSKLog(@"Could not create trust from certificate, got status %d", status);
+        TSKLogError(@"Could not create trust from certificate, got status %d", status);
         return nil;
     }
     
@@ -357,7 +862,7 @@ static BOOL _isProtectedDataAvailable(void) {
     evaluateCertificateChainTrust(trust, &trustResult, &error);
     if ((error != NULL) && (trustResult != kSecTrustResultRecoverableTrustFailure))
     {
-        TSKLog(@"Could not evaluate trust for the certificate: %@", [error localizedDescription]);
+        TSKLogError(@"Could not evaluate trust for the certificate: %@", [error localizedDescription]);
         CFRelease(trust);
         return nil;
     }
@@ -374,6 +879,11 @@ static BOOL _isProtectedDataAvailable(void) {
     return [cachesDirUrl URLByAppendingPathComponent:self.spkiCacheFilename];
 }
 
+- (NSURL *)SPKICacheJournalPath
+{
+    return [[self SPKICachePath] URLByAppendingPathExtension:kTSKSPKICacheJournalExtension];
+}
+
 @end
 
 
@@ -383,12 +893,29 @@ static BOOL _isProtectedDataAvailable(void) {
 {
     // Discard SPKI cache
     [NSFileManager.defaultManager removeItemAtURL:[self SPKICachePath] error:nil];
+    [NSFileManager.defaultManager removeItemAtURL:[self SPKICacheJournalPath] error:nil];
+}
+
+
+- (void)flushPendingSubjectPublicKeyInfoEntries
+{
+    // Write the pending entries right away instead of waiting for the scheduled flush
+    BOOL isProtectedDataAvailable = _isProtectedDataAvailable();
+    dispatch_sync(self.persistenceQueue, ^{
+        [self flushPendingEntriesIfProtectedDataAvailable:isProtectedDataAvailable];
+    });
 }
 
 
 - (SPKICacheDictionnary *)getSubjectPublicKeyInfoHashesCache
 {
-    return _spkiCache;
+    // Materialize the mapped snapshot along with the entries that are only in memory
+    __block SPKICacheDictionnary *spkiCache = [NSMutableDictionary new];
+    dispatch_sync(self.lockQueue, ^{
+        addSnapshotToEntries(self->_snapshotFile, spkiCache);
+        [spkiCache addEntriesFromDictionary:self->_spkiCache];
+    });
+    return spkiCache;
 }
 
 @end
@@ -0,0 +1,99 @@
+/*
+
+ TSKTrustDecisionCache.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#if __has_feature(modules)
+@import Foundation;
+#else
+#import <Foundation/Foundation.h>
+#endif
+
+#if __has_feature(modules)
+@import Security;
+#else
+#import <Security/Security.h>
+#endif
+
+NS_ASSUME_NONNULL_BEGIN
+
+// The maximum number of decisions kept by the cache that TrustKit creates when kTSKTrustDecisionCacheTimeToLive is set
+static const NSUInteger kTSKTrustDecisionCacheDefaultMaximumEntryCount = 256;
+
+/**
+ A cache of the successful pinning validations, keyed by the server's hostname and the digest of its
+ certificate chain, so that connecting again to the same server with the same certificate chain does not
+ require evaluating the chain and matching its pins again.
+
+ Entries expire after the time to live, or when the domain's pinning policy expires if that is sooner.
+ Failed validations are never cached, so that each one is reported and so that a server whose
+ certificate chain got fixed is trusted again right away.
+ */
+@interface TSKTrustDecisionCache : NSObject
+
+- (instancetype)new NS_UNAVAILABLE;
+- (instancetype)init NS_UNAVAILABLE;
+
+/**
+ Create a new, empty decision cache.
+
+ @param timeToLive How long a successful validation is cached for, in seconds
+ @param maximumEntryCount The maximum number of entries; the oldest one gets evicted to make room for a new one
+ @return An initialized decision cache.
+ */
+- (instancetype)initWithTimeToLive:(NSTimeInterval)timeToLive
+                 maximumEntryCount:(NSUInteger)maximumEntryCount NS_DESIGNATED_INITIALIZER;
+
+/**
+ Compute the digest identifying a certificate chain: the SHA-256 of the SHA-256 of each certificate, in order.
+
+ @param serverTrust The trust object containing the server's certificate chain
+ @return The digest of the chain.
+ */
++ (NSData *)digestForCertificateChain:(SecTrustRef)serverTrust;
+
+/**
+ Same as digestForCertificateChain: but from the digests of the certificates of the chain, as returned by
+ +[TSKSPKIHashCache digestsForCertificates:], so that they can also be used to look up the SPKI hashes.
+
+ @param certificateDigests The SHA-256 of each certificate of the chain, in order
+ @return The digest of the chain.
+ */
++ (NSData *)digestForCertificateDigests:(NSArray<NSData *> *)certificateDigests;
+
+/**
+ Look for a cached successful validation of the chain for the hostname.
+
+ @return YES if the chain was successfully validated for the hostname and the entry has not expired yet.
+ */
+- (BOOL)containsSuccessfulValidationForHostname:(NSString *)hostname chainDigest:(NSData *)chainDigest;
+
+/**
+ Cache the successful validation of the chain for the hostname.
+
+ @param expirationDate The expiration date of the domain's pinning policy, if it has one
+ */
+- (void)addSuccessfulValidationForHostname:(NSString *)hostname
+                               chainDigest:(NSData *)chainDigest
+                      policyExpirationDate:(NSDate * _Nullable)expirationDate;
+
+- (void)removeAllValidations;
+
+@property (nonatomic, readonly) NSTimeInterval timeToLive;
+@property (nonatomic, readonly) NSUInteger maximumEntryCount;
+
+// Counters, for tests and metrics
+@property (nonatomic, readonly) NSUInteger entryCount;
+@property (nonatomic, readonly) NSUInteger hitCount;
+@property (nonatomic, readonly) NSUInteger missCount;
+@property (nonatomic, readonly) NSUInteger evictionCount;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -0,0 +1,199 @@
+/*
+
+ TSKTrustDecisionCache.m
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#import "TSKTrustDecisionCache.h"
+#import "TSKSPKIHashCache.h"
+#import "pinning_utils.h"
+#import "sha256_engine.h"
+#import "../metrics_registry.h"
+
+
+@interface TSKTrustDecisionCache ()
+{
+    // Only accessed on the lockQueue
+    NSUInteger _hitCount;
+    NSUInteger _missCount;
+    NSUInteger _evictionCount;
+}
+
+// Each key is the chain digest followed by the hostname, and each value is the system uptime at which the entry expires
+@property (nonatomic) NSMutableDictionary<NSData *, NSNumber *> *entries;
+
+// The keys of the entries from the oldest to the newest, for evicting the oldest entry when the cache is full
+@property (nonatomic) NSMutableOrderedSet<NSData *> *insertionOrder;
+
+// Serial queue protecting the entries and the counters
+@property (nonatomic) dispatch_queue_t lockQueue;
+
+@end
+
+
+@implementation TSKTrustDecisionCache
+
+- (instancetype)initWithTimeToLive:(NSTimeInterval)timeToLive maximumEntryCount:(NSUInteger)maximumEntryCount
+{
+    self = [super init];
+    if (self) {
+        _timeToLive = timeToLive;
+        _maximumEntryCount = maximumEntryCount;
+        _entries = [NSMutableDictionary new];
+        _insertionOrder = [NSMutableOrderedSet new];
+        _lockQueue = dispatch_queue_create("TSKTrustDecisionCacheLock", DISPATCH_QUEUE_SERIAL);
+    }
+    return self;
+}
+
+
++ (NSData *)digestForCertificateChain:(SecTrustRef)serverTrust
+{
+    return [self digestForCertificateDigests:[TSKSPKIHashCache digestsForCertificates:copyCertificateChain(serverTrust)]];
+}
+
+
++ (NSData *)digestForCertificateDigests:(NSArray<NSData *> *)certificateDigests
+{
+    // Hash the digests of the certificates rather than their concatenation, so that the certificates
+    // can be hashed together and no copy of the chain is needed
+    NSMutableData *concatenatedDigests = [NSMutableData dataWithCapacity:certificateDigests.count * TSK_SHA256_DIGEST_LENGTH];
+    for (NSData *certificateDigest in certificateDigests)
+    {
+        [concatenatedDigests appendData:certificateDigest];
+    }
+    NSMutableData *chainDigest = [NSMutableData dataWithLength:TSK_SHA256_DIGEST_LENGTH];
+    TSKSHA256Hash(concatenatedDigests.bytes, concatenatedDigests.length, chainDigest.mutableBytes);
+    return chainDigest;
+}
+
+
+- (NSData *)keyForHostname:(NSString *)hostname chainDigest:(NSData *)chainDigest
+{
+    NSMutableData *key = [NSMutableData dataWithData:chainDigest];
+    [key appendData:[hostname.lowercaseString dataUsingEncoding:NSUTF8StringEncoding]];
+    return key;
+}
+
+
+- (BOOL)containsSuccessfulValidationForHostname:(NSString *)hostname chainDigest:(NSData *)chainDigest
+{
+    NSData *key = [self keyForHostname:hostname chainDigest:chainDigest];
+    NSTimeInterval now = [NSProcessInfo processInfo].systemUptime;
+    __block BOOL isCached = NO;
+    dispatch_sync(self.lockQueue, ^{
+        NSNumber *expiration = self.entries[key];
+        if ((expiration != nil) && (expiration.doubleValue <= now))
+        {
+            // Expired entries are removed when they are found, or when they are the oldest and room is needed
+            [self.entries removeObjectForKey:key];
+            [self.insertionOrder removeObject:key];
+            expiration = nil;
+        }
+        isCached = (expiration != nil);
+        if (isCached)
+        {
+            self->_hitCount += 1;
+        }
+        else
+        {
+            self->_missCount += 1;
+        }
+    });
+    TSKMetricsIncrement(isCached ? TSKMetricTrustDecisionCacheHits : TSKMetricTrustDecisionCacheMisses);
+    return isCached;
+}
+
+
+- (void)addSuccessfulValidationForHostname:(NSString *)hostname
+                               chainDigest:(NSData *)chainDigest
+                      policyExpirationDate:(NSDate *)expirationDate
+{
+    if (self.maximumEntryCount == 0)
+    {
+        return;
+    }
+
+    // Use the system uptime so that changing the clock does not extend the entries
+    NSTimeInterval now = [NSProcessInfo processInfo].systemUptime;
+    NSTimeInterval timeToLive = self.timeToLive;
+    if (expirationDate != nil)
+    {
+        timeToLive = MIN(timeToLive, expirationDate.timeIntervalSinceNow);
+    }
+    if (timeToLive <= 0)
+    {
+        return;
+    }
+
+    NSData *key = [self keyForHostname:hostname chainDigest:chainDigest];
+    dispatch_sync(self.lockQueue, ^{
+        [self.insertionOrder removeObject:key];
+        while (self.insertionOrder.count >= self.maximumEntryCount)
+        {
+            NSData *oldestKey = self.insertionOrder.firstObject;
+            [self.entries removeObjectForKey:oldestKey];
+            [self.insertionOrder removeObjectAtIndex:0];
+            self->_evictionCount += 1;
+            TSKMetricsIncrement(TSKMetricTrustDecisionCacheEvictions);
+        }
+        self.entries[key] = @(now + timeToLive);
+        [self.insertionOrder addObject:key];
+    });
+}
+
+
+- (void)removeAllValidations
+{
+    dispatch_sync(self.lockQueue, ^{
+        [self.entries removeAllObjects];
+        [self.insertionOrder removeAllObjects];
+    });
+}
+
+
+- (NSUInteger)entryCount
+{
+    __block NSUInteger count = 0;
+    dispatch_sync(self.lockQueue, ^{
+        count = self.entries.count;
+    });
+    return count;
+}
+
+
+- (NSUInteger)hitCount
+{
+    __block NSUInteger count = 0;
+    dispatch_sync(self.lockQueue, ^{
+        count = self->_hitCount;
+    });
+    return count;
+}
+
+
+- (NSUInteger)missCount
+{
+    __block NSUInteger count = 0;
+    dispatch_sync(self.lockQueue, ^{
+        count = self->_missCount;
+    });
+    return count;
+}
+
+
+- (NSUInteger)evictionCount
+{
+    __block NSUInteger count = 0;
+    dispatch_sync(self.lockQueue, ^{
+        count = self->_evictionCount;
+    });
+    return count;
+}
+
+@end
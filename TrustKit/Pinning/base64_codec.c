@@ -0,0 +1,451 @@
+/*
+
+ base64_codec.c
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "base64_codec.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define TSK_BASE64_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define TSK_BASE64_NEON 1
+#include <arm_neon.h>
+#endif
+
+
+static const char encodingTable[64] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// 0xFF for the characters that are not in the alphabet, including the padding
+static const uint8_t decodingTable[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 62,   0xFF, 0xFF, 0xFF, 63,
+    52,   53,   54,   55,   56,   57,   58,   59,   60,   61,   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0,    1,    2,    3,    4,    5,    6,    7,    8,    9,    10,   11,   12,   13,   14,
+    15,   16,   17,   18,   19,   20,   21,   22,   23,   24,   25,   0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 26,   27,   28,   29,   30,   31,   32,   33,   34,   35,   36,   37,   38,   39,   40,
+    41,   42,   43,   44,   45,   46,   47,   48,   49,   50,   51,   0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+};
+
+
+// The SIMD paths only process whole blocks and return how many bytes (when encoding) or characters
+// (when decoding) they consumed; the scalar path then takes care of the rest
+typedef size_t (*TSKBase64EncodeBlocksFunction)(const uint8_t *input, size_t length, char *output);
+typedef size_t (*TSKBase64DecodeBlocksFunction)(const uint8_t *input, size_t length, uint8_t *output, bool *isValid);
+
+
+// Scalar
+
+static size_t encodeBlocksScalar(const uint8_t *input, size_t length, char *output)
+{
+    size_t i = 0;
+    for (; i + 3 <= length; i += 3)
+    {
+        uint32_t triple = ((uint32_t)input[i] << 16) | ((uint32_t)input[i + 1] << 8) | input[i + 2];
+        *output++ = encodingTable[(triple >> 18) & 0x3F];
+        *output++ = encodingTable[(triple >> 12) & 0x3F];
+        *output++ = encodingTable[(triple >> 6) & 0x3F];
+        *output++ = encodingTable[triple & 0x3F];
+    }
+    return i;
+}
+
+static size_t decodeBlocksScalar(const uint8_t *input, size_t length, uint8_t *output, bool *isValid)
+{
+    uint8_t invalidBits = 0;
+    size_t i = 0;
+    for (; i + 4 <= length; i += 4)
+    {
+        uint8_t a = decodingTable[input[i]];
+        uint8_t b = decodingTable[input[i + 1]];
+        uint8_t c = decodingTable[input[i + 2]];
+        uint8_t d = decodingTable[input[i + 3]];
+        invalidBits |= a | b | c | d;
+
+        uint32_t triple = ((uint32_t)a << 18) | ((uint32_t)b << 12) | ((uint32_t)c << 6) | d;
+        *output++ = (uint8_t)(triple >> 16);
+        *output++ = (uint8_t)(triple >> 8);
+        *output++ = (uint8_t)triple;
+    }
+    *isValid = (invalidBits & 0x80) == 0;
+    return i;
+}
+
+
+// AVX2; based on "Faster Base64 Encoding and Decoding Using AVX2 Instructions" by Muła and Lemire
+
+#if TSK_BASE64_AVX2
+__attribute__((target("avx2")))
+static size_t encodeBlocksAVX2(const uint8_t *input, size_t length, char *output)
+{
+    // Spread each group of 3 bytes over 4 bytes, as b1 b0 b2 b1, within each 128-bit lane
+    const __m256i spreadShuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                                   1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    // The value added to each 6-bit index to get its character, looked up from the reduced index below
+    const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                             '/' - 63, 'A', 0, 0,
+                                             'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                             '/' - 63, 'A', 0, 0);
+
+    size_t i = 0;
+    for (; i + 24 <= length; i += 24)
+    {
+        // 12 bytes in each lane; the loads stay within the 24 bytes of the block
+        __m128i low = _mm_loadu_si128((const __m128i *)(input + i));
+        int32_t last;
+        memcpy(&last, input + i + 20, sizeof(last));
+        __m128i high = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *)(input + i + 12)), _mm_cvtsi32_si128(last));
+        __m256i bytes = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1), spreadShuffle);
+
+        // Move each 6-bit index to the bottom of its own byte
+        __m256i indices0 = _mm256_mulhi_epu16(_mm256_and_si256(bytes, _mm256_set1_epi32(0x0FC0FC00)),
+                                              _mm256_set1_epi32(0x04000040));
+        __m256i indices1 = _mm256_mullo_epi16(_mm256_and_si256(bytes, _mm256_set1_epi32(0x003F03F0)),
+                                              _mm256_set1_epi32(0x01000010));
+        __m256i indices = _mm256_or_si256(indices0, indices1);
+
+        // 0-25 map to 13, 26-51 to 0, 52-61 to 1-10, 62 to 11 and 63 to 12
+        __m256i reduced = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        __m256i isUppercase = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        reduced = _mm256_or_si256(reduced, _mm256_and_si256(isUppercase, _mm256_set1_epi8(13)));
+        __m256i characters = _mm256_add_epi8(indices, _mm256_shuffle_epi8(offsets, reduced));
+
+        _mm256_storeu_si256((__m256i *)(output + i / 3 * 4), characters);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static size_t decodeBlocksAVX2(const uint8_t *input, size_t length, uint8_t *output, bool *isValid)
+{
+    // Bit sets of the character classes, indexed by the low and the high nibble; a character is invalid
+    // when the two sets intersect
+    const __m256i lowNibbleClasses = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                                      0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                                      0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                                      0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i highNibbleClasses = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                                       0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                                       0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                                       0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    // The value added to each valid character to get its 6-bit index, indexed by its high nibble ('/' uses 1)
+    const __m256i offsets = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                             0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i packShuffle = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                                 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i nibbleMask = _mm256_set1_epi8(0x0F);
+
+    size_t i = 0;
+    for (; i + 32 <= length; i += 32)
+    {
+        __m256i characters = _mm256_loadu_si256((const __m256i *)(input + i));
+        __m256i highNibbles = _mm256_and_si256(_mm256_srli_epi32(characters, 4), nibbleMask);
+        __m256i lowNibbles = _mm256_and_si256(characters, nibbleMask);
+        __m256i lowClasses = _mm256_shuffle_epi8(lowNibbleClasses, lowNibbles);
+        __m256i highClasses = _mm256_shuffle_epi8(highNibbleClasses, highNibbles);
+        if (!_mm256_testz_si256(lowClasses, highClasses))
+        {
+            *isValid = false;
+            return i;
+        }
+
+        __m256i isSlash = _mm256_cmpeq_epi8(characters, _mm256_set1_epi8('/'));
+        __m256i indices = _mm256_add_epi8(characters, _mm256_shuffle_epi8(offsets, _mm256_add_epi8(isSlash, highNibbles)));
+
+        // Pack the four 6-bit indices of each 32-bit word into 3 bytes, then the 3-byte groups together
+        __m256i pairs = _mm256_maddubs_epi16(indices, _mm256_set1_epi32(0x01400140));
+        __m256i words = _mm256_madd_epi16(pairs, _mm256_set1_epi32(0x00011000));
+        __m256i bytes = _mm256_shuffle_epi8(words, packShuffle);
+        bytes = _mm256_permutevar8x32_epi32(bytes, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+
+        uint8_t *blockOutput = output + i / 4 * 3;
+        _mm_storeu_si128((__m128i *)blockOutput, _mm256_castsi256_si128(bytes));
+        _mm_storel_epi64((__m128i *)(blockOutput + 16), _mm256_extracti128_si256(bytes, 1));
+    }
+    *isValid = true;
+    return i;
+}
+
+static bool isAVX2Supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+
+// NEON
+
+#if TSK_BASE64_NEON
+static uint8x16x4_t loadTable(const uint8_t table[64])
+{
+    uint8x16x4_t vectors;
+    vectors.val[0] = vld1q_u8(table);
+    vectors.val[1] = vld1q_u8(table + 16);
+    vectors.val[2] = vld1q_u8(table + 32);
+    vectors.val[3] = vld1q_u8(table + 48);
+    return vectors;
+}
+
+static size_t encodeBlocksNEON(const uint8_t *input, size_t length, char *output)
+{
+    const uint8x16x4_t alphabet = loadTable((const uint8_t *)encodingTable);
+    const uint8x16_t indexMask = vdupq_n_u8(0x3F);
+
+    size_t i = 0;
+    for (; i + 48 <= length; i += 48)
+    {
+        uint8x16x3_t bytes = vld3q_u8(input + i);
+        uint8x16x4_t indices;
+        indices.val[0] = vshrq_n_u8(bytes.val[0], 2);
+        indices.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(bytes.val[0], 4), vshrq_n_u8(bytes.val[1], 4)), indexMask);
+        indices.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(bytes.val[1], 2), vshrq_n_u8(bytes.val[2], 6)), indexMask);
+        indices.val[3] = vandq_u8(bytes.val[2], indexMask);
+
+        uint8x16x4_t characters;
+        for (int j = 0; j < 4; j++)
+        {
+            characters.val[j] = vqtbl4q_u8(alphabet, indices.val[j]);
+        }
+        vst4q_u8((uint8_t *)output + i / 3 * 4, characters);
+    }
+    return i;
+}
+
+// Table lookups return 0 for out-of-range indices, which is why each half of the ASCII range has its own
+// lookup and characters above 127 are checked separately
+static uint8x16_t decodeCharactersNEON(uint8x16_t characters, uint8x16x4_t lowTable, uint8x16x4_t highTable, uint8x16_t *invalidBits)
+{
+    uint8x16_t indices = vorrq_u8(vqtbl4q_u8(lowTable, characters),
+                                  vqtbl4q_u8(highTable, vsubq_u8(characters, vdupq_n_u8(64))));
+    *invalidBits = vorrq_u8(*invalidBits, vorrq_u8(indices, characters));
+    return indices;
+}
+
+static size_t decodeBlocksNEON(const uint8_t *input, size_t length, uint8_t *output, bool *isValid)
+{
+    const uint8x16x4_t lowTable = loadTable(decodingTable);
+    const uint8x16x4_t highTable = loadTable(decodingTable + 64);
+
+    size_t i = 0;
+    for (; i + 64 <= length; i += 64)
+    {
+        uint8x16x4_t characters = vld4q_u8(input + i);
+        uint8x16_t invalidBits = vdupq_n_u8(0);
+        uint8x16_t a = decodeCharactersNEON(characters.val[0], lowTable, highTable, &invalidBits);
+        uint8x16_t b = decodeCharactersNEON(characters.val[1], lowTable, highTable, &invalidBits);
+        uint8x16_t c = decodeCharactersNEON(characters.val[2], lowTable, highTable, &invalidBits);
+        uint8x16_t d = decodeCharactersNEON(characters.val[3], lowTable, highTable, &invalidBits);
+        if (vmaxvq_u8(invalidBits) & 0x80)
+        {
+            *isValid = false;
+            return i;
+        }
+
+        uint8x16x3_t bytes;
+        bytes.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+        bytes.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+        bytes.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+        vst3q_u8(output + i / 4 * 3, bytes);
+    }
+    *isValid = true;
+    return i;
+}
+#endif
+
+
+// Path selection
+
+static pthread_once_t pathSelectionOnce = PTHREAD_ONCE_INIT;
+static bool isSIMDAvailable;
+static bool isSIMDEnabled;
+static TSKBase64EncodeBlocksFunction encodeBlocksSIMD;
+static TSKBase64DecodeBlocksFunction decodeBlocksSIMD;
+
+static void selectPath(void)
+{
+#if TSK_BASE64_AVX2
+    if (isAVX2Supported())
+    {
+        encodeBlocksSIMD = encodeBlocksAVX2;
+        decodeBlocksSIMD = decodeBlocksAVX2;
+    }
+#elif TSK_BASE64_NEON
+    encodeBlocksSIMD = encodeBlocksNEON;
+    decodeBlocksSIMD = decodeBlocksNEON;
+#endif
+    isSIMDAvailable = (encodeBlocksSIMD != NULL);
+    isSIMDEnabled = isSIMDAvailable;
+}
+
+bool TSKBase64IsSIMDEnabled(void)
+{
+    pthread_once(&pathSelectionOnce, selectPath);
+    return isSIMDEnabled;
+}
+
+bool TSKBase64SetSIMDEnabled(bool enabled)
+{
+    pthread_once(&pathSelectionOnce, selectPath);
+    if (enabled && !isSIMDAvailable)
+    {
+        return false;
+    }
+    isSIMDEnabled = enabled;
+    return true;
+}
+
+
+// Encoding
+
+size_t TSKBase64EncodedLength(size_t length, size_t lineLength)
+{
+    size_t encodedLength = (length + 2) / 3 * 4;
+    if ((lineLength == 0) || (encodedLength == 0))
+    {
+        return encodedLength;
+    }
+    // CRLF between lines, but not after the last one
+    return encodedLength + ((encodedLength - 1) / lineLength) * 2;
+}
+
+static size_t encodeLine(const uint8_t *input, size_t length, char *output)
+{
+    size_t encodedCount = 0;
+    if (isSIMDEnabled)
+    {
+        encodedCount = encodeBlocksSIMD(input, length, output);
+    }
+    encodedCount += encodeBlocksScalar(input + encodedCount, length - encodedCount, output + encodedCount / 3 * 4);
+    char *tail = output + encodedCount / 3 * 4;
+
+    size_t remainderLength = length - encodedCount;
+    if (remainderLength > 0)
+    {
+        uint32_t triple = (uint32_t)input[encodedCount] << 16;
+        if (remainderLength == 2)
+        {
+            triple |= (uint32_t)input[encodedCount + 1] << 8;
+        }
+        *tail++ = encodingTable[(triple >> 18) & 0x3F];
+        *tail++ = encodingTable[(triple >> 12) & 0x3F];
+        *tail++ = (remainderLength == 2) ? encodingTable[(triple >> 6) & 0x3F] : '=';
+        *tail++ = '=';
+    }
+    return (size_t)(tail - output);
+}
+
+size_t TSKBase64Encode(const void *data, size_t length, size_t lineLength, char *output)
+{
+    pthread_once(&pathSelectionOnce, selectPath);
+    const uint8_t *input = data;
+    if (lineLength == 0)
+    {
+        return encodeLine(input, length, output);
+    }
+
+    size_t lineInputLength = lineLength / 4 * 3;
+    size_t outputLength = 0;
+    for (size_t i = 0; i < length; i += lineInputLength)
+    {
+        if (i > 0)
+        {
+            output[outputLength++] = '\r';
+            output[outputLength++] = '\n';
+        }
+        size_t chunkLength = (length - i < lineInputLength) ? length - i : lineInputLength;
+        outputLength += encodeLine(input + i, chunkLength, output + outputLength);
+    }
+    return outputLength;
+}
+
+
+// Decoding
+
+size_t TSKBase64DecodedMaxLength(size_t encodedLength)
+{
+    return encodedLength / 4 * 3;
+}
+
+bool TSKBase64Decode(const char *encoded, size_t encodedLength, void *output, size_t *outputLength)
+{
+    pthread_once(&pathSelectionOnce, selectPath);
+    const uint8_t *input = (const uint8_t *)encoded;
+    uint8_t *bytes = output;
+    *outputLength = 0;
+    if ((encodedLength % 4) != 0)
+    {
+        return false;
+    }
+    if (encodedLength == 0)
+    {
+        return true;
+    }
+
+    // The last group is the only one that can be padded, so it is decoded separately
+    size_t bodyLength = encodedLength - 4;
+    size_t decodedCount = 0;
+    bool isValid = true;
+    if (isSIMDEnabled)
+    {
+        decodedCount = decodeBlocksSIMD(input, bodyLength, bytes, &isValid);
+    }
+    if (isValid)
+    {
+        decodedCount += decodeBlocksScalar(input + decodedCount, bodyLength - decodedCount, bytes + decodedCount / 4 * 3, &isValid);
+    }
+    if (!isValid)
+    {
+        return false;
+    }
+
+    const uint8_t *last = input + bodyLength;
+    size_t paddingLength = (last[3] == '=') ? ((last[2] == '=') ? 2 : 1) : 0;
+    uint8_t a = decodingTable[last[0]];
+    uint8_t b = decodingTable[last[1]];
+    uint8_t c = (paddingLength < 2) ? decodingTable[last[2]] : 0;
+    uint8_t d = (paddingLength < 1) ? decodingTable[last[3]] : 0;
+    if ((a | b | c | d) & 0x80)
+    {
+        return false;
+    }
+
+    // The bits of the last character that do not make it into the output are ignored, like Foundation does;
+    // hand-written pins such as "BBBB...B=" rely on this
+    uint8_t *tail = bytes + bodyLength / 4 * 3;
+    uint32_t triple = ((uint32_t)a << 18) | ((uint32_t)b << 12) | ((uint32_t)c << 6) | d;
+    *tail++ = (uint8_t)(triple >> 16);
+    if (paddingLength < 2)
+    {
+        *tail++ = (uint8_t)(triple >> 8);
+    }
+    if (paddingLength < 1)
+    {
+        *tail++ = (uint8_t)triple;
+    }
+    *outputLength = (size_t)(tail - bytes);
+    return true;
+}
@@ -0,0 +1,66 @@
+/*
+
+ base64_codec.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_base64_codec_h
+#define TrustKit_base64_codec_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Base64 (RFC 4648, standard alphabet) encoder and decoder used for the pins in the configuration,
+ the pins sent in reports and the PEM certificates sent in reports.
+
+ Both directions process 24 bytes at a time with AVX2 on x86-64 CPUs that support it and 48 bytes
+ at a time with NEON on ARMv8; the rest of the input, and other CPUs, use a table-based scalar path.
+ */
+
+// Line length used for PEM certificates (RFC 7468)
+#define TSK_BASE64_PEM_LINE_LENGTH 64
+
+// The number of characters TSKBase64Encode() writes for the supplied number of bytes
+size_t TSKBase64EncodedLength(size_t length, size_t lineLength);
+
+/*
+ Encode the data with padding and write the result, which is not NUL-terminated, to output.
+
+ When lineLength is not 0, the output is split in lines of lineLength characters separated by CRLF,
+ like NSDataBase64Encoding64CharacterLineLength does; lineLength must then be a multiple of 4.
+ Returns the number of characters written.
+ */
+size_t TSKBase64Encode(const void *data, size_t length, size_t lineLength, char *output);
+
+// An upper bound of the number of bytes TSKBase64Decode() writes for the supplied number of characters
+size_t TSKBase64DecodedMaxLength(size_t encodedLength);
+
+/*
+ Decode the characters, and write the number of bytes written to output in outputLength.
+
+ Decoding is strict: the input must be a multiple of 4 characters from the standard alphabet, without
+ whitespace or line breaks, and padded at the end only. Returns false if the input is not valid.
+ */
+bool TSKBase64Decode(const char *encoded, size_t encodedLength, void *output, size_t *outputLength);
+
+
+// Whether the AVX2 or NEON paths are used; they can be disabled to compare against the scalar path
+bool TSKBase64IsSIMDEnabled(void);
+bool TSKBase64SetSIMDEnabled(bool enabled);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TrustKit_base64_codec_h */
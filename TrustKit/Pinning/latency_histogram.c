@@ -0,0 +1,264 @@
+/*
+
+ latency_histogram.c
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "latency_histogram.h"
+
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+#define SUB_BUCKET_COUNT (1u << TSK_LATENCY_HISTOGRAM_SUB_BUCKET_BITS)
+
+// Enough for the threads that typically validate connections at the same time to not share a shard
+#define SHARD_COUNT 8
+
+
+typedef struct
+{
+    _Atomic uint64_t count;
+    _Atomic uint64_t sum;
+    _Atomic uint64_t min;
+    _Atomic uint64_t max;
+    _Atomic uint64_t buckets[TSK_LATENCY_HISTOGRAM_BUCKET_COUNT];
+} TSKLatencyHistogramShard;
+
+struct TSKLatencyHistogram
+{
+    _Atomic(TSKLatencyHistogramShard *) shards[SHARD_COUNT];
+};
+
+
+// Buckets
+
+size_t TSKLatencyHistogramGetBucketIndex(uint64_t nanoseconds)
+{
+    if (nanoseconds > TSK_LATENCY_HISTOGRAM_MAX_VALUE)
+    {
+        nanoseconds = TSK_LATENCY_HISTOGRAM_MAX_VALUE;
+    }
+    if (nanoseconds < 2 * SUB_BUCKET_COUNT)
+    {
+        return (size_t)nanoseconds;
+    }
+
+    // Keep the top bits of the value, the first one of which is always set
+    unsigned mostSignificantBit = 63 - (unsigned)__builtin_clzll(nanoseconds);
+    unsigned shift = mostSignificantBit - TSK_LATENCY_HISTOGRAM_SUB_BUCKET_BITS;
+    return (size_t)(shift + 1) * SUB_BUCKET_COUNT + (size_t)((nanoseconds >> shift) - SUB_BUCKET_COUNT);
+}
+
+uint64_t TSKLatencyHistogramGetBucketLowestValue(size_t bucketIndex)
+{
+    if (bucketIndex < 2 * SUB_BUCKET_COUNT)
+    {
+        return bucketIndex;
+    }
+    unsigned shift = (unsigned)(bucketIndex / SUB_BUCKET_COUNT) - 1;
+    uint64_t subBucket = (bucketIndex % SUB_BUCKET_COUNT) + SUB_BUCKET_COUNT;
+    return subBucket << shift;
+}
+
+uint64_t TSKLatencyHistogramGetBucketHighestValue(size_t bucketIndex)
+{
+    if (bucketIndex < 2 * SUB_BUCKET_COUNT)
+    {
+        return bucketIndex;
+    }
+    unsigned shift = (unsigned)(bucketIndex / SUB_BUCKET_COUNT) - 1;
+    uint64_t subBucket = (bucketIndex % SUB_BUCKET_COUNT) + SUB_BUCKET_COUNT;
+    return ((subBucket + 1) << shift) - 1;
+}
+
+
+// Shards
+
+static atomic_uint nextShardIndex;
+
+// The shard of the calling thread plus one, or 0 until the thread records its first value
+static _Thread_local unsigned threadShardIndex;
+
+static TSKLatencyHistogramShard *createShard(void)
+{
+    TSKLatencyHistogramShard *shard = calloc(1, sizeof(TSKLatencyHistogramShard));
+    if (shard != NULL)
+    {
+        atomic_init(&shard->min, UINT64_MAX);
+    }
+    return shard;
+}
+
+static TSKLatencyHistogramShard *getThreadShard(TSKLatencyHistogram *histogram)
+{
+    if (threadShardIndex == 0)
+    {
+        threadShardIndex = (atomic_fetch_add_explicit(&nextShardIndex, 1, memory_order_relaxed) % SHARD_COUNT) + 1;
+    }
+
+    _Atomic(TSKLatencyHistogramShard *) *slot = &histogram->shards[threadShardIndex - 1];
+    TSKLatencyHistogramShard *shard = atomic_load_explicit(slot, memory_order_acquire);
+    if (shard == NULL)
+    {
+        // Another thread sharing the slot may allocate it at the same time; only one of the two shards is kept
+        TSKLatencyHistogramShard *newShard = createShard();
+        if (newShard == NULL)
+        {
+            return NULL;
+        }
+        if (atomic_compare_exchange_strong_explicit(slot, &shard, newShard, memory_order_acq_rel, memory_order_acquire))
+        {
+            shard = newShard;
+        }
+        else
+        {
+            free(newShard);
+        }
+    }
+    return shard;
+}
+
+
+// Histogram
+
+TSKLatencyHistogram *TSKLatencyHistogramCreate(void)
+{
+    TSKLatencyHistogram *histogram = malloc(sizeof(TSKLatencyHistogram));
+    if (histogram == NULL)
+    {
+        return NULL;
+    }
+    for (size_t i = 0; i < SHARD_COUNT; i++)
+    {
+        atomic_init(&histogram->shards[i], NULL);
+    }
+    return histogram;
+}
+
+void TSKLatencyHistogramDestroy(TSKLatencyHistogram *histogram)
+{
+    if (histogram == NULL)
+    {
+        return;
+    }
+    for (size_t i = 0; i < SHARD_COUNT; i++)
+    {
+        free(atomic_load_explicit(&histogram->shards[i], memory_order_acquire));
+    }
+    free(histogram);
+}
+
+void TSKLatencyHistogramRecord(TSKLatencyHistogram *histogram, uint64_t nanoseconds)
+{
+    TSKLatencyHistogramShard *shard = getThreadShard(histogram);
+    if (shard == NULL)
+    {
+        return;
+    }
+    if (nanoseconds > TSK_LATENCY_HISTOGRAM_MAX_VALUE)
+    {
+        nanoseconds = TSK_LATENCY_HISTOGRAM_MAX_VALUE;
+    }
+
+    atomic_fetch_add_explicit(&shard->buckets[TSKLatencyHistogramGetBucketIndex(nanoseconds)], 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shard->count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shard->sum, nanoseconds, memory_order_relaxed);
+
+    uint64_t min = atomic_load_explicit(&shard->min, memory_order_relaxed);
+    while ((nanoseconds < min)
+           && !atomic_compare_exchange_weak_explicit(&shard->min, &min, nanoseconds, memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+    uint64_t max = atomic_load_explicit(&shard->max, memory_order_relaxed);
+    while ((nanoseconds > max)
+           && !atomic_compare_exchange_weak_explicit(&shard->max, &max, nanoseconds, memory_order_relaxed, memory_order_relaxed))
+    {
+    }
+}
+
+void TSKLatencyHistogramGetSnapshot(const TSKLatencyHistogram *histogram, TSKLatencyHistogramSnapshot *snapshot)
+{
+    memset(snapshot, 0, sizeof(*snapshot));
+    uint64_t min = UINT64_MAX;
+    for (size_t i = 0; i < SHARD_COUNT; i++)
+    {
+        TSKLatencyHistogramShard *shard = atomic_load_explicit(&histogram->shards[i], memory_order_acquire);
+        if (shard == NULL)
+        {
+            continue;
+        }
+        for (size_t bucket = 0; bucket < TSK_LATENCY_HISTOGRAM_BUCKET_COUNT; bucket++)
+        {
+            snapshot->buckets[bucket] += atomic_load_explicit(&shard->buckets[bucket], memory_order_relaxed);
+        }
+        snapshot->sum += atomic_load_explicit(&shard->sum, memory_order_relaxed);
+
+        uint64_t shardMin = atomic_load_explicit(&shard->min, memory_order_relaxed);
+        uint64_t shardMax = atomic_load_explicit(&shard->max, memory_order_relaxed);
+        min = (shardMin < min) ? shardMin : min;
+        snapshot->max = (shardMax > snapshot->max) ? shardMax : snapshot->max;
+    }
+
+    // Count what is in the buckets, rather than the shards' counts, so that the percentiles add up
+    for (size_t bucket = 0; bucket < TSK_LATENCY_HISTOGRAM_BUCKET_COUNT; bucket++)
+    {
+        snapshot->count += snapshot->buckets[bucket];
+    }
+    snapshot->min = (snapshot->count > 0) ? min : 0;
+}
+
+uint64_t TSKLatencyHistogramSnapshotGetValueAtPercentile(const TSKLatencyHistogramSnapshot *snapshot, double percentile)
+{
+    if (snapshot->count == 0)
+    {
+        return 0;
+    }
+    if (!(percentile > 0))
+    {
+        percentile = 0;
+    }
+    else if (percentile > 100)
+    {
+        percentile = 100;
+    }
+
+    uint64_t rank = (uint64_t)ceil(percentile / 100 * (double)snapshot->count);
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+    uint64_t cumulativeCount = 0;
+    for (size_t bucket = 0; bucket < TSK_LATENCY_HISTOGRAM_BUCKET_COUNT; bucket++)
+    {
+        cumulativeCount += snapshot->buckets[bucket];
+        if (cumulativeCount >= rank)
+        {
+            uint64_t value = TSKLatencyHistogramGetBucketHighestValue(bucket);
+            return (value < snapshot->max) ? value : snapshot->max;
+        }
+    }
+    return snapshot->max;
+}
+
+
+// Time
+
+uint64_t TSKMonotonicTimeNanoseconds(void)
+{
+#if defined(__APPLE__)
+    return clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
+}
@@ -0,0 +1,83 @@
+/*
+
+ latency_histogram.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_latency_histogram_h
+#define TrustKit_latency_histogram_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ A histogram of durations in nanoseconds, with the log-linear buckets of an HDR histogram: values below
+ 64 ns each get their own bucket, and every power of two above is split into 32 buckets, so a recorded
+ value is known within about 3%. Values above TSK_LATENCY_HISTOGRAM_MAX_VALUE are clamped to it.
+
+ Recording is lock-free and does not allocate after a thread's first value: each thread is assigned one
+ of a few shards, whose counters it updates with relaxed atomics, and shards only get allocated when a
+ thread first uses them. Snapshots merge the shards without stopping the threads that are recording, so
+ a snapshot taken during a burst may be missing a few of the values recorded at that time.
+ */
+
+#define TSK_LATENCY_HISTOGRAM_SUB_BUCKET_BITS 5
+#define TSK_LATENCY_HISTOGRAM_BUCKET_COUNT 1024
+
+// About 68 seconds; the largest value that fits in the buckets
+#define TSK_LATENCY_HISTOGRAM_MAX_VALUE ((UINT64_C(1) << 36) - 1)
+
+typedef struct TSKLatencyHistogram TSKLatencyHistogram;
+
+typedef struct
+{
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[TSK_LATENCY_HISTOGRAM_BUCKET_COUNT];
+} TSKLatencyHistogramSnapshot;
+
+
+// Return NULL if the histogram could not be allocated
+TSKLatencyHistogram *TSKLatencyHistogramCreate(void);
+
+void TSKLatencyHistogramDestroy(TSKLatencyHistogram *histogram);
+
+void TSKLatencyHistogramRecord(TSKLatencyHistogram *histogram, uint64_t nanoseconds);
+
+// Merge the values recorded by all the threads so far; min and max are 0 if nothing was recorded
+void TSKLatencyHistogramGetSnapshot(const TSKLatencyHistogram *histogram, TSKLatencyHistogramSnapshot *snapshot);
+
+// Return the highest value that is equivalent to the value at the supplied percentile (0 to 100), or 0 if empty
+uint64_t TSKLatencyHistogramSnapshotGetValueAtPercentile(const TSKLatencyHistogramSnapshot *snapshot, double percentile);
+
+
+// Buckets
+
+size_t TSKLatencyHistogramGetBucketIndex(uint64_t nanoseconds);
+
+// The range of values, both inclusive, that get counted in a bucket
+uint64_t TSKLatencyHistogramGetBucketLowestValue(size_t bucketIndex);
+uint64_t TSKLatencyHistogramGetBucketHighestValue(size_t bucketIndex);
+
+
+// Time
+
+// A monotonic clock that does not advance while the device sleeps, in nanoseconds
+uint64_t TSKMonotonicTimeNanoseconds(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TrustKit_latency_histogram_h */
@@ -0,0 +1,467 @@
+/*
+
+ pin_set.c
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "pin_set.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define TSK_PIN_SET_AVX2 1
+#include <immintrin.h>
+#endif
+
+#if defined(__aarch64__)
+#define TSK_PIN_SET_NEON 1
+#include <arm_neon.h>
+#endif
+
+
+typedef bool (*TSKPinSetContainsFunction)(const TSKPinSet *pinSet, const uint8_t pin[TSK_PIN_LENGTH]);
+
+// A binary fuse filter with 8-bit fingerprints and three hashes per key, as described in "Binary Fuse
+// Filters: Fast and Smaller Than Xor Filters" by Graf and Lemire; false positives happen for about 0.4% of keys
+typedef struct
+{
+    uint64_t seed;
+    uint32_t segmentLength;
+    uint32_t segmentLengthMask;
+    uint32_t segmentCountLength;
+    uint32_t fingerprintCount;
+    uint8_t *fingerprints;
+} TSKBinaryFuseFilter;
+
+struct TSKPinSet
+{
+    TSKPinSetContainsFunction contains;
+    size_t pinCount;
+
+    // 32-byte aligned so that each pin can be loaded with a single aligned 256-bit load
+    uint8_t (*pins)[TSK_PIN_LENGTH];
+
+    // Only used by the largest sets; fingerprints is NULL otherwise
+    TSKBinaryFuseFilter filter;
+};
+
+
+static int comparePins(const void *a, const void *b)
+{
+    return memcmp(a, b, TSK_PIN_LENGTH);
+}
+
+
+// Scanning; every pin is compared, so the time taken does not depend on where (or whether) the pin is found
+
+static bool scanPortable(const TSKPinSet *pinSet, const uint8_t pin[TSK_PIN_LENGTH])
+{
+    uint64_t needle[4];
+    memcpy(needle, pin, sizeof(needle));
+
+    uint64_t isFound = 0;
+    for (size_t i = 0; i < pinSet->pinCount; i++)
+    {
+        uint64_t candidate[4];
+        memcpy(candidate, pinSet->pins[i], sizeof(candidate));
+        uint64_t difference = (candidate[0] ^ needle[0]) | (candidate[1] ^ needle[1])
+                              | (candidate[2] ^ needle[2]) | (candidate[3] ^ needle[3]);
+        isFound |= (difference == 0);
+    }
+    return isFound != 0;
+}
+
+#if TSK_PIN_SET_AVX2
+__attribute__((target("avx2")))
+static bool scanAVX2(const TSKPinSet *pinSet, const uint8_t pin[TSK_PIN_LENGTH])
+{
+    __m256i needle = _mm256_loadu_si256((const __m256i *)pin);
+    uint32_t isFound = 0;
+    for (size_t i = 0; i < pinSet->pinCount; i++)
+    {
+        __m256i candidate = _mm256_load_si256((const __m256i *)pinSet->pins[i]);
+        uint32_t equalBytes = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(candidate, needle));
+        isFound |= (equalBytes == 0xFFFFFFFFu);
+    }
+    return isFound != 0;
+}
+
+static bool isAVX2Supported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+#if TSK_PIN_SET_NEON
+static bool scanNEON(const TSKPinSet *pinSet, const uint8_t pin[TSK_PIN_LENGTH])
+{
+    uint8x16_t needleLow = vld1q_u8(pin);
+    uint8x16_t needleHigh = vld1q_u8(pin + 16);
+    uint32_t isFound = 0;
+    for (size_t i = 0; i < pinSet->pinCount; i++)
+    {
+        uint8x16_t equalBytes = vandq_u8(vceqq_u8(vld1q_u8(pinSet->pins[i]), needleLow),
+                                         vceqq_u8(vld1q_u8(pinSet->pins[i] + 16), needleHigh));
+        isFound |= (vminvq_u8(equalBytes) == 0xFF);
+    }
+    return isFound != 0;
+}
+#endif
+
+
+// Binary search, for the sets that are too large to be scanned
+
+static bool binarySearch(const TSKPinSet *pinSet, const uint8_t pin[TSK_PIN_LENGTH])
+{
+    return bsearch(pin, pinSet->pins, pinSet->pinCount, TSK_PIN_LENGTH, comparePins) != NULL;
+}
+
+
+// Binary fuse filter
+
+#define TSK_BINARY_FUSE_ARITY 3
+#define TSK_BINARY_FUSE_MAX_ATTEMPTS 100
+
+static uint64_t filterKeyForPin(const uint8_t pin[TSK_PIN_LENGTH])
+{
+    // Pins are SHA-256 hashes, so any 64 bits of them are already uniformly distributed
+    uint64_t key;
+    memcpy(&key, pin, sizeof(key));
+    return key;
+}
+
+static uint64_t mixKey(uint64_t key, uint64_t seed)
+{
+    // MurmurHash3's 64-bit finalizer
+    uint64_t hash = key + seed;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static uint64_t nextSeed(uint64_t *state)
+{
+    // SplitMix64
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static uint8_t fingerprintForHash(uint64_t hash)
+{
+    return (uint8_t)(hash ^ (hash >> 32));
+}
+
+// The high 64 bits of hash * value, without relying on 128-bit integers which 32-bit targets lack
+static uint32_t multiplyHigh(uint64_t hash, uint32_t value)
+{
+    uint64_t low = (hash & 0xFFFFFFFFu) * value;
+    uint64_t high = (hash >> 32) * value;
+    return (uint32_t)((high + (low >> 32)) >> 32);
+}
+
+// The three positions of a hash are in three consecutive segments
+static void filterPositionsForHash(const TSKBinaryFuseFilter *filter, uint64_t hash, uint32_t positions[TSK_BINARY_FUSE_ARITY])
+{
+    positions[0] = multiplyHigh(hash, filter->segmentCountLength);
+    positions[1] = (positions[0] + filter->segmentLength) ^ ((uint32_t)(hash >> 18) & filter->segmentLengthMask);
+    positions[2] = (positions[0] + 2 * filter->segmentLength) ^ ((uint32_t)hash & filter->segmentLengthMask);
+}
+
+static bool filterMayContain(const TSKBinaryFuseFilter *filter, uint64_t key)
+{
+    uint64_t hash = mixKey(key, filter->seed);
+    uint32_t positions[TSK_BINARY_FUSE_ARITY];
+    filterPositionsForHash(filter, hash, positions);
+    uint8_t fingerprint = fingerprintForHash(hash);
+    return (fingerprint ^ filter->fingerprints[positions[0]] ^ filter->fingerprints[positions[1]]
+            ^ filter->fingerprints[positions[2]]) == 0;
+}
+
+static int compareKeys(const void *a, const void *b)
+{
+    uint64_t keyA = *(const uint64_t *)a;
+    uint64_t keyB = *(const uint64_t *)b;
+    return (keyA > keyB) - (keyA < keyB);
+}
+
+// Size the filter for the supplied number of keys, using the parameters recommended by the paper
+static void sizeFilter(TSKBinaryFuseFilter *filter, size_t keyCount)
+{
+    uint32_t segmentLength = 1u << (int)floor(log((double)keyCount) / log(3.33) + 2.25);
+    if (segmentLength > 262144)
+    {
+        segmentLength = 262144;
+    }
+    double sizeFactor = fmax(1.125, 0.875 + 0.25 * log(1000000.0) / log((double)keyCount));
+    uint32_t capacity = (uint32_t)round((double)keyCount * sizeFactor);
+    uint32_t segmentCount = (capacity + segmentLength - 1) / segmentLength;
+    segmentCount = (segmentCount > TSK_BINARY_FUSE_ARITY - 1) ? segmentCount - (TSK_BINARY_FUSE_ARITY - 1) : 1;
+
+    filter->segmentLength = segmentLength;
+    filter->segmentLengthMask = segmentLength - 1;
+    filter->segmentCountLength = segmentCount * segmentLength;
+    filter->fingerprintCount = (segmentCount + TSK_BINARY_FUSE_ARITY - 1) * segmentLength;
+}
+
+// Find an order in which every key has a position that no key after it uses (peeling), then assign the
+// fingerprints in the reverse order; retry with another seed if some keys cannot be peeled
+static bool buildFilter(TSKBinaryFuseFilter *filter, uint64_t *keys, size_t keyCount)
+{
+    // Identical keys can never be peeled
+    qsort(keys, keyCount, sizeof(uint64_t), compareKeys);
+    size_t uniqueCount = 0;
+    for (size_t i = 0; i < keyCount; i++)
+    {
+        if ((uniqueCount == 0) || (keys[uniqueCount - 1] != keys[i]))
+        {
+            keys[uniqueCount++] = keys[i];
+        }
+    }
+    keyCount = uniqueCount;
+    if ((keyCount < 2) || (keyCount > UINT32_MAX / 2))
+    {
+        return false;
+    }
+
+    sizeFilter(filter, keyCount);
+    size_t slotCount = filter->fingerprintCount;
+    filter->fingerprints = calloc(slotCount, 1);
+
+    // For each slot: how many keys use it, and the XOR of their hashes, which is the hash of the last key left
+    uint32_t *slotKeyCounts = malloc(slotCount * sizeof(uint32_t));
+    uint64_t *slotHashes = malloc(slotCount * sizeof(uint64_t));
+    uint32_t *queue = malloc(slotCount * sizeof(uint32_t));
+    uint64_t *peeledHashes = malloc(keyCount * sizeof(uint64_t));
+    uint32_t *peeledSlots = malloc(keyCount * sizeof(uint32_t));
+
+    bool isBuilt = false;
+    uint64_t seedState = 0x726b2b9d438b9d4dULL;
+    for (int attempt = 0; (attempt < TSK_BINARY_FUSE_MAX_ATTEMPTS) && (filter->fingerprints != NULL) && (slotKeyCounts != NULL)
+         && (slotHashes != NULL) && (queue != NULL) && (peeledHashes != NULL) && (peeledSlots != NULL); attempt++)
+    {
+        filter->seed = nextSeed(&seedState);
+        memset(slotKeyCounts, 0, slotCount * sizeof(uint32_t));
+        memset(slotHashes, 0, slotCount * sizeof(uint64_t));
+        for (size_t i = 0; i < keyCount; i++)
+        {
+            uint64_t hash = mixKey(keys[i], filter->seed);
+            uint32_t positions[TSK_BINARY_FUSE_ARITY];
+            filterPositionsForHash(filter, hash, positions);
+            for (int j = 0; j < TSK_BINARY_FUSE_ARITY; j++)
+            {
+                slotKeyCounts[positions[j]] += 1;
+                slotHashes[positions[j]] ^= hash;
+            }
+        }
+
+        size_t queueLength = 0;
+        for (uint32_t slot = 0; slot < slotCount; slot++)
+        {
+            if (slotKeyCounts[slot] == 1)
+            {
+                queue[queueLength++] = slot;
+            }
+        }
+
+        size_t peeledCount = 0;
+        while (queueLength > 0)
+        {
+            uint32_t slot = queue[--queueLength];
+            if (slotKeyCounts[slot] != 1)
+            {
+                // Another key was peeled from this slot since it was queued
+                continue;
+            }
+            uint64_t hash = slotHashes[slot];
+            peeledHashes[peeledCount] = hash;
+            peeledSlots[peeledCount] = slot;
+            peeledCount++;
+
+            uint32_t positions[TSK_BINARY_FUSE_ARITY];
+            filterPositionsForHash(filter, hash, positions);
+            for (int j = 0; j < TSK_BINARY_FUSE_ARITY; j++)
+            {
+                slotKeyCounts[positions[j]] -= 1;
+                slotHashes[positions[j]] ^= hash;
+                if (slotKeyCounts[positions[j]] == 1)
+                {
+                    queue[queueLength++] = positions[j];
+                }
+            }
+        }
+
+        if (peeledCount == keyCount)
+        {
+            // The key peeled last is assigned first; its other slots are not used by any key assigned after it
+            memset(filter->fingerprints, 0, slotCount);
+            for (size_t i = peeledCount; i-- > 0;)
+            {
+                uint32_t positions[TSK_BINARY_FUSE_ARITY];
+                filterPositionsForHash(filter, peeledHashes[i], positions);
+                uint8_t fingerprint = fingerprintForHash(peeledHashes[i]);
+                for (int j = 0; j < TSK_BINARY_FUSE_ARITY; j++)
+                {
+                    if (positions[j] != peeledSlots[i])
+                    {
+                        fingerprint ^= filter->fingerprints[positions[j]];
+                    }
+                }
+                filter->fingerprints[peeledSlots[i]] = fingerprint;
+            }
+            isBuilt = true;
+            break;
+        }
+    }
+
+    free(slotKeyCounts);
+    free(slotHashes);
+    free(queue);
+    free(peeledHashes);
+    free(peeledSlots);
+    if (!isBuilt)
+    {
+        free(filter->fingerprints);
+        filter->fingerprints = NULL;
+    }
+    return isBuilt;
+}
+
+static bool filteredBinarySearch(const TSKPinSet *pinSet, const uint8_t pin[TSK_PIN_LENGTH])
+{
+    // The filter has no false negatives, so only the hashes it lets through need an exact confirmation
+    if (!filterMayContain(&pinSet->filter, filterKeyForPin(pin)))
+    {
+        return false;
+    }
+    return binarySearch(pinSet, pin);
+}
+
+
+static TSKPinSetContainsFunction selectContainsFunction(const TSKPinSet *pinSet)
+{
+    size_t pinCount = pinSet->pinCount;
+    if (pinSet->filter.fingerprints != NULL)
+    {
+        return filteredBinarySearch;
+    }
+    if (pinCount > TSK_PIN_SET_MAX_SCANNED_PINS)
+    {
+        return binarySearch;
+    }
+#if TSK_PIN_SET_NEON
+    return scanNEON;
+#else
+#if TSK_PIN_SET_AVX2
+    if (isAVX2Supported())
+    {
+        return scanAVX2;
+    }
+#endif
+    return scanPortable;
+#endif
+}
+
+
+TSKPinSet *TSKPinSetCreate(const uint8_t (*pins)[TSK_PIN_LENGTH], size_t pinCount)
+{
+    TSKPinSet *pinSet = calloc(1, sizeof(TSKPinSet));
+    if (pinSet == NULL)
+    {
+        return NULL;
+    }
+
+    void *storage = NULL;
+    if ((pinCount > 0) && (posix_memalign(&storage, 32, pinCount * TSK_PIN_LENGTH) != 0))
+    {
+        free(pinSet);
+        return NULL;
+    }
+    pinSet->pins = storage;
+
+    // Sorting makes duplicates adjacent, and is required for the binary search anyway
+    if (pinCount > 0)
+    {
+        memcpy(pinSet->pins, pins, pinCount * TSK_PIN_LENGTH);
+        qsort(pinSet->pins, pinCount, TSK_PIN_LENGTH, comparePins);
+    }
+    size_t uniqueCount = 0;
+    for (size_t i = 0; i < pinCount; i++)
+    {
+        if ((uniqueCount == 0) || (comparePins(pinSet->pins[uniqueCount - 1], pinSet->pins[i]) != 0))
+        {
+            memmove(pinSet->pins[uniqueCount++], pinSet->pins[i], TSK_PIN_LENGTH);
+        }
+    }
+    pinSet->pinCount = uniqueCount;
+
+    if (uniqueCount >= TSK_PIN_SET_MIN_FILTERED_PINS)
+    {
+        uint64_t *keys = malloc(uniqueCount * sizeof(uint64_t));
+        if (keys != NULL)
+        {
+            for (size_t i = 0; i < uniqueCount; i++)
+            {
+                keys[i] = filterKeyForPin(pinSet->pins[i]);
+            }
+            // Without a filter, lookups are still correct, only slower
+            buildFilter(&pinSet->filter, keys, uniqueCount);
+            free(keys);
+        }
+    }
+
+    pinSet->contains = selectContainsFunction(pinSet);
+    return pinSet;
+}
+
+void TSKPinSetDestroy(TSKPinSet *pinSet)
+{
+    if (pinSet == NULL)
+    {
+        return;
+    }
+    free(pinSet->filter.fingerprints);
+    free(pinSet->pins);
+    free(pinSet);
+}
+
+size_t TSKPinSetGetCount(const TSKPinSet *pinSet)
+{
+    return (pinSet == NULL) ? 0 : pinSet->pinCount;
+}
+
+bool TSKPinSetContains(const TSKPinSet *pinSet, const uint8_t pin[TSK_PIN_LENGTH])
+{
+    if (pinSet == NULL)
+    {
+        return false;
+    }
+    return pinSet->contains(pinSet, pin);
+}
+
+bool TSKPinSetHasFilter(const TSKPinSet *pinSet)
+{
+    return (pinSet != NULL) && (pinSet->filter.fingerprints != NULL);
+}
+
+size_t TSKPinSetGetMemorySize(const TSKPinSet *pinSet)
+{
+    if (pinSet == NULL)
+    {
+        return 0;
+    }
+    size_t filterSize = (pinSet->filter.fingerprints != NULL) ? pinSet->filter.fingerprintCount : 0;
+    return sizeof(TSKPinSet) + pinSet->pinCount * TSK_PIN_LENGTH + filterSize;
+}
@@ -0,0 +1,64 @@
+/*
+
+ pin_set.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_pin_set_h
+#define TrustKit_pin_set_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ A set of SPKI pins stored as a packed array of 32-byte SHA-256 digests.
+
+ Small sets, which is what most pinning policies have, are scanned in full with 256-bit compares
+ (AVX2 on x86-64, NEON on ARMv8, 64-bit words elsewhere) and without any data-dependent branch.
+ Larger sets are sorted and searched with a binary search instead.
+
+ Very large sets, such as an allowlist of every key issued by a private PKI, also get a binary fuse
+ filter (about 9 to 10 bits per pin) that rejects most unknown hashes with three memory accesses, so that
+ the binary search only runs to confirm the hashes the filter lets through.
+ */
+
+#define TSK_PIN_LENGTH 32
+
+// Sets with more pins than this are sorted and binary-searched instead of scanned
+#define TSK_PIN_SET_MAX_SCANNED_PINS 64
+
+// Sets with at least this many pins are put behind an approximate-membership filter
+#define TSK_PIN_SET_MIN_FILTERED_PINS 1024
+
+typedef struct TSKPinSet TSKPinSet;
+
+// Copy the supplied pins into a new set, dropping duplicates; returns NULL if memory could not be allocated
+TSKPinSet *TSKPinSetCreate(const uint8_t (*pins)[TSK_PIN_LENGTH], size_t pinCount);
+
+void TSKPinSetDestroy(TSKPinSet *pinSet);
+
+size_t TSKPinSetGetCount(const TSKPinSet *pinSet);
+
+bool TSKPinSetContains(const TSKPinSet *pinSet, const uint8_t pin[TSK_PIN_LENGTH]);
+
+// Whether the set is using a filter, which it may not if it is too small or the filter could not be built
+bool TSKPinSetHasFilter(const TSKPinSet *pinSet);
+
+// The number of bytes allocated for the set, including its filter
+size_t TSKPinSetGetMemorySize(const TSKPinSet *pinSet);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TrustKit_pin_set_h */
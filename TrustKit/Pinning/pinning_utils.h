@@ -47,6 +47,15 @@ void evaluateCertificateChainTrust(SecTrustRef serverTrust, SecTrustResultType *
  */
 SecCertificateRef getCertificateAtIndex(SecTrustRef serverTrust, CFIndex index);
 
+/**
+ Returns the certificates from the certificate chain used to evaluate trust, starting with the leaf.
+
+ Unlike calling getCertificateAtIndex() in a loop, this only copies the chain once on iOS 15+, macOS 12+.
+ @param serverTrust The trust management object to evaluate
+ @return An array of SecCertificateRef which remain valid after the trust object has been released.
+ */
+NSArray *copyCertificateChain(SecTrustRef serverTrust);
+
 /**
  Returns the public key for a leaf certificate after it has been evaluated.
  
@@ -44,31 +44,69 @@ void evaluateCertificateChainTrust(SecTrustRef serverTrust, SecTrustResultType *
     }
 }
 
-SecCertificateRef getCertificateAtIndex(SecTrustRef serverTrust, CFIndex index) {
-    NSInteger majorVersion = [[NSProcessInfo processInfo] operatingSystemVersion].majorVersion;
+typedef CFArrayRef (*TSKSecTrustCopyCertificateChainFunction)(SecTrustRef);
+typedef SecCertificateRef (*TSKSecTrustGetCertificateAtIndexFunction)(SecTrustRef, CFIndex);
+
+// SecTrustCopyCertificateChain() on iOS 15+, macOS 12+, and SecTrustGetCertificateAtIndex() otherwise; they
+// are looked up once as the first one is not in older SDKs and the second one is deprecated in newer ones
+typedef struct
+{
+    TSKSecTrustCopyCertificateChainFunction copyCertificateChain;
+    TSKSecTrustGetCertificateAtIndexFunction getCertificateAtIndex;
+} TSKCertificateChainFunctions;
+
+static TSKCertificateChainFunctions getCertificateChainFunctions(void) {
+    static TSKCertificateChainFunctions functions;
+    static dispatch_once_t onceToken;
+    dispatch_once(&onceToken, ^{
+        NSInteger majorVersion = [[NSProcessInfo processInfo] operatingSystemVersion].majorVersion;
 #if TARGET_OS_WATCH
-    int osVersionThreshold = 8; // watchOS 8+
+        int osVersionThreshold = 8; // watchOS 8+
 #elif TARGET_OS_IPHONE || TARGET_OS_SIMULATOR || TARGET_OS_IOS
-    int osVersionThreshold = 15; // iOS 15+, tvOS 15+
+        int osVersionThreshold = 15; // iOS 15+, tvOS 15+
 #else
-    int osVersionThreshold = 12; // macOS 12+
+        int osVersionThreshold = 12; // macOS 12+
 #endif
-    SecCertificateRef certificate = NULL;
-    void *_Security = dlopen("/System/Library/Frameworks/Security.framework/Security", RTLD_NOW);
+        void *_Security = dlopen("/System/Library/Frameworks/Security.framework/Security", RTLD_NOW);
+        if (majorVersion >= osVersionThreshold)
+        {
+            functions.copyCertificateChain = (TSKSecTrustCopyCertificateChainFunction)dlsym(_Security, "SecTrustCopyCertificateChain");
+        }
+        else
+        {
+            functions.getCertificateAtIndex = (TSKSecTrustGetCertificateAtIndexFunction)dlsym(_Security, "SecTrustGetCertificateAtIndex");
+        }
+    });
+    return functions;
+}
 
-    if (majorVersion >= osVersionThreshold)
+SecCertificateRef getCertificateAtIndex(SecTrustRef serverTrust, CFIndex index) {
+    TSKCertificateChainFunctions functions = getCertificateChainFunctions();
+    if (functions.copyCertificateChain != NULL)
     {
-        CFArrayRef (*_SecTrustCopyCertificateChain)(SecTrustRef) = dlsym(_Security, "SecTrustCopyCertificateChain");
-        CFArrayRef certs = _SecTrustCopyCertificateChain(serverTrust);
-        certificate = (SecCertificateRef)CFArrayGetValueAtIndex(certs, index);
+        CFArrayRef certs = functions.copyCertificateChain(serverTrust);
+        SecCertificateRef certificate = (SecCertificateRef)CFArrayGetValueAtIndex(certs, index);
         CFRelease(certs);
+        return certificate;
     }
-    else
+    return functions.getCertificateAtIndex(serverTrust, index);
+}
+
+NSArray *copyCertificateChain(SecTrustRef serverTrust) {
+    TSKCertificateChainFunctions functions = getCertificateChainFunctions();
+    if (functions.copyCertificateChain != NULL)
+    {
+        CFArrayRef certs = functions.copyCertificateChain(serverTrust);
+        return (certs != NULL) ? (__bridge_transfer NSArray *)certs : @[];
+    }
+
+    CFIndex chainLen = SecTrustGetCertificateCount(serverTrust);
+    NSMutableArray *certificates = [NSMutableArray arrayWithCapacity:chainLen];
+    for (CFIndex i=0;i<chainLen;i++)
     {
-        SecCertificateRef (*_SecTrustGetCertificateAtIndex)(SecTrustRef, CFIndex) = dlsym(_Security, "SecTrustGetCertificateAtIndex");
-        certificate = _SecTrustGetCertificateAtIndex(serverTrust, index);
+        [certificates addObject:(__bridge id)functions.getCertificateAtIndex(serverTrust, i)];
     }
-    return certificate;
+    return certificates;
 }
 
 SecKeyRef copyKey(SecTrustRef serverTrust) {
@@ -0,0 +1,710 @@
+/*
+
+ sha256_engine.c
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "sha256_engine.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define TSK_SHA256_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+// The ARMv8 backend is only built when the target has the cryptography extensions, which is the
+// case for every Apple arm64 device
+#if defined(__aarch64__) && (defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO))
+#define TSK_SHA256_ARMV8 1
+#include <arm_neon.h>
+#endif
+
+
+typedef void (*TSKSHA256CompressFunction)(uint32_t state[8], const uint8_t *blocks, size_t blockCount);
+
+static const uint32_t kInitialState[8] =
+{
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+static const uint32_t kRoundConstants[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+
+static uint32_t readBigEndian32(const uint8_t *bytes)
+{
+    return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+}
+
+static void writeBigEndian32(uint8_t *bytes, uint32_t value)
+{
+    bytes[0] = (uint8_t)(value >> 24);
+    bytes[1] = (uint8_t)(value >> 16);
+    bytes[2] = (uint8_t)(value >> 8);
+    bytes[3] = (uint8_t)value;
+}
+
+// Write the padding of a message after its last full block; returns the number of blocks (1 or 2)
+static size_t padFinalBlocks(uint8_t finalBlocks[128], const uint8_t *remainder, size_t remainderLength, size_t messageLength)
+{
+    size_t blockCount = (remainderLength + 9 > 64) ? 2 : 1;
+    memset(finalBlocks, 0, blockCount * 64);
+    if (remainderLength > 0)
+    {
+        memcpy(finalBlocks, remainder, remainderLength);
+    }
+    finalBlocks[remainderLength] = 0x80;
+
+    uint64_t bitLength = (uint64_t)messageLength * 8;
+    uint8_t *lengthBytes = finalBlocks + blockCount * 64 - 8;
+    writeBigEndian32(lengthBytes, (uint32_t)(bitLength >> 32));
+    writeBigEndian32(lengthBytes + 4, (uint32_t)bitLength);
+    return blockCount;
+}
+
+static void hashWithCompressFunction(TSKSHA256CompressFunction compress, const void *data, size_t length,
+                                     uint8_t digest[TSK_SHA256_DIGEST_LENGTH])
+{
+    uint32_t state[8];
+    memcpy(state, kInitialState, sizeof(state));
+
+    const uint8_t *bytes = data;
+    size_t fullBlockCount = length / 64;
+    compress(state, bytes, fullBlockCount);
+
+    uint8_t finalBlocks[128];
+    size_t finalBlockCount = padFinalBlocks(finalBlocks, bytes + fullBlockCount * 64, length % 64, length);
+    compress(state, finalBlocks, finalBlockCount);
+
+    for (int i = 0; i < 8; i++)
+    {
+        writeBigEndian32(digest + 4 * i, state[i]);
+    }
+}
+
+
+// Portable backend
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void compressPortable(uint32_t state[8], const uint8_t *blocks, size_t blockCount)
+{
+    for (size_t block = 0; block < blockCount; block++, blocks += 64)
+    {
+        uint32_t w[64];
+        for (int t = 0; t < 16; t++)
+        {
+            w[t] = readBigEndian32(blocks + 4 * t);
+        }
+        for (int t = 16; t < 64; t++)
+        {
+            uint32_t s0 = ROTR32(w[t - 15], 7) ^ ROTR32(w[t - 15], 18) ^ (w[t - 15] >> 3);
+            uint32_t s1 = ROTR32(w[t - 2], 17) ^ ROTR32(w[t - 2], 19) ^ (w[t - 2] >> 10);
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int t = 0; t < 64; t++)
+        {
+            uint32_t t1 = h + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25)) + ((e & f) ^ (~e & g)) + kRoundConstants[t] + w[t];
+            uint32_t t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+
+// x86-64 backends
+
+#if TSK_SHA256_X86
+
+__attribute__((target("sha,sse4.1,ssse3")))
+static void compressSHAExtensions(uint32_t state[8], const uint8_t *blocks, size_t blockCount)
+{
+    const __m128i byteSwapMask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // The SHA instructions work on the state as ABEF and CDGH
+    __m128i cdab = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);
+    __m128i efgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B);
+    __m128i abef = _mm_alignr_epi8(cdab, efgh, 8);
+    __m128i cdgh = _mm_blend_epi16(efgh, cdab, 0xF0);
+
+    for (size_t block = 0; block < blockCount; block++, blocks += 64)
+    {
+        __m128i savedAbef = abef;
+        __m128i savedCdgh = cdgh;
+
+        // Four message words are scheduled and consumed per iteration; w[i % 4] holds W[i - 4..i - 1]
+        __m128i w[4];
+        for (int i = 0; i < 16; i++)
+        {
+            __m128i words;
+            if (i < 4)
+            {
+                words = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(blocks + 16 * i)), byteSwapMask);
+            }
+            else
+            {
+                words = _mm_sha256msg1_epu32(w[i & 3], w[(i + 1) & 3]);
+                words = _mm_add_epi32(words, _mm_alignr_epi8(w[(i + 3) & 3], w[(i + 2) & 3], 4));
+                words = _mm_sha256msg2_epu32(words, w[(i + 3) & 3]);
+            }
+            w[i & 3] = words;
+
+            __m128i roundInput = _mm_add_epi32(words, _mm_loadu_si128((const __m128i *)&kRoundConstants[4 * i]));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, roundInput);
+            roundInput = _mm_shuffle_epi32(roundInput, 0x0E);
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, roundInput);
+        }
+
+        abef = _mm_add_epi32(abef, savedAbef);
+        cdgh = _mm_add_epi32(cdgh, savedCdgh);
+    }
+
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1B);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+    _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(feba, dchg, 0xF0));
+    _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(dchg, feba, 8));
+}
+
+
+#define ROTR256(x, n) _mm256_or_si256(_mm256_srli_epi32((x), (n)), _mm256_slli_epi32((x), 32 - (n)))
+
+// Transpose eight vectors of eight 32-bit words in place
+__attribute__((target("avx2")))
+static void transpose8x8(__m256i rows[8])
+{
+    __m256i t[8], u[8];
+    for (int i = 0; i < 8; i += 2)
+    {
+        t[i] = _mm256_unpacklo_epi32(rows[i], rows[i + 1]);
+        t[i + 1] = _mm256_unpackhi_epi32(rows[i], rows[i + 1]);
+    }
+    for (int i = 0; i < 8; i += 4)
+    {
+        u[i] = _mm256_unpacklo_epi64(t[i], t[i + 2]);
+        u[i + 1] = _mm256_unpackhi_epi64(t[i], t[i + 2]);
+        u[i + 2] = _mm256_unpacklo_epi64(t[i + 1], t[i + 3]);
+        u[i + 3] = _mm256_unpackhi_epi64(t[i + 1], t[i + 3]);
+    }
+    for (int i = 0; i < 4; i++)
+    {
+        rows[i] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x20);
+        rows[i + 4] = _mm256_permute2x128_si256(u[i], u[i + 4], 0x31);
+    }
+}
+
+// Hash up to eight messages of any length, one per 32-bit lane; lanes that run out of blocks are masked out
+__attribute__((target("avx2")))
+static void hashMultiBufferAVX2(const TSKSHA256Message *messages, size_t messageCount,
+                                uint8_t (*digests)[TSK_SHA256_DIGEST_LENGTH])
+{
+    const __m256i byteSwapMask = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+                                                 12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+
+    uint8_t finalBlocks[TSK_SHA256_MAX_LANES][128];
+    size_t fullBlockCounts[TSK_SHA256_MAX_LANES];
+    int32_t blockCounts[TSK_SHA256_MAX_LANES];
+    size_t maxBlockCount = 0;
+    for (size_t lane = 0; lane < TSK_SHA256_MAX_LANES; lane++)
+    {
+        // Unused lanes hash an empty message and their result is dropped
+        const uint8_t *bytes = (lane < messageCount) ? messages[lane].data : NULL;
+        size_t length = (lane < messageCount) ? messages[lane].length : 0;
+        fullBlockCounts[lane] = length / 64;
+        size_t finalBlockCount = padFinalBlocks(finalBlocks[lane], (bytes != NULL) ? bytes + fullBlockCounts[lane] * 64 : NULL,
+                                                length % 64, length);
+        blockCounts[lane] = (int32_t)(fullBlockCounts[lane] + finalBlockCount);
+        if ((size_t)blockCounts[lane] > maxBlockCount)
+        {
+            maxBlockCount = (size_t)blockCounts[lane];
+        }
+    }
+
+    __m256i state[8];
+    for (int i = 0; i < 8; i++)
+    {
+        state[i] = _mm256_set1_epi32((int)kInitialState[i]);
+    }
+    __m256i laneBlockCounts = _mm256_loadu_si256((const __m256i *)blockCounts);
+
+    for (size_t block = 0; block < maxBlockCount; block++)
+    {
+        // Load the current block of every lane and transpose it so that each vector holds one word of all lanes
+        __m256i w[16];
+        __m256i rows[8], rowsHigh[8];
+        for (size_t lane = 0; lane < TSK_SHA256_MAX_LANES; lane++)
+        {
+            const uint8_t *blockBytes;
+            if (block < fullBlockCounts[lane])
+            {
+                blockBytes = (const uint8_t *)messages[lane].data + block * 64;
+            }
+            else if (block < (size_t)blockCounts[lane])
+            {
+                blockBytes = finalBlocks[lane] + (block - fullBlockCounts[lane]) * 64;
+            }
+            else
+            {
+                // The lane is done; whatever it computes is discarded below
+                blockBytes = finalBlocks[lane];
+            }
+            rows[lane] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)blockBytes), byteSwapMask);
+            rowsHigh[lane] = _mm256_shuffle_epi8(_mm256_loadu_si256((const __m256i *)(blockBytes + 32)), byteSwapMask);
+        }
+        transpose8x8(rows);
+        transpose8x8(rowsHigh);
+        for (int i = 0; i < 8; i++)
+        {
+            w[i] = rows[i];
+            w[i + 8] = rowsHigh[i];
+        }
+
+        __m256i a = state[0], b = state[1], c = state[2], d = state[3];
+        __m256i e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int t = 0; t < 64; t++)
+        {
+            __m256i wt;
+            if (t < 16)
+            {
+                wt = w[t];
+            }
+            else
+            {
+                __m256i w15 = w[(t - 15) & 15];
+                __m256i w2 = w[(t - 2) & 15];
+                __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(ROTR256(w15, 7), ROTR256(w15, 18)), _mm256_srli_epi32(w15, 3));
+                __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(ROTR256(w2, 17), ROTR256(w2, 19)), _mm256_srli_epi32(w2, 10));
+                wt = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0), _mm256_add_epi32(w[(t - 7) & 15], s1));
+                w[t & 15] = wt;
+            }
+
+            __m256i sigma1 = _mm256_xor_si256(_mm256_xor_si256(ROTR256(e, 6), ROTR256(e, 11)), ROTR256(e, 25));
+            __m256i choice = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+            __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, sigma1),
+                                          _mm256_add_epi32(choice, _mm256_add_epi32(_mm256_set1_epi32((int)kRoundConstants[t]), wt)));
+            __m256i sigma0 = _mm256_xor_si256(_mm256_xor_si256(ROTR256(a, 2), ROTR256(a, 13)), ROTR256(a, 22));
+            __m256i majority = _mm256_xor_si256(_mm256_xor_si256(_mm256_and_si256(a, b), _mm256_and_si256(a, c)), _mm256_and_si256(b, c));
+            __m256i t2 = _mm256_add_epi32(sigma0, majority);
+            h = g;
+            g = f;
+            f = e;
+            e = _mm256_add_epi32(d, t1);
+            d = c;
+            c = b;
+            b = a;
+            a = _mm256_add_epi32(t1, t2);
+        }
+
+        // Only update the lanes that still had a block to process
+        __m256i isActive = _mm256_cmpgt_epi32(laneBlockCounts, _mm256_set1_epi32((int)block));
+        __m256i results[8] = { a, b, c, d, e, f, g, h };
+        for (int i = 0; i < 8; i++)
+        {
+            state[i] = _mm256_blendv_epi8(state[i], _mm256_add_epi32(state[i], results[i]), isActive);
+        }
+    }
+
+    // Back to one vector of eight state words per lane
+    transpose8x8(state);
+    for (size_t lane = 0; lane < messageCount; lane++)
+    {
+        _mm256_storeu_si256((__m256i *)digests[lane], _mm256_shuffle_epi8(state[lane], byteSwapMask));
+    }
+}
+
+static bool isSHAExtensionsSupported(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3))
+    {
+        return false;
+    }
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & (1u << 29));
+}
+
+static bool isAVX2Supported(void)
+{
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE) || !(ecx & bit_AVX))
+    {
+        return false;
+    }
+
+    // The OS must also save the YMM registers on context switches
+    uint32_t xcr0Low, xcr0High;
+    __asm__ volatile("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+    if ((xcr0Low & 0x6) != 0x6)
+    {
+        return false;
+    }
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_AVX2);
+}
+
+#endif /* TSK_SHA256_X86 */
+
+
+// ARMv8 backend
+
+#if TSK_SHA256_ARMV8
+
+static void compressARMv8(uint32_t state[8], const uint8_t *blocks, size_t blockCount)
+{
+    uint32x4_t abcd = vld1q_u32(&state[0]);
+    uint32x4_t efgh = vld1q_u32(&state[4]);
+
+    for (size_t block = 0; block < blockCount; block++, blocks += 64)
+    {
+        uint32x4_t savedAbcd = abcd;
+        uint32x4_t savedEfgh = efgh;
+
+        // Four message words are scheduled and consumed per iteration; w[i % 4] holds W[i - 4..i - 1]
+        uint32x4_t w[4];
+        for (int i = 0; i < 16; i++)
+        {
+            uint32x4_t words;
+            if (i < 4)
+            {
+                words = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(blocks + 16 * i)));
+            }
+            else
+            {
+                words = vsha256su1q_u32(vsha256su0q_u32(w[i & 3], w[(i + 1) & 3]), w[(i + 2) & 3], w[(i + 3) & 3]);
+            }
+            w[i & 3] = words;
+
+            uint32x4_t roundInput = vaddq_u32(words, vld1q_u32(&kRoundConstants[4 * i]));
+            uint32x4_t previousAbcd = abcd;
+            abcd = vsha256hq_u32(abcd, efgh, roundInput);
+            efgh = vsha256h2q_u32(efgh, previousAbcd, roundInput);
+        }
+
+        abcd = vaddq_u32(abcd, savedAbcd);
+        efgh = vaddq_u32(efgh, savedEfgh);
+    }
+
+    vst1q_u32(&state[0], abcd);
+    vst1q_u32(&state[4], efgh);
+}
+
+#endif /* TSK_SHA256_ARMV8 */
+
+
+// Backend selection
+
+static const TSKSHA256CompressFunction kCompressFunctions[TSKSHA256BackendCount] =
+{
+    compressPortable,
+#if TSK_SHA256_X86
+    compressSHAExtensions,
+#else
+    NULL,
+#endif
+#if TSK_SHA256_ARMV8
+    compressARMv8,
+#else
+    NULL,
+#endif
+};
+
+static pthread_once_t backendSelectionOnce = PTHREAD_ONCE_INIT;
+static bool isBackendAvailable[TSKSHA256BackendCount];
+static bool isMultiBufferAvailable;
+static bool isMultiBufferEnabled;
+static TSKSHA256Backend selectedBackend = TSKSHA256BackendPortable;
+
+
+static bool isBackendSupportedByCPU(TSKSHA256Backend backend)
+{
+    switch (backend)
+    {
+        case TSKSHA256BackendPortable:
+            return true;
+#if TSK_SHA256_X86
+        case TSKSHA256BackendSHAExtensions:
+            return isSHAExtensionsSupported();
+#endif
+#if TSK_SHA256_ARMV8
+        case TSKSHA256BackendARMv8:
+            return true;
+#endif
+        default:
+            return false;
+    }
+}
+
+static void hexToBytes(const char *hex, uint8_t *bytes)
+{
+    for (size_t i = 0; hex[2 * i] != '\0'; i++)
+    {
+        unsigned int high = (unsigned int)((hex[2 * i] <= '9') ? hex[2 * i] - '0' : hex[2 * i] - 'a' + 10);
+        unsigned int low = (unsigned int)((hex[2 * i + 1] <= '9') ? hex[2 * i + 1] - '0' : hex[2 * i + 1] - 'a' + 10);
+        bytes[i] = (uint8_t)((high << 4) | low);
+    }
+}
+
+// Messages of 0 to 191 bytes cover every way the padding can be laid out over one to four blocks
+#define SELF_TEST_MESSAGE_LENGTH 192
+
+static void fillSelfTestMessage(uint8_t message[SELF_TEST_MESSAGE_LENGTH])
+{
+    for (size_t i = 0; i < SELF_TEST_MESSAGE_LENGTH; i++)
+    {
+        message[i] = (uint8_t)(i * 31 + 7);
+    }
+}
+
+static bool selfTestCompressFunction(TSKSHA256CompressFunction compress)
+{
+    // FIPS 180-2 test vectors
+    static const struct
+    {
+        const char *message;
+        const char *digest;
+    } knownVectors[] =
+    {
+        { "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+        { "abc", "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad" },
+        { "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+          "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1" },
+        { "abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu",
+          "cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1" },
+    };
+
+    for (size_t i = 0; i < sizeof(knownVectors) / sizeof(knownVectors[0]); i++)
+    {
+        uint8_t expectedDigest[TSK_SHA256_DIGEST_LENGTH];
+        uint8_t digest[TSK_SHA256_DIGEST_LENGTH];
+        hexToBytes(knownVectors[i].digest, expectedDigest);
+        hashWithCompressFunction(compress, knownVectors[i].message, strlen(knownVectors[i].message), digest);
+        if (memcmp(digest, expectedDigest, sizeof(digest)) != 0)
+        {
+            return false;
+        }
+    }
+
+    if (compress == compressPortable)
+    {
+        return true;
+    }
+
+    // Then compare with the portable backend, which was checked first
+    uint8_t message[SELF_TEST_MESSAGE_LENGTH];
+    fillSelfTestMessage(message);
+    for (size_t length = 0; length < SELF_TEST_MESSAGE_LENGTH; length++)
+    {
+        uint8_t expectedDigest[TSK_SHA256_DIGEST_LENGTH];
+        uint8_t digest[TSK_SHA256_DIGEST_LENGTH];
+        hashWithCompressFunction(compressPortable, message, length, expectedDigest);
+        hashWithCompressFunction(compress, message, length, digest);
+        if (memcmp(digest, expectedDigest, sizeof(digest)) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+#if TSK_SHA256_X86
+static bool selfTestMultiBuffer(void)
+{
+    uint8_t message[SELF_TEST_MESSAGE_LENGTH];
+    fillSelfTestMessage(message);
+
+    // Lanes of different lengths, so that they finish after a different number of blocks
+    for (size_t firstLength = 0; firstLength < SELF_TEST_MESSAGE_LENGTH; firstLength += 7)
+    {
+        TSKSHA256Message messages[TSK_SHA256_MAX_LANES];
+        uint8_t digests[TSK_SHA256_MAX_LANES][TSK_SHA256_DIGEST_LENGTH];
+        for (size_t lane = 0; lane < TSK_SHA256_MAX_LANES; lane++)
+        {
+            messages[lane].data = message + lane;
+            messages[lane].length = (firstLength + lane * 23) % (SELF_TEST_MESSAGE_LENGTH - TSK_SHA256_MAX_LANES);
+        }
+
+        size_t messageCount = TSK_SHA256_MAX_LANES - (firstLength % 3);
+        hashMultiBufferAVX2(messages, messageCount, digests);
+        for (size_t lane = 0; lane < messageCount; lane++)
+        {
+            uint8_t expectedDigest[TSK_SHA256_DIGEST_LENGTH];
+            hashWithCompressFunction(compressPortable, messages[lane].data, messages[lane].length, expectedDigest);
+            if (memcmp(digests[lane], expectedDigest, sizeof(expectedDigest)) != 0)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+#endif
+
+static void selectBackend(void)
+{
+    for (int backend = 0; backend < TSKSHA256BackendCount; backend++)
+    {
+        isBackendAvailable[backend] = (kCompressFunctions[backend] != NULL)
+                                      && isBackendSupportedByCPU((TSKSHA256Backend)backend)
+                                      && selfTestCompressFunction(kCompressFunctions[backend]);
+        if (isBackendAvailable[backend])
+        {
+            // The accelerated backends come after the portable one
+            selectedBackend = (TSKSHA256Backend)backend;
+        }
+    }
+
+#if TSK_SHA256_X86
+    isMultiBufferAvailable = isAVX2Supported() && selfTestMultiBuffer();
+#endif
+    isMultiBufferEnabled = isMultiBufferAvailable;
+}
+
+static void selectBackendOnce(void)
+{
+    pthread_once(&backendSelectionOnce, selectBackend);
+}
+
+
+TSKSHA256Backend TSKSHA256GetBackend(void)
+{
+    selectBackendOnce();
+    return selectedBackend;
+}
+
+bool TSKSHA256IsBackendAvailable(TSKSHA256Backend backend)
+{
+    selectBackendOnce();
+    return (backend >= 0) && (backend < TSKSHA256BackendCount) && isBackendAvailable[backend];
+}
+
+bool TSKSHA256SetBackend(TSKSHA256Backend backend)
+{
+    if (!TSKSHA256IsBackendAvailable(backend))
+    {
+        return false;
+    }
+    selectedBackend = backend;
+    return true;
+}
+
+bool TSKSHA256IsMultiBufferEnabled(void)
+{
+    selectBackendOnce();
+    return isMultiBufferEnabled;
+}
+
+bool TSKSHA256SetMultiBufferEnabled(bool enabled)
+{
+    selectBackendOnce();
+    if (enabled && !isMultiBufferAvailable)
+    {
+        return false;
+    }
+    isMultiBufferEnabled = enabled;
+    return true;
+}
+
+const char *TSKSHA256GetBackendName(TSKSHA256Backend backend)
+{
+    switch (backend)
+    {
+        case TSKSHA256BackendPortable:
+            return "portable";
+        case TSKSHA256BackendSHAExtensions:
+            return "sha-ni";
+        case TSKSHA256BackendARMv8:
+            return "armv8-ce";
+        default:
+            return "unknown";
+    }
+}
+
+bool TSKSHA256SelfTest(void)
+{
+    selectBackendOnce();
+    for (int backend = 0; backend < TSKSHA256BackendCount; backend++)
+    {
+        if (isBackendAvailable[backend] && !selfTestCompressFunction(kCompressFunctions[backend]))
+        {
+            return false;
+        }
+    }
+#if TSK_SHA256_X86
+    if (isMultiBufferAvailable && !selfTestMultiBuffer())
+    {
+        return false;
+    }
+#endif
+    return true;
+}
+
+
+// Hashing
+
+void TSKSHA256Hash(const void *data, size_t length, uint8_t digest[TSK_SHA256_DIGEST_LENGTH])
+{
+    selectBackendOnce();
+    hashWithCompressFunction(kCompressFunctions[selectedBackend], data, length, digest);
+}
+
+void TSKSHA256HashMany(const TSKSHA256Message *messages, size_t messageCount, uint8_t (*digests)[TSK_SHA256_DIGEST_LENGTH])
+{
+    selectBackendOnce();
+    size_t hashedCount = 0;
+
+#if TSK_SHA256_X86
+    // Unused lanes cost as much as used ones, so with the SHA extensions the multi-buffer backend is
+    // only faster for (almost) full batches; without them it pays off as soon as two lanes are used
+    size_t minimumLaneCount = (selectedBackend == TSKSHA256BackendPortable) ? 2 : 6;
+    if (isMultiBufferEnabled)
+    {
+        while (messageCount - hashedCount >= minimumLaneCount)
+        {
+            size_t laneCount = messageCount - hashedCount;
+            if (laneCount > TSK_SHA256_MAX_LANES)
+            {
+                laneCount = TSK_SHA256_MAX_LANES;
+            }
+            hashMultiBufferAVX2(messages + hashedCount, laneCount, digests + hashedCount);
+            hashedCount += laneCount;
+        }
+    }
+#endif
+
+    for (; hashedCount < messageCount; hashedCount++)
+    {
+        TSKSHA256Hash(messages[hashedCount].data, messages[hashedCount].length, digests[hashedCount]);
+    }
+}
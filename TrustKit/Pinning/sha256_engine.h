@@ -0,0 +1,84 @@
+/*
+
+ sha256_engine.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_sha256_engine_h
+#define TrustKit_sha256_engine_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ SHA-256 implementation used for hashing certificates and their Subject Public Key Info.
+
+ The backend is selected the first time a hash is computed, based on what the CPU supports:
+ the SHA extensions on x86-64 or the cryptography extensions on ARMv8, and a portable
+ implementation everywhere else. An accelerated backend is only selected after it passed
+ a self-test against known vectors, so a broken backend results in the portable one being used.
+
+ Independently, TSKSHA256HashMany() hashes up to eight messages at once using AVX2 when available,
+ which is faster than hashing them one after the other when enough messages are supplied together.
+ */
+
+#define TSK_SHA256_DIGEST_LENGTH 32
+
+// The number of messages hashed together by the multi-buffer backend
+#define TSK_SHA256_MAX_LANES 8
+
+typedef enum
+{
+    TSKSHA256BackendPortable = 0,
+    TSKSHA256BackendSHAExtensions,  // x86-64 SHA-NI
+    TSKSHA256BackendARMv8,          // ARMv8 cryptography extensions
+    TSKSHA256BackendCount
+} TSKSHA256Backend;
+
+typedef struct
+{
+    const void *data;
+    size_t length;
+} TSKSHA256Message;
+
+
+void TSKSHA256Hash(const void *data, size_t length, uint8_t digest[TSK_SHA256_DIGEST_LENGTH]);
+
+// Hash several messages, using the multi-buffer backend for as many of them as possible
+void TSKSHA256HashMany(const TSKSHA256Message *messages, size_t messageCount, uint8_t (*digests)[TSK_SHA256_DIGEST_LENGTH]);
+
+
+// Backend selection
+
+TSKSHA256Backend TSKSHA256GetBackend(void);
+
+// Whether the CPU supports the backend and the backend passed its self-test
+bool TSKSHA256IsBackendAvailable(TSKSHA256Backend backend);
+
+// Force a specific backend, for tests and benchmarks; returns false if it is not available
+bool TSKSHA256SetBackend(TSKSHA256Backend backend);
+
+// Whether TSKSHA256HashMany() uses AVX2; it can be disabled to compare against the single-buffer backends
+bool TSKSHA256IsMultiBufferEnabled(void);
+bool TSKSHA256SetMultiBufferEnabled(bool enabled);
+
+const char *TSKSHA256GetBackendName(TSKSHA256Backend backend);
+
+// Check every available backend against known vectors
+bool TSKSHA256SelfTest(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TrustKit_sha256_engine_h */
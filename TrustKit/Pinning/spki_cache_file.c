@@ -0,0 +1,398 @@
+/*
+
+ spki_cache_file.c
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "spki_cache_file.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+static const char kSnapshotMagic[8] = { 'T', 'S', 'K', 'S', 'P', 'K', 'I', 'C' };
+static const uint32_t kSnapshotVersion = 1;
+static const size_t kSnapshotHeaderLength = 32;
+
+// Offsets of the fields within the snapshot header
+enum
+{
+    kHeaderVersionOffset = 8,
+    kHeaderRecordSizeOffset = 12,
+    kHeaderRecordCountOffset = 16,
+    kHeaderChecksumOffset = 28,
+};
+
+struct TSKSPKICacheFile
+{
+    const uint8_t *mapping;
+    size_t mappingLength;
+    const TSKSPKICacheRecord *records;
+    size_t recordCount;
+};
+
+
+static uint32_t checksum(const uint8_t *bytes, size_t length)
+{
+    // FNV-1a; this only needs to catch torn writes and foreign files, not malicious ones
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void writeUInt32(uint8_t *bytes, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+static uint32_t readUInt32(const uint8_t *bytes)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        value |= (uint32_t)bytes[i] << (8 * i);
+    }
+    return value;
+}
+
+static void writeUInt64(uint8_t *bytes, uint64_t value)
+{
+    writeUInt32(bytes, (uint32_t)value);
+    writeUInt32(bytes + 4, (uint32_t)(value >> 32));
+}
+
+static uint64_t readUInt64(const uint8_t *bytes)
+{
+    return (uint64_t)readUInt32(bytes) | ((uint64_t)readUInt32(bytes + 4) << 32);
+}
+
+static uint32_t recordChecksum(const TSKSPKICacheRecord *record)
+{
+    return checksum(record->certificateDigest, sizeof(record->certificateDigest) + sizeof(record->spkiHash));
+}
+
+static bool writeAll(int fd, const void *bytes, size_t length)
+{
+    const uint8_t *cursor = bytes;
+    while (length > 0)
+    {
+        ssize_t written = write(fd, cursor, length);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        cursor += written;
+        length -= (size_t)written;
+    }
+    return true;
+}
+
+// Drop the torn data at the end of the journal so that new records get appended right after the valid ones;
+// if it cannot be truncated, remove the journal instead as records appended after the torn data would be lost
+static void truncateJournal(const char *path, size_t validLength)
+{
+    if (truncate(path, (off_t)validLength) != 0)
+    {
+        unlink(path);
+    }
+}
+
+static int compareRecords(const void *a, const void *b)
+{
+    return memcmp(((const TSKSPKICacheRecord *)a)->certificateDigest,
+                  ((const TSKSPKICacheRecord *)b)->certificateDigest,
+                  TSK_SPKI_CACHE_DIGEST_LENGTH);
+}
+
+
+void TSKSPKICacheRecordInit(TSKSPKICacheRecord *record,
+                            const uint8_t certificateDigest[TSK_SPKI_CACHE_DIGEST_LENGTH],
+                            const uint8_t spkiHash[TSK_SPKI_CACHE_DIGEST_LENGTH])
+{
+    memcpy(record->certificateDigest, certificateDigest, TSK_SPKI_CACHE_DIGEST_LENGTH);
+    memcpy(record->spkiHash, spkiHash, TSK_SPKI_CACHE_DIGEST_LENGTH);
+    writeUInt32(record->checksum, recordChecksum(record));
+    memset(record->reserved, 0, sizeof(record->reserved));
+}
+
+bool TSKSPKICacheRecordIsValid(const TSKSPKICacheRecord *record)
+{
+    return readUInt32(record->checksum) == recordChecksum(record);
+}
+
+
+// Snapshot
+
+TSKSPKICacheFile *TSKSPKICacheFileOpen(const char *path)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+
+    struct stat fileInfo;
+    if ((fstat(fd, &fileInfo) != 0) || (fileInfo.st_size < (off_t)kSnapshotHeaderLength))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    size_t mappingLength = (size_t)fileInfo.st_size;
+    void *mapping = mmap(NULL, mappingLength, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    // Only the header is validated here so that opening the snapshot does not depend on its size
+    const uint8_t *header = mapping;
+    uint64_t recordCount = readUInt64(header + kHeaderRecordCountOffset);
+    if ((memcmp(header, kSnapshotMagic, sizeof(kSnapshotMagic)) != 0)
+        || (readUInt32(header + kHeaderVersionOffset) != kSnapshotVersion)
+        || (readUInt32(header + kHeaderRecordSizeOffset) != sizeof(TSKSPKICacheRecord))
+        || (readUInt32(header + kHeaderChecksumOffset) != checksum(header, kHeaderChecksumOffset))
+        || (recordCount != (mappingLength - kSnapshotHeaderLength) / sizeof(TSKSPKICacheRecord))
+        || ((mappingLength - kSnapshotHeaderLength) % sizeof(TSKSPKICacheRecord) != 0))
+    {
+        munmap(mapping, mappingLength);
+        return NULL;
+    }
+
+    TSKSPKICacheFile *file = malloc(sizeof(TSKSPKICacheFile));
+    if (file == NULL)
+    {
+        munmap(mapping, mappingLength);
+        return NULL;
+    }
+    file->mapping = mapping;
+    file->mappingLength = mappingLength;
+    file->records = (const TSKSPKICacheRecord *)(header + kSnapshotHeaderLength);
+    file->recordCount = (size_t)recordCount;
+    return file;
+}
+
+void TSKSPKICacheFileClose(TSKSPKICacheFile *file)
+{
+    if (file == NULL)
+    {
+        return;
+    }
+    munmap((void *)file->mapping, file->mappingLength);
+    free(file);
+}
+
+size_t TSKSPKICacheFileGetRecordCount(const TSKSPKICacheFile *file)
+{
+    return (file == NULL) ? 0 : file->recordCount;
+}
+
+bool TSKSPKICacheFileLookup(const TSKSPKICacheFile *file,
+                            const uint8_t certificateDigest[TSK_SPKI_CACHE_DIGEST_LENGTH],
+                            uint8_t spkiHashOut[TSK_SPKI_CACHE_DIGEST_LENGTH])
+{
+    if (file == NULL)
+    {
+        return false;
+    }
+
+    size_t low = 0;
+    size_t high = file->recordCount;
+    while (low < high)
+    {
+        size_t middle = low + (high - low) / 2;
+        const TSKSPKICacheRecord *record = &file->records[middle];
+        int comparison = memcmp(certificateDigest, record->certificateDigest, TSK_SPKI_CACHE_DIGEST_LENGTH);
+        if (comparison == 0)
+        {
+            // A corrupt record is treated as a miss; the hash will get computed and re-written
+            if (!TSKSPKICacheRecordIsValid(record))
+            {
+                return false;
+            }
+            memcpy(spkiHashOut, record->spkiHash, TSK_SPKI_CACHE_DIGEST_LENGTH);
+            return true;
+        }
+        else if (comparison < 0)
+        {
+            high = middle;
+        }
+        else
+        {
+            low = middle + 1;
+        }
+    }
+    return false;
+}
+
+const TSKSPKICacheRecord *TSKSPKICacheFileGetRecord(const TSKSPKICacheFile *file, size_t index)
+{
+    if ((file == NULL) || (index >= file->recordCount) || !TSKSPKICacheRecordIsValid(&file->records[index]))
+    {
+        return NULL;
+    }
+    return &file->records[index];
+}
+
+bool TSKSPKICacheFileWrite(const char *path, TSKSPKICacheRecord *records, size_t recordCount)
+{
+    // Sort the records and drop the invalid and duplicate ones in place
+    qsort(records, recordCount, sizeof(TSKSPKICacheRecord), compareRecords);
+    size_t uniqueCount = 0;
+    for (size_t i = 0; i < recordCount; i++)
+    {
+        if (!TSKSPKICacheRecordIsValid(&records[i]))
+        {
+            continue;
+        }
+        if ((uniqueCount > 0) && (compareRecords(&records[uniqueCount - 1], &records[i]) == 0))
+        {
+            continue;
+        }
+        records[uniqueCount++] = records[i];
+    }
+
+    uint8_t header[kSnapshotHeaderLength];
+    memset(header, 0, sizeof(header));
+    memcpy(header, kSnapshotMagic, sizeof(kSnapshotMagic));
+    writeUInt32(header + kHeaderVersionOffset, kSnapshotVersion);
+    writeUInt32(header + kHeaderRecordSizeOffset, sizeof(TSKSPKICacheRecord));
+    writeUInt64(header + kHeaderRecordCountOffset, uniqueCount);
+    writeUInt32(header + kHeaderChecksumOffset, checksum(header, kHeaderChecksumOffset));
+
+    // Write to a temporary file and rename it so that readers only ever see a complete snapshot;
+    // mappings of the previous snapshot stay valid as they keep a reference to the old file
+    size_t temporaryPathLength = strlen(path) + sizeof(".tmp");
+    char *temporaryPath = malloc(temporaryPathLength);
+    if (temporaryPath == NULL)
+    {
+        return false;
+    }
+    snprintf(temporaryPath, temporaryPathLength, "%s.tmp", path);
+
+    bool didWrite = false;
+    int fd = open(temporaryPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd >= 0)
+    {
+        didWrite = writeAll(fd, header, sizeof(header))
+                   && writeAll(fd, records, uniqueCount * sizeof(TSKSPKICacheRecord))
+                   && (fsync(fd) == 0);
+        close(fd);
+        didWrite = didWrite && (rename(temporaryPath, path) == 0);
+        if (!didWrite)
+        {
+            unlink(temporaryPath);
+        }
+    }
+    free(temporaryPath);
+    return didWrite;
+}
+
+
+// Journal
+
+bool TSKSPKICacheJournalAppend(const char *path, const TSKSPKICacheRecord *records, size_t recordCount)
+{
+    int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool didWrite = writeAll(fd, records, recordCount * sizeof(TSKSPKICacheRecord));
+    close(fd);
+    return didWrite;
+}
+
+size_t TSKSPKICacheJournalRead(const char *path, TSKSPKICacheRecord **recordsOut)
+{
+    *recordsOut = NULL;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    struct stat fileInfo;
+    if (fstat(fd, &fileInfo) != 0)
+    {
+        close(fd);
+        return 0;
+    }
+    if (fileInfo.st_size < (off_t)sizeof(TSKSPKICacheRecord))
+    {
+        close(fd);
+        if (fileInfo.st_size > 0)
+        {
+            // Nothing but a torn record
+            truncateJournal(path, 0);
+        }
+        return 0;
+    }
+
+    size_t journalLength = (size_t)fileInfo.st_size;
+    TSKSPKICacheRecord *records = malloc(journalLength);
+    size_t bytesRead = 0;
+    while ((records != NULL) && (bytesRead < journalLength))
+    {
+        ssize_t result = read(fd, (uint8_t *)records + bytesRead, journalLength - bytesRead);
+        if ((result < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        if (result <= 0)
+        {
+            break;
+        }
+        bytesRead += (size_t)result;
+    }
+    close(fd);
+    if (records == NULL)
+    {
+        return 0;
+    }
+
+    // Stop at the first record that is incomplete or fails its checksum
+    size_t recordCount = 0;
+    size_t availableCount = bytesRead / sizeof(TSKSPKICacheRecord);
+    while ((recordCount < availableCount) && TSKSPKICacheRecordIsValid(&records[recordCount]))
+    {
+        recordCount++;
+    }
+
+    if (recordCount * sizeof(TSKSPKICacheRecord) < journalLength)
+    {
+        // The last append was interrupted
+        truncateJournal(path, recordCount * sizeof(TSKSPKICacheRecord));
+    }
+
+    if (recordCount == 0)
+    {
+        free(records);
+        return 0;
+    }
+    *recordsOut = records;
+    return recordCount;
+}
@@ -0,0 +1,100 @@
+/*
+
+ spki_cache_file.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_spki_cache_file_h
+#define TrustKit_spki_cache_file_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ On-disk format of the SPKI hash cache, which does not depend on Foundation.
+
+ The snapshot file is a header followed by fixed-size records sorted by certificate digest:
+
+   [magic: 8 bytes "TSKSPKIC"][version: uint32][record size: uint32][record count: uint64]
+   [reserved: uint32][header checksum: uint32][record 0]...[record N-1]
+
+ All integers are little-endian. The snapshot is memory-mapped and looked up with a binary search
+ so that opening it does not depend on its size; a record's own checksum is only verified when
+ that record is returned by a lookup. Files with a different magic, version or size, or with a bad
+ header checksum, are rejected so that the cache starts empty instead.
+
+ The journal uses the same records without any header; it is only ever appended to, and a record
+ that was torn by a crash fails its checksum and gets truncated away when the journal is read.
+ */
+
+#define TSK_SPKI_CACHE_DIGEST_LENGTH 32
+
+typedef struct
+{
+    // The SHA-256 digest of the certificate's DER data
+    uint8_t certificateDigest[TSK_SPKI_CACHE_DIGEST_LENGTH];
+
+    // The SHA-256 hash of the certificate's Subject Public Key Info
+    uint8_t spkiHash[TSK_SPKI_CACHE_DIGEST_LENGTH];
+
+    // Little-endian checksum of the two fields above
+    uint8_t checksum[4];
+    uint8_t reserved[4];
+} TSKSPKICacheRecord;
+
+// Fill a record and compute its checksum
+void TSKSPKICacheRecordInit(TSKSPKICacheRecord *record,
+                            const uint8_t certificateDigest[TSK_SPKI_CACHE_DIGEST_LENGTH],
+                            const uint8_t spkiHash[TSK_SPKI_CACHE_DIGEST_LENGTH]);
+
+bool TSKSPKICacheRecordIsValid(const TSKSPKICacheRecord *record);
+
+
+// Snapshot
+
+typedef struct TSKSPKICacheFile TSKSPKICacheFile;
+
+// Map an existing snapshot; returns NULL if the file is missing, corrupt or in a different format
+TSKSPKICacheFile *TSKSPKICacheFileOpen(const char *path);
+
+void TSKSPKICacheFileClose(TSKSPKICacheFile *file);
+
+size_t TSKSPKICacheFileGetRecordCount(const TSKSPKICacheFile *file);
+
+// Look for the SPKI hash of a certificate; returns false if it is not in the snapshot or if its record is corrupt
+bool TSKSPKICacheFileLookup(const TSKSPKICacheFile *file,
+                            const uint8_t certificateDigest[TSK_SPKI_CACHE_DIGEST_LENGTH],
+                            uint8_t spkiHashOut[TSK_SPKI_CACHE_DIGEST_LENGTH]);
+
+// Return a pointer to the record at the supplied index within the mapping, or NULL if it is corrupt
+const TSKSPKICacheRecord *TSKSPKICacheFileGetRecord(const TSKSPKICacheFile *file, size_t index);
+
+// Sort the records and atomically replace the snapshot at the supplied path with them; records with
+// the same certificate digest are only written once, and invalid records are skipped
+bool TSKSPKICacheFileWrite(const char *path, TSKSPKICacheRecord *records, size_t recordCount);
+
+
+// Journal
+
+bool TSKSPKICacheJournalAppend(const char *path, const TSKSPKICacheRecord *records, size_t recordCount);
+
+// Read all the valid records of the journal, truncating it after the last one if needed, or removing
+// it if it cannot be truncated; the returned array must be released with free(). Returns 0 and NULL
+// if the journal is empty or missing
+size_t TSKSPKICacheJournalRead(const char *path, TSKSPKICacheRecord **recordsOut);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TrustKit_spki_cache_file_h */
@@ -10,6 +10,7 @@
  */
 
 #import "../public/TSKTrustDecision.h"
+#import "pin_set.h"
 #if __has_feature(modules)
 @import Foundation;
 #else
@@ -18,8 +19,47 @@
 
 @class TSKSPKIHashCache;
 
+// Details of a pin verification, exchanged with verifyPublicKeyPinWithInfo()
+typedef struct
+{
+    // Set by the caller: the index in the chain (the leaf being 0) of the certificate to check first, or -1
+    CFIndex preferredCertificateIndex;
+    
+    // Set by the caller: the digests of the certificates that it already computed, keyed by the certificate
+    // objects, or nil; it must be kept alive by the caller for the duration of the verification
+    __unsafe_unretained NSMapTable * _Nullable certificateDigests;
+    
+    // Set on return: the index in the chain of the certificate whose pin matched, or -1
+    CFIndex matchedCertificateIndex;
+    
+    // Set on return: the number of SPKI hashes that were checked against the pins, and how many more
+    // would have been checked by scanning the chain from the CA without the preferred index
+    NSUInteger checkedHashCount;
+    NSUInteger avoidedHashCount;
+    
+    // Set on return: the time spent, in nanoseconds, evaluating the certificate chain, getting the SPKI
+    // hashes of its certificates and looking for these hashes in the pins
+    uint64_t chainEvaluationDuration;
+    uint64_t spkiHashingDuration;
+    uint64_t pinMatchingDuration;
+} TSKPinVerificationInfo;
+
+
+// Pack the supplied SPKI hashes into a pin set, which must be released with TSKPinSetDestroy()
+TSKPinSet * _Nullable createPinSetFromPins(NSSet<NSData *> * _Nonnull pins);
+
+
 // Validate that the server trust contains at least one of the know/expected pins
 TSKTrustEvaluationResult verifyPublicKeyPin(SecTrustRef _Nonnull serverTrust,
                                             NSString * _Nonnull serverHostname,
                                             NSSet<NSData *> * _Nonnull knownPins,
                                             TSKSPKIHashCache * _Nullable hashCache);
+
+// Same as verifyPublicKeyPin() but first checks the certificate at info->preferredCertificateIndex, if any;
+// when it matches and the SPKI hashes of the certificates closer to the CA are cached, these certificates are
+// not checked. Otherwise the whole chain gets scanned
+TSKTrustEvaluationResult verifyPublicKeyPinWithInfo(SecTrustRef _Nonnull serverTrust,
+                                                    NSString * _Nonnull serverHostname,
+                                                    const TSKPinSet * _Nonnull knownPins,
+                                                    TSKSPKIHashCache * _Nullable hashCache,
+                                                    TSKPinVerificationInfo * _Nullable info);
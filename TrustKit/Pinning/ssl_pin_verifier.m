@@ -15,17 +15,110 @@
 #import "../configuration_utils.h"
 #import "../TSKLog.h"
 #import "pinning_utils.h"
+#import "latency_histogram.h"
 
 
 #pragma mark SSL Pin Verifier
 
+static void logCertificateSubject(SecCertificateRef certificate)
+{
+    // Copying the subject is costly and this runs for every certificate checked
+    if (!TSKLogIsEnabled(TSKLogLevelDebug))
+    {
+        return;
+    }
+    
+    CFStringRef certificateSubject = SecCertificateCopySubjectSummary(certificate);
+    if (certificateSubject != nil)
+    {
+        TSKLogDebug(@"Checking certificate with CN: %@", certificateSubject);
+        CFRelease(certificateSubject);
+    }
+    else
+    {
+        TSKLogDebug(@"Could not parse certificate subject");
+    }
+}
+
+
+// Whether the SPKI hashes of the certificates closer to the CA than the supplied index are all cached, which means
+// that their keys are supported; the digests that the caller did not compute, such as for a rebuilt chain, are computed
+static BOOL haveCachedHashesAboveIndex(SecTrustRef serverTrust, CFIndex index, NSMapTable *knownDigests, TSKSPKIHashCache *hashCache)
+{
+    CFIndex certificateChainLen = SecTrustGetCertificateCount(serverTrust);
+    NSMutableArray<NSData *> *certificateDigests = [NSMutableArray arrayWithCapacity:(NSUInteger)certificateChainLen];
+    NSMutableArray *undigestedCertificates = [NSMutableArray array];
+    for (CFIndex i = index + 1; i < certificateChainLen; i++)
+    {
+        SecCertificateRef certificate = getCertificateAtIndex(serverTrust, i);
+        NSData *certificateDigest = [knownDigests objectForKey:(__bridge id)certificate];
+        if (certificateDigest != nil)
+        {
+            [certificateDigests addObject:certificateDigest];
+        }
+        else
+        {
+            [undigestedCertificates addObject:(__bridge id)certificate];
+        }
+    }
+    if (undigestedCertificates.count > 0)
+    {
+        [certificateDigests addObjectsFromArray:[TSKSPKIHashCache digestsForCertificates:undigestedCertificates]];
+    }
+    return [hashCache hasSubjectPublicKeyInfoHashesForCertificateDigests:certificateDigests];
+}
+
+
+TSKPinSet *createPinSetFromPins(NSSet<NSData *> *pins)
+{
+    NSMutableData *packedPins = [NSMutableData dataWithCapacity:pins.count * TSK_PIN_LENGTH];
+    for (NSData *pin in pins)
+    {
+        // Anything else cannot match a SHA-256 hash anyway
+        if (pin.length == TSK_PIN_LENGTH)
+        {
+            [packedPins appendData:pin];
+        }
+    }
+    return TSKPinSetCreate(packedPins.bytes, packedPins.length / TSK_PIN_LENGTH);
+}
+
+
 TSKTrustEvaluationResult verifyPublicKeyPin(SecTrustRef serverTrust, NSString *serverHostname, NSSet<NSData *> *knownPins, TSKSPKIHashCache *hashCache)
 {
+    NSCParameterAssert(knownPins);
+    if (knownPins == nil)
+    {
+        TSKLogError(@"Invalid pinning parameters for %@", serverHostname);
+        return TSKTrustEvaluationErrorInvalidParameters;
+    }
+    
+    TSKPinSet *pinSet = createPinSetFromPins(knownPins);
+    TSKTrustEvaluationResult result = verifyPublicKeyPinWithInfo(serverTrust, serverHostname, pinSet, hashCache, NULL);
+    TSKPinSetDestroy(pinSet);
+    return result;
+}
+
+
+TSKTrustEvaluationResult verifyPublicKeyPinWithInfo(SecTrustRef serverTrust, NSString *serverHostname, const TSKPinSet *knownPins, TSKSPKIHashCache *hashCache, TSKPinVerificationInfo *info)
+{
+    TSKPinVerificationInfo ignoredInfo = { .preferredCertificateIndex = -1 };
+    if (info == NULL)
+    {
+        info = &ignoredInfo;
+    }
+    info->matchedCertificateIndex = -1;
+    info->checkedHashCount = 0;
+    info->avoidedHashCount = 0;
+    info->chainEvaluationDuration = 0;
+    info->spkiHashingDuration = 0;
+    info->pinMatchingDuration = 0;
+    
     NSCParameterAssert(serverTrust);
     NSCParameterAssert(knownPins);
-    if ((serverTrust == NULL) || (knownPins == nil))
+    if ((serverTrust == NULL) || (knownPins == NULL))
     {
-        TSKLog(@"Invalid pinning parameters for %@", serverHostname);
+        TSKLogError(@"Invalid pinning parameters for %@", serverHostname);
         return TSKTrustEvaluationErrorInvalidParameters;
     }
 
@@ -43,10 +136,12 @@ TSKTrustEvaluationResult verifyPublicKeyPin(SecTrustRef serverTrust, NSString *s
     NSError *error = NULL;
     SecTrustResultType trustResult = 0;
     
+    uint64_t chainEvaluationStartTime = TSKMonotonicTimeNanoseconds();
     evaluateCertificateChainTrust(serverTrust, &trustResult, &error);
+    info->chainEvaluationDuration = TSKMonotonicTimeNanoseconds() - chainEvaluationStartTime;
     if ((error != NULL) && (trustResult == kSecTrustResultInvalid))
     {
-        TSKLog(@"SecTrustEvaluate error for %@: %@", serverHostname, [error localizedDescription]);
+        TSKLogWarning(@"SecTrustEvaluate error for %@: %@", serverHostname, [error localizedDescription]);
         CFRelease(serverTrust);
         return TSKTrustEvaluationErrorInvalidParameters;
     }
@@ -55,47 +150,100 @@ TSKTrustEvaluationResult verifyPublicKeyPin(SecTrustRef serverTrust, NSString *s
     {
         // Default SSL validation failed
         CFDictionaryRef evaluationDetails = SecTrustCopyResult(serverTrust);
-        TSKLog(@"Error: default SSL validation failed for %@: %@", serverHostname, evaluationDetails);
+        TSKLogWarning(@"Error: default SSL validation failed for %@: %@", serverHostname, evaluationDetails);
         CFRelease(evaluationDetails);
         CFRelease(serverTrust);
         return TSKTrustEvaluationFailedInvalidCertificateChain;
     }
     
-    // Check each certificate in the server's certificate chain (the trust object); start with the CA all the way down to the leaf
     CFIndex certificateChainLen = SecTrustGetCertificateCount(serverTrust);
-    for(int i=(int)certificateChainLen-1;i>=0;i--)
+    
+    // Start with the certificate that matched for this policy last time, if any; as the chain position that
+    // matches is usually stable, this avoids hashing the certificates between the CA and that position. These
+    // certificates must still have supported keys, as scanning the chain from the CA would fail otherwise
+    CFIndex preferredIndex = info->preferredCertificateIndex;
+    if ((hashCache != nil) && (preferredIndex >= 0) && (preferredIndex < certificateChainLen))
     {
-        // Extract the certificate
-        SecCertificateRef certificate = getCertificateAtIndex(serverTrust, i);
-        
-        CFStringRef certificateSubject = SecCertificateCopySubjectSummary(certificate);
-        if (certificateSubject != nil)
+        SecCertificateRef certificate = getCertificateAtIndex(serverTrust, preferredIndex);
+        logCertificateSubject(certificate);
+        uint64_t hashingStartTime = TSKMonotonicTimeNanoseconds();
+        NSData *subjectPublicKeyInfoHash = [hashCache hashSubjectPublicKeyInfoFromCertificate:certificate
+                                                                          certificateDigest:[info->certificateDigests objectForKey:(__bridge id)certificate]];
+        uint64_t matchingStartTime = TSKMonotonicTimeNanoseconds();
+        info->spkiHashingDuration += matchingStartTime - hashingStartTime;
+        info->checkedHashCount += 1;
+        BOOL isPinned = (subjectPublicKeyInfoHash != nil) && TSKPinSetContains(knownPins, subjectPublicKeyInfoHash.bytes);
+        info->pinMatchingDuration += TSKMonotonicTimeNanoseconds() - matchingStartTime;
+        if (isPinned && haveCachedHashesAboveIndex(serverTrust, preferredIndex, info->certificateDigests, hashCache))
         {
-            TSKLog(@"Checking certificate with CN: %@", certificateSubject);
-            CFRelease(certificateSubject);
-        }
-        else
-        {
-            TSKLog(@"Could not parse certificate subject");
+            TSKLogDebug(@"SSL Pin found for %@ at the expected chain position", serverHostname);
+            info->matchedCertificateIndex = preferredIndex;
+            info->avoidedHashCount = (NSUInteger)(certificateChainLen - 1 - preferredIndex);
+            CFRelease(serverTrust);
+            return TSKTrustEvaluationSuccess;
         }
+        // Otherwise fall back to scanning the whole chain, so the result is the same as without a preferred index:
+        // the pin did not match, or a certificate closer to the CA was never hashed and may not be supported
+    }
+    
+    // Check each certificate in the server's certificate chain (the trust object); start with the CA all the way down to the leaf
+    NSMutableArray *certificates = [NSMutableArray arrayWithCapacity:certificateChainLen];
+    for(int i=(int)certificateChainLen-1;i>=0;i--)
+    {
+        [certificates addObject:(__bridge id)getCertificateAtIndex(serverTrust, i)];
+    }
+    
+    if ((hashCache == nil) && (certificateChainLen > 0))
+    {
+        TSKLogError(@"Error - could not generate the SPKI hash for %@", serverHostname);
+        CFRelease(serverTrust);
+        return TSKTrustEvaluationErrorCouldNotGenerateSpkiHash;
+    }
+    
+    // The hashes of the whole chain get generated concurrently, but they are checked in order and the
+    // ones that are not needed anymore are cancelled as soon as a result is found
+    // Everything but the time spent in the block is spent getting the hashes
+    __block TSKTrustEvaluationResult chainResult = TSKTrustEvaluationFailedNoMatchingPin;
+    __block uint64_t blockDuration = 0;
+    uint64_t enumerationStartTime = TSKMonotonicTimeNanoseconds();
+    [hashCache enumerateSubjectPublicKeyInfoHashesFromCertificates:certificates
+                                                certificateDigests:info->certificateDigests
+                                                        usingBlock:^(NSUInteger index, NSData *subjectPublicKeyInfoHash, BOOL *stop)
+    {
+        uint64_t blockStartTime = TSKMonotonicTimeNanoseconds();
+        logCertificateSubject((__bridge SecCertificateRef)certificates[index]);
+        info->checkedHashCount += 1;
         
-        // Generate the subject public key info hash
-        NSData *subjectPublicKeyInfoHash = [hashCache hashSubjectPublicKeyInfoFromCertificate:certificate];
         if (subjectPublicKeyInfoHash == nil)
         {
-            TSKLog(@"Error - could not generate the SPKI hash for %@", serverHostname);
-            CFRelease(serverTrust);
-            return TSKTrustEvaluationErrorCouldNotGenerateSpkiHash;
+            TSKLogError(@"Error - could not generate the SPKI hash for %@", serverHostname);
+            chainResult = TSKTrustEvaluationErrorCouldNotGenerateSpkiHash;
+            *stop = YES;
+            blockDuration += TSKMonotonicTimeNanoseconds() - blockStartTime;
+            return;
         }
         
         // Is the generated hash in our set of pinned hashes ?
-        TSKLog(@"Testing SSL Pin %@", subjectPublicKeyInfoHash);
-        if ([knownPins containsObject:subjectPublicKeyInfoHash])
+        TSKLogDebug(@"Testing SSL Pin %@", subjectPublicKeyInfoHash);
+        uint64_t matchingStartTime = TSKMonotonicTimeNanoseconds();
+        BOOL isPinned = TSKPinSetContains(knownPins, subjectPublicKeyInfoHash.bytes);
+        info->pinMatchingDuration += TSKMonotonicTimeNanoseconds() - matchingStartTime;
+        if (isPinned)
         {
-            TSKLog(@"SSL Pin found for %@", serverHostname);
-            CFRelease(serverTrust);
-            return TSKTrustEvaluationSuccess;
+            TSKLogDebug(@"SSL Pin found for %@", serverHostname);
+            info->matchedCertificateIndex = certificateChainLen - 1 - (CFIndex)index;
+            chainResult = TSKTrustEvaluationSuccess;
+            *stop = YES;
         }
+        blockDuration += TSKMonotonicTimeNanoseconds() - blockStartTime;
+    }];
+    uint64_t enumerationDuration = TSKMonotonicTimeNanoseconds() - enumerationStartTime;
+    info->spkiHashingDuration += (enumerationDuration > blockDuration) ? enumerationDuration - blockDuration : 0;
+    
+    if (chainResult != TSKTrustEvaluationFailedNoMatchingPin)
+    {
+        CFRelease(serverTrust);
+        return chainResult;
     }
     
 #if !TARGET_OS_IPHONE
@@ -130,7 +278,7 @@ TSKTrustEvaluationResult verifyPublicKeyPin(SecTrustRef serverTrust, NSString *s
             // Is the certificate chain's anchor a user-defined anchor ?
             if ([customRootCerts containsObject:(__bridge id)(certificate)])
             {
-                TSKLog(@"Detected user-defined trust anchor in the certificate chain");
+                TSKLogInfo(@"Detected user-defined trust anchor in the certificate chain");
                 CFRelease(serverTrust);
                 return TSKTrustEvaluationFailedUserDefinedTrustAnchor;
             }
@@ -139,7 +287,7 @@ TSKTrustEvaluationResult verifyPublicKeyPin(SecTrustRef serverTrust, NSString *s
 #endif
     
     // If we get here, we didn't find any matching SPKI hash in the chain
-    TSKLog(@"Error: SSL Pin not found for %@", serverHostname);
+    TSKLogWarning(@"Error: SSL Pin not found for %@", serverHostname);
     CFRelease(serverTrust);
     return TSKTrustEvaluationFailedNoMatchingPin;
 }
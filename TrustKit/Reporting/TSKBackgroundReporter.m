@@ -17,6 +17,7 @@
 #import "reporting_utils.h"
 #import "TSKReportsRateLimiter.h"
 #import "vendor_identifier.h"
+#import "../metrics_registry.h"
 
 
 // Session identifier for background uploads: <bundle_id>.TSKBackgroundReporter
@@ -84,7 +85,7 @@ static NSString * const kTSKBackgroundSessionIdentifierFormat = @"%@.TSKBackgrou
         {
             // The bundle ID we get is nil if we're running tests on Travis. If the bundle ID is nil, background sessions can't be used
             // backgroundSessionConfigurationWithIdentifier: will throw an exception
-            TSKLog(@"Null bundle ID: we are running the test suite; falling back to a normal session.");
+            TSKLogInfo(@"Null bundle ID: we are running the test suite; falling back to a normal session.");
             _appBundleId = @"N/A";
             _appVendorId = @"unit-tests";
             
@@ -172,12 +173,13 @@ static NSString * const kTSKBackgroundSessionIdentifierFormat = @"%@.TSKBackgrou
                                                                         knownPins:formattedPins
                                                                  validationResult:validationResult
                                                                    expirationDate:knownPinsExpirationDate];
+    TSKMetricsIncrement(TSKMetricReportsGenerated);
     
     // Should we rate-limit this report?
     if (_shouldRateLimitReports && [self.rateLimiter shouldRateLimitReport:report])
     {
         // We recently sent the exact same report; do not send this report
-        TSKLog(@"Pin failure report for %@ was not sent due to rate-limiting", serverHostname);
+        TSKLogInfo(@"Pin failure report for %@ was not sent due to rate-limiting", serverHostname);
         return;
     }
     
@@ -204,7 +206,7 @@ static NSString * const kTSKBackgroundSessionIdentifierFormat = @"%@.TSKBackgrou
                     format:@"Report cannot be saved to file: %@", [error description]];
 #endif
     }
-    TSKLog(@"Report for %@ created at: %@", serverHostname, [tmpFileURL path]);
+    TSKLogInfo(@"Report for %@ created at: %@", serverHostname, [tmpFileURL path]);
     
     
     // Create the HTTP request for all the configured report URIs and send it
@@ -228,11 +230,13 @@ static NSString * const kTSKBackgroundSessionIdentifierFormat = @"%@.TSKBackgrou
 {
     if (error == nil)
     {
-        TSKLog(@"Background upload - task completed successfully: pinning failure report sent");
+        TSKLogInfo(@"Background upload - task completed successfully: pinning failure report sent");
+        TSKMetricsIncrement(TSKMetricReportsUploaded);
     }
     else
     {
-        TSKLog(@"Background upload - task completed with error: %@ (code %ld)", [error localizedDescription], (long)error.code);
+        TSKLogWarning(@"Background upload - task completed with error: %@ (code %ld)", [error localizedDescription], (long)error.code);
+        TSKMetricsIncrement(TSKMetricReportUploadFailures);
     }
 }
 
@@ -11,6 +11,7 @@
 
 #import "TSKReportsRateLimiter.h"
 #import "reporting_utils.h"
+#import "../metrics_registry.h"
 
 static const NSTimeInterval kIntervalBetweenReportsCacheReset = 3600 * 24;
 
@@ -78,6 +79,10 @@ static const NSTimeInterval kIntervalBetweenReportsCacheReset = 3600 * 24;
         }
     });
     
+    if (shouldRateLimitReport)
+    {
+        TSKMetricsIncrement(TSKMetricReportsRateLimited);
+    }
     return shouldRateLimitReport;
 }
 
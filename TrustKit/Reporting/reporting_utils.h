@@ -19,6 +19,7 @@
 #define TrustKit_reporting_utils_h
 
 NSArray<NSString *> *convertTrustToPemArray(SecTrustRef serverTrust);
+NSArray<NSString *> *convertCertificatesToPemArray(NSArray *certificates);
 NSArray<NSString *> *convertPinsToHpkpPins(NSSet<NSData *> *knownPins);
 
 #endif
@@ -11,22 +11,52 @@
 
 #import "reporting_utils.h"
 #import "../Pinning/pinning_utils.h"
+#import "../Pinning/base64_codec.h"
+
+
+static NSString * const kTSKPemHeader = @"-----BEGIN CERTIFICATE-----\n";
+static NSString * const kTSKPemFooter = @"\n-----END CERTIFICATE-----";
+
+// The length of the base64 encoding of a 32-byte SHA-256 pin
+enum { kTSKPinBase64Length = 44 };
 
 NSArray<NSString *> *convertTrustToPemArray(SecTrustRef serverTrust)
 {
     // Convert the trust object into an array of PEM certificates
     // Warning: SecTrustEvaluate() always needs to be called first on the serverTrust to be able to extract the certificates
-    NSMutableArray *certificateChain = [NSMutableArray array];
-    CFIndex chainLen = SecTrustGetCertificateCount(serverTrust);
-    for (CFIndex i=0;i<chainLen;i++)
+    return convertCertificatesToPemArray(copyCertificateChain(serverTrust));
+}
+
+
+NSArray<NSString *> *convertCertificatesToPemArray(NSArray *certificates)
+{
+    NSMutableArray *certificateChain = [NSMutableArray arrayWithCapacity:certificates.count];
+    for (id certificateRef in certificates)
     {
-        SecCertificateRef certificate = getCertificateAtIndex(serverTrust, i);
+        SecCertificateRef certificate = (__bridge SecCertificateRef)certificateRef;
         CFDataRef certificateData = SecCertificateCopyData(certificate);
         
-        // Craft the PEM certificate
-        NSString *certificatePem = [NSString
-                                    stringWithFormat:@"-----BEGIN CERTIFICATE-----\n%@\n-----END CERTIFICATE-----",
-                                    [(__bridge NSData *)certificateData base64EncodedStringWithOptions:NSDataBase64Encoding64CharacterLineLength]];
+        // Craft the PEM certificate in a single buffer
+        const CFIndex certificateLength = CFDataGetLength(certificateData);
+        const size_t headerLength = kTSKPemHeader.length;
+        const size_t footerLength = kTSKPemFooter.length;
+        const size_t pemLength = headerLength + TSKBase64EncodedLength(certificateLength, TSK_BASE64_PEM_LINE_LENGTH) + footerLength;
+        char *pem = malloc(pemLength);
+        if (pem == NULL)
+        {
+            // The report gets sent without this certificate
+            CFRelease(certificateData);
+            continue;
+        }
+        memcpy(pem, kTSKPemHeader.UTF8String, headerLength);
+        size_t encodedLength = TSKBase64Encode(CFDataGetBytePtr(certificateData), certificateLength,
+                                               TSK_BASE64_PEM_LINE_LENGTH, pem + headerLength);
+        memcpy(pem + headerLength + encodedLength, kTSKPemFooter.UTF8String, footerLength);
+        
+        NSString *certificatePem = [[NSString alloc] initWithBytesNoCopy:pem
+                                                                  length:pemLength
+                                                                encoding:NSASCIIStringEncoding
+                                                            freeWhenDone:YES];
         [certificateChain addObject:certificatePem];
         CFRelease(certificateData);
     }
@@ -37,10 +67,18 @@ NSArray<NSString *> *convertTrustToPemArray(SecTrustRef serverTrust)
 NSArray<NSString *> *convertPinsToHpkpPins(NSSet<NSData *> *knownPins)
 {
     // Convert the know pins from a set of data to an array of strings as described in the HPKP spec
-    NSMutableArray *formattedPins = [NSMutableArray array];
+    NSMutableArray *formattedPins = [NSMutableArray arrayWithCapacity:knownPins.count];
     for (NSData *pin in knownPins)
     {
-        [formattedPins addObject:[NSString stringWithFormat:@"pin-sha256=\"%@\"", [pin base64EncodedStringWithOptions:(NSDataBase64EncodingOptions)0]]];
+        // Pins are SHA-256 hashes, so this is only ever a few dozen characters; anything longer is not a pin
+        char encodedPin[kTSKPinBase64Length];
+        if (TSKBase64EncodedLength(pin.length, 0) > sizeof(encodedPin))
+        {
+            continue;
+        }
+        size_t encodedLength = TSKBase64Encode(pin.bytes, pin.length, 0, encodedPin);
+        NSString *pinBase64 = [[NSString alloc] initWithBytes:encodedPin length:encodedLength encoding:NSASCIIStringEncoding];
+        [formattedPins addObject:[NSString stringWithFormat:@"pin-sha256=\"%@\"", pinBase64]];
     }
     return formattedPins;
 }
@@ -1,12 +1,12 @@
 /*
- 
+
  TSKLog.h
  TrustKit
- 
+
  Copyright 2015 The TrustKit Project Authors
  Licensed under the MIT license, see associated LICENSE file for terms.
  See AUTHORS file for the list of project authors.
- 
+
  */
 
 // Common header with internal constants and defines.
@@ -14,8 +14,48 @@
 #ifndef TSKLog_h
 #define TSKLog_h
 
-// The logging function we use within TrustKit
-void TSKLog(NSString *format, ...);
+#import "public/TSKLogLevel.h"
+
+#include <stdatomic.h>
+
+// The most verbose level passed to the logger block, or TSKLogLevelNone if there is no logger block
+extern _Atomic(TSKLogLevel) _TSKLogFormattingLevel;
+
+// The most verbose level recorded in the log event ring buffer, or TSKLogLevelNone if recording is off
+extern _Atomic(TSKLogLevel) _TSKLogRecordingLevel;
+
+// The levels can be changed while other threads log; a statement racing with the change may use either level
+#define _TSKLogLoadLevel(levelVariable) atomic_load_explicit(&(levelVariable), memory_order_relaxed)
+
+// Record the log statement in the ring buffer without formatting it; the format must be a string literal
+void TSKLogRecordEvent(TSKLogLevel level, NSString *format);
+
+// Format the message and pass it to the logger block
+void TSKLogFormatted(TSKLogLevel level, NSString *format, ...) NS_FORMAT_FUNCTION(2,3);
+
+// Whether a message of this level would be logged or recorded; use it to skip computing costly values only
+// needed by the log messages
+static inline BOOL TSKLogIsEnabled(TSKLogLevel level)
+{
+    return (level <= _TSKLogLoadLevel(_TSKLogFormattingLevel)) || (level <= _TSKLogLoadLevel(_TSKLogRecordingLevel));
+}
+
+// The logging macros we use within TrustKit: the arguments are only evaluated, and the message only
+// formatted, if the logger block takes messages of this level
+#define TSKLogWithLevel(level, format, ...) \
+    do { \
+        if ((level) <= _TSKLogLoadLevel(_TSKLogRecordingLevel)) { \
+            TSKLogRecordEvent((level), (format)); \
+        } \
+        if ((level) <= _TSKLogLoadLevel(_TSKLogFormattingLevel)) { \
+            TSKLogFormatted((level), (format), ##__VA_ARGS__); \
+        } \
+    } while (0)
+
+#define TSKLogError(format, ...) TSKLogWithLevel(TSKLogLevelError, format, ##__VA_ARGS__)
+#define TSKLogWarning(format, ...) TSKLogWithLevel(TSKLogLevelWarning, format, ##__VA_ARGS__)
+#define TSKLogInfo(format, ...) TSKLogWithLevel(TSKLogLevelInfo, format, ##__VA_ARGS__)
+#define TSKLogDebug(format, ...) TSKLogWithLevel(TSKLogLevelDebug, format, ##__VA_ARGS__)
 
 
 #endif /* TSKLog_h */
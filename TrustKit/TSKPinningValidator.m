@@ -14,11 +14,109 @@
 #import "TSKTrustDecision.h"
 #import "TSKPinningValidatorResult.h"
 #import "Pinning/TSKSPKIHashCache.h"
+#import "Pinning/TSKTrustDecisionCache.h"
 #import "Pinning/ssl_pin_verifier.h"
+#import "Pinning/pinning_utils.h"
+#import "Pinning/latency_histogram.h"
+#import "metrics_registry.h"
 #import "configuration_utils.h"
 #import "TrustKit.h"
 #import "TSKLog.h"
 #import "TSKPinningValidator_Private.h"
+#import <stdatomic.h>
+
+
+// The number of asynchronous evaluations that can be pending on the worker pool, per CPU
+static const NSUInteger kTSKPendingEvaluationsPerProcessor = 4;
+
+
+// The phases of a validation whose durations get recorded, each in its own histogram
+typedef NS_ENUM(NSUInteger, TSKValidationPhaseIndex)
+{
+    TSKValidationPhaseIndexPolicyLookup,
+    TSKValidationPhaseIndexDecisionCache,
+    TSKValidationPhaseIndexChainEvaluation,
+    TSKValidationPhaseIndexSPKIHashing,
+    TSKValidationPhaseIndexPinMatching,
+    TSKValidationPhaseIndexTotal,
+    TSKValidationPhaseIndexCount,
+};
+
+// The duration of a phase that was not performed during a validation
+static const uint64_t kTSKPhaseNotPerformed = UINT64_MAX;
+
+static TSKMetric metricForTrustDecision(TSKTrustDecision trustDecision)
+{
+    switch (trustDecision)
+    {
+        case TSKTrustDecisionShouldAllowConnection:
+            return TSKMetricEvaluationsAllowed;
+        case TSKTrustDecisionDomainNotPinned:
+            return TSKMetricEvaluationsNotPinned;
+        default:
+            return TSKMetricEvaluationsBlocked;
+    }
+}
+
+static TSKMetric metricForEvaluationResult(TSKTrustEvaluationResult evaluationResult)
+{
+    switch (evaluationResult)
+    {
+        case TSKTrustEvaluationSuccess:
+            return TSKMetricEvaluationResultSuccess;
+        case TSKTrustEvaluationFailedNoMatchingPin:
+            return TSKMetricEvaluationResultNoMatchingPin;
+        case TSKTrustEvaluationFailedInvalidCertificateChain:
+            return TSKMetricEvaluationResultInvalidCertificateChain;
+#if !TARGET_OS_IPHONE
+        case TSKTrustEvaluationFailedUserDefinedTrustAnchor:
+            return TSKMetricEvaluationResultUserDefinedTrustAnchor;
+#endif
+        case TSKTrustEvaluationErrorCouldNotGenerateSpkiHash:
+            return TSKMetricEvaluationResultCouldNotGenerateSpkiHash;
+        default:
+            return TSKMetricEvaluationResultInvalidParameters;
+    }
+}
+
+static TSKValidationPhase validationPhaseForIndex(TSKValidationPhaseIndex phaseIndex)
+{
+    switch (phaseIndex)
+    {
+        case TSKValidationPhaseIndexPolicyLookup:
+            return kTSKValidationPhasePolicyLookup;
+        case TSKValidationPhaseIndexDecisionCache:
+            return kTSKValidationPhaseDecisionCache;
+        case TSKValidationPhaseIndexChainEvaluation:
+            return kTSKValidationPhaseChainEvaluation;
+        case TSKValidationPhaseIndexSPKIHashing:
+            return kTSKValidationPhaseSPKIHashing;
+        case TSKValidationPhaseIndexPinMatching:
+            return kTSKValidationPhasePinMatching;
+        default:
+            return kTSKValidationPhaseTotal;
+    }
+}
+
+
+// An evaluation of the pins of a certificate chain for a hostname, that other threads evaluating the
+// same chain for the same hostname at the same time can wait for instead of doing the same work
+@interface TSKInFlightEvaluation : NSObject
+@property (nonatomic, readonly) dispatch_group_t group;
+@property (nonatomic) TSKTrustEvaluationResult result;
+@end
+
+@implementation TSKInFlightEvaluation
+- (instancetype)init
+{
+    self = [super init];
+    if (self) {
+        _group = dispatch_group_create();
+        dispatch_group_enter(_group);
+    }
+    return self;
+}
+@end
 
 
 @interface TSKPinningValidator ()
@@ -46,9 +144,50 @@
  */
 @property (nonatomic, readonly, nonnull) dispatch_queue_t validationCallbackQueue;
 
+/**
+ The pins of each noted hostname packed into a TSKPinSet, which is faster to search than the NSSet of the
+ pinning policy. Built once when the validator is created and released when it gets deallocated.
+ */
+@property (nonatomic, readonly, nonnull) NSDictionary<NSString *, NSValue *> *domainPinSets;
+
+/**
+ The index in the certificate chain (the leaf being 0) of the certificate whose pin last matched, for
+ each noted hostname. Only accessed on the chainPositionLockQueue, along with the prediction counters.
+ */
+@property (nonatomic, nonnull) NSMutableDictionary<NSString *, NSNumber *> *matchedChainPositions;
+@property (nonatomic, nonnull) dispatch_queue_t chainPositionLockQueue;
+@property (nonatomic) NSUInteger predictionCount;
+@property (nonatomic) NSUInteger predictionHitCount;
+@property (nonatomic) NSUInteger avoidedHashCount;
+
+@property (nonatomic, nullable) TSKTrustDecisionCache *trustDecisionCache;
+
+/**
+ The evaluations currently running, keyed by the chain digest followed by the hostname, along with the
+ number of evaluations that ran and the number that waited for an identical one instead. Only accessed
+ on the inFlightLockQueue.
+ */
+@property (nonatomic, nonnull) NSMutableDictionary<NSData *, TSKInFlightEvaluation *> *inFlightEvaluations;
+@property (nonatomic, nonnull) dispatch_queue_t inFlightLockQueue;
+@property (nonatomic) NSUInteger leaderEvaluationCount;
+@property (nonatomic) NSUInteger coalescedEvaluationCount;
+
+/**
+ The pool running the asynchronous evaluations: a concurrent queue that never has more than
+ maxPendingEvaluationCount blocks submitted to it, which also bounds the number of its threads.
+ */
+@property (nonatomic, nonnull) dispatch_queue_t evaluationQueue;
+@property (nonatomic) NSUInteger maxPendingEvaluationCount;
+
 @end
 
 @implementation TSKPinningValidator
+{
+    _Atomic(NSUInteger) _pendingEvaluationCount;
+    
+    // The durations of each phase of the validations of pinned domains
+    TSKLatencyHistogram *_phaseHistograms[TSKValidationPhaseIndexCount];
+}
 
 + (BOOL)allowsAdditionalTrustAnchors
 {
@@ -77,26 +216,66 @@
         _validationCallbackQueue = validationCallbackQueue;
         _validationCallback = validationCallback;
         _spkiHashCache = hashCache;
+        _matchedChainPositions = [NSMutableDictionary new];
+        
+        NSMutableDictionary<NSString *, NSValue *> *domainPinSets = [NSMutableDictionary dictionary];
+        [domainPinningPolicies enumerateKeysAndObjectsUsingBlock:^(NSString *domain, TKSDomainPinningPolicy *policy, BOOL *stop) {
+            NSSet<NSData *> *pins = policy[kTSKPublicKeyHashes];
+            TSKPinSet *pinSet = (pins != nil) ? createPinSetFromPins(pins) : NULL;
+            if (pinSet != NULL)
+            {
+                domainPinSets[domain] = [NSValue valueWithPointer:pinSet];
+            }
+        }];
+        _domainPinSets = domainPinSets;
+        _chainPositionLockQueue = dispatch_queue_create("TSKPinningValidatorChainPositionLock", DISPATCH_QUEUE_SERIAL);
+        _inFlightEvaluations = [NSMutableDictionary new];
+        _inFlightLockQueue = dispatch_queue_create("TSKPinningValidatorInFlightLock", DISPATCH_QUEUE_SERIAL);
+        _evaluationQueue = dispatch_queue_create("TSKPinningValidatorEvaluation", DISPATCH_QUEUE_CONCURRENT);
+        _maxPendingEvaluationCount = [NSProcessInfo processInfo].activeProcessorCount * kTSKPendingEvaluationsPerProcessor;
+        atomic_init(&_pendingEvaluationCount, 0);
+        for (NSUInteger i = 0; i < TSKValidationPhaseIndexCount; i++)
+        {
+            _phaseHistograms[i] = TSKLatencyHistogramCreate();
+        }
     }
     return self;
 }
 
+- (void)dealloc
+{
+    for (NSValue *pinSet in _domainPinSets.allValues)
+    {
+        TSKPinSetDestroy(pinSet.pointerValue);
+    }
+    for (NSUInteger i = 0; i < TSKValidationPhaseIndexCount; i++)
+    {
+        TSKLatencyHistogramDestroy(_phaseHistograms[i]);
+    }
+}
+
 - (TSKTrustDecision)evaluateTrust:(SecTrustRef _Nonnull)serverTrust forHostname:(NSString * _Nonnull)serverHostname
 {
     TSKTrustDecision finalTrustDecision = TSKTrustDecisionShouldBlockConnection;
     
     if ((serverTrust == NULL) || (serverHostname == nil))
     {
-        TSKLog(@"Pin validation error - invalid parameters for %@", serverHostname);
+        TSKLogError(@"Pin validation error - invalid parameters for %@", serverHostname);
         return finalTrustDecision;
     }
     CFRetain(serverTrust);
     
     // Register start time for duration computations
-    NSTimeInterval validationStartTime = [NSDate timeIntervalSinceReferenceDate];
+    uint64_t phaseDurations[TSKValidationPhaseIndexCount];
+    for (NSUInteger i = 0; i < TSKValidationPhaseIndexCount; i++)
+    {
+        phaseDurations[i] = kTSKPhaseNotPerformed;
+    }
+    uint64_t validationStartTime = TSKMonotonicTimeNanoseconds();
     
     // Retrieve the pinning configuration for this specific domain, if there is one
     NSString *domainConfigKey = getPinningConfigurationKeyForDomain(serverHostname, self.domainPinningPolicies);
+    phaseDurations[TSKValidationPhaseIndexPolicyLookup] = TSKMonotonicTimeNanoseconds() - validationStartTime;
     if (domainConfigKey == nil)
     {
         // The domain has no pinning policy: nothing to do/validate
@@ -122,28 +301,70 @@
         else
         {            
             // The domain has a pinning policy that has not expired
-            // Look for one the configured public key pins in the server's evaluated certificate chain
-            TSKTrustEvaluationResult validationResult = verifyPublicKeyPin(serverTrust,
-                                                                           serverHostname,
-                                                                           domainConfig[kTSKPublicKeyHashes],
-                                                                           self.spkiHashCache);
+            TSKTrustEvaluationResult validationResult;
+            TSKTrustDecisionCache *trustDecisionCache = self.trustDecisionCache;
+            uint64_t cacheStartTime = TSKMonotonicTimeNanoseconds();
+            
+            // The digests of the certificates identify the chain for the decision cache and the coalescing of
+            // evaluations, and they are also the keys of the SPKI cache, so they only get computed once
+            NSArray *certificates = copyCertificateChain(serverTrust);
+            NSArray<NSData *> *certificateDigestList = [TSKSPKIHashCache digestsForCertificates:certificates];
+            NSData *chainDigest = [TSKTrustDecisionCache digestForCertificateDigests:certificateDigestList];
+            BOOL isCached = (trustDecisionCache != nil) && [trustDecisionCache containsSuccessfulValidationForHostname:serverHostname chainDigest:chainDigest];
+            uint64_t cacheDuration = TSKMonotonicTimeNanoseconds() - cacheStartTime;
+            if (isCached)
+            {
+                // The same certificate chain was recently validated for this server
+                TSKLogDebug(@"Using the cached pin validation for %@", serverHostname);
+                validationResult = TSKTrustEvaluationSuccess;
+            }
+            else
+            {
+                // Chain evaluation may rebuild the chain, so the digests are matched to the certificates by identity
+                NSMapTable *certificateDigests = [[NSMapTable alloc] initWithKeyOptions:NSPointerFunctionsStrongMemory | NSPointerFunctionsObjectPointerPersonality
+                                                                           valueOptions:NSPointerFunctionsStrongMemory
+                                                                               capacity:certificates.count];
+                for (NSUInteger i = 0; i < certificates.count; i++)
+                {
+                    [certificateDigests setObject:certificateDigestList[i] forKey:certificates[i]];
+                }
+                validationResult = [self verifyPinsForTrust:serverTrust
+                                                forHostname:serverHostname
+                                                chainDigest:chainDigest
+                                         certificateDigests:certificateDigests
+                                              notedHostname:domainConfigKey
+                                             phaseDurations:phaseDurations];
+                
+                if ((trustDecisionCache != nil) && (validationResult == TSKTrustEvaluationSuccess))
+                {
+                    cacheStartTime = TSKMonotonicTimeNanoseconds();
+                    [trustDecisionCache addSuccessfulValidationForHostname:serverHostname
+                                                               chainDigest:chainDigest
+                                                      policyExpirationDate:expirationDate];
+                    cacheDuration += TSKMonotonicTimeNanoseconds() - cacheStartTime;
+                }
+            }
+            if (trustDecisionCache != nil)
+            {
+                phaseDurations[TSKValidationPhaseIndexDecisionCache] = cacheDuration;
+            }
             
             if (validationResult == TSKTrustEvaluationSuccess)
             {
                 // Pin validation was successful
-                TSKLog(@"Pin validation succeeded for %@", serverHostname);
+                TSKLogDebug(@"Pin validation succeeded for %@", serverHostname);
                 finalTrustDecision = TSKTrustDecisionShouldAllowConnection;
             }
             else
             {
                 // Pin validation failed
-                TSKLog(@"Pin validation failed for %@", serverHostname);
+                TSKLogWarning(@"Pin validation failed for %@", serverHostname);
 #if !TARGET_OS_IPHONE
                 if ((validationResult == TSKTrustEvaluationFailedUserDefinedTrustAnchor)
                     && (self.ignorePinsForUserTrustAnchors))
                 {
                     // OS-X only: user-defined trust anchors can be whitelisted (for corporate proxies, etc.) so don't send reports
-                    TSKLog(@"Ignoring pinning failure due to user-defined trust anchor for %@", serverHostname);
+                    TSKLogWarning(@"Ignoring pinning failure due to user-defined trust anchor for %@", serverHostname);
                     finalTrustDecision = TSKTrustDecisionShouldAllowConnection;
                 }
                 else
@@ -170,26 +391,306 @@
                 }
             }
             
+            phaseDurations[TSKValidationPhaseIndexTotal] = TSKMonotonicTimeNanoseconds() - validationStartTime;
+            [self recordPhaseDurations:phaseDurations];
+            TSKMetricsIncrement(metricForEvaluationResult(validationResult));
+            
             // Send a notification after all validation is done; this will also trigger a report if pin validation failed
             if (self.validationCallbackQueue && self.validationCallback) {
-                NSTimeInterval validationDuration = [NSDate timeIntervalSinceReferenceDate] - validationStartTime;
+                NSTimeInterval validationDuration = (NSTimeInterval)phaseDurations[TSKValidationPhaseIndexTotal] / NSEC_PER_SEC;
                 TSKPinningValidatorResult *result = [[TSKPinningValidatorResult alloc] initWithServerHostname:serverHostname
                                                                                                   serverTrust:serverTrust
                                                                                              validationResult:validationResult
                                                                                            finalTrustDecision:finalTrustDecision
                                                                                            validationDuration:validationDuration];
+                [result setPhaseDurations:[TSKPinningValidator dictionaryFromPhaseDurations:phaseDurations]];
+                BOOL isQueueDepthCounted = TSKMetricsIncrement(TSKMetricCallbackQueueDepth);
                 dispatch_async(self.validationCallbackQueue, ^{
+                    if (isQueueDepthCounted)
+                    {
+                        TSKMetricsSubtract(TSKMetricCallbackQueueDepth, 1);
+                    }
                     self.validationCallback(result, domainConfigKey, domainConfig);
                 });
             }
         }
     }
     CFRelease(serverTrust);
+    TSKMetricsIncrement(metricForTrustDecision(finalTrustDecision));
     
     return finalTrustDecision;
 }
 
 
+// Look for one the configured public key pins in the server's evaluated certificate chain, unless the same chain
+// is already being evaluated for the same hostname, in which case wait for that evaluation and use its result;
+// the durations of the phases of the verification are only set when it was not coalesced with another one
+- (TSKTrustEvaluationResult)verifyPinsForTrust:(SecTrustRef)serverTrust
+                                   forHostname:(NSString *)serverHostname
+                                   chainDigest:(NSData *)chainDigest
+                            certificateDigests:(NSMapTable *)certificateDigests
+                                 notedHostname:(NSString *)notedHostname
+                                phaseDurations:(uint64_t *)phaseDurations
+{
+    NSMutableData *key = [NSMutableData dataWithData:chainDigest];
+    [key appendData:[serverHostname.lowercaseString dataUsingEncoding:NSUTF8StringEncoding]];
+    
+    __block TSKInFlightEvaluation *evaluation = nil;
+    __block BOOL isLeader = NO;
+    dispatch_sync(self.inFlightLockQueue, ^{
+        evaluation = self.inFlightEvaluations[key];
+        if (evaluation == nil)
+        {
+            evaluation = [TSKInFlightEvaluation new];
+            self.inFlightEvaluations[key] = evaluation;
+            self.leaderEvaluationCount += 1;
+            isLeader = YES;
+        }
+        else
+        {
+            self.coalescedEvaluationCount += 1;
+        }
+        TSKMetricsIncrement(isLeader ? TSKMetricPinValidations : TSKMetricCoalescedPinValidations);
+    });
+    
+    if (!isLeader)
+    {
+        TSKLogDebug(@"Waiting for the pin validation already running for %@", serverHostname);
+        dispatch_group_wait(evaluation.group, DISPATCH_TIME_FOREVER);
+        return evaluation.result;
+    }
+    
+    // Start with the chain position that matched last time for this policy
+    __block NSNumber *matchedChainPosition = nil;
+    dispatch_sync(self.chainPositionLockQueue, ^{
+        matchedChainPosition = self.matchedChainPositions[notedHostname];
+    });
+    TSKPinVerificationInfo verificationInfo = {
+        .preferredCertificateIndex = matchedChainPosition ? matchedChainPosition.integerValue : -1,
+        .certificateDigests = certificateDigests,
+    };
+    TSKTrustEvaluationResult validationResult = verifyPublicKeyPinWithInfo(serverTrust,
+                                                                           serverHostname,
+                                                                           [self.domainPinSets[notedHostname] pointerValue],
+                                                                           self.spkiHashCache,
+                                                                           &verificationInfo);
+    [self recordVerificationInfo:verificationInfo forNotedHostname:notedHostname];
+    phaseDurations[TSKValidationPhaseIndexChainEvaluation] = verificationInfo.chainEvaluationDuration;
+    if (verificationInfo.checkedHashCount > 0)
+    {
+        phaseDurations[TSKValidationPhaseIndexSPKIHashing] = verificationInfo.spkiHashingDuration;
+        phaseDurations[TSKValidationPhaseIndexPinMatching] = verificationInfo.pinMatchingDuration;
+    }
+    
+    // Only the evaluations that started while this one was running use its result; later ones run again
+    evaluation.result = validationResult;
+    dispatch_sync(self.inFlightLockQueue, ^{
+        [self.inFlightEvaluations removeObjectForKey:key];
+    });
+    dispatch_group_leave(evaluation.group);
+    return validationResult;
+}
+
+
+#pragma mark Instrumentation
+
+- (void)recordPhaseDurations:(const uint64_t *)phaseDurations
+{
+    for (NSUInteger i = 0; i < TSKValidationPhaseIndexCount; i++)
+    {
+        if ((phaseDurations[i] != kTSKPhaseNotPerformed) && (_phaseHistograms[i] != NULL))
+        {
+            TSKLatencyHistogramRecord(_phaseHistograms[i], phaseDurations[i]);
+        }
+    }
+}
+
+
++ (NSDictionary<TSKValidationPhase, NSNumber *> *)dictionaryFromPhaseDurations:(const uint64_t *)phaseDurations
+{
+    NSMutableDictionary<TSKValidationPhase, NSNumber *> *durations = [NSMutableDictionary dictionary];
+    for (NSUInteger i = 0; i < TSKValidationPhaseIndexCount; i++)
+    {
+        if (phaseDurations[i] != kTSKPhaseNotPerformed)
+        {
+            durations[validationPhaseForIndex(i)] = @((NSTimeInterval)phaseDurations[i] / NSEC_PER_SEC);
+        }
+    }
+    return durations;
+}
+
+
+- (NSDictionary<TSKValidationPhase, TSKValidationLatencySnapshot *> *)validationLatencySnapshots
+{
+    NSMutableDictionary<TSKValidationPhase, TSKValidationLatencySnapshot *> *snapshots = [NSMutableDictionary dictionary];
+    for (NSUInteger i = 0; i < TSKValidationPhaseIndexCount; i++)
+    {
+        if (_phaseHistograms[i] == NULL)
+        {
+            continue;
+        }
+        TSKValidationLatencySnapshot *snapshot = [[TSKValidationLatencySnapshot alloc] initWithHistogram:_phaseHistograms[i]];
+        if (snapshot.count > 0)
+        {
+            snapshots[validationPhaseForIndex(i)] = snapshot;
+        }
+    }
+    return snapshots;
+}
+
+
+- (NSUInteger)pinValidationCount
+{
+    __block NSUInteger count = 0;
+    dispatch_sync(self.inFlightLockQueue, ^{
+        count = self.leaderEvaluationCount;
+    });
+    return count;
+}
+
+
+- (NSUInteger)coalescedPinValidationCount
+{
+    __block NSUInteger count = 0;
+    dispatch_sync(self.inFlightLockQueue, ^{
+        count = self.coalescedEvaluationCount;
+    });
+    return count;
+}
+
+
+- (void)recordVerificationInfo:(TSKPinVerificationInfo)verificationInfo forNotedHostname:(NSString *)notedHostname
+{
+    dispatch_sync(self.chainPositionLockQueue, ^{
+        if (verificationInfo.preferredCertificateIndex >= 0)
+        {
+            self.predictionCount += 1;
+            if (verificationInfo.matchedCertificateIndex == verificationInfo.preferredCertificateIndex)
+            {
+                self.predictionHitCount += 1;
+                self.avoidedHashCount += verificationInfo.avoidedHashCount;
+            }
+        }
+        
+        // Only remember positions that matched; a failed evaluation keeps the previous prediction
+        if (verificationInfo.matchedCertificateIndex >= 0)
+        {
+            self.matchedChainPositions[notedHostname] = @(verificationInfo.matchedCertificateIndex);
+        }
+    });
+    TSKLogDebug(@"Checked %lu SPKI hashes for %@, %lu avoided by the chain position prediction",
+           (unsigned long)verificationInfo.checkedHashCount, notedHostname, (unsigned long)verificationInfo.avoidedHashCount);
+}
+
+
+- (NSUInteger)chainPositionPredictionCount
+{
+    __block NSUInteger count = 0;
+    dispatch_sync(self.chainPositionLockQueue, ^{
+        count = self.predictionCount;
+    });
+    return count;
+}
+
+
+- (NSUInteger)chainPositionPredictionHitCount
+{
+    __block NSUInteger count = 0;
+    dispatch_sync(self.chainPositionLockQueue, ^{
+        count = self.predictionHitCount;
+    });
+    return count;
+}
+
+
+- (NSUInteger)avoidedSubjectPublicKeyInfoHashCount
+{
+    __block NSUInteger count = 0;
+    dispatch_sync(self.chainPositionLockQueue, ^{
+        count = self.avoidedHashCount;
+    });
+    return count;
+}
+
+
+- (void)evaluateTrust:(SecTrustRef _Nonnull)serverTrust
+          forHostname:(NSString * _Nonnull)serverHostname
+    completionHandler:(void (^ _Nonnull)(TSKTrustDecision trustDecision))completionHandler
+{
+    NSParameterAssert(completionHandler);
+    
+    // Backpressure: when the pool is full, the caller evaluates the trust itself rather than queueing more work
+    if (atomic_fetch_add(&_pendingEvaluationCount, 1) >= self.maxPendingEvaluationCount)
+    {
+        atomic_fetch_sub(&_pendingEvaluationCount, 1);
+        TSKLogWarning(@"Too many pending evaluations; evaluating %@ on the calling thread", serverHostname);
+        completionHandler([self evaluateTrust:serverTrust forHostname:serverHostname]);
+        return;
+    }
+    
+    if (serverTrust != NULL)
+    {
+        CFRetain(serverTrust);
+    }
+    
+    // Run at the quality of service of the caller, so that evaluations for a user-initiated request are not
+    // stuck behind background work
+    dispatch_block_t evaluationBlock = dispatch_block_create_with_qos_class(DISPATCH_BLOCK_ENFORCE_QOS_CLASS, qos_class_self(), 0, ^{
+        TSKTrustDecision trustDecision = [self evaluateTrust:serverTrust forHostname:serverHostname];
+        atomic_fetch_sub(&self->_pendingEvaluationCount, 1);
+        completionHandler(trustDecision);
+        if (serverTrust != NULL)
+        {
+            CFRelease(serverTrust);
+        }
+    });
+    dispatch_async(self.evaluationQueue, evaluationBlock);
+}
+
+
+- (BOOL)handleChallengeAsynchronously:(NSURLAuthenticationChallenge * _Nonnull)challenge
+                    completionHandler:(void (^ _Nonnull)(NSURLSessionAuthChallengeDisposition disposition,
+                                                         NSURLCredential * _Nullable credential))completionHandler
+{
+    if (![challenge.protectionSpace.authenticationMethod isEqualToString:NSURLAuthenticationMethodServerTrust])
+    {
+        return NO;
+    }
+    
+    SecTrustRef serverTrust = challenge.protectionSpace.serverTrust;
+    NSString *serverHostname = challenge.protectionSpace.host;
+    [self evaluateTrust:serverTrust forHostname:serverHostname completionHandler:^(TSKTrustDecision trustDecision) {
+        // The challenge is captured to keep its server trust alive until the credential is created
+        [TSKPinningValidator completeChallengeForTrust:challenge.protectionSpace.serverTrust
+                                     withTrustDecision:trustDecision
+                                     completionHandler:completionHandler];
+    }];
+    return YES;
+}
+
+
++ (void)completeChallengeForTrust:(SecTrustRef)serverTrust
+                withTrustDecision:(TSKTrustDecision)trustDecision
+                completionHandler:(void (^ _Nonnull)(NSURLSessionAuthChallengeDisposition disposition, NSURLCredential * _Nullable credential))completionHandler
+{
+    if (trustDecision == TSKTrustDecisionShouldAllowConnection)
+    {
+        // Success
+        completionHandler(NSURLSessionAuthChallengeUseCredential, [NSURLCredential credentialForTrust:serverTrust]);
+    }
+    else if (trustDecision == TSKTrustDecisionDomainNotPinned)
+    {
+        // Domain was not pinned; we need to do the default validation to avoid disabling SSL validation for all non-pinned domains
+        completionHandler(NSURLSessionAuthChallengePerformDefaultHandling, NULL);
+    }
+    else
+    {
+        // Pinning validation failed - block the connection
+        completionHandler(NSURLSessionAuthChallengeCancelAuthenticationChallenge, NULL);
+    }
+}
+
+
 - (BOOL)handleChallenge:(NSURLAuthenticationChallenge * _Nonnull)challenge completionHandler:(void (^ _Nonnull)(NSURLSessionAuthChallengeDisposition disposition, NSURLCredential * _Nullable credential))completionHandler
 {
     BOOL wasChallengeHandled = NO;
@@ -200,24 +701,8 @@
         NSString *serverHostname = challenge.protectionSpace.host;
         
         TSKTrustDecision trustDecision = [self evaluateTrust:serverTrust forHostname:serverHostname];
-        if (trustDecision == TSKTrustDecisionShouldAllowConnection)
-        {
-            // Success
-            wasChallengeHandled = YES;
-            completionHandler(NSURLSessionAuthChallengeUseCredential, [NSURLCredential credentialForTrust:serverTrust]);
-        }
-        else if (trustDecision == TSKTrustDecisionDomainNotPinned)
-        {
-            // Domain was not pinned; we need to do the default validation to avoid disabling SSL validation for all non-pinned domains
-            wasChallengeHandled = YES;
-            completionHandler(NSURLSessionAuthChallengePerformDefaultHandling, NULL);
-        }
-        else
-        {
-            // Pinning validation failed - block the connection
-            wasChallengeHandled = YES;
-            completionHandler(NSURLSessionAuthChallengeCancelAuthenticationChallenge, NULL);
-        }
+        wasChallengeHandled = YES;
+        [TSKPinningValidator completeChallengeForTrust:serverTrust withTrustDecision:trustDecision completionHandler:completionHandler];
     }
     return wasChallengeHandled;
 }
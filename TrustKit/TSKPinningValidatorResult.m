@@ -11,6 +11,20 @@
 
 #import "TSKPinningValidatorResult.h"
 #import "Reporting/reporting_utils.h"
+#import "Pinning/pinning_utils.h"
+
+
+@interface TSKPinningValidatorResult ()
+{
+    // The server's certificates, until they get converted to PEM the first time certificateChain is read
+    NSArray *_certificates;
+    NSArray *_certificateChain;
+}
+
+@property (nonatomic, readwrite, nonnull) NSDictionary<TSKValidationPhase, NSNumber *> *phaseDurations;
+
+@end
+
 
 @implementation TSKPinningValidatorResult
 
@@ -29,11 +43,27 @@
         _evaluationResult = validationResult;
         _finalTrustDecision = finalTrustDecision;
         _validationDuration = validationDuration;
+        _phaseDurations = @{};
         
-        // Convert the server trust to a certificate chain as soon as we get it, as the trust object sometimes gets freed right after the authentication challenge has been handled
-        _certificateChain = convertTrustToPemArray(serverTrust);
+        // Copy the certificates out of the server trust as soon as we get it, as the trust object sometimes gets freed right after the authentication challenge has been handled
+        // Converting them to PEM is only needed for reports, so it is deferred until the certificate chain is actually read
+        _certificates = copyCertificateChain(serverTrust);
     }
     return self;
 }
 
+
+- (NSArray *)certificateChain
+{
+    @synchronized(self)
+    {
+        if (_certificateChain == nil)
+        {
+            _certificateChain = convertCertificatesToPemArray(_certificates);
+            _certificates = nil;
+        }
+        return _certificateChain;
+    }
+}
+
 @end
@@ -9,8 +9,12 @@
  
  */
 
+#import "Pinning/latency_histogram.h"
+
 NS_ASSUME_NONNULL_BEGIN
 
+@class TSKTrustDecisionCache;
+
 /* Methods that are internal to TrustKit */
 @interface TSKPinningValidator (Internal)
 
@@ -30,6 +34,29 @@ NS_ASSUME_NONNULL_BEGIN
                                 validationCallbackQueue:(dispatch_queue_t)validationCallbackQueue
                                      validationCallback:(TSKPinningValidatorCallback)validationCallback;
 
+/**
+ Counters of the chain position prediction: the number of evaluations that first checked the chain position
+ whose pin matched last time for the same noted hostname, how many of them matched at that position, and
+ the total number of SPKI hashes this avoided compared to scanning the chain from the CA.
+ */
+- (NSUInteger)chainPositionPredictionCount;
+- (NSUInteger)chainPositionPredictionHitCount;
+- (NSUInteger)avoidedSubjectPublicKeyInfoHashCount;
+
+/**
+ Counters of the coalescing of concurrent identical evaluations: the number of times the pins of a certificate
+ chain were checked, and the number of evaluations that waited for the same chain to be checked for the same
+ hostname on another thread instead.
+ */
+- (NSUInteger)pinValidationCount;
+- (NSUInteger)coalescedPinValidationCount;
+
+/**
+ The cache of successful validations, or nil if the trust decision cache is disabled, which is the default.
+ */
+- (TSKTrustDecisionCache * _Nullable)trustDecisionCache;
+- (void)setTrustDecisionCache:(TSKTrustDecisionCache * _Nullable)trustDecisionCache;
+
 @end
 
 
@@ -41,6 +68,16 @@ NS_ASSUME_NONNULL_BEGIN
                               finalTrustDecision:(TSKTrustDecision)finalTrustDecision
                               validationDuration:(NSTimeInterval)validationDuration;
 
+- (void)setPhaseDurations:(NSDictionary<TSKValidationPhase, NSNumber *> *)phaseDurations;
+
+@end
+
+
+@interface TSKValidationLatencySnapshot (Internal)
+
+// Take a snapshot of the values recorded so far in the histogram
+- (instancetype)initWithHistogram:(const TSKLatencyHistogram *)histogram;
+
 @end
 
 NS_ASSUME_NONNULL_END
@@ -18,6 +18,7 @@ const TSKGlobalConfigurationKey kTSKSwizzleNetworkDelegates = @"TSKSwizzleNetwor
 const TSKGlobalConfigurationKey kTSKPinnedDomains = @"TSKPinnedDomains";
 
 const TSKGlobalConfigurationKey kTSKIgnorePinningForUserDefinedTrustAnchors = @"TSKIgnorePinningForUserDefinedTrustAnchors";
+const TSKGlobalConfigurationKey kTSKTrustDecisionCacheTimeToLive = @"TSKTrustDecisionCacheTimeToLive";
 
 // Keys for each domain within the TSKPinnedDomains entry
 const TSKDomainConfigurationKey kTSKPublicKeyHashes = @"TSKPublicKeyHashes";
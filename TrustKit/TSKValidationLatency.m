@@ -0,0 +1,90 @@
+/*
+
+ TSKValidationLatency.m
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#import "TSKValidationLatency.h"
+#import "Pinning/latency_histogram.h"
+
+
+const TSKValidationPhase kTSKValidationPhasePolicyLookup = @"TSKValidationPhasePolicyLookup";
+const TSKValidationPhase kTSKValidationPhaseDecisionCache = @"TSKValidationPhaseDecisionCache";
+const TSKValidationPhase kTSKValidationPhaseChainEvaluation = @"TSKValidationPhaseChainEvaluation";
+const TSKValidationPhase kTSKValidationPhaseSPKIHashing = @"TSKValidationPhaseSPKIHashing";
+const TSKValidationPhase kTSKValidationPhasePinMatching = @"TSKValidationPhasePinMatching";
+const TSKValidationPhase kTSKValidationPhaseTotal = @"TSKValidationPhaseTotal";
+
+
+static NSTimeInterval timeIntervalFromNanoseconds(uint64_t nanoseconds)
+{
+    return (NSTimeInterval)nanoseconds / NSEC_PER_SEC;
+}
+
+
+@interface TSKValidationLatencySnapshot ()
+{
+    TSKLatencyHistogramSnapshot _snapshot;
+}
+@end
+
+
+@implementation TSKValidationLatencySnapshot
+
+- (instancetype _Nonnull)initWithHistogram:(const TSKLatencyHistogram * _Nonnull)histogram
+{
+    self = [super init];
+    if (self) {
+        TSKLatencyHistogramGetSnapshot(histogram, &_snapshot);
+    }
+    return self;
+}
+
+
+- (NSUInteger)count
+{
+    return (NSUInteger)_snapshot.count;
+}
+
+
+- (NSTimeInterval)minimumDuration
+{
+    return timeIntervalFromNanoseconds(_snapshot.min);
+}
+
+
+- (NSTimeInterval)maximumDuration
+{
+    return timeIntervalFromNanoseconds(_snapshot.max);
+}
+
+
+- (NSTimeInterval)meanDuration
+{
+    if (_snapshot.count == 0)
+    {
+        return 0;
+    }
+    return timeIntervalFromNanoseconds(_snapshot.sum) / _snapshot.count;
+}
+
+
+- (NSTimeInterval)durationAtPercentile:(double)percentile
+{
+    return timeIntervalFromNanoseconds(TSKLatencyHistogramSnapshotGetValueAtPercentile(&_snapshot, percentile));
+}
+
+
+- (NSString *)description
+{
+    return [NSString stringWithFormat:@"<%@: count=%lu p50=%.6fs p99=%.6fs max=%.6fs>",
+            NSStringFromClass([self class]), (unsigned long)self.count,
+            [self durationAtPercentile:50], [self durationAtPercentile:99], self.maximumDuration];
+}
+
+@end
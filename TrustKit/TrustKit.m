@@ -12,6 +12,7 @@
 #import "TrustKit.h"
 #import "Reporting/TSKBackgroundReporter.h"
 #import "Pinning/TSKSPKIHashCache.h"
+#import "Pinning/TSKTrustDecisionCache.h"
 #import "Swizzling/TSKNSURLConnectionDelegateProxy.h"
 #import "Swizzling/TSKNSURLSessionDelegateProxy.h"
 #import "Pinning/TSKSPKIHashCache.h"
@@ -19,6 +20,10 @@
 #import "TSKPinningValidatorResult.h"
 #import "TSKLog.h"
 #import "TSKPinningValidator_Private.h"
+#import "metrics_registry.h"
+#import "log_ring_buffer.h"
+
+#include <stdatomic.h>
 
 
 // Info.plist key we read the public key hashes from
@@ -43,19 +48,57 @@ static TSKSPKIHashCache *sharedHashCache;
 // Default logger block: only log in debug builds and add TrustKit at the beginning of the line
 #if DEBUG
 void (^_loggerBlock)(NSString *) = ^void(NSString *message) { NSLog(@"=== TrustKit: %@", message); };
+_Atomic(TSKLogLevel) _TSKLogFormattingLevel = TSKLogLevelDebug;
 #else
 void (^_loggerBlock)(NSString *) = NULL;
+_Atomic(TSKLogLevel) _TSKLogFormattingLevel = TSKLogLevelNone;
 #endif
 
-// The logging function we use within TrustKit
-void TSKLog(NSString *format, ...)
+// The level set with +setLogLevel:, which only applies when there is a logger block
+static TSKLogLevel _logLevel = TSKLogLevelDebug;
+
+_Atomic(TSKLogLevel) _TSKLogRecordingLevel = TSKLogLevelNone;
+
+// Allocated the first time recording is enabled, and never freed so that it can be written without a lock
+static TSKLogRingBuffer * _Atomic _logRingBuffer;
+
+static const size_t kTSKLogRingBufferCapacity = 1024;
+
+static NSString *nameForLogLevel(TSKLogLevel level)
+{
+    switch (level)
+    {
+        case TSKLogLevelError:
+            return @"Error";
+        case TSKLogLevelWarning:
+            return @"Warning";
+        case TSKLogLevelInfo:
+            return @"Info";
+        case TSKLogLevelDebug:
+            return @"Debug";
+        default:
+            return @"None";
+    }
+}
+
+void TSKLogRecordEvent(TSKLogLevel level, NSString *format)
+{
+    TSKLogRingBuffer *ringBuffer = atomic_load_explicit(&_logRingBuffer, memory_order_acquire);
+    if (ringBuffer)
+    {
+        TSKLogRingBufferRecord(ringBuffer, (uint32_t)level, (__bridge const void *)format);
+    }
+}
+
+void TSKLogFormatted(TSKLogLevel level, NSString *format, ...)
 {
-    if (_loggerBlock) {
+    void (^loggerBlock)(NSString *) = _loggerBlock;
+    if (loggerBlock) {
         va_list args;
         va_start(args, format);
         NSString *message = [[NSString alloc] initWithFormat:format arguments:args];
         va_end(args);
-        _loggerBlock(message);
+        loggerBlock(message);
     }
 }
 
@@ -94,7 +137,7 @@ void TSKLog(NSString *format, ...)
 + (void)initSharedInstanceWithConfiguration:(NSDictionary<TSKGlobalConfigurationKey, id> *)trustKitConfig
                   sharedContainerIdentifier:(NSString *)sharedContainerIdentifier
 {
-    TSKLog(@"Configuration passed via explicit call to initSharedInstanceWithConfiguration:");
+    TSKLogInfo(@"Configuration passed via explicit call to initSharedInstanceWithConfiguration:");
     
     static dispatch_once_t onceToken;
     dispatch_once(&onceToken, ^{
@@ -207,7 +250,15 @@ void TSKLog(NSString *format, ...)
                                                                                            pinningPolicy:notedHostnamePinningPolicy];
                                                                     }];
         
-        TSKLog(@"Successfully initialized with configuration %@", _configuration);
+        // TSKTrustDecisionCacheTimeToLive - the cache belongs to the validator, so it only ever holds decisions made with this configuration
+        NSTimeInterval trustDecisionCacheTimeToLive = [_configuration[kTSKTrustDecisionCacheTimeToLive] doubleValue];
+        if (trustDecisionCacheTimeToLive > 0)
+        {
+            _pinningValidator.trustDecisionCache = [[TSKTrustDecisionCache alloc] initWithTimeToLive:trustDecisionCacheTimeToLive
+                                                                                   maximumEntryCount:kTSKTrustDecisionCacheDefaultMaximumEntryCount];
+        }
+        
+        TSKLogInfo(@"Successfully initialized with configuration %@", _configuration);
     }
     return self;
 }
@@ -267,6 +318,96 @@ void TSKLog(NSString *format, ...)
 + (void)setLoggerBlock:(void (^)(NSString *))block
 {
     _loggerBlock = block;
+    atomic_store_explicit(&_TSKLogFormattingLevel, (block) ? _logLevel : TSKLogLevelNone, memory_order_relaxed);
+}
+
+
++ (void)setLogLevel:(TSKLogLevel)level
+{
+    _logLevel = level;
+    atomic_store_explicit(&_TSKLogFormattingLevel, (_loggerBlock) ? level : TSKLogLevelNone, memory_order_relaxed);
+}
+
+
++ (void)setLogEventRecordingLevel:(TSKLogLevel)level
+{
+    if ((level != TSKLogLevelNone) && (atomic_load_explicit(&_logRingBuffer, memory_order_acquire) == NULL))
+    {
+        TSKLogRingBuffer *ringBuffer = TSKLogRingBufferCreate(kTSKLogRingBufferCapacity);
+        TSKLogRingBuffer *expectedRingBuffer = NULL;
+        if (!atomic_compare_exchange_strong_explicit(&_logRingBuffer, &expectedRingBuffer, ringBuffer,
+                                                     memory_order_acq_rel, memory_order_acquire))
+        {
+            // Another thread enabled recording at the same time
+            TSKLogRingBufferDestroy(ringBuffer);
+        }
+    }
+    atomic_store_explicit(&_TSKLogRecordingLevel, level, memory_order_relaxed);
+}
+
+
++ (NSArray<NSString *> *)recordedLogEvents
+{
+    TSKLogRingBuffer *ringBuffer = atomic_load_explicit(&_logRingBuffer, memory_order_acquire);
+    if (ringBuffer == NULL)
+    {
+        return @[];
+    }
+
+    size_t capacity = TSKLogRingBufferGetCapacity(ringBuffer);
+    TSKLogRecord *records = malloc(capacity * sizeof(TSKLogRecord));
+    if (records == NULL)
+    {
+        return @[];
+    }
+    size_t recordCount = TSKLogRingBufferCopyRecords(ringBuffer, records, capacity);
+
+    NSMutableArray<NSString *> *events = [NSMutableArray arrayWithCapacity:recordCount];
+    for (size_t i = 0; i < recordCount; i++)
+    {
+        // The events are the format strings of the log statements, which are literals that are never deallocated
+        [events addObject:[NSString stringWithFormat:@"%.6f %@: %@",
+                           (double)records[i].timestamp / NSEC_PER_SEC,
+                           nameForLogLevel((TSKLogLevel)records[i].level),
+                           (__bridge NSString *)records[i].event]];
+    }
+    free(records);
+    return events;
+}
+
+
+#pragma mark Metrics
+
+
++ (void)setMetricsEnabled:(BOOL)enabled
+{
+    TSKMetricsSetEnabled(enabled);
+}
+
+
++ (NSDictionary<NSString *, NSNumber *> *)metricsSnapshot
+{
+    TSKMetricsSnapshot snapshot;
+    TSKMetricsGetSnapshot(&snapshot);
+    NSMutableDictionary<NSString *, NSNumber *> *metrics = [NSMutableDictionary dictionaryWithCapacity:TSKMetricCount];
+    for (NSUInteger i = 0; i < TSKMetricCount; i++)
+    {
+        NSString *name = @(TSKMetricGetName((TSKMetric)i));
+        metrics[name] = (i == TSKMetricCallbackQueueDepth) ? @((int64_t)snapshot.values[i]) : @(snapshot.values[i]);
+    }
+    return metrics;
+}
+
+
++ (NSString *)metricsInOpenMetricsFormat
+{
+    TSKMetricsSnapshot snapshot;
+    TSKMetricsGetSnapshot(&snapshot);
+    size_t length = TSKMetricsRenderOpenMetrics(&snapshot, NULL, 0);
+    NSMutableData *text = [NSMutableData dataWithLength:length + 1];
+    TSKMetricsRenderOpenMetrics(&snapshot, text.mutableBytes, text.length);
+    text.length = length;
+    return [[NSString alloc] initWithData:text encoding:NSUTF8StringEncoding];
 }
 
 @end
@@ -284,7 +425,7 @@ __attribute__((constructor)) static void initializeWithInfoPlist(int argc, const
     NSDictionary *trustKitConfigFromInfoPlist = (__bridge NSDictionary *)CFBundleGetValueForInfoDictionaryKey(appBundle, (__bridge CFStringRef)kTSKConfiguration);
     if (trustKitConfigFromInfoPlist)
     {
-        TSKLog(@"Configuration supplied via the App's Info.plist");
+        TSKLogInfo(@"Configuration supplied via the App's Info.plist");
         [TrustKit initSharedInstanceWithConfiguration:trustKitConfigFromInfoPlist];
     }
 }
@@ -13,6 +13,7 @@
 #import "TSKTrustKitConfig.h"
 #import "Dependencies/domain_registry/domain_registry.h"
 #import "TSKLog.h"
+#import "metrics_registry.h"
 
 
 static NSUInteger isSubdomain(NSString *domain, NSString *subdomain)
@@ -27,6 +28,7 @@ static NSUInteger isSubdomain(NSString *domain, NSString *subdomain)
     // Ensure that the TLDs are the same; this can get tricky with TLDs like .co.uk so we take a cautious approach
     size_t domainRegistryLength = GetRegistryLength([domain UTF8String]);
     size_t subdomainRegistryLength = GetRegistryLength([subdomain UTF8String]);
+    TSKMetricsAdd(TSKMetricRegistryLookups, 2);
     if (subdomainRegistryLength != domainRegistryLength)
     {
         return 0;
@@ -70,18 +72,18 @@ NSString * _Nullable getPinningConfigurationKeyForDomain(NSString * _Nonnull hos
             if ([domainPinningPolicies[pinnedServerName][kTSKIncludeSubdomains] boolValue])
             {
                 // Is the server a subdomain of this pinned server?
-                TSKLog(@"Checking includeSubdomains configuration for %@", pinnedServerName);
+                TSKLogDebug(@"Checking includeSubdomains configuration for %@", pinnedServerName);
                 NSUInteger currentMatch = isSubdomain(pinnedServerName, hostname);
                 if (currentMatch > 0 && currentMatch > bestMatch)
                 {
                     // Yes; let's use the parent domain's pinning configuration
-                    TSKLog(@"Applying includeSubdomains configuration from %@ to %@ (new best match of %d chars)", pinnedServerName, hostname, currentMatch);
+                    TSKLogDebug(@"Applying includeSubdomains configuration from %@ to %@ (new best match of %d chars)", pinnedServerName, hostname, currentMatch);
                     bestMatch = currentMatch;
                     notedHostname = pinnedServerName;
                 }
                 else if (currentMatch > 0)
                 {
-                    TSKLog(@"Not applying includeSubdomains configuration from %@ to %@ (current match of %d chars does not exceed best match)", pinnedServerName, hostname, currentMatch);
+                    TSKLogDebug(@"Not applying includeSubdomains configuration from %@ to %@ (current match of %d chars does not exceed best match)", pinnedServerName, hostname, currentMatch);
                 }
             }
         }
@@ -94,7 +96,7 @@ NSString * _Nullable getPinningConfigurationKeyForDomain(NSString * _Nonnull hos
     
     if (notedHostname == nil)
     {
-        TSKLog(@"Domain %@ is not pinned", hostname);
+        TSKLogDebug(@"Domain %@ is not pinned", hostname);
     }
     return notedHostname;
 }
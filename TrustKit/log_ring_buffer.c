@@ -0,0 +1,128 @@
+/*
+
+ log_ring_buffer.c
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "log_ring_buffer.h"
+#include "Pinning/latency_histogram.h"
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+
+typedef struct
+{
+    // 2 * sequence + 1 while the record is being written, 2 * sequence + 2 once it has been written
+    _Atomic uint64_t state;
+    _Atomic uint64_t timestamp;
+    _Atomic uintptr_t event;
+    _Atomic uint32_t level;
+} TSKLogSlot;
+
+struct TSKLogRingBuffer
+{
+    _Atomic uint64_t head;
+    size_t mask;
+    TSKLogSlot slots[];
+};
+
+
+TSKLogRingBuffer *TSKLogRingBufferCreate(size_t capacity)
+{
+    size_t roundedCapacity = 1;
+    while (roundedCapacity < capacity)
+    {
+        roundedCapacity <<= 1;
+    }
+
+    TSKLogRingBuffer *buffer = calloc(1, sizeof(TSKLogRingBuffer) + roundedCapacity * sizeof(TSKLogSlot));
+    if (buffer == NULL)
+    {
+        return NULL;
+    }
+    buffer->mask = roundedCapacity - 1;
+    return buffer;
+}
+
+
+void TSKLogRingBufferDestroy(TSKLogRingBuffer *buffer)
+{
+    free(buffer);
+}
+
+
+size_t TSKLogRingBufferGetCapacity(const TSKLogRingBuffer *buffer)
+{
+    return buffer->mask + 1;
+}
+
+
+void TSKLogRingBufferRecord(TSKLogRingBuffer *buffer, uint32_t level, const void *event)
+{
+    uint64_t sequence = atomic_fetch_add_explicit(&buffer->head, 1, memory_order_relaxed);
+    TSKLogSlot *slot = &buffer->slots[sequence & buffer->mask];
+
+    // Claim the slot; if the writer of the previous lap is still writing it, or a writer of the next lap
+    // already claimed it, drop the record rather than wait
+    uint64_t state = atomic_load_explicit(&slot->state, memory_order_relaxed);
+    if (((state & 1) != 0) || (state > 2 * sequence)
+        || !atomic_compare_exchange_strong_explicit(&slot->state, &state, 2 * sequence + 1,
+                                                    memory_order_relaxed, memory_order_relaxed))
+    {
+        return;
+    }
+    atomic_thread_fence(memory_order_release);
+
+    atomic_store_explicit(&slot->timestamp, TSKMonotonicTimeNanoseconds(), memory_order_relaxed);
+    atomic_store_explicit(&slot->event, (uintptr_t)event, memory_order_relaxed);
+    atomic_store_explicit(&slot->level, level, memory_order_relaxed);
+    atomic_store_explicit(&slot->state, 2 * sequence + 2, memory_order_release);
+}
+
+
+size_t TSKLogRingBufferCopyRecords(TSKLogRingBuffer *buffer, TSKLogRecord *records, size_t maxCount)
+{
+    uint64_t head = atomic_load_explicit(&buffer->head, memory_order_acquire);
+    uint64_t recordCount = head;
+    if (recordCount > buffer->mask + 1)
+    {
+        recordCount = buffer->mask + 1;
+    }
+    if (recordCount > maxCount)
+    {
+        recordCount = maxCount;
+    }
+
+    size_t copiedCount = 0;
+    for (uint64_t sequence = head - recordCount; sequence < head; sequence++)
+    {
+        TSKLogSlot *slot = &buffer->slots[sequence & buffer->mask];
+        uint64_t state = atomic_load_explicit(&slot->state, memory_order_acquire);
+        if (state != 2 * sequence + 2)
+        {
+            // Not written yet, dropped, or already overwritten
+            continue;
+        }
+
+        TSKLogRecord *record = &records[copiedCount];
+        record->sequence = sequence;
+        record->timestamp = atomic_load_explicit(&slot->timestamp, memory_order_relaxed);
+        record->event = (const void *)atomic_load_explicit(&slot->event, memory_order_relaxed);
+        record->level = atomic_load_explicit(&slot->level, memory_order_relaxed);
+
+        // Discard the record if it got overwritten while it was being copied
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&slot->state, memory_order_relaxed) == state)
+        {
+            copiedCount++;
+        }
+    }
+    return copiedCount;
+}
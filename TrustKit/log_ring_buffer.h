@@ -0,0 +1,60 @@
+/*
+
+ log_ring_buffer.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_log_ring_buffer_h
+#define TrustKit_log_ring_buffer_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ A fixed-size ring buffer of binary log records, for keeping a trace of the most recent log events
+ without formatting them.
+
+ Writers claim a slot with a single atomic increment and never wait; once the buffer is full, the oldest
+ records get overwritten. Each slot carries a sequence number that is odd while the slot is being written,
+ so readers can skip the records that get overwritten while they are being copied.
+ */
+
+typedef struct
+{
+    // Position of the record since the creation of the buffer
+    uint64_t sequence;
+    // From TSKMonotonicTimeNanoseconds()
+    uint64_t timestamp;
+    // Identifies the log statement, such as the address of its format string; it is not dereferenced
+    const void *event;
+    uint32_t level;
+} TSKLogRecord;
+
+typedef struct TSKLogRingBuffer TSKLogRingBuffer;
+
+// The capacity gets rounded up to a power of two; return NULL if the allocation failed
+TSKLogRingBuffer *TSKLogRingBufferCreate(size_t capacity);
+
+void TSKLogRingBufferDestroy(TSKLogRingBuffer *buffer);
+
+size_t TSKLogRingBufferGetCapacity(const TSKLogRingBuffer *buffer);
+
+void TSKLogRingBufferRecord(TSKLogRingBuffer *buffer, uint32_t level, const void *event);
+
+// Copy up to maxCount of the most recent records, oldest first, and return the number of records copied
+size_t TSKLogRingBufferCopyRecords(TSKLogRingBuffer *buffer, TSKLogRecord *records, size_t maxCount);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TrustKit_log_ring_buffer_h */
@@ -0,0 +1,225 @@
+/*
+
+ metrics_registry.c
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "metrics_registry.h"
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+
+// Metric descriptions
+
+typedef enum
+{
+    TSKMetricFamilyEvaluations,
+    TSKMetricFamilyEvaluationResults,
+    TSKMetricFamilyPinValidations,
+    TSKMetricFamilyCoalescedPinValidations,
+    TSKMetricFamilyTrustDecisionCacheHits,
+    TSKMetricFamilyTrustDecisionCacheMisses,
+    TSKMetricFamilyTrustDecisionCacheEvictions,
+    TSKMetricFamilySPKICacheHits,
+    TSKMetricFamilySPKICacheMisses,
+    TSKMetricFamilySPKICachePersistedBytes,
+    TSKMetricFamilyRegistryLookups,
+    TSKMetricFamilyReportsGenerated,
+    TSKMetricFamilyReportsRateLimited,
+    TSKMetricFamilyReportsUploaded,
+    TSKMetricFamilyReportUploadFailures,
+    TSKMetricFamilyCallbackQueueDepth,
+} TSKMetricFamily;
+
+typedef struct
+{
+    const char *name;
+    const char *type;
+    const char *help;
+} TSKMetricFamilyDescription;
+
+static const TSKMetricFamilyDescription familyDescriptions[] = {
+    [TSKMetricFamilyEvaluations] = { "trustkit_evaluations", "counter", "Trust evaluations by final trust decision." },
+    [TSKMetricFamilyEvaluationResults] = { "trustkit_evaluation_results", "counter", "Trust evaluations of pinned domains by result." },
+    [TSKMetricFamilyPinValidations] = { "trustkit_pin_validations", "counter", "Certificate chains whose pins were checked." },
+    [TSKMetricFamilyCoalescedPinValidations] = { "trustkit_coalesced_pin_validations", "counter", "Evaluations that used the result of an identical check running on another thread." },
+    [TSKMetricFamilyTrustDecisionCacheHits] = { "trustkit_trust_decision_cache_hits", "counter", "Evaluations served from the trust decision cache." },
+    [TSKMetricFamilyTrustDecisionCacheMisses] = { "trustkit_trust_decision_cache_misses", "counter", "Evaluations not found in the trust decision cache." },
+    [TSKMetricFamilyTrustDecisionCacheEvictions] = { "trustkit_trust_decision_cache_evictions", "counter", "Decisions evicted from a full trust decision cache." },
+    [TSKMetricFamilySPKICacheHits] = { "trustkit_spki_cache_hits", "counter", "SPKI hashes found in the cache." },
+    [TSKMetricFamilySPKICacheMisses] = { "trustkit_spki_cache_misses", "counter", "SPKI hashes that had to be computed." },
+    [TSKMetricFamilySPKICachePersistedBytes] = { "trustkit_spki_cache_persisted_bytes", "counter", "Bytes of SPKI cache records written to the filesystem." },
+    [TSKMetricFamilyRegistryLookups] = { "trustkit_registry_lookups", "counter", "Lookups of a domain in the public suffix registry." },
+    [TSKMetricFamilyReportsGenerated] = { "trustkit_reports_generated", "counter", "Pin failure reports generated." },
+    [TSKMetricFamilyReportsRateLimited] = { "trustkit_reports_rate_limited", "counter", "Pin failure reports not sent because an identical one was recently sent." },
+    [TSKMetricFamilyReportsUploaded] = { "trustkit_reports_uploaded", "counter", "Pin failure report uploads that completed." },
+    [TSKMetricFamilyReportUploadFailures] = { "trustkit_report_upload_failures", "counter", "Pin failure report uploads that failed." },
+    [TSKMetricFamilyCallbackQueueDepth] = { "trustkit_callback_queue_depth", "gauge", "Validation results waiting to be delivered on the validation callback queue." },
+};
+
+typedef struct
+{
+    TSKMetricFamily family;
+    const char *name;
+} TSKMetricDescription;
+
+// The metrics of a family are next to each other, so that they get rendered together
+static const TSKMetricDescription metricDescriptions[TSKMetricCount] = {
+    [TSKMetricEvaluationsAllowed] = { TSKMetricFamilyEvaluations, "trustkit_evaluations_total{decision=\"allow\"}" },
+    [TSKMetricEvaluationsBlocked] = { TSKMetricFamilyEvaluations, "trustkit_evaluations_total{decision=\"block\"}" },
+    [TSKMetricEvaluationsNotPinned] = { TSKMetricFamilyEvaluations, "trustkit_evaluations_total{decision=\"not_pinned\"}" },
+    [TSKMetricEvaluationResultSuccess] = { TSKMetricFamilyEvaluationResults, "trustkit_evaluation_results_total{result=\"success\"}" },
+    [TSKMetricEvaluationResultNoMatchingPin] = { TSKMetricFamilyEvaluationResults, "trustkit_evaluation_results_total{result=\"no_matching_pin\"}" },
+    [TSKMetricEvaluationResultInvalidCertificateChain] = { TSKMetricFamilyEvaluationResults, "trustkit_evaluation_results_total{result=\"invalid_certificate_chain\"}" },
+    [TSKMetricEvaluationResultInvalidParameters] = { TSKMetricFamilyEvaluationResults, "trustkit_evaluation_results_total{result=\"invalid_parameters\"}" },
+    [TSKMetricEvaluationResultUserDefinedTrustAnchor] = { TSKMetricFamilyEvaluationResults, "trustkit_evaluation_results_total{result=\"user_defined_trust_anchor\"}" },
+    [TSKMetricEvaluationResultCouldNotGenerateSpkiHash] = { TSKMetricFamilyEvaluationResults, "trustkit_evaluation_results_total{result=\"could_not_generate_spki_hash\"}" },
+    [TSKMetricPinValidations] = { TSKMetricFamilyPinValidations, "trustkit_pin_validations_total" },
+    [TSKMetricCoalescedPinValidations] = { TSKMetricFamilyCoalescedPinValidations, "trustkit_coalesced_pin_validations_total" },
+    [TSKMetricTrustDecisionCacheHits] = { TSKMetricFamilyTrustDecisionCacheHits, "trustkit_trust_decision_cache_hits_total" },
+    [TSKMetricTrustDecisionCacheMisses] = { TSKMetricFamilyTrustDecisionCacheMisses, "trustkit_trust_decision_cache_misses_total" },
+    [TSKMetricTrustDecisionCacheEvictions] = { TSKMetricFamilyTrustDecisionCacheEvictions, "trustkit_trust_decision_cache_evictions_total" },
+    [TSKMetricSPKICacheHits] = { TSKMetricFamilySPKICacheHits, "trustkit_spki_cache_hits_total" },
+    [TSKMetricSPKICacheMisses] = { TSKMetricFamilySPKICacheMisses, "trustkit_spki_cache_misses_total" },
+    [TSKMetricSPKICachePersistedBytes] = { TSKMetricFamilySPKICachePersistedBytes, "trustkit_spki_cache_persisted_bytes_total" },
+    [TSKMetricRegistryLookups] = { TSKMetricFamilyRegistryLookups, "trustkit_registry_lookups_total" },
+    [TSKMetricReportsGenerated] = { TSKMetricFamilyReportsGenerated, "trustkit_reports_generated_total" },
+    [TSKMetricReportsRateLimited] = { TSKMetricFamilyReportsRateLimited, "trustkit_reports_rate_limited_total" },
+    [TSKMetricReportsUploaded] = { TSKMetricFamilyReportsUploaded, "trustkit_reports_uploaded_total" },
+    [TSKMetricReportUploadFailures] = { TSKMetricFamilyReportUploadFailures, "trustkit_report_upload_failures_total" },
+    [TSKMetricCallbackQueueDepth] = { TSKMetricFamilyCallbackQueueDepth, "trustkit_callback_queue_depth" },
+};
+
+const char *TSKMetricGetName(TSKMetric metric)
+{
+    if (metric >= TSKMetricCount)
+    {
+        return NULL;
+    }
+    return metricDescriptions[metric].name;
+}
+
+
+// Counters
+
+// Each counter gets its own cache line so that threads updating different counters do not contend
+typedef struct
+{
+    _Alignas(64) _Atomic uint64_t value;
+} TSKMetricCounter;
+
+static TSKMetricCounter counters[TSKMetricCount];
+
+#if !TSK_METRICS_DISABLED
+
+static atomic_bool isEnabled;
+
+void TSKMetricsSetEnabled(bool enabled)
+{
+    atomic_store_explicit(&isEnabled, enabled, memory_order_relaxed);
+}
+
+bool TSKMetricsIsEnabled(void)
+{
+    return atomic_load_explicit(&isEnabled, memory_order_relaxed);
+}
+
+bool TSKMetricsAdd(TSKMetric metric, uint64_t value)
+{
+    if (!atomic_load_explicit(&isEnabled, memory_order_relaxed) || (metric >= TSKMetricCount))
+    {
+        return false;
+    }
+    atomic_fetch_add_explicit(&counters[metric].value, value, memory_order_relaxed);
+    return true;
+}
+
+void TSKMetricsSubtract(TSKMetric metric, uint64_t value)
+{
+    if (metric >= TSKMetricCount)
+    {
+        return;
+    }
+    atomic_fetch_sub_explicit(&counters[metric].value, value, memory_order_relaxed);
+}
+
+#endif
+
+void TSKMetricsGetSnapshot(TSKMetricsSnapshot *snapshot)
+{
+    for (size_t i = 0; i < TSKMetricCount; i++)
+    {
+        snapshot->values[i] = atomic_load_explicit(&counters[i].value, memory_order_relaxed);
+    }
+}
+
+void TSKMetricsReset(void)
+{
+    for (size_t i = 0; i < TSKMetricCount; i++)
+    {
+        atomic_store_explicit(&counters[i].value, 0, memory_order_relaxed);
+    }
+}
+
+
+// OpenMetrics
+
+// Append to the buffer while there is room, and keep counting the length of the text once there is not
+static void appendFormat(char *buffer, size_t bufferSize, size_t *length, const char *format, ...)
+{
+    va_list arguments;
+    va_start(arguments, format);
+    char *destination = (*length < bufferSize) ? buffer + *length : NULL;
+    size_t remainingSize = (*length < bufferSize) ? bufferSize - *length : 0;
+    int written = vsnprintf(destination, remainingSize, format, arguments);
+    va_end(arguments);
+    if (written > 0)
+    {
+        *length += (size_t)written;
+    }
+}
+
+size_t TSKMetricsRenderOpenMetrics(const TSKMetricsSnapshot *snapshot, char *buffer, size_t bufferSize)
+{
+    if ((buffer != NULL) && (bufferSize > 0))
+    {
+        buffer[0] = '\0';
+    }
+    else
+    {
+        buffer = NULL;
+        bufferSize = 0;
+    }
+
+    size_t length = 0;
+    for (size_t i = 0; i < TSKMetricCount; i++)
+    {
+        const TSKMetricDescription *metric = &metricDescriptions[i];
+        if ((i == 0) || (metricDescriptions[i - 1].family != metric->family))
+        {
+            const TSKMetricFamilyDescription *family = &familyDescriptions[metric->family];
+            appendFormat(buffer, bufferSize, &length, "# TYPE %s %s\n# HELP %s %s\n",
+                         family->name, family->type, family->name, family->help);
+        }
+
+        if (i == TSKMetricCallbackQueueDepth)
+        {
+            // Gauges are decremented, so they are signed
+            appendFormat(buffer, bufferSize, &length, "%s %" PRId64 "\n", metric->name, (int64_t)snapshot->values[i]);
+        }
+        else
+        {
+            appendFormat(buffer, bufferSize, &length, "%s %" PRIu64 "\n", metric->name, snapshot->values[i]);
+        }
+    }
+    appendFormat(buffer, bufferSize, &length, "# EOF\n");
+    return length;
+}
@@ -0,0 +1,122 @@
+/*
+
+ metrics_registry.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_metrics_registry_h
+#define TrustKit_metrics_registry_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ Process-wide counters describing what TrustKit's pinning engine did, shared by all the TrustKit instances.
+
+ Counters are relaxed atomics, each on its own cache line, so updating them from the validation threads
+ does not take any lock. Recording is disabled until TSKMetricsSetEnabled() is called, and then only costs
+ the load of a flag; building with TSK_METRICS_DISABLED defined to 1 removes the recording altogether.
+ */
+
+typedef enum
+{
+    // Evaluations by final trust decision
+    TSKMetricEvaluationsAllowed,
+    TSKMetricEvaluationsBlocked,
+    TSKMetricEvaluationsNotPinned,
+
+    // Evaluations of pinned domains by result
+    TSKMetricEvaluationResultSuccess,
+    TSKMetricEvaluationResultNoMatchingPin,
+    TSKMetricEvaluationResultInvalidCertificateChain,
+    TSKMetricEvaluationResultInvalidParameters,
+    TSKMetricEvaluationResultUserDefinedTrustAnchor,
+    TSKMetricEvaluationResultCouldNotGenerateSpkiHash,
+
+    // Pins checks, and evaluations that waited for an identical check running on another thread
+    TSKMetricPinValidations,
+    TSKMetricCoalescedPinValidations,
+
+    TSKMetricTrustDecisionCacheHits,
+    TSKMetricTrustDecisionCacheMisses,
+    TSKMetricTrustDecisionCacheEvictions,
+
+    TSKMetricSPKICacheHits,
+    TSKMetricSPKICacheMisses,
+    TSKMetricSPKICachePersistedBytes,
+
+    TSKMetricRegistryLookups,
+
+    TSKMetricReportsGenerated,
+    TSKMetricReportsRateLimited,
+    TSKMetricReportsUploaded,
+    TSKMetricReportUploadFailures,
+
+    // Gauge: validation results waiting to be delivered on the validation callback queue
+    TSKMetricCallbackQueueDepth,
+
+    TSKMetricCount,
+} TSKMetric;
+
+typedef struct
+{
+    uint64_t values[TSKMetricCount];
+} TSKMetricsSnapshot;
+
+
+#if TSK_METRICS_DISABLED
+
+static inline void TSKMetricsSetEnabled(bool enabled) { (void)enabled; }
+static inline bool TSKMetricsIsEnabled(void) { return false; }
+static inline bool TSKMetricsAdd(TSKMetric metric, uint64_t value) { (void)metric; (void)value; return false; }
+static inline void TSKMetricsSubtract(TSKMetric metric, uint64_t value) { (void)metric; (void)value; }
+
+#else
+
+// Start or stop recording; the values recorded so far are kept
+void TSKMetricsSetEnabled(bool enabled);
+
+bool TSKMetricsIsEnabled(void);
+
+// Return false if recording is disabled and nothing was added; a gauge must only be decremented when its
+// increment was recorded, so that it does not underflow when recording gets enabled in between
+bool TSKMetricsAdd(TSKMetric metric, uint64_t value);
+
+void TSKMetricsSubtract(TSKMetric metric, uint64_t value);
+
+#endif
+
+#define TSKMetricsIncrement(metric) TSKMetricsAdd((metric), 1)
+
+
+// Read all the counters; they are read one by one, so the snapshot may include an update of some
+// counters and not of others when it is taken while they are being updated
+void TSKMetricsGetSnapshot(TSKMetricsSnapshot *snapshot);
+
+void TSKMetricsReset(void);
+
+// The name of the metric's sample in the OpenMetrics exposition, including its labels
+const char *TSKMetricGetName(TSKMetric metric);
+
+
+// OpenMetrics
+
+// Render the snapshot in the OpenMetrics text format, terminated by "# EOF"; like snprintf(), the output is
+// truncated to the supplied size and the return value is the length of the whole text
+size_t TSKMetricsRenderOpenMetrics(const TSKMetricsSnapshot *snapshot, char *buffer, size_t bufferSize);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* TrustKit_metrics_registry_h */
@@ -14,6 +14,7 @@
 #import "parse_configuration.h"
 #import <CommonCrypto/CommonDigest.h>
 #import "configuration_utils.h"
+#import "Pinning/base64_codec.h"
 
 
 NSDictionary *parseTrustKitConfiguration(NSDictionary *trustKitArguments)
@@ -58,6 +59,23 @@ NSDictionary *parseTrustKitConfiguration(NSDictionary *trustKitArguments)
     }
 #endif
     
+    // Extract the optional trust decision cache time to live
+    NSNumber *trustDecisionCacheTimeToLive = trustKitArguments[kTSKTrustDecisionCacheTimeToLive];
+    if (trustDecisionCacheTimeToLive == nil)
+    {
+        // Default setting is 0, which disables the cache
+        finalConfiguration[kTSKTrustDecisionCacheTimeToLive] = @(0);
+    }
+    else if (![trustDecisionCacheTimeToLive isKindOfClass:[NSNumber class]] || ([trustDecisionCacheTimeToLive doubleValue] < 0))
+    {
+        [NSException raise:@"TrustKit configuration invalid"
+                    format:@"TrustKit was initialized with an invalid value for %@", kTSKTrustDecisionCacheTimeToLive];
+    }
+    else
+    {
+        finalConfiguration[kTSKTrustDecisionCacheTimeToLive] = trustDecisionCacheTimeToLive;
+    }
+    
     // Retrieve the pinning policy for each domains
     if ((trustKitArguments[kTSKPinnedDomains] == nil) || ([trustKitArguments[kTSKPinnedDomains] count] < 1))
     {
@@ -191,16 +209,25 @@ NSDictionary *parseTrustKitConfiguration(NSDictionary *trustKitArguments)
         NSMutableSet<NSData *> *serverSslPinsSet = [NSMutableSet set];
         
         for (NSString *pinnedKeyHashBase64 in serverSslPinsBase64) {
-            NSData *pinnedKeyHash = [[NSData alloc] initWithBase64EncodedString:pinnedKeyHashBase64 options:(NSDataBase64DecodingOptions)0];
+            // The 44 characters of a SHA-256 pin decode to at most 33 bytes; longer pins are rejected without being decoded
+            const char *pinnedKeyHashChars = [pinnedKeyHashBase64 UTF8String];
+            size_t pinnedKeyHashCharsLength = strlen(pinnedKeyHashChars);
+            uint8_t pinnedKeyHashBytes[CC_SHA256_DIGEST_LENGTH + 1];
+            size_t pinnedKeyHashLength = 0;
+            if ((TSKBase64DecodedMaxLength(pinnedKeyHashCharsLength) > sizeof(pinnedKeyHashBytes))
+                || !TSKBase64Decode(pinnedKeyHashChars, pinnedKeyHashCharsLength, pinnedKeyHashBytes, &pinnedKeyHashLength))
+            {
+                pinnedKeyHashLength = 0;
+            }
             
-            if ([pinnedKeyHash length] != CC_SHA256_DIGEST_LENGTH)
+            if (pinnedKeyHashLength != CC_SHA256_DIGEST_LENGTH)
             {
                 // The subject public key info hash doesn't have a valid size
                 [NSException raise:@"TrustKit configuration invalid"
                             format:@"TrustKit was initialized with an invalid Pin %@ for domain %@", pinnedKeyHashBase64, domainName];
             }
             
-            [serverSslPinsSet addObject:pinnedKeyHash];
+            [serverSslPinsSet addObject:[NSData dataWithBytes:pinnedKeyHashBytes length:pinnedKeyHashLength]];
         }
         
         
@@ -0,0 +1,43 @@
+/*
+
+ TSKLogLevel.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ The severity of TrustKit's log messages; each level includes the levels above it.
+ */
+typedef NS_ENUM(NSInteger, TSKLogLevel)
+{
+    /**
+     No message.
+     */
+    TSKLogLevelNone,
+
+    /**
+     Failures that prevent TrustKit from working as configured, such as a pin that could not be computed.
+     */
+    TSKLogLevelError,
+
+    /**
+     Pinning failures and conditions that may be unexpected.
+     */
+    TSKLogLevelWarning,
+
+    /**
+     Initialization, configuration and reporting events.
+     */
+    TSKLogLevelInfo,
+
+    /**
+     Details of each pinning validation; these are logged on the connections' hot path.
+     */
+    TSKLogLevelDebug,
+};
@@ -10,6 +10,7 @@
  */
 
 #import <TrustKit/TSKTrustDecision.h>
+#import <TrustKit/TSKValidationLatency.h>
 #import <Foundation/Foundation.h>
 
 @class TSKPinningValidatorResult;
@@ -66,6 +67,28 @@
                                            NSURLCredential * _Nullable credential))completionHandler;
 
 
+/**
+ Asynchronous version of `handleChallenge:completionHandler:`, which returns without waiting for the server's
+ certificate chain to be evaluated, so that the delegate queue (often the App's main operation queue) is not
+ blocked while it is.
+ 
+ The evaluation runs on a pool of TrustKit worker threads, at the quality of service of the calling thread.
+ The pool is bounded: when too many evaluations are already pending, the challenge is evaluated on the
+ calling thread instead, before this method returns.
+ 
+ @param challenge The authentication challenge, supplied by the URL loading system to the delegate's challenge handler method.
+ 
+ @param completionHandler A block to invoke to respond to the challenge, supplied by the URL loading system to the delegate's challenge handler method. It may be invoked on any thread.
+ 
+ @return `YES` if the challenge will be handled and the `completionHandler` will be invoked. `NO` if the challenge could not be handled because it was not for server certificate validation, in which case the `completionHandler` is not invoked.
+ 
+ @exception NSException Thrown when TrustKit has not been initialized with a pinning policy.
+ */
+- (BOOL)handleChallengeAsynchronously:(NSURLAuthenticationChallenge * _Nonnull)challenge
+                    completionHandler:(void (^ _Nonnull)(NSURLSessionAuthChallengeDisposition disposition,
+                                                         NSURLCredential * _Nullable credential))completionHandler;
+
+
 #pragma mark Low-level Validation Method
 
 /**
@@ -88,5 +111,39 @@
 - (TSKTrustDecision)evaluateTrust:(SecTrustRef _Nonnull)serverTrust forHostname:(NSString * _Nonnull)serverHostname;
 
 
+/**
+ Asynchronous version of `evaluateTrust:forHostname:`, which evaluates the server trust on a pool of TrustKit
+ worker threads, at the quality of service of the calling thread.
+ 
+ The pool is bounded: when too many evaluations are already pending, the server trust is evaluated on the
+ calling thread instead, and the `completionHandler` is invoked before this method returns.
+ 
+ @param serverTrust The trust object representing the server's certificate chain; it is retained until the evaluation completes.
+ 
+ @param serverHostname The hostname of the server whose identity is being validated.
+ 
+ @param completionHandler The block invoked with the `TSKTrustDecision`, on any thread.
+ 
+ @warning As with `evaluateTrust:forHostname:`, `TSKTrustDecisionDomainNotPinned` means that the server's _serverTrust_ object __must__ be verified against the device's trust store.
+ */
+- (void)evaluateTrust:(SecTrustRef _Nonnull)serverTrust
+          forHostname:(NSString * _Nonnull)serverHostname
+    completionHandler:(void (^ _Nonnull)(TSKTrustDecision trustDecision))completionHandler;
+
+
+#pragma mark Instrumentation
+
+/**
+ Retrieve the distribution of the durations of each phase of the pinning validations performed so far by this
+ validator, for example to track the p99 of the validations in production.
+ 
+ Durations are measured with a monotonic clock and recorded without taking any lock, so the instrumentation is
+ always enabled. Only the validations of domains that have a pinning policy are measured, and a phase is only
+ recorded when it was performed: for example, a validation served from the trust decision cache does not record
+ an evaluation of the certificate chain.
+ 
+ @return A snapshot for each phase that was recorded at least once.
+ */
+- (NSDictionary<TSKValidationPhase, TSKValidationLatencySnapshot *> * _Nonnull)validationLatencySnapshots;
 
 @end
@@ -10,6 +10,7 @@
  */
 
 #import <TrustKit/TSKTrustDecision.h>
+#import <TrustKit/TSKValidationLatency.h>
 #import <Foundation/Foundation.h>
 
 /**
@@ -45,6 +46,12 @@
  */
 @property (nonatomic, readonly) NSTimeInterval validationDuration;
 
+/**
+ The time spent in each phase of the validation. Phases that were not performed for this connection,
+ for example because the chain was already being validated on another thread, are missing.
+ */
+@property (nonatomic, readonly, nonnull) NSDictionary<TSKValidationPhase, NSNumber *> *phaseDurations;
+
 /**
  The certificate chain sent by the server when establishing the connection as PEM-formatted certificates. 
  */
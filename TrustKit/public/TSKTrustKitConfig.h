@@ -90,6 +90,19 @@ FOUNDATION_EXPORT const TSKGlobalConfigurationKey kTSKPinnedDomains;
 FOUNDATION_EXPORT const TSKGlobalConfigurationKey kTSKIgnorePinningForUserDefinedTrustAnchors NS_AVAILABLE_MAC(10_9);
 
 
+/**
+ A number of seconds. If set, successful pinning validations are cached for this long, so that connecting
+ again to the same server with the same certificate chain returns the previous trust decision without
+ evaluating the chain and matching its pins again; default value is `0`, which disables the cache.
+
+ A validation is never cached for longer than the domain's `kTSKExpirationDate`, failed validations are
+ never cached, and the cache is discarded with the configuration it was created for. As the certificate
+ chain is not evaluated again while it is cached, a certificate that gets revoked or that expires during
+ that time is still trusted, so the value should be kept short (such as a few minutes).
+ */
+FOUNDATION_EXPORT const TSKGlobalConfigurationKey kTSKTrustDecisionCacheTimeToLive;
+
+
 #pragma mark Domain-Specific Configuration Keys - Required
 
 /**
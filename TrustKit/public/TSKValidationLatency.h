@@ -0,0 +1,80 @@
+/*
+
+ TSKValidationLatency.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#import <Foundation/Foundation.h>
+
+NS_ASSUME_NONNULL_BEGIN
+
+/**
+ The phases of a pinning validation whose duration is measured by the `TSKPinningValidator`.
+ */
+typedef NSString *TSKValidationPhase NS_STRING_ENUM;
+
+/**
+ Finding the pinning policy that applies to the server's hostname.
+ */
+FOUNDATION_EXPORT const TSKValidationPhase kTSKValidationPhasePolicyLookup;
+
+/**
+ Computing the digest of the certificate chain, and looking up and storing the result in the trust
+ decision cache. Only measured when `kTSKTrustDecisionCacheTimeToLive` is set.
+ */
+FOUNDATION_EXPORT const TSKValidationPhase kTSKValidationPhaseDecisionCache;
+
+/**
+ Evaluating the certificate chain with the default SSL validation, before its pins get checked.
+ */
+FOUNDATION_EXPORT const TSKValidationPhase kTSKValidationPhaseChainEvaluation;
+
+/**
+ Generating or retrieving from the cache the hashes of the Subject Public Key Info of the certificates.
+ */
+FOUNDATION_EXPORT const TSKValidationPhase kTSKValidationPhaseSPKIHashing;
+
+/**
+ Looking for the hashes in the set of pins configured for the domain.
+ */
+FOUNDATION_EXPORT const TSKValidationPhase kTSKValidationPhasePinMatching;
+
+/**
+ The whole validation, including the phases above.
+ */
+FOUNDATION_EXPORT const TSKValidationPhase kTSKValidationPhaseTotal;
+
+
+/**
+ A `TSKValidationLatencySnapshot` describes the distribution of the durations of one phase of the
+ pinning validations performed by a `TSKPinningValidator`, as of when the snapshot was taken.
+
+ Durations are recorded in buckets that are about 3% wide, so the percentiles are approximate.
+ */
+@interface TSKValidationLatencySnapshot : NSObject
+
+/**
+ The number of durations that were recorded.
+ */
+@property (nonatomic, readonly) NSUInteger count;
+
+@property (nonatomic, readonly) NSTimeInterval minimumDuration;
+@property (nonatomic, readonly) NSTimeInterval maximumDuration;
+@property (nonatomic, readonly) NSTimeInterval meanDuration;
+
+/**
+ The duration that the supplied percentage of the recorded durations did not exceed.
+
+ @param percentile The percentile, between 0 and 100; for example 99 for the p99
+ @return The duration at the percentile, or 0 if nothing was recorded.
+ */
+- (NSTimeInterval)durationAtPercentile:(double)percentile;
+
+@end
+
+NS_ASSUME_NONNULL_END
@@ -18,6 +18,8 @@
     #import <TrustKit/TSKPinningValidatorCallback.h>
     #import <TrustKit/TSKPinningValidator.h>
     #import <TrustKit/TSKTrustDecision.h>
+    #import <TrustKit/TSKValidationLatency.h>
+    #import <TrustKit/TSKLogLevel.h>
 #endif /* _TRUSTKIT_ */
 
 NS_ASSUME_NONNULL_BEGIN
@@ -214,5 +216,62 @@ NS_ASSUME_NONNULL_BEGIN
  */
 + (void)setLoggerBlock:(void (^)(NSString *))block;
 
+
+/**
+ Set the most verbose level of the messages passed to the global logger; the default is `TSKLogLevelDebug`, which
+ passes all the messages.
+ 
+ The messages of the levels that are not passed to the logger are not formatted, and the values they would
+ include are not computed. `TSKLogLevelDebug` messages are logged for every pinning validation; lowering the level to
+ `TSKLogLevelInfo` or below removes the cost of logging from the validations while a logger is set.
+ */
++ (void)setLogLevel:(TSKLogLevel)level;
+
+
+/**
+ Record TrustKit's log events up to the supplied level in an in-memory ring buffer; recording is disabled by default.
+ 
+ Unlike the messages passed to the global logger, the recorded events are not formatted: only the time, the level
+ and which message was logged are recorded, without taking any lock, which makes it cheap enough to keep enabled in
+ release builds. The buffer keeps the 1024 most recent events. Recording is disabled by setting the level to
+ `TSKLogLevelNone`; the events recorded so far are kept.
+ */
++ (void)setLogEventRecordingLevel:(TSKLogLevel)level;
+
+
+/**
+ Retrieve the log events recorded since `+setLogEventRecordingLevel:` was first called, oldest first.
+ 
+ Each event is described as its time in seconds from an arbitrary point, its level, and the unformatted message
+ that was logged; for example: `1532.004187 Debug: Pin validation succeeded for %@`.
+ */
++ (NSArray<NSString *> *)recordedLogEvents;
+
+
+#pragma mark Metrics
+
+/**
+ Enable or disable the recording of TrustKit's metrics; they are disabled by default.
+ 
+ The metrics are process-wide counters of what all the TrustKit instances did: evaluations by trust decision and by
+ result, SPKI and trust decision cache hits, misses and evictions, public suffix registry lookups, pin failure reports
+ generated, rate-limited and uploaded, and the number of validation results waiting on the validation callback queue.
+ Recording them does not take any lock, and does nothing but check a flag while they are disabled. Disabling them
+ keeps the values recorded so far.
+ */
++ (void)setMetricsEnabled:(BOOL)enabled;
+
+/**
+ Retrieve the current value of each metric, keyed by the name of its sample in the OpenMetrics exposition,
+ for example `trustkit_evaluations_total{decision="block"}`.
+ */
++ (NSDictionary<NSString *, NSNumber *> *)metricsSnapshot;
+
+/**
+ Render the current value of each metric in the OpenMetrics text format, for example to be served to a Prometheus
+ scraper or attached to a diagnostics report.
+ */
++ (NSString *)metricsInOpenMetricsFormat;
+
 @end
 NS_ASSUME_NONNULL_END
@@ -0,0 +1,258 @@
+/*
+
+ apple_trust_backend.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "apple_trust_backend.h"
+
+#include <stdexcept>
+
+#include <Security/Security.h>
+
+namespace trustkit {
+
+namespace {
+
+// Releases a Core Foundation object when going out of scope
+template <typename T>
+class ScopedCFRef
+{
+public:
+    explicit ScopedCFRef(T reference = nullptr) : _reference(reference) {}
+    ~ScopedCFRef()
+    {
+        if (_reference != nullptr)
+        {
+            CFRelease(_reference);
+        }
+    }
+    ScopedCFRef(const ScopedCFRef &) = delete;
+    ScopedCFRef &operator=(const ScopedCFRef &) = delete;
+
+    T get() const { return _reference; }
+    T *addressOf() { return &_reference; }
+    explicit operator bool() const { return _reference != nullptr; }
+
+private:
+    T _reference;
+};
+
+SecCertificateRef createCertificate(const std::vector<uint8_t> &certificate)
+{
+    ScopedCFRef<CFDataRef> data(CFDataCreate(kCFAllocatorDefault, certificate.data(), static_cast<CFIndex>(certificate.size())));
+    if (!data)
+    {
+        return nullptr;
+    }
+    return SecCertificateCreateWithData(kCFAllocatorDefault, data.get());
+}
+
+// Convert DER-encoded certificates to an array of SecCertificateRef, or return null if one cannot be parsed
+CFArrayRef createCertificateArray(const CertificateChain &certificates)
+{
+    CFMutableArrayRef certificateArray = CFArrayCreateMutable(kCFAllocatorDefault, static_cast<CFIndex>(certificates.size()), &kCFTypeArrayCallBacks);
+    for (const std::vector<uint8_t> &certificate : certificates)
+    {
+        ScopedCFRef<SecCertificateRef> parsedCertificate(createCertificate(certificate));
+        if (!parsedCertificate)
+        {
+            CFRelease(certificateArray);
+            return nullptr;
+        }
+        CFArrayAppendValue(certificateArray, parsedCertificate.get());
+    }
+    return certificateArray;
+}
+
+std::vector<uint8_t> copyCertificateData(SecCertificateRef certificate)
+{
+    ScopedCFRef<CFDataRef> data(SecCertificateCopyData(certificate));
+    if (!data)
+    {
+        return {};
+    }
+    const uint8_t *bytes = CFDataGetBytePtr(data.get());
+    return std::vector<uint8_t>(bytes, bytes + CFDataGetLength(data.get()));
+}
+
+CertificateChain copyCertificateChain(SecTrustRef trust)
+{
+    CertificateChain chain;
+    if (__builtin_available(macOS 12.0, iOS 15.0, tvOS 15.0, watchOS 8.0, *))
+    {
+        ScopedCFRef<CFArrayRef> certificates(SecTrustCopyCertificateChain(trust));
+        CFIndex certificateCount = certificates ? CFArrayGetCount(certificates.get()) : 0;
+        for (CFIndex i = 0; i < certificateCount; i++)
+        {
+            chain.push_back(copyCertificateData((SecCertificateRef)CFArrayGetValueAtIndex(certificates.get(), i)));
+        }
+    }
+    else
+    {
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+        CFIndex certificateCount = SecTrustGetCertificateCount(trust);
+        for (CFIndex i = 0; i < certificateCount; i++)
+        {
+            chain.push_back(copyCertificateData(SecTrustGetCertificateAtIndex(trust, i)));
+        }
+#pragma clang diagnostic pop
+    }
+    return chain;
+}
+
+bool evaluateTrust(SecTrustRef trust, std::string *errorDescription)
+{
+    if (__builtin_available(macOS 10.14, iOS 12.0, tvOS 12.0, watchOS 5.0, *))
+    {
+        CFErrorRef error = nullptr;
+        bool isTrusted = SecTrustEvaluateWithError(trust, &error);
+        if (error != nullptr)
+        {
+            ScopedCFRef<CFStringRef> description(CFErrorCopyDescription(error));
+            char buffer[256];
+            if (description && CFStringGetCString(description.get(), buffer, sizeof(buffer), kCFStringEncodingUTF8))
+            {
+                *errorDescription = buffer;
+            }
+            CFRelease(error);
+        }
+        return isTrusted;
+    }
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+    SecTrustResultType trustResult = kSecTrustResultInvalid;
+    OSStatus status = SecTrustEvaluate(trust, &trustResult);
+#pragma clang diagnostic pop
+    if ((status != errSecSuccess) || ((trustResult != kSecTrustResultUnspecified) && (trustResult != kSecTrustResultProceed)))
+    {
+        *errorDescription = "SecTrustEvaluate() failed";
+        return false;
+    }
+    return true;
+}
+
+ChainEvaluation untrustedChain(const char *errorDescription)
+{
+    ChainEvaluation evaluation;
+    evaluation.errorDescription = errorDescription;
+    return evaluation;
+}
+
+} // namespace
+
+
+AppleTrustBackend::~AppleTrustBackend()
+{
+    if (_anchorCertificates != nullptr)
+    {
+        CFRelease(_anchorCertificates);
+    }
+}
+
+
+void AppleTrustBackend::setTrustAnchors(const CertificateChain &anchors)
+{
+    CFArrayRef anchorCertificates = createCertificateArray(anchors);
+    if (anchorCertificates == nullptr)
+    {
+        throw std::invalid_argument("Invalid trust anchor certificate");
+    }
+    if (_anchorCertificates != nullptr)
+    {
+        CFRelease(_anchorCertificates);
+    }
+    _anchorCertificates = anchorCertificates;
+}
+
+
+ChainEvaluation AppleTrustBackend::evaluateChain(const CertificateChain &serverChain, const std::string &hostname)
+{
+    if (serverChain.empty() || hostname.empty())
+    {
+        return untrustedChain("No certificate or hostname");
+    }
+
+    ScopedCFRef<CFArrayRef> certificates(createCertificateArray(serverChain));
+    if (!certificates)
+    {
+        return untrustedChain("Could not parse a certificate");
+    }
+    ScopedCFRef<CFStringRef> serverHostname(CFStringCreateWithBytes(kCFAllocatorDefault,
+                                                                    reinterpret_cast<const UInt8 *>(hostname.data()),
+                                                                    static_cast<CFIndex>(hostname.size()),
+                                                                    kCFStringEncodingUTF8, false));
+    if (!serverHostname)
+    {
+        return untrustedChain("Invalid hostname");
+    }
+
+    // A sane SSL policy forces hostname validation
+    ScopedCFRef<SecPolicyRef> policy(SecPolicyCreateSSL(true, serverHostname.get()));
+    ScopedCFRef<SecTrustRef> trust;
+    if (!policy || (SecTrustCreateWithCertificates(certificates.get(), policy.get(), trust.addressOf()) != errSecSuccess))
+    {
+        return untrustedChain("Could not create the trust object");
+    }
+    if (_anchorCertificates != nullptr)
+    {
+        SecTrustSetAnchorCertificates(trust.get(), _anchorCertificates);
+        SecTrustSetAnchorCertificatesOnly(trust.get(), true);
+    }
+    if (_verificationTime)
+    {
+        ScopedCFRef<CFDateRef> verifyDate(CFDateCreate(kCFAllocatorDefault, static_cast<CFAbsoluteTime>(*_verificationTime) - kCFAbsoluteTimeIntervalSince1970));
+        SecTrustSetVerifyDate(trust.get(), verifyDate.get());
+    }
+
+    ChainEvaluation evaluation;
+    evaluation.isTrusted = evaluateTrust(trust.get(), &evaluation.errorDescription);
+    if (evaluation.isTrusted)
+    {
+        evaluation.verifiedChain = copyCertificateChain(trust.get());
+    }
+    return evaluation;
+}
+
+
+#if TARGET_OS_OSX
+bool AppleTrustBackend::containsUserDefinedTrustAnchor(const CertificateChain &verifiedChain)
+{
+    // Retrieve the OS X host's list of user-defined CA certificates
+    ScopedCFRef<CFMutableArrayRef> customRootCertificates(CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks));
+    const SecTrustSettingsDomain domains[] = { kSecTrustSettingsDomainUser, kSecTrustSettingsDomainAdmin };
+    for (SecTrustSettingsDomain domain : domains)
+    {
+        CFArrayRef rootCertificates = nullptr;
+        if (SecTrustSettingsCopyCertificates(domain, &rootCertificates) == errSecSuccess)
+        {
+            CFArrayAppendArray(customRootCertificates.get(), rootCertificates, CFRangeMake(0, CFArrayGetCount(rootCertificates)));
+            CFRelease(rootCertificates);
+        }
+    }
+    CFIndex customRootCertificateCount = CFArrayGetCount(customRootCertificates.get());
+    if (customRootCertificateCount == 0)
+    {
+        return false;
+    }
+
+    // Is any certificate in the chain a custom anchor that was manually added to the OS' trust store?
+    for (const std::vector<uint8_t> &certificate : verifiedChain)
+    {
+        ScopedCFRef<SecCertificateRef> parsedCertificate(createCertificate(certificate));
+        if (parsedCertificate && CFArrayContainsValue(customRootCertificates.get(), CFRangeMake(0, customRootCertificateCount), parsedCertificate.get()))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+#endif
+
+} // namespace trustkit
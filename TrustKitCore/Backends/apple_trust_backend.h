@@ -0,0 +1,58 @@
+/*
+
+ apple_trust_backend.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_apple_trust_backend_h
+#define TrustKit_apple_trust_backend_h
+
+#include "../trust_backend.h"
+
+#include <ctime>
+#include <optional>
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <TargetConditionals.h>
+
+namespace trustkit {
+
+// Validates chains with Security.framework and an SSL policy for the hostname, like the Objective-C validator does
+class AppleTrustBackend : public TrustBackend
+{
+public:
+    // Use the system's trust store
+    AppleTrustBackend() = default;
+
+    ~AppleTrustBackend() override;
+
+    AppleTrustBackend(const AppleTrustBackend &) = delete;
+    AppleTrustBackend &operator=(const AppleTrustBackend &) = delete;
+
+    // Only trust the supplied DER-encoded certificates instead of the system's trust store; throw
+    // std::invalid_argument if one cannot be parsed. This must be set before the backend is used from multiple threads
+    void setTrustAnchors(const CertificateChain &anchors);
+
+    // Validate the chains as of the supplied time instead of the current time; this must be set before the backend
+    // is used from multiple threads
+    void setVerificationTime(std::time_t verificationTime) { _verificationTime = verificationTime; }
+
+    ChainEvaluation evaluateChain(const CertificateChain &serverChain, const std::string &hostname) override;
+
+#if TARGET_OS_OSX
+    bool containsUserDefinedTrustAnchor(const CertificateChain &verifiedChain) override;
+#endif
+
+private:
+    CFArrayRef _anchorCertificates = nullptr;
+    std::optional<std::time_t> _verificationTime;
+};
+
+} // namespace trustkit
+
+#endif /* TrustKit_apple_trust_backend_h */
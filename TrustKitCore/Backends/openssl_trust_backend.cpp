@@ -0,0 +1,175 @@
+/*
+
+ openssl_trust_backend.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "openssl_trust_backend.h"
+
+#include <memory>
+#include <new>
+#include <stdexcept>
+
+#include <openssl/x509.h>
+#include <openssl/x509_vfy.h>
+#include <openssl/x509v3.h>
+
+namespace trustkit {
+
+namespace {
+
+struct X509Deleter
+{
+    void operator()(X509 *certificate) const { X509_free(certificate); }
+};
+
+struct X509StackDeleter
+{
+    void operator()(STACK_OF(X509) *certificates) const { sk_X509_pop_free(certificates, X509_free); }
+};
+
+struct X509StoreContextDeleter
+{
+    void operator()(X509_STORE_CTX *context) const { X509_STORE_CTX_free(context); }
+};
+
+using X509Pointer = std::unique_ptr<X509, X509Deleter>;
+using X509StackPointer = std::unique_ptr<STACK_OF(X509), X509StackDeleter>;
+
+X509Pointer parseCertificate(const std::vector<uint8_t> &certificate)
+{
+    const unsigned char *bytes = certificate.data();
+    X509Pointer parsedCertificate(d2i_X509(nullptr, &bytes, static_cast<long>(certificate.size())));
+    if (parsedCertificate && (bytes != certificate.data() + certificate.size()))
+    {
+        // Trailing data after the certificate
+        parsedCertificate.reset();
+    }
+    return parsedCertificate;
+}
+
+ChainEvaluation untrustedChain(const char *errorDescription)
+{
+    ChainEvaluation evaluation;
+    evaluation.errorDescription = errorDescription;
+    return evaluation;
+}
+
+} // namespace
+
+
+OpenSSLTrustBackend::OpenSSLTrustBackend()
+    : _store(X509_STORE_new())
+{
+    if (_store == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    X509_STORE_set_default_paths(_store);
+}
+
+OpenSSLTrustBackend::OpenSSLTrustBackend(X509_STORE *store)
+    : _store(store)
+{
+    if ((_store == nullptr) || (X509_STORE_up_ref(_store) != 1))
+    {
+        throw std::invalid_argument("Invalid X509_STORE");
+    }
+}
+
+OpenSSLTrustBackend::~OpenSSLTrustBackend()
+{
+    X509_STORE_free(_store);
+}
+
+
+void OpenSSLTrustBackend::addTrustAnchor(const std::vector<uint8_t> &certificate)
+{
+    X509Pointer anchor = parseCertificate(certificate);
+    if (!anchor || (X509_STORE_add_cert(_store, anchor.get()) != 1))
+    {
+        throw std::invalid_argument("Invalid trust anchor certificate");
+    }
+}
+
+
+ChainEvaluation OpenSSLTrustBackend::evaluateChain(const CertificateChain &serverChain, const std::string &hostname)
+{
+    if (serverChain.empty() || hostname.empty())
+    {
+        return untrustedChain("No certificate or hostname");
+    }
+
+    X509Pointer leafCertificate = parseCertificate(serverChain.front());
+    X509StackPointer intermediateCertificates(sk_X509_new_null());
+    if (!leafCertificate || !intermediateCertificates)
+    {
+        return untrustedChain("Could not parse the leaf certificate");
+    }
+    for (size_t i = 1; i < serverChain.size(); i++)
+    {
+        X509Pointer certificate = parseCertificate(serverChain[i]);
+        if (!certificate || !sk_X509_push(intermediateCertificates.get(), certificate.get()))
+        {
+            return untrustedChain("Could not parse an intermediate certificate");
+        }
+        certificate.release();
+    }
+
+    std::unique_ptr<X509_STORE_CTX, X509StoreContextDeleter> context(X509_STORE_CTX_new());
+    if (!context || (X509_STORE_CTX_init(context.get(), _store, leafCertificate.get(), intermediateCertificates.get()) != 1))
+    {
+        return untrustedChain("Could not initialize the verification");
+    }
+    X509_STORE_CTX_set_purpose(context.get(), X509_PURPOSE_SSL_SERVER);
+    X509_VERIFY_PARAM *parameters = X509_STORE_CTX_get0_param(context.get());
+    // Servers are identified by IP address when the hostname is one
+    // Without a hostname to check, any valid chain would be trusted, so a hostname that cannot be set (one with a NUL
+    // byte for instance) makes the chain untrusted
+    if ((X509_VERIFY_PARAM_set1_ip_asc(parameters, hostname.c_str()) != 1) &&
+        (X509_VERIFY_PARAM_set1_host(parameters, hostname.c_str(), hostname.size()) != 1))
+    {
+        return untrustedChain("Invalid hostname");
+    }
+    if (_verificationTime)
+    {
+        X509_STORE_CTX_set_time(context.get(), 0, *_verificationTime);
+    }
+
+    ChainEvaluation evaluation;
+    if (X509_verify_cert(context.get()) != 1)
+    {
+        evaluation.errorDescription = X509_verify_cert_error_string(X509_STORE_CTX_get_error(context.get()));
+        return evaluation;
+    }
+
+    X509StackPointer verifiedChain(X509_STORE_CTX_get1_chain(context.get()));
+    if (!verifiedChain)
+    {
+        return untrustedChain("Could not retrieve the verified chain");
+    }
+    int certificateCount = sk_X509_num(verifiedChain.get());
+    evaluation.verifiedChain.reserve(static_cast<size_t>(certificateCount));
+    for (int i = 0; i < certificateCount; i++)
+    {
+        X509 *certificate = sk_X509_value(verifiedChain.get(), i);
+        int length = i2d_X509(certificate, nullptr);
+        if (length <= 0)
+        {
+            return untrustedChain("Could not encode the verified chain");
+        }
+        std::vector<uint8_t> encodedCertificate(static_cast<size_t>(length));
+        unsigned char *bytes = encodedCertificate.data();
+        i2d_X509(certificate, &bytes);
+        evaluation.verifiedChain.push_back(std::move(encodedCertificate));
+    }
+    evaluation.isTrusted = true;
+    return evaluation;
+}
+
+} // namespace trustkit
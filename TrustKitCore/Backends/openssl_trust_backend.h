@@ -0,0 +1,59 @@
+/*
+
+ openssl_trust_backend.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_openssl_trust_backend_h
+#define TrustKit_openssl_trust_backend_h
+
+#include "../trust_backend.h"
+
+#include <ctime>
+#include <optional>
+#include <vector>
+
+#include <openssl/ossl_typ.h>
+
+namespace trustkit {
+
+// Validates chains with OpenSSL against an X509_STORE, with the checks of a TLS client: the chain must be valid for
+// server authentication and the leaf certificate must match the hostname (or the IP address)
+class OpenSSLTrustBackend : public TrustBackend
+{
+public:
+    // Use the system's trust store, from OpenSSL's default locations
+    OpenSSLTrustBackend();
+
+    // Use the supplied trust store, which gets retained
+    explicit OpenSSLTrustBackend(X509_STORE *store);
+
+    ~OpenSSLTrustBackend() override;
+
+    OpenSSLTrustBackend(const OpenSSLTrustBackend &) = delete;
+    OpenSSLTrustBackend &operator=(const OpenSSLTrustBackend &) = delete;
+
+    // Trust an additional DER-encoded certificate; throw std::invalid_argument if it cannot be parsed
+    void addTrustAnchor(const std::vector<uint8_t> &certificate);
+
+    // Validate the chains as of the supplied time instead of the current time; this must be set before the backend
+    // is used from multiple threads
+    void setVerificationTime(std::time_t verificationTime) { _verificationTime = verificationTime; }
+
+    X509_STORE *store() const { return _store; }
+
+    ChainEvaluation evaluateChain(const CertificateChain &serverChain, const std::string &hostname) override;
+
+private:
+    X509_STORE *_store = nullptr;
+    std::optional<std::time_t> _verificationTime;
+};
+
+} // namespace trustkit
+
+#endif /* TrustKit_openssl_trust_backend_h */
@@ -0,0 +1,87 @@
+/*
+
+ curl_pinning.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "curl_pinning.h"
+
+#include <openssl/ssl.h>
+
+#include <exception>
+
+namespace trustkit {
+
+CurlPinning::CurlPinning(std::shared_ptr<const PinningPolicy> pinningPolicy,
+                         FailureReportCallback failureReportCallback,
+                         size_t maxPendingReportCount)
+    : _verifier(std::move(pinningPolicy))
+{
+    if (!failureReportCallback)
+    {
+        return;
+    }
+
+    _reporter = std::make_unique<AsyncValidationReporter>(std::move(failureReportCallback), maxPendingReportCount);
+    AsyncValidationReporter *reporter = _reporter.get();
+    _verifier.setValidationCallback([reporter](const std::string &serverHostname, const ValidationResult &result) {
+        // Only the failures get reported, like with TrustKit's reporters
+        if (result.evaluationResult != TrustEvaluationResult::Success)
+        {
+            reporter->post(serverHostname, result);
+        }
+    });
+}
+
+
+CURLcode CurlPinning::attach(CURL *handle)
+{
+    CURLcode result = curl_easy_setopt(handle, CURLOPT_SSL_CTX_FUNCTION, sslContextCallback);
+    if (result == CURLE_OK)
+    {
+        result = curl_easy_setopt(handle, CURLOPT_SSL_CTX_DATA, this);
+    }
+    return result;
+}
+
+CURLMcode CurlPinning::addHandle(CURLM *multiHandle, CURL *handle)
+{
+    if (attach(handle) != CURLE_OK)
+    {
+        return CURLM_BAD_EASY_HANDLE;
+    }
+    return curl_multi_add_handle(multiHandle, handle);
+}
+
+
+void CurlPinning::flushReports()
+{
+    if (_reporter)
+    {
+        _reporter->flush();
+    }
+}
+
+
+CURLcode CurlPinning::sslContextCallback(CURL *handle, void *sslContext, void *curlPinning)
+{
+    (void)handle;
+    // Called for each new connection, with the SSL_CTX that libcurl configured for it; exceptions must not
+    // unwind through libcurl, and the connection must not proceed without the verifier
+    try
+    {
+        static_cast<CurlPinning *>(curlPinning)->_verifier.attach(static_cast<SSL_CTX *>(sslContext));
+    }
+    catch (const std::exception &)
+    {
+        return CURLE_SSL_CERTPROBLEM;
+    }
+    return CURLE_OK;
+}
+
+} // namespace trustkit
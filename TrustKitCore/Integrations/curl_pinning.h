@@ -0,0 +1,75 @@
+/*
+
+ curl_pinning.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_curl_pinning_h
+#define TrustKit_curl_pinning_h
+
+#include "../async_validation_reporter.h"
+#include "openssl_pinning_verifier.h"
+
+#include <memory>
+
+#include <curl/curl.h>
+
+namespace trustkit {
+
+// Enforces a pinning policy on the transfers of libcurl handles, unlike CURLOPT_PINNEDPUBLICKEY with multiple domains,
+// includeSubdomains, report-only and expiring policies, and failure reports. It uses CURLOPT_SSL_CTX_FUNCTION, so
+// libcurl must be built with OpenSSL. One instance can serve any number of handles, and transfers running at the same
+// time on different threads or on a curl_multi loop; it must outlive them.
+//
+// The chains are validated by OpenSSL, with libcurl's trust store, even if CURLOPT_SSL_VERIFYPEER is disabled;
+// libcurl then checks the hostname as usual. Resumed TLS sessions reuse the decision of the handshake that established
+// them, unless the pinning policy was replaced or the domain's policy expired in the meantime
+class CurlPinning
+{
+public:
+    // Called on a dedicated thread for each failed pin validation, including the ones that did not block the
+    // connection because pinning is not enforced for the domain
+    using FailureReportCallback = AsyncValidationReporter::ReportCallback;
+
+    explicit CurlPinning(std::shared_ptr<const PinningPolicy> pinningPolicy,
+                         FailureReportCallback failureReportCallback = nullptr,
+                         size_t maxPendingReportCount = 1024);
+
+    CurlPinning(const CurlPinning &) = delete;
+    CurlPinning &operator=(const CurlPinning &) = delete;
+
+    // Pin the transfers of an easy handle; this replaces its CURLOPT_SSL_CTX_FUNCTION
+    CURLcode attach(CURL *handle);
+
+    // Pin the transfers of an easy handle, then add it to a multi handle
+    CURLMcode addHandle(CURLM *multiHandle, CURL *handle);
+
+    // Wait until the failures so far were reported
+    void flushReports();
+
+    // Failure reports dropped because too many were pending
+    uint64_t droppedReportCount() const { return _reporter ? _reporter->droppedReportCount() : 0; }
+
+    // Failure reports for which the report callback threw an exception
+    uint64_t failedReportCount() const { return _reporter ? _reporter->failedReportCount() : 0; }
+
+    // Replace the pinning policy, for the next transfers
+    void setPinningPolicy(std::shared_ptr<const PinningPolicy> pinningPolicy) { _verifier.setPinningPolicy(std::move(pinningPolicy)); }
+
+    std::shared_ptr<const PinningPolicy> pinningPolicy() const { return _verifier.pinningPolicy(); }
+
+private:
+    static CURLcode sslContextCallback(CURL *handle, void *sslContext, void *curlPinning);
+
+    OpenSSLPinningVerifier _verifier;
+    std::unique_ptr<AsyncValidationReporter> _reporter;
+};
+
+} // namespace trustkit
+
+#endif /* TrustKit_curl_pinning_h */
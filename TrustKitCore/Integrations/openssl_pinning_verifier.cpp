@@ -0,0 +1,464 @@
+/*
+
+ openssl_pinning_verifier.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "openssl_pinning_verifier.h"
+
+#include "../pin_verifier.h"
+
+#include "../../TrustKit/Pinning/sha256_engine.h"
+
+#include <chrono>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+#include <openssl/ssl.h>
+#include <openssl/x509.h>
+#include <openssl/x509v3.h>
+#include <openssl/x509_vfy.h>
+
+namespace trustkit {
+
+namespace {
+
+// Large enough for the subjectPublicKeyInfo of an RSA 8192 key, so that hashing it does not allocate
+const size_t kSubjectPublicKeyInfoBufferLength = 2048;
+
+// The pinning decision of the handshake that established a TLS session, for the handshakes that resume it. It keeps
+// the policy it was made with alive, so that a replaced policy cannot be mistaken for a new one at the same address
+struct SessionPinningDecision
+{
+    std::shared_ptr<const PinningPolicy> pinningPolicy;
+    std::string serverHostname;
+
+    // Set if the pins were checked and the domain's policy expires
+    std::optional<std::chrono::system_clock::time_point> expirationDate;
+
+    bool isValid(const std::shared_ptr<const PinningPolicy> &currentPinningPolicy, const char *currentServerHostname) const
+    {
+        if ((pinningPolicy != currentPinningPolicy) || (currentServerHostname == nullptr) ||
+            (serverHostname != currentServerHostname))
+        {
+            return false;
+        }
+        return !expirationDate || (std::chrono::system_clock::now() < *expirationDate);
+    }
+};
+
+// The index of the verifier in the ex_data of the connections it was attached to with SSL_set_verify()
+int verifierExDataIndex()
+{
+    static const int exDataIndex = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return exDataIndex;
+}
+
+// The index of the verifier in the ex_data of the contexts it was attached to
+int contextVerifierExDataIndex()
+{
+    static const int exDataIndex = SSL_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return exDataIndex;
+}
+
+void freeSessionPinningDecision(void *session, void *decision, CRYPTO_EX_DATA *exData, int index, long argl, void *argp)
+{
+    (void)session;
+    (void)exData;
+    (void)index;
+    (void)argl;
+    (void)argp;
+    delete static_cast<SessionPinningDecision *>(decision);
+}
+
+// Sessions are duplicated for the tickets received after a TLS 1.3 handshake; they get their own copy of the decision
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+int duplicateSessionPinningDecision(CRYPTO_EX_DATA *to, const CRYPTO_EX_DATA *from, void **decision, int index, long argl, void *argp)
+#else
+int duplicateSessionPinningDecision(CRYPTO_EX_DATA *to, const CRYPTO_EX_DATA *from, void *fromData, int index, long argl, void *argp)
+#endif
+{
+    (void)to;
+    (void)from;
+    (void)index;
+    (void)argl;
+    (void)argp;
+#if OPENSSL_VERSION_NUMBER < 0x30000000L
+    void **decision = static_cast<void **>(fromData);
+#endif
+    if (*decision != nullptr)
+    {
+        *decision = new SessionPinningDecision(*static_cast<const SessionPinningDecision *>(*decision));
+    }
+    return 1;
+}
+
+// The index of the pinning decision in the ex_data of the sessions
+int sessionDecisionExDataIndex()
+{
+    static const int exDataIndex = SSL_SESSION_get_ex_new_index(0, nullptr, nullptr, duplicateSessionPinningDecision,
+                                                                freeSessionPinningDecision);
+    return exDataIndex;
+}
+
+SSL *connectionForHandshake(X509_STORE_CTX *storeContext)
+{
+    return static_cast<SSL *>(X509_STORE_CTX_get_ex_data(storeContext, SSL_get_ex_data_X509_STORE_CTX_idx()));
+}
+
+const char *serverHostnameForConnection(const SSL *connection, X509_VERIFY_PARAM *verifyParameters)
+{
+    if (connection != nullptr)
+    {
+        const char *serverName = SSL_get_servername(connection, TLSEXT_NAMETYPE_host_name);
+        if (serverName != nullptr)
+        {
+            return serverName;
+        }
+    }
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    return X509_VERIFY_PARAM_get0_host(verifyParameters, 0);
+#else
+    (void)verifyParameters;
+    return nullptr;
+#endif
+}
+
+const char *serverHostnameForHandshake(X509_STORE_CTX *storeContext)
+{
+    return serverHostnameForConnection(connectionForHandshake(storeContext), X509_STORE_CTX_get0_param(storeContext));
+}
+
+// Whether OpenSSL checks the leaf certificate against a hostname, set with SSL_set1_host() for instance
+bool hasHostnameCheck(X509_VERIFY_PARAM *verifyParameters)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    return X509_VERIFY_PARAM_get0_host(verifyParameters, 0) != nullptr;
+#else
+    (void)verifyParameters;
+    return false;
+#endif
+}
+
+// Keep the decision of a full handshake that did not block the connection in its new session, which no other
+// connection can use yet
+void storeSessionPinningDecision(SSL *connection,
+                                 std::shared_ptr<const PinningPolicy> pinningPolicy,
+                                 const char *serverHostname)
+{
+    SSL_SESSION *session = (connection != nullptr) ? SSL_get_session(connection) : nullptr;
+    if ((session == nullptr) || SSL_session_reused(connection) || (sessionDecisionExDataIndex() < 0))
+    {
+        return;
+    }
+
+    auto decision = std::make_unique<SessionPinningDecision>();
+    const PinnedDomain *pinnedDomain = pinningPolicy->findPinnedDomain(serverHostname);
+    if ((pinnedDomain != nullptr) && shouldCheckPins(pinnedDomain->policy()))
+    {
+        decision->expirationDate = pinnedDomain->policy().expirationDate;
+    }
+    decision->pinningPolicy = std::move(pinningPolicy);
+    decision->serverHostname = serverHostname;
+
+    void *previousDecision = SSL_SESSION_get_ex_data(session, sessionDecisionExDataIndex());
+    if (SSL_SESSION_set_ex_data(session, sessionDecisionExDataIndex(), decision.get()) == 1)
+    {
+        decision.release();
+        delete static_cast<SessionPinningDecision *>(previousDecision);
+    }
+}
+
+// Look for one of the domain's pins in the chain built by OpenSSL, from the trust anchor down to the leaf; the
+// subjectPublicKeyInfo of each certificate is encoded from its X509_PUBKEY rather than from the whole certificate
+TrustEvaluationResult findPinInChain(STACK_OF(X509) *chain, const PinnedDomain &pinnedDomain)
+{
+    int certificateCount = (chain != nullptr) ? sk_X509_num(chain) : 0;
+    if (certificateCount <= 0)
+    {
+        return TrustEvaluationResult::ErrorInvalidParameters;
+    }
+
+    uint8_t subjectPublicKeyInfoBuffer[kSubjectPublicKeyInfoBufferLength];
+    std::vector<uint8_t> largeSubjectPublicKeyInfo;
+    for (int i = certificateCount - 1; i >= 0; i--)
+    {
+        X509_PUBKEY *publicKey = X509_get_X509_PUBKEY(sk_X509_value(chain, i));
+        int length = (publicKey != nullptr) ? i2d_X509_PUBKEY(publicKey, nullptr) : -1;
+        if (length <= 0)
+        {
+            return TrustEvaluationResult::ErrorCouldNotGenerateSpkiHash;
+        }
+
+        unsigned char *subjectPublicKeyInfo = subjectPublicKeyInfoBuffer;
+        if (static_cast<size_t>(length) > sizeof(subjectPublicKeyInfoBuffer))
+        {
+            largeSubjectPublicKeyInfo.resize(static_cast<size_t>(length));
+            subjectPublicKeyInfo = largeSubjectPublicKeyInfo.data();
+        }
+        unsigned char *encodingEnd = subjectPublicKeyInfo;
+        if (i2d_X509_PUBKEY(publicKey, &encodingEnd) != length)
+        {
+            return TrustEvaluationResult::ErrorCouldNotGenerateSpkiHash;
+        }
+
+        Pin subjectPublicKeyInfoHash;
+        TSKSHA256Hash(subjectPublicKeyInfo, static_cast<size_t>(length), subjectPublicKeyInfoHash.data());
+        if (pinnedDomain.containsPin(subjectPublicKeyInfoHash))
+        {
+            return TrustEvaluationResult::Success;
+        }
+    }
+    return TrustEvaluationResult::FailedNoMatchingPin;
+}
+
+} // namespace
+
+
+OpenSSLPinningVerifier::OpenSSLPinningVerifier(std::shared_ptr<const PinningPolicy> pinningPolicy)
+    : _pinningPolicy(std::move(pinningPolicy))
+{
+    if (!_pinningPolicy)
+    {
+        throw std::invalid_argument("A pinning policy is required");
+    }
+}
+
+
+void OpenSSLPinningVerifier::attach(SSL_CTX *context)
+{
+    if ((contextVerifierExDataIndex() < 0) || (SSL_CTX_set_ex_data(context, contextVerifierExDataIndex(), this) != 1))
+    {
+        throw std::runtime_error("Could not attach the pinning verifier to the context");
+    }
+    SSL_CTX_set_cert_verify_callback(context, certificateVerifyCallback, this);
+    SSL_CTX_set_verify(context, SSL_VERIFY_PEER, nullptr);
+    SSL_CTX_set_info_callback(context, infoCallback);
+}
+
+void OpenSSLPinningVerifier::attach(SSL *connection)
+{
+    if ((verifierExDataIndex() < 0) || (SSL_set_ex_data(connection, verifierExDataIndex(), this) != 1))
+    {
+        throw std::runtime_error("Could not attach the pinning verifier to the connection");
+    }
+    SSL_set_verify(connection, SSL_VERIFY_PEER, verifyCallback);
+    SSL_set_info_callback(connection, infoCallback);
+}
+
+
+void OpenSSLPinningVerifier::setPinningPolicy(std::shared_ptr<const PinningPolicy> pinningPolicy)
+{
+    if (!pinningPolicy)
+    {
+        throw std::invalid_argument("A pinning policy is required");
+    }
+    std::atomic_store(&_pinningPolicy, std::move(pinningPolicy));
+}
+
+
+ValidationResult OpenSSLPinningVerifier::validate(X509_STORE_CTX *storeContext,
+                                                  const char *serverHostname,
+                                                  bool isChainTrusted) const
+{
+    return validate(pinningPolicy(), storeContext, serverHostname, isChainTrusted);
+}
+
+ValidationResult OpenSSLPinningVerifier::validate(const std::shared_ptr<const PinningPolicy> &pinningPolicy,
+                                                  X509_STORE_CTX *storeContext,
+                                                  const char *serverHostname,
+                                                  bool isChainTrusted) const
+{
+    ValidationResult validationResult;
+    if ((storeContext == nullptr) || (serverHostname == nullptr) || (serverHostname[0] == '\0'))
+    {
+        // The domain cannot be known; fail closed
+        validationResult.finalTrustDecision = TrustDecision::ShouldBlockConnection;
+        recordValidationMetrics(validationResult);
+        return validationResult;
+    }
+
+    const PinnedDomain *pinnedDomain = pinningPolicy->findPinnedDomain(serverHostname);
+    if (pinnedDomain == nullptr)
+    {
+        validationResult.finalTrustDecision = TrustDecision::DomainNotPinned;
+    }
+    else
+    {
+        const DomainPinningPolicy &domainPolicy = pinnedDomain->policy();
+        validationResult.notedHostname = domainPolicy.domain;
+        validationResult.pinningPolicy = pinningPolicy;
+        if (!shouldCheckPins(domainPolicy))
+        {
+            validationResult.finalTrustDecision = TrustDecision::DomainNotPinned;
+        }
+        else
+        {
+            // OpenSSL has no user-defined trust anchors
+            TrustEvaluationResult evaluationResult = isChainTrusted
+                ? findPinInChain(X509_STORE_CTX_get0_chain(storeContext), *pinnedDomain)
+                : TrustEvaluationResult::FailedInvalidCertificateChain;
+            validationResult.evaluationResult = evaluationResult;
+            validationResult.finalTrustDecision = trustDecisionForEvaluationResult(evaluationResult, domainPolicy, false);
+        }
+    }
+    recordValidationMetrics(validationResult);
+    return validationResult;
+}
+
+
+bool OpenSSLPinningVerifier::verifyHandshake(X509_STORE_CTX *storeContext, bool isChainTrusted) const
+{
+    std::shared_ptr<const PinningPolicy> pinningPolicy = this->pinningPolicy();
+    const char *serverHostname = serverHostnameForHandshake(storeContext);
+    ValidationResult validationResult = validate(pinningPolicy, storeContext, serverHostname, isChainTrusted);
+    if (validationResult.evaluationResult && _validationCallback)
+    {
+        _validationCallback(serverHostname, validationResult);
+    }
+
+    if (validationResult.finalTrustDecision == TrustDecision::ShouldBlockConnection)
+    {
+        if (isChainTrusted)
+        {
+            X509_STORE_CTX_set_error(storeContext, X509_V_ERR_APPLICATION_VERIFICATION);
+        }
+        return false;
+    }
+    // Pinning does not make an invalid chain valid
+    if (isChainTrusted)
+    {
+        storeSessionPinningDecision(connectionForHandshake(storeContext), std::move(pinningPolicy), serverHostname);
+    }
+    return isChainTrusted;
+}
+
+
+void OpenSSLPinningVerifier::discardStaleSession(SSL *connection) const
+{
+    SSL_SESSION *session = SSL_get_session(connection);
+    if (session == nullptr)
+    {
+        return;
+    }
+    const auto *decision = (sessionDecisionExDataIndex() >= 0)
+        ? static_cast<const SessionPinningDecision *>(SSL_SESSION_get_ex_data(session, sessionDecisionExDataIndex()))
+        : nullptr;
+    if ((decision != nullptr) && decision->isValid(pinningPolicy(), serverHostnameForConnection(connection, SSL_get0_param(connection))))
+    {
+        return;
+    }
+
+    // The session was established with another policy, its domain's policy expired, or its pins were never checked:
+    // do not offer it, so that the server's chain goes through the verification callback of a full handshake. The
+    // client may still hold on to the session, but it gets discarded again whenever it is offered
+    SSL_CTX_remove_session(SSL_get_SSL_CTX(connection), session);
+    SSL_set_session(connection, nullptr);
+}
+
+
+int OpenSSLPinningVerifier::certificateVerifyCallback(X509_STORE_CTX *storeContext, void *verifier)
+{
+    // The pins are checked for the SNI hostname, so OpenSSL must check the certificate against it too, like
+    // TSKPinningValidator does with SecPolicyCreateSSL(), when the client did not set a hostname to check
+    const char *serverHostname = serverHostnameForHandshake(storeContext);
+    X509_VERIFY_PARAM *verifyParameters = X509_STORE_CTX_get0_param(storeContext);
+    bool hasHostname = (serverHostname == nullptr) || hasHostnameCheck(verifyParameters) ||
+                       (X509_VERIFY_PARAM_set1_host(verifyParameters, serverHostname, 0) == 1);
+
+    // Let OpenSSL build and validate the chain first, with the connection's settings
+    bool isChainTrusted = hasHostname && (X509_verify_cert(storeContext) == 1);
+
+    // Exceptions, such as from the validation callback, must not unwind through OpenSSL; fail closed instead
+    try
+    {
+        return static_cast<OpenSSLPinningVerifier *>(verifier)->verifyHandshake(storeContext, isChainTrusted) ? 1 : 0;
+    }
+    catch (...)
+    {
+        X509_STORE_CTX_set_error(storeContext, X509_V_ERR_APPLICATION_VERIFICATION);
+        return 0;
+    }
+}
+
+
+int OpenSSLPinningVerifier::verifyCallback(int isPreverified, X509_STORE_CTX *storeContext)
+{
+    // Called for each certificate of the chain, ending with the leaf certificate, and for each error; the pins are
+    // checked once the whole chain was validated, or on the first error
+    if (isPreverified && (X509_STORE_CTX_get_error_depth(storeContext) != 0))
+    {
+        return 1;
+    }
+
+    SSL *connection = connectionForHandshake(storeContext);
+    auto *verifier = (connection != nullptr)
+        ? static_cast<const OpenSSLPinningVerifier *>(SSL_get_ex_data(connection, verifierExDataIndex()))
+        : nullptr;
+    if (verifier == nullptr)
+    {
+        return isPreverified;
+    }
+
+    // The verification parameters cannot be changed anymore, so the leaf certificate is checked against the SNI
+    // hostname here when the client did not set a hostname for OpenSSL to check
+    const char *serverHostname = serverHostnameForHandshake(storeContext);
+    if (isPreverified && (serverHostname != nullptr) && !hasHostnameCheck(X509_STORE_CTX_get0_param(storeContext)) &&
+        (X509_check_host(X509_STORE_CTX_get0_cert(storeContext), serverHostname, 0, 0, nullptr) != 1))
+    {
+        X509_STORE_CTX_set_error(storeContext, X509_V_ERR_HOSTNAME_MISMATCH);
+        isPreverified = 0;
+    }
+
+    try
+    {
+        return verifier->verifyHandshake(storeContext, isPreverified != 0) ? 1 : 0;
+    }
+    catch (...)
+    {
+        X509_STORE_CTX_set_error(storeContext, X509_V_ERR_APPLICATION_VERIFICATION);
+        return 0;
+    }
+}
+
+
+void OpenSSLPinningVerifier::infoCallback(const SSL *connection, int where, int ret)
+{
+    (void)ret;
+    // Only the start of the first handshake of a client connection, before the session is offered to the server,
+    // and the end of a handshake that resumed a session are of interest
+    bool isStarting = ((where & SSL_CB_HANDSHAKE_START) != 0) && !SSL_is_server(connection) && SSL_in_before(connection);
+    bool isResumed = ((where & SSL_CB_HANDSHAKE_DONE) != 0) && SSL_session_reused(connection);
+    if (!isStarting && !isResumed)
+    {
+        return;
+    }
+
+    auto *verifier = static_cast<const OpenSSLPinningVerifier *>(SSL_get_ex_data(connection, verifierExDataIndex()));
+    if (verifier == nullptr)
+    {
+        verifier = static_cast<const OpenSSLPinningVerifier *>(
+            SSL_CTX_get_ex_data(SSL_get_SSL_CTX(connection), contextVerifierExDataIndex()));
+    }
+    if (verifier == nullptr)
+    {
+        return;
+    }
+    if (isStarting)
+    {
+        verifier->discardStaleSession(const_cast<SSL *>(connection));
+    }
+    else
+    {
+        // Only a session whose decision was still valid could be offered
+        verifier->_reusedDecisionCount.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+} // namespace trustkit
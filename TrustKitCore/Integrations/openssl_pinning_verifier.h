@@ -0,0 +1,99 @@
+/*
+
+ openssl_pinning_verifier.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_openssl_pinning_verifier_h
+#define TrustKit_openssl_pinning_verifier_h
+
+#include "../pinning_policy.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include <openssl/ossl_typ.h>
+
+namespace trustkit {
+
+// Enforces a pinning policy during the TLS handshakes of OpenSSL clients. The certificate chain is first validated by
+// OpenSSL as usual, then the pins of the server's domain are looked for in the chain that OpenSSL built, directly from
+// its X509 objects; the decisions are the same as TSKPinningValidator's, including for the domains whose pinning is
+// not enforced and for the expired policies.
+//
+// The server's domain is the SNI hostname set with SSL_set_tlsext_host_name(), or else the first hostname set with
+// SSL_set1_host(); the handshake fails if neither is set. When only the SNI hostname is set, the server's certificate
+// is also checked against it, as SSL_set1_host() would. The verifier must outlive the SSL_CTX and SSL objects it is
+// attached to.
+//
+// OpenSSL does not validate the chain again when a TLS session is resumed: the decision of the handshake that
+// established the session is stored in the SSL_SESSION, and reused as long as the pinning policy was not replaced and
+// the domain's policy did not expire. Otherwise the session is not offered to the server when the handshake starts, so
+// that the chain is validated and its pins checked by a full handshake, which fails if the connection is blocked.
+class OpenSSLPinningVerifier
+{
+public:
+    // Called during the handshake once the pins of a pinned domain were checked, like TSKPinningValidatorCallback;
+    // the hostname is the one the connection is for. If it throws, the connection is blocked
+    using ValidationCallback = std::function<void(const std::string &serverHostname, const ValidationResult &result)>;
+
+    explicit OpenSSLPinningVerifier(std::shared_ptr<const PinningPolicy> pinningPolicy);
+
+    OpenSSLPinningVerifier(const OpenSSLPinningVerifier &) = delete;
+    OpenSSLPinningVerifier &operator=(const OpenSSLPinningVerifier &) = delete;
+
+    // Must be set before the verifier is attached
+    void setValidationCallback(ValidationCallback validationCallback) { _validationCallback = std::move(validationCallback); }
+
+    // Verify all the connections of the context, with SSL_CTX_set_cert_verify_callback(); this also sets the
+    // verification mode of the context to SSL_VERIFY_PEER, so that a failed verification aborts the handshake, and
+    // replaces the context's info callback to check the resumed sessions
+    void attach(SSL_CTX *context);
+
+    // Verify only this connection, with SSL_set_verify() and SSL_VERIFY_PEER; this replaces the connection's
+    // verification and info callbacks
+    void attach(SSL *connection);
+
+    // Check the pins of the chain that OpenSSL built and validated (or failed to validate) for the hostname
+    ValidationResult validate(X509_STORE_CTX *storeContext, const char *serverHostname, bool isChainTrusted) const;
+
+    // Replace the pinning policy, for instance after it was updated; the handshakes in progress may still use the
+    // previous one, and the sessions established with it are not resumed anymore
+    void setPinningPolicy(std::shared_ptr<const PinningPolicy> pinningPolicy);
+
+    std::shared_ptr<const PinningPolicy> pinningPolicy() const { return std::atomic_load(&_pinningPolicy); }
+
+    // The resumed handshakes that reused the decision of the handshake that established their session
+    uint64_t reusedDecisionCount() const { return _reusedDecisionCount.load(std::memory_order_relaxed); }
+
+private:
+    static int certificateVerifyCallback(X509_STORE_CTX *storeContext, void *verifier);
+    static int verifyCallback(int isPreverified, X509_STORE_CTX *storeContext);
+    static void infoCallback(const SSL *connection, int where, int ret);
+
+    ValidationResult validate(const std::shared_ptr<const PinningPolicy> &pinningPolicy,
+                              X509_STORE_CTX *storeContext,
+                              const char *serverHostname,
+                              bool isChainTrusted) const;
+
+    // Run the pinning validation for the handshake and return whether it may continue
+    bool verifyHandshake(X509_STORE_CTX *storeContext, bool isChainTrusted) const;
+
+    // Drop the session set with SSL_set_session() before it is offered if its pinning decision cannot be reused
+    void discardStaleSession(SSL *connection) const;
+
+    std::shared_ptr<const PinningPolicy> _pinningPolicy;
+    ValidationCallback _validationCallback;
+    mutable std::atomic<uint64_t> _reusedDecisionCount{0};
+};
+
+} // namespace trustkit
+
+#endif /* TrustKit_openssl_pinning_verifier_h */
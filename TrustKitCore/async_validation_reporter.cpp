@@ -0,0 +1,106 @@
+/*
+
+ async_validation_reporter.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "async_validation_reporter.h"
+
+#include "../TrustKit/metrics_registry.h"
+
+#include <stdexcept>
+
+namespace trustkit {
+
+AsyncValidationReporter::AsyncValidationReporter(ReportCallback reportCallback, size_t maxPendingReportCount)
+    : _reportCallback(std::move(reportCallback)),
+      _maxPendingReportCount(maxPendingReportCount)
+{
+    if (!_reportCallback || (_maxPendingReportCount == 0))
+    {
+        throw std::invalid_argument("A report callback and room for at least one report are required");
+    }
+    _thread = std::thread(&AsyncValidationReporter::deliverReports, this);
+}
+
+AsyncValidationReporter::~AsyncValidationReporter()
+{
+    {
+        std::lock_guard<ContentionCountingMutex> lock(_mutex);
+        _isStopping = true;
+    }
+    _reportPosted.notify_one();
+    _thread.join();
+}
+
+
+bool AsyncValidationReporter::post(const std::string &serverHostname, const ValidationResult &result)
+{
+    {
+        std::lock_guard<ContentionCountingMutex> lock(_mutex);
+        if (_pendingReports.size() >= _maxPendingReportCount)
+        {
+            _droppedReportCount.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        bool isQueueDepthCounted = TSKMetricsIncrement(TSKMetricCallbackQueueDepth);
+        _pendingReports.push_back({ serverHostname, result, isQueueDepthCounted });
+    }
+    _reportPosted.notify_one();
+    return true;
+}
+
+
+void AsyncValidationReporter::flush()
+{
+    std::unique_lock<ContentionCountingMutex> lock(_mutex);
+    _reportsDelivered.wait(lock, [this] { return _pendingReports.empty() && !_isDelivering; });
+}
+
+
+void AsyncValidationReporter::deliverReports()
+{
+    std::unique_lock<ContentionCountingMutex> lock(_mutex);
+    while (true)
+    {
+        _reportPosted.wait(lock, [this] { return _isStopping || !_pendingReports.empty(); });
+        if (_pendingReports.empty())
+        {
+            // Stopping, and everything was delivered
+            return;
+        }
+
+        PendingReport report = std::move(_pendingReports.front());
+        _pendingReports.pop_front();
+        _isDelivering = true;
+        lock.unlock();
+
+        if (report.isQueueDepthCounted)
+        {
+            TSKMetricsSubtract(TSKMetricCallbackQueueDepth, 1);
+        }
+        try
+        {
+            _reportCallback(report.serverHostname, report.result);
+        }
+        catch (...)
+        {
+            // Escaping the thread would terminate the process; the report is lost either way
+            _failedReportCount.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        lock.lock();
+        _isDelivering = false;
+        if (_pendingReports.empty())
+        {
+            _reportsDelivered.notify_all();
+        }
+    }
+}
+
+} // namespace trustkit
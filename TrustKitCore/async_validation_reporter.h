@@ -0,0 +1,89 @@
+/*
+
+ async_validation_reporter.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_async_validation_reporter_h
+#define TrustKit_async_validation_reporter_h
+
+#include "contention_counting_mutex.h"
+#include "trust_decision.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace trustkit {
+
+// Delivers validation results to a callback on a dedicated thread, so that reporting never slows down the handshakes;
+// this plays the role of the validation callback queue of TSKPinningValidator. Results are delivered in order, and
+// dropped when too many are pending. An exception thrown by the callback is dropped as well, so that it cannot stop the
+// reporting thread
+class AsyncValidationReporter
+{
+public:
+    using ReportCallback = std::function<void(const std::string &serverHostname, const ValidationResult &result)>;
+
+    explicit AsyncValidationReporter(ReportCallback reportCallback, size_t maxPendingReportCount = 1024);
+
+    // Deliver the pending reports, then stop the thread
+    ~AsyncValidationReporter();
+
+    AsyncValidationReporter(const AsyncValidationReporter &) = delete;
+    AsyncValidationReporter &operator=(const AsyncValidationReporter &) = delete;
+
+    // Queue a report; return false if it was dropped because too many reports are pending
+    bool post(const std::string &serverHostname, const ValidationResult &result);
+
+    // Wait until all the reports posted so far were delivered
+    void flush();
+
+    uint64_t droppedReportCount() const { return _droppedReportCount.load(std::memory_order_relaxed); }
+
+    // Reports for which the callback threw an exception
+    uint64_t failedReportCount() const { return _failedReportCount.load(std::memory_order_relaxed); }
+
+    // How much the threads posting reports and the reporting thread wait for each other
+    LockContention queueLockContention() const { return _mutex.contention(); }
+
+private:
+    struct PendingReport
+    {
+        std::string serverHostname;
+        ValidationResult result;
+        // Whether the report was counted in the queue depth metric, which may have been enabled since
+        bool isQueueDepthCounted;
+    };
+
+    void deliverReports();
+
+    ReportCallback _reportCallback;
+    size_t _maxPendingReportCount;
+
+    ContentionCountingMutex _mutex;
+    std::condition_variable_any _reportPosted;
+    std::condition_variable_any _reportsDelivered;
+    std::deque<PendingReport> _pendingReports;
+    bool _isDelivering = false;
+    bool _isStopping = false;
+    std::atomic<uint64_t> _droppedReportCount{0};
+    std::atomic<uint64_t> _failedReportCount{0};
+
+    // Started last, once the other members are initialized
+    std::thread _thread;
+};
+
+} // namespace trustkit
+
+#endif /* TrustKit_async_validation_reporter_h */
@@ -0,0 +1,81 @@
+/*
+
+ contention_counting_mutex.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_contention_counting_mutex_h
+#define TrustKit_contention_counting_mutex_h
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace trustkit {
+
+struct LockContention
+{
+    uint64_t lockCount = 0;
+
+    // The acquisitions that had to wait for another thread to release the lock, and how long they waited in total
+    uint64_t contendedLockCount = 0;
+    uint64_t contendedWaitNanoseconds = 0;
+};
+
+// A mutex that counts how often it is acquired, and how often and how long threads had to wait for it. The counters
+// are updated while the lock is held, next to the mutex itself, and only the contended acquisitions read the clock
+class ContentionCountingMutex
+{
+public:
+    void lock()
+    {
+        if (!_mutex.try_lock())
+        {
+            auto waitStart = std::chrono::steady_clock::now();
+            _mutex.lock();
+            auto waitDuration = std::chrono::steady_clock::now() - waitStart;
+            _contendedLockCount.fetch_add(1, std::memory_order_relaxed);
+            _contendedWaitNanoseconds.fetch_add(
+                static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(waitDuration).count()),
+                std::memory_order_relaxed);
+        }
+        _lockCount.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    bool try_lock()
+    {
+        if (!_mutex.try_lock())
+        {
+            return false;
+        }
+        _lockCount.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void unlock() { _mutex.unlock(); }
+
+    LockContention contention() const
+    {
+        LockContention contention;
+        contention.lockCount = _lockCount.load(std::memory_order_relaxed);
+        contention.contendedLockCount = _contendedLockCount.load(std::memory_order_relaxed);
+        contention.contendedWaitNanoseconds = _contendedWaitNanoseconds.load(std::memory_order_relaxed);
+        return contention;
+    }
+
+private:
+    std::mutex _mutex;
+    std::atomic<uint64_t> _lockCount{0};
+    std::atomic<uint64_t> _contendedLockCount{0};
+    std::atomic<uint64_t> _contendedWaitNanoseconds{0};
+};
+
+} // namespace trustkit
+
+#endif /* TrustKit_contention_counting_mutex_h */
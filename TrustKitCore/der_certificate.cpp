@@ -0,0 +1,203 @@
+/*
+
+ der_certificate.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "der_certificate.h"
+
+#include "../TrustKit/Pinning/sha256_engine.h"
+
+#include <vector>
+
+namespace trustkit {
+
+namespace {
+
+const uint8_t kDerTagInteger = 0x02;
+const uint8_t kDerTagSequence = 0x30;
+const uint8_t kDerTagExplicitVersion = 0xa0;
+
+// A DER element: its tag, and its contents without the tag and the length
+struct DerElement
+{
+    uint8_t tag;
+    DerSlice contents;
+    // The whole element, including the tag and the length
+    DerSlice encoding;
+};
+
+// Read the element at the beginning of the input and advance the input past it
+std::optional<DerElement> readElement(DerSlice *input)
+{
+    const uint8_t *bytes = input->data;
+    size_t remaining = input->length;
+    if (remaining < 2)
+    {
+        return std::nullopt;
+    }
+
+    uint8_t tag = bytes[0];
+    if ((tag & 0x1f) == 0x1f)
+    {
+        // Multi-byte tags do not appear before the subjectPublicKeyInfo
+        return std::nullopt;
+    }
+
+    size_t headerLength = 2;
+    size_t contentsLength = bytes[1];
+    if (contentsLength & 0x80)
+    {
+        // Long form; the indefinite form (0x80) is not allowed in DER
+        size_t lengthByteCount = contentsLength & 0x7f;
+        if ((lengthByteCount == 0) || (lengthByteCount > 4) || (remaining < 2 + lengthByteCount))
+        {
+            return std::nullopt;
+        }
+        contentsLength = 0;
+        for (size_t i = 0; i < lengthByteCount; i++)
+        {
+            contentsLength = (contentsLength << 8) | bytes[2 + i];
+        }
+        headerLength += lengthByteCount;
+    }
+    if (contentsLength > remaining - headerLength)
+    {
+        return std::nullopt;
+    }
+
+    DerElement element;
+    element.tag = tag;
+    element.contents = { bytes + headerLength, contentsLength };
+    element.encoding = { bytes, headerLength + contentsLength };
+    input->data += element.encoding.length;
+    input->length -= element.encoding.length;
+    return element;
+}
+
+std::optional<DerElement> readElementWithTag(DerSlice *input, uint8_t tag)
+{
+    std::optional<DerElement> element = readElement(input);
+    if (!element || (element->tag != tag))
+    {
+        return std::nullopt;
+    }
+    return element;
+}
+
+} // namespace
+
+
+std::optional<DerSlice> findSubjectPublicKeyInfo(DerSlice certificate)
+{
+    if (certificate.data == nullptr)
+    {
+        return std::nullopt;
+    }
+
+    // Certificate ::= SEQUENCE { tbsCertificate, signatureAlgorithm, signatureValue }
+    std::optional<DerElement> certificateElement = readElementWithTag(&certificate, kDerTagSequence);
+    if (!certificateElement)
+    {
+        return std::nullopt;
+    }
+    DerSlice certificateContents = certificateElement->contents;
+    std::optional<DerElement> tbsCertificate = readElementWithTag(&certificateContents, kDerTagSequence);
+    if (!tbsCertificate)
+    {
+        return std::nullopt;
+    }
+
+    // TBSCertificate ::= SEQUENCE { [0] version OPTIONAL, serialNumber, signature, issuer, validity, subject,
+    // subjectPublicKeyInfo, ... }
+    DerSlice fields = tbsCertificate->contents;
+    if ((fields.length > 0) && (fields.data[0] == kDerTagExplicitVersion) && !readElement(&fields))
+    {
+        return std::nullopt;
+    }
+    if (!readElementWithTag(&fields, kDerTagInteger))
+    {
+        return std::nullopt;
+    }
+    // signature, issuer, validity and subject
+    for (int i = 0; i < 4; i++)
+    {
+        if (!readElementWithTag(&fields, kDerTagSequence))
+        {
+            return std::nullopt;
+        }
+    }
+    std::optional<DerElement> subjectPublicKeyInfo = readElementWithTag(&fields, kDerTagSequence);
+    if (!subjectPublicKeyInfo)
+    {
+        return std::nullopt;
+    }
+    return subjectPublicKeyInfo->encoding;
+}
+
+
+std::optional<Pin> hashSubjectPublicKeyInfo(DerSlice certificate)
+{
+    std::optional<DerSlice> subjectPublicKeyInfo = findSubjectPublicKeyInfo(certificate);
+    if (!subjectPublicKeyInfo)
+    {
+        return std::nullopt;
+    }
+    Pin pin;
+    TSKSHA256Hash(subjectPublicKeyInfo->data, subjectPublicKeyInfo->length, pin.data());
+    return pin;
+}
+
+
+namespace {
+
+// Hash the digests of the certificates rather than their concatenation, so that the certificates can be hashed
+// together and no copy of the chain is needed. Only unusually long chains need the heap
+template <typename GetCertificate>
+ChainDigest digestForCertificates(size_t certificateCount, GetCertificate getCertificate)
+{
+    constexpr size_t kMaxStackChainLength = 8;
+    TSKSHA256Message stackMessages[kMaxStackChainLength];
+    uint8_t stackCertificateDigests[kMaxStackChainLength][TSK_SHA256_DIGEST_LENGTH];
+    std::vector<TSKSHA256Message> heapMessages;
+    std::vector<uint8_t> heapCertificateDigests;
+    TSKSHA256Message *messages = stackMessages;
+    uint8_t (*certificateDigests)[TSK_SHA256_DIGEST_LENGTH] = stackCertificateDigests;
+    if (certificateCount > kMaxStackChainLength)
+    {
+        heapMessages.resize(certificateCount);
+        heapCertificateDigests.resize(certificateCount * TSK_SHA256_DIGEST_LENGTH);
+        messages = heapMessages.data();
+        certificateDigests = reinterpret_cast<uint8_t (*)[TSK_SHA256_DIGEST_LENGTH]>(heapCertificateDigests.data());
+    }
+
+    for (size_t i = 0; i < certificateCount; i++)
+    {
+        DerSlice certificate = getCertificate(i);
+        messages[i] = { certificate.data, certificate.length };
+    }
+    TSKSHA256HashMany(messages, certificateCount, certificateDigests);
+    ChainDigest chainDigest;
+    TSKSHA256Hash(certificateDigests[0], certificateCount * TSK_SHA256_DIGEST_LENGTH, chainDigest.data());
+    return chainDigest;
+}
+
+} // namespace
+
+
+ChainDigest digestForCertificateChain(const CertificateChain &chain)
+{
+    return digestForCertificates(chain.size(), [&chain](size_t i) { return DerSlice{ chain[i].data(), chain[i].size() }; });
+}
+
+ChainDigest digestForCertificateChain(const DerSlice *chain, size_t certificateCount)
+{
+    return digestForCertificates(certificateCount, [chain](size_t i) { return chain[i]; });
+}
+
+} // namespace trustkit
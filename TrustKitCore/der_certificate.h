@@ -0,0 +1,43 @@
+/*
+
+ der_certificate.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_der_certificate_h
+#define TrustKit_der_certificate_h
+
+#include "trust_decision.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+namespace trustkit {
+
+// A range of bytes within a DER-encoded certificate; it does not own the bytes
+struct DerSlice
+{
+    const uint8_t *data = nullptr;
+    size_t length = 0;
+};
+
+// Locate the subjectPublicKeyInfo of an X.509 certificate, including its tag and length, without copying or
+// decoding anything else; return nothing if the certificate is not well-formed up to that field
+std::optional<DerSlice> findSubjectPublicKeyInfo(DerSlice certificate);
+
+// The pin of the certificate: the SHA-256 digest of its subjectPublicKeyInfo
+std::optional<Pin> hashSubjectPublicKeyInfo(DerSlice certificate);
+
+// Identify a chain by hashing the digests of its certificates, like +[TSKTrustDecisionCache digestForCertificateChain:]
+ChainDigest digestForCertificateChain(const CertificateChain &chain);
+ChainDigest digestForCertificateChain(const DerSlice *chain, size_t certificateCount);
+
+} // namespace trustkit
+
+#endif /* TrustKit_der_certificate_h */
@@ -0,0 +1,187 @@
+/*
+
+ pin_failure_report.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "pin_failure_report.h"
+
+#include "../TrustKit/Pinning/base64_codec.h"
+
+#include <ctime>
+
+namespace trustkit {
+
+namespace {
+
+const char kPemHeader[] = "-----BEGIN CERTIFICATE-----\n";
+const char kPemFooter[] = "\n-----END CERTIFICATE-----";
+
+void appendJsonString(std::string &json, const std::string &value)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    json += '"';
+    for (char character : value)
+    {
+        switch (character)
+        {
+            case '"':
+                json += "\\\"";
+                break;
+            case '\\':
+                json += "\\\\";
+                break;
+            case '\n':
+                json += "\\n";
+                break;
+            case '\r':
+                json += "\\r";
+                break;
+            case '\t':
+                json += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(character) < 0x20)
+                {
+                    json += "\\u00";
+                    json += hexDigits[static_cast<unsigned char>(character) >> 4];
+                    json += hexDigits[static_cast<unsigned char>(character) & 0xf];
+                }
+                else
+                {
+                    json += character;
+                }
+        }
+    }
+    json += '"';
+}
+
+void appendKey(std::string &json, const char *key)
+{
+    json += (json.size() > 1) ? ",\"" : "\"";
+    json += key;
+    json += "\":";
+}
+
+// Dates are in UTC, formatted like the report's NSDateFormatters
+void appendDate(std::string &json, std::chrono::system_clock::time_point date, const char *format)
+{
+    std::time_t time = std::chrono::system_clock::to_time_t(date);
+    std::tm utcTime = {};
+    char formattedDate[32];
+    if ((gmtime_r(&time, &utcTime) == nullptr) || (std::strftime(formattedDate, sizeof(formattedDate), format, &utcTime) == 0))
+    {
+        json += "null";
+        return;
+    }
+    json += '"';
+    json += formattedDate;
+    json += '"';
+}
+
+// The PEM certificates only have base64 characters, and CRLF line breaks like NSDataBase64Encoding64CharacterLineLength
+void appendPemCertificate(std::string &json, const std::vector<uint8_t> &certificate)
+{
+    std::string pem(sizeof(kPemHeader) - 1 + TSKBase64EncodedLength(certificate.size(), TSK_BASE64_PEM_LINE_LENGTH) +
+                        sizeof(kPemFooter) - 1,
+                    '\0');
+    pem.replace(0, sizeof(kPemHeader) - 1, kPemHeader);
+    size_t encodedLength = TSKBase64Encode(certificate.data(), certificate.size(), TSK_BASE64_PEM_LINE_LENGTH,
+                                           &pem[sizeof(kPemHeader) - 1]);
+    pem.replace(sizeof(kPemHeader) - 1 + encodedLength, sizeof(kPemFooter) - 1, kPemFooter);
+    appendJsonString(json, pem);
+}
+
+void appendPin(std::string &json, const Pin &pin)
+{
+    char encodedPin[((sizeof(Pin) + 2) / 3) * 4];
+    size_t encodedLength = TSKBase64Encode(pin.data(), pin.size(), 0, encodedPin);
+    json += "\"pin-sha256=\\\"";
+    json.append(encodedPin, encodedLength);
+    json += "\\\"\"";
+}
+
+} // namespace
+
+
+std::string pinFailureReportJson(const PinFailureReport &report)
+{
+    std::string json;
+    size_t certificatesLength = 0;
+    for (const std::vector<uint8_t> &certificate : report.validatedCertificateChain)
+    {
+        certificatesLength += TSKBase64EncodedLength(certificate.size(), TSK_BASE64_PEM_LINE_LENGTH) + 128;
+    }
+    json.reserve(512 + certificatesLength + (report.knownPins.size() * 64));
+
+    json += '{';
+    appendKey(json, "app-bundle-id");
+    appendJsonString(json, report.appBundleId);
+    appendKey(json, "app-version");
+    appendJsonString(json, report.appVersion);
+    appendKey(json, "app-platform");
+    appendJsonString(json, report.appPlatform);
+    appendKey(json, "app-platform-version");
+    appendJsonString(json, report.appPlatformVersion);
+    appendKey(json, "app-vendor-id");
+    appendJsonString(json, report.appVendorId);
+    appendKey(json, "trustkit-version");
+    appendJsonString(json, report.trustkitVersion);
+    appendKey(json, "date-time");
+    appendDate(json, report.dateTime, "%Y-%m-%dT%H:%M:%SZ");
+    appendKey(json, "hostname");
+    appendJsonString(json, report.hostname);
+    appendKey(json, "port");
+    json += std::to_string(report.port);
+    appendKey(json, "noted-hostname");
+    appendJsonString(json, report.notedHostname);
+    appendKey(json, "include-subdomains");
+    json += report.includeSubdomains ? "true" : "false";
+    appendKey(json, "enforce-pinning");
+    json += report.enforcePinning ? "true" : "false";
+
+    appendKey(json, "validated-certificate-chain");
+    json += '[';
+    for (size_t i = 0; i < report.validatedCertificateChain.size(); i++)
+    {
+        if (i > 0)
+        {
+            json += ',';
+        }
+        appendPemCertificate(json, report.validatedCertificateChain[i]);
+    }
+    json += ']';
+
+    appendKey(json, "known-pins");
+    json += '[';
+    for (size_t i = 0; i < report.knownPins.size(); i++)
+    {
+        if (i > 0)
+        {
+            json += ',';
+        }
+        appendPin(json, report.knownPins[i]);
+    }
+    json += ']';
+
+    appendKey(json, "validation-result");
+    json += std::to_string(static_cast<int>(report.validationResult));
+    appendKey(json, "known-pins-expiration-date");
+    if (report.knownPinsExpirationDate)
+    {
+        appendDate(json, *report.knownPinsExpirationDate, "%Y-%m-%d");
+    }
+    else
+    {
+        json += "null";
+    }
+    json += '}';
+    return json;
+}
+
+} // namespace trustkit
@@ -0,0 +1,60 @@
+/*
+
+ pin_failure_report.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_pin_failure_report_h
+#define TrustKit_pin_failure_report_h
+
+#include "trust_decision.h"
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace trustkit {
+
+// The details of a pin validation failure sent to the report URIs of a domain, the same as TSKPinFailureReport's
+struct PinFailureReport
+{
+    // Not part of the HPKP spec
+    std::string appBundleId;
+    std::string appVersion;
+    std::string appPlatform;
+    std::string appPlatformVersion;
+    std::string appVendorId;
+    std::string trustkitVersion;
+
+    std::string hostname;
+    uint16_t port = 0;
+    std::chrono::system_clock::time_point dateTime;
+    std::string notedHostname;
+    bool includeSubdomains = false;
+    bool enforcePinning = false;
+
+    // DER certificates, starting with the server's leaf certificate; they are sent as PEM
+    CertificateChain validatedCertificateChain;
+
+    // Sent as pin-sha256="<base64>" strings, as described in the HPKP spec
+    std::vector<Pin> knownPins;
+
+    TrustEvaluationResult validationResult = TrustEvaluationResult::FailedNoMatchingPin;
+
+    // Only the day is sent, as specified in the pinning policy
+    std::optional<std::chrono::system_clock::time_point> knownPinsExpirationDate;
+};
+
+// The report in the same JSON format as TSKPinFailureReport's, for POSTing it
+std::string pinFailureReportJson(const PinFailureReport &report);
+
+} // namespace trustkit
+
+#endif /* TrustKit_pin_failure_report_h */
@@ -0,0 +1,204 @@
+/*
+
+ pin_verifier.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "pin_verifier.h"
+
+#include "der_certificate.h"
+
+#include "../TrustKit/metrics_registry.h"
+
+#include <chrono>
+
+namespace trustkit {
+
+namespace {
+
+TSKMetric metricForTrustDecision(TrustDecision trustDecision)
+{
+    switch (trustDecision)
+    {
+        case TrustDecision::ShouldAllowConnection:
+            return TSKMetricEvaluationsAllowed;
+        case TrustDecision::DomainNotPinned:
+            return TSKMetricEvaluationsNotPinned;
+        default:
+            return TSKMetricEvaluationsBlocked;
+    }
+}
+
+TSKMetric metricForEvaluationResult(TrustEvaluationResult evaluationResult)
+{
+    switch (evaluationResult)
+    {
+        case TrustEvaluationResult::Success:
+            return TSKMetricEvaluationResultSuccess;
+        case TrustEvaluationResult::FailedNoMatchingPin:
+            return TSKMetricEvaluationResultNoMatchingPin;
+        case TrustEvaluationResult::FailedInvalidCertificateChain:
+            return TSKMetricEvaluationResultInvalidCertificateChain;
+        case TrustEvaluationResult::FailedUserDefinedTrustAnchor:
+            return TSKMetricEvaluationResultUserDefinedTrustAnchor;
+        case TrustEvaluationResult::ErrorCouldNotGenerateSpkiHash:
+            return TSKMetricEvaluationResultCouldNotGenerateSpkiHash;
+        default:
+            return TSKMetricEvaluationResultInvalidParameters;
+    }
+}
+
+// Whether the key of the certificate is one of the domain's pins; nothing if the key could not be found
+std::optional<bool> isCertificatePinned(DerSlice certificate, const PinnedDomain &pinnedDomain)
+{
+    std::optional<Pin> subjectPublicKeyInfoHash = hashSubjectPublicKeyInfo(certificate);
+    if (!subjectPublicKeyInfoHash)
+    {
+        return std::nullopt;
+    }
+    return pinnedDomain.containsPin(*subjectPublicKeyInfoHash);
+}
+
+} // namespace
+
+
+TrustEvaluationResult verifyPublicKeyPin(const CertificateChain &serverChain,
+                                         const std::string &serverHostname,
+                                         const PinnedDomain &pinnedDomain,
+                                         TrustBackend &trustBackend)
+{
+    if (serverChain.empty() || serverHostname.empty())
+    {
+        return TrustEvaluationResult::ErrorInvalidParameters;
+    }
+
+    // First check the certificate chain using the default SSL validation; this ensures the certificate chain is sane
+    // and gives us the exact path that successfully validated the chain
+    ChainEvaluation chainEvaluation = trustBackend.evaluateChain(serverChain, serverHostname);
+    if (!chainEvaluation.isTrusted)
+    {
+        return TrustEvaluationResult::FailedInvalidCertificateChain;
+    }
+
+    // Check each certificate in the validated chain; start with the CA all the way down to the leaf
+    const CertificateChain &verifiedChain = chainEvaluation.verifiedChain;
+    for (auto certificate = verifiedChain.rbegin(); certificate != verifiedChain.rend(); ++certificate)
+    {
+        std::optional<bool> isPinned = isCertificatePinned({ certificate->data(), certificate->size() }, pinnedDomain);
+        if (!isPinned)
+        {
+            return TrustEvaluationResult::ErrorCouldNotGenerateSpkiHash;
+        }
+        if (*isPinned)
+        {
+            return TrustEvaluationResult::Success;
+        }
+    }
+
+    // If user-defined anchors are whitelisted, allow the App to not enforce pin validation
+    if (trustBackend.containsUserDefinedTrustAnchor(verifiedChain))
+    {
+        return TrustEvaluationResult::FailedUserDefinedTrustAnchor;
+    }
+    return TrustEvaluationResult::FailedNoMatchingPin;
+}
+
+
+
+TrustEvaluationResult findPinInVerifiedChain(const DerSlice *verifiedChain,
+                                             size_t certificateCount,
+                                             const PinnedDomain &pinnedDomain)
+{
+    if ((verifiedChain == nullptr) || (certificateCount == 0))
+    {
+        return TrustEvaluationResult::ErrorInvalidParameters;
+    }
+
+    // Check each certificate in the chain; start with the CA all the way down to the leaf
+    for (size_t i = certificateCount; i > 0; i--)
+    {
+        std::optional<bool> isPinned = isCertificatePinned(verifiedChain[i - 1], pinnedDomain);
+        if (!isPinned)
+        {
+            return TrustEvaluationResult::ErrorCouldNotGenerateSpkiHash;
+        }
+        if (*isPinned)
+        {
+            return TrustEvaluationResult::Success;
+        }
+    }
+    return TrustEvaluationResult::FailedNoMatchingPin;
+}
+
+
+TrustEvaluationResult findPinInSpkiHashes(const ChainSpkiHash *spkiHashes,
+                                          size_t hashCount,
+                                          const PinnedDomain &pinnedDomain)
+{
+    if ((spkiHashes == nullptr) || (hashCount == 0))
+    {
+        return TrustEvaluationResult::ErrorInvalidParameters;
+    }
+
+    // Whichever certificate the pin is for, the outcome is the same
+    for (size_t i = 0; i < hashCount; i++)
+    {
+        if (pinnedDomain.containsPin(spkiHashes[i].spkiHash))
+        {
+            return TrustEvaluationResult::Success;
+        }
+    }
+    return TrustEvaluationResult::FailedNoMatchingPin;
+}
+
+
+bool shouldCheckPins(const DomainPinningPolicy &domainPolicy, std::chrono::system_clock::time_point evaluationTime)
+{
+    if (domainPolicy.expirationDate && (*domainPolicy.expirationDate < evaluationTime))
+    {
+        // The pinning policy has expired
+        return false;
+    }
+    // A subdomain that was explicitly excluded from the parent domain's policy has no pins
+    return !domainPolicy.excludeSubdomainFromParentPolicy;
+}
+
+
+TrustDecision trustDecisionForEvaluationResult(TrustEvaluationResult evaluationResult,
+                                               const DomainPinningPolicy &domainPolicy,
+                                               bool ignorePinsForUserTrustAnchors)
+{
+    if (evaluationResult == TrustEvaluationResult::Success)
+    {
+        return TrustDecision::ShouldAllowConnection;
+    }
+    else if ((evaluationResult == TrustEvaluationResult::FailedUserDefinedTrustAnchor) && ignorePinsForUserTrustAnchors)
+    {
+        // User-defined trust anchors can be whitelisted (for corporate proxies, etc.)
+        return TrustDecision::ShouldAllowConnection;
+    }
+    else if (evaluationResult == TrustEvaluationResult::FailedNoMatchingPin)
+    {
+        // Is pinning enforced?
+        return domainPolicy.enforcePinning ? TrustDecision::ShouldBlockConnection : TrustDecision::ShouldAllowConnection;
+    }
+    // Misc pinning errors (such as invalid certificate chain) - block the connection
+    return TrustDecision::ShouldBlockConnection;
+}
+
+
+void recordValidationMetrics(const ValidationResult &validationResult)
+{
+    if (validationResult.evaluationResult)
+    {
+        TSKMetricsIncrement(metricForEvaluationResult(*validationResult.evaluationResult));
+    }
+    TSKMetricsIncrement(metricForTrustDecision(validationResult.finalTrustDecision));
+}
+
+} // namespace trustkit
@@ -0,0 +1,56 @@
+/*
+
+ pin_verifier.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_pin_verifier_h
+#define TrustKit_pin_verifier_h
+
+#include "der_certificate.h"
+#include "pinning_policy.h"
+#include "trust_backend.h"
+
+#include <chrono>
+
+namespace trustkit {
+
+// Validate the server's certificate chain with the backend, then look for one of the domain's pins in the validated
+// chain, from the trust anchor down to the leaf certificate; this does the same as verifyPublicKeyPin()
+TrustEvaluationResult verifyPublicKeyPin(const CertificateChain &serverChain,
+                                         const std::string &serverHostname,
+                                         const PinnedDomain &pinnedDomain,
+                                         TrustBackend &trustBackend);
+
+// Look for one of the domain's pins in a chain that was already validated, from the trust anchor down to the leaf
+// certificate; the certificates are not copied
+TrustEvaluationResult findPinInVerifiedChain(const DerSlice *verifiedChain,
+                                             size_t certificateCount,
+                                             const PinnedDomain &pinnedDomain);
+
+// Look for one of the domain's pins among the hashes of the subject public key info of a validated chain's certificates
+TrustEvaluationResult findPinInSpkiHashes(const ChainSpkiHash *spkiHashes,
+                                          size_t hashCount,
+                                          const PinnedDomain &pinnedDomain);
+
+// Whether the pins of a domain have to be checked: its policy did not expire at the evaluation time, and the domain is
+// not excluded from its parent domain's policy
+bool shouldCheckPins(const DomainPinningPolicy &domainPolicy,
+                     std::chrono::system_clock::time_point evaluationTime = std::chrono::system_clock::now());
+
+// The decision for the outcome of the pin check of a domain, the same as TSKPinningValidator's
+TrustDecision trustDecisionForEvaluationResult(TrustEvaluationResult evaluationResult,
+                                               const DomainPinningPolicy &domainPolicy,
+                                               bool ignorePinsForUserTrustAnchors);
+
+// Count a validation in the metrics registry
+void recordValidationMetrics(const ValidationResult &validationResult);
+
+} // namespace trustkit
+
+#endif /* TrustKit_pin_verifier_h */
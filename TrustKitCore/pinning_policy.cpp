@@ -0,0 +1,231 @@
+/*
+
+ pinning_policy.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "pinning_policy.h"
+
+#include "../TrustKit/Dependencies/domain_registry/domain_registry.h"
+#include "../TrustKit/Pinning/base64_codec.h"
+#include "../TrustKit/Pinning/pin_set.h"
+#include "../TrustKit/metrics_registry.h"
+
+#include <algorithm>
+#include <cstring>
+#include <new>
+
+namespace trustkit {
+
+namespace {
+
+// Days since 1970-01-01 of a date in the proleptic Gregorian calendar
+int64_t daysFromCivil(int64_t year, unsigned month, unsigned day)
+{
+    year -= (month <= 2);
+    int64_t era = ((year >= 0) ? year : year - 399) / 400;
+    unsigned yearOfEra = static_cast<unsigned>(year - era * 400);
+    unsigned dayOfYear = (153 * ((month > 2) ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + static_cast<int64_t>(dayOfEra) - 719468;
+}
+
+bool parseDigits(std::string_view digits, unsigned *value)
+{
+    *value = 0;
+    for (char digit : digits)
+    {
+        if ((digit < '0') || (digit > '9'))
+        {
+            return false;
+        }
+        *value = *value * 10 + static_cast<unsigned>(digit - '0');
+    }
+    return true;
+}
+
+} // namespace
+
+
+Pin pinFromBase64(std::string_view base64Pin)
+{
+    // The 44 characters of a SHA-256 pin decode to at most 33 bytes; longer pins are rejected without being decoded
+    uint8_t pinBytes[TSK_PIN_LENGTH + 1];
+    size_t pinLength = 0;
+    if ((TSKBase64DecodedMaxLength(base64Pin.size()) > sizeof(pinBytes))
+        || !TSKBase64Decode(base64Pin.data(), base64Pin.size(), pinBytes, &pinLength)
+        || (pinLength != TSK_PIN_LENGTH))
+    {
+        throw ConfigurationError("Invalid pin " + std::string(base64Pin));
+    }
+    Pin pin;
+    std::copy(pinBytes, pinBytes + TSK_PIN_LENGTH, pin.begin());
+    return pin;
+}
+
+
+std::chrono::system_clock::time_point expirationDateFromString(std::string_view date)
+{
+    unsigned year, month, day;
+    if ((date.size() != 10) || (date[4] != '-') || (date[7] != '-')
+        || !parseDigits(date.substr(0, 4), &year) || !parseDigits(date.substr(5, 2), &month) || !parseDigits(date.substr(8, 2), &day)
+        || (month < 1) || (month > 12) || (day < 1) || (day > 31))
+    {
+        throw ConfigurationError("Invalid expiration date " + std::string(date));
+    }
+    std::chrono::hours hoursSinceEpoch(daysFromCivil(year, month, day) * 24);
+    return std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(hoursSinceEpoch));
+}
+
+
+// PinnedDomain
+
+PinnedDomain::PinnedDomain(DomainPinningPolicy policy)
+    : _policy(std::move(policy))
+{
+    static_assert(sizeof(Pin) == TSK_PIN_LENGTH, "Pins must be packed");
+    _pinSet = TSKPinSetCreate(reinterpret_cast<const uint8_t (*)[TSK_PIN_LENGTH]>(_policy.publicKeyHashes.data()),
+                              _policy.publicKeyHashes.size());
+    if (_pinSet == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+}
+
+PinnedDomain::~PinnedDomain()
+{
+    TSKPinSetDestroy(_pinSet);
+}
+
+size_t PinnedDomain::pinCount() const
+{
+    return TSKPinSetGetCount(_pinSet);
+}
+
+bool PinnedDomain::containsPin(const Pin &pin) const
+{
+    return TSKPinSetContains(_pinSet, pin.data());
+}
+
+
+// PinningPolicy
+
+PinningPolicy::PinningPolicy(std::vector<DomainPinningPolicy> domainPolicies)
+{
+    InitializeDomainRegistry();
+    if (domainPolicies.empty())
+    {
+        throw ConfigurationError("No pinned domains");
+    }
+
+    for (DomainPinningPolicy &domainPolicy : domainPolicies)
+    {
+        const std::string &domain = domainPolicy.domain;
+        size_t registryLength = GetRegistryLength(domain.c_str());
+        if (registryLength == 0)
+        {
+            throw ConfigurationError("Invalid domain " + domain);
+        }
+
+        if (domainPolicy.excludeSubdomainFromParentPolicy)
+        {
+            if (!domainPolicy.publicKeyHashes.empty() || domainPolicy.includeSubdomains || domainPolicy.expirationDate)
+            {
+                throw ConfigurationError("excludeSubdomainFromParentPolicy set along with other settings for domain " + domain);
+            }
+        }
+        else
+        {
+            // Prevent pinning on *.com
+            if (domainPolicy.includeSubdomains && (registryLength == domain.size()))
+            {
+                throw ConfigurationError("includeSubdomains set for a domain suffix " + domain);
+            }
+        }
+
+        std::string key = domain;
+        auto pinnedDomain = std::make_unique<PinnedDomain>(std::move(domainPolicy));
+        size_t requiredPinCount = pinnedDomain->policy().enforcePinning ? 2 : 1;
+        if (!pinnedDomain->policy().excludeSubdomainFromParentPolicy && (pinnedDomain->pinCount() < requiredPinCount))
+        {
+            throw ConfigurationError("Less than " + std::to_string(requiredPinCount) + " pins (ie. no backup pins) for domain " + key);
+        }
+        _pinnedDomains[key] = DomainEntry{ std::move(pinnedDomain), registryLength };
+    }
+
+    // Lastly, ensure that we can find a parent policy for subdomains configured with excludeSubdomainFromParentPolicy
+    for (const auto &entry : _pinnedDomains)
+    {
+        // To force the lookup of a parent domain, we prepend 'a' to this subdomain so we don't retrieve its policy
+        if (entry.second.pinnedDomain->policy().excludeSubdomainFromParentPolicy && (findPinnedDomain("a" + entry.first) == nullptr))
+        {
+            throw ConfigurationError("excludeSubdomainFromParentPolicy set but no parent domain policy for domain " + entry.first);
+        }
+    }
+}
+
+
+const PinnedDomain *PinningPolicy::findPinnedDomain(std::string_view hostname) const
+{
+    auto exactMatch = _pinnedDomains.find(hostname);
+    if (exactMatch != _pinnedDomains.end())
+    {
+        return exactMatch->second.pinnedDomain.get();
+    }
+
+    // No pins explicitly configured for this domain; look up its parent domains, closest first, for an
+    // includeSubdomains policy that applies. This matches what isSubdomain() in configuration_utils.m accepts
+
+    // GetRegistryLength() takes a C string; copy the hostname on the stack, as longer hostnames are invalid anyway
+    char hostnameString[256];
+    if (hostname.size() >= sizeof(hostnameString))
+    {
+        return nullptr;
+    }
+    std::memcpy(hostnameString, hostname.data(), hostname.size());
+    hostnameString[hostname.size()] = '\0';
+    size_t hostnameRegistryLength = 0;
+    bool isRegistryLengthKnown = false;
+
+    for (size_t labelEnd = hostname.find('.'); labelEnd != std::string_view::npos; labelEnd = hostname.find('.', labelEnd + 1))
+    {
+        auto parentMatch = _pinnedDomains.find(hostname.substr(labelEnd + 1));
+        if ((parentMatch == _pinnedDomains.end()) || !parentMatch->second.pinnedDomain->policy().includeSubdomains)
+        {
+            continue;
+        }
+
+        // Ensure that the TLDs are the same; this can get tricky with TLDs like .co.uk so we take a cautious approach
+        size_t domainRegistryLength = parentMatch->second.registryLength;
+        if (!isRegistryLengthKnown)
+        {
+            hostnameRegistryLength = GetRegistryLength(hostnameString);
+            isRegistryLengthKnown = true;
+            TSKMetricsAdd(TSKMetricRegistryLookups, 1);
+        }
+        if ((hostnameRegistryLength == domainRegistryLength) && (parentMatch->first.size() > domainRegistryLength))
+        {
+            return parentMatch->second.pinnedDomain.get();
+        }
+    }
+    return nullptr;
+}
+
+
+std::vector<DomainPinningPolicy> PinningPolicy::domainPolicies() const
+{
+    std::vector<DomainPinningPolicy> domainPolicies;
+    domainPolicies.reserve(_pinnedDomains.size());
+    for (const auto &entry : _pinnedDomains)
+    {
+        domainPolicies.push_back(entry.second.pinnedDomain->policy());
+    }
+    return domainPolicies;
+}
+
+} // namespace trustkit
@@ -0,0 +1,120 @@
+/*
+
+ pinning_policy.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_pinning_policy_h
+#define TrustKit_pinning_policy_h
+
+#include "trust_decision.h"
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct TSKPinSet;
+
+namespace trustkit {
+
+// Thrown when a pinning policy is invalid; the same checks as parseTrustKitConfiguration() are performed
+class ConfigurationError : public std::invalid_argument
+{
+public:
+    using std::invalid_argument::invalid_argument;
+};
+
+// The pinning policy of a domain, with the same settings and defaults as the TSKDomainConfigurationKey settings
+struct DomainPinningPolicy
+{
+    std::string domain;
+
+    // kTSKPublicKeyHashes; at least two pins, including a backup pin, are required when pinning is enforced
+    std::vector<Pin> publicKeyHashes;
+
+    // kTSKEnforcePinning
+    bool enforcePinning = true;
+
+    // kTSKIncludeSubdomains
+    bool includeSubdomains = false;
+
+    // kTSKExcludeSubdomainFromParentPolicy; no other setting can be set along with it
+    bool excludeSubdomainFromParentPolicy = false;
+
+    // kTSKExpirationDate; the policy is not enforced anymore after this date
+    std::optional<std::chrono::system_clock::time_point> expirationDate;
+};
+
+// Decode a pin from the base64 form used in TrustKit configurations; throw ConfigurationError if it is invalid
+Pin pinFromBase64(std::string_view base64Pin);
+
+// Convert an expiration date in the yyyy-MM-dd format of kTSKExpirationDate to the start of that day in UTC;
+// throw ConfigurationError if it is invalid
+std::chrono::system_clock::time_point expirationDateFromString(std::string_view date);
+
+
+// A configured domain and the set of its pins
+class PinnedDomain
+{
+public:
+    explicit PinnedDomain(DomainPinningPolicy policy);
+    ~PinnedDomain();
+
+    PinnedDomain(const PinnedDomain &) = delete;
+    PinnedDomain &operator=(const PinnedDomain &) = delete;
+
+    const DomainPinningPolicy &policy() const { return _policy; }
+
+    // The number of distinct pins
+    size_t pinCount() const;
+
+    bool containsPin(const Pin &pin) const;
+
+private:
+    DomainPinningPolicy _policy;
+    TSKPinSet *_pinSet = nullptr;
+};
+
+
+// The pinning policies of all the configured domains
+class PinningPolicy
+{
+public:
+    // Throw ConfigurationError if a domain policy is invalid, or if no domain is configured
+    explicit PinningPolicy(std::vector<DomainPinningPolicy> domainPolicies);
+
+    // Find the domain whose policy applies to the hostname: the hostname itself if it is configured, otherwise the
+    // configured parent domain with includeSubdomains that is the closest to it; return null if there is none.
+    // This does the same as getPinningConfigurationKeyForDomain()
+    const PinnedDomain *findPinnedDomain(std::string_view hostname) const;
+
+    size_t domainCount() const { return _pinnedDomains.size(); }
+
+    // The policies of all the configured domains, sorted by domain
+    std::vector<DomainPinningPolicy> domainPolicies() const;
+
+private:
+    struct DomainEntry
+    {
+        std::unique_ptr<PinnedDomain> pinnedDomain;
+
+        // GetRegistryLength() of the domain, computed once
+        size_t registryLength = 0;
+    };
+
+    std::map<std::string, DomainEntry, std::less<>> _pinnedDomains;
+};
+
+} // namespace trustkit
+
+#endif /* TrustKit_pinning_policy_h */
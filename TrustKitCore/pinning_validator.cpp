@@ -0,0 +1,271 @@
+/*
+
+ pinning_validator.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "pinning_validator.h"
+
+#include "der_certificate.h"
+#include "pin_verifier.h"
+
+#include "../TrustKit/metrics_registry.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <iterator>
+#include <stdexcept>
+
+namespace trustkit {
+
+// An evaluation of the pins of a certificate chain for a hostname, that other threads evaluating the
+// same chain for the same hostname at the same time can wait for instead of doing the same work
+struct PinningValidator::InFlightEvaluation
+{
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool isDone = false;
+    TrustEvaluationResult result = TrustEvaluationResult::ErrorInvalidParameters;
+};
+
+
+PinningValidator::PinningValidator(std::shared_ptr<const PinningPolicy> pinningPolicy,
+                                   std::shared_ptr<TrustBackend> trustBackend,
+                                   bool ignorePinsForUserTrustAnchors)
+    : _pinningPolicy(std::move(pinningPolicy)),
+      _trustBackend(std::move(trustBackend)),
+      _ignorePinsForUserTrustAnchors(ignorePinsForUserTrustAnchors)
+{
+    if (!_pinningPolicy || !_trustBackend)
+    {
+        throw std::invalid_argument("A pinning policy and a trust backend are required");
+    }
+}
+
+
+ValidationResult PinningValidator::validate(const CertificateChain &serverChain, const std::string &serverHostname)
+{
+    std::shared_ptr<ValidationTraceRecorder> traceRecorder = this->traceRecorder();
+    if (!traceRecorder)
+    {
+        return validateChain(serverChain, serverHostname);
+    }
+
+    std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+    ValidationResult validationResult = validateChain(serverChain, serverHostname);
+    std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+    std::vector<DerSlice> serverChainSlices;
+    serverChainSlices.reserve(serverChain.size());
+    for (const std::vector<uint8_t> &certificate : serverChain)
+    {
+        serverChainSlices.push_back({ certificate.data(), certificate.size() });
+    }
+    traceRecorder->record(TracedValidationKind::TrustBackend, _pinningPolicy, serverChainSlices.data(),
+                          serverChainSlices.size(), serverHostname, validationResult, startTime, endTime);
+    return validationResult;
+}
+
+
+ValidationResult PinningValidator::validateChain(const CertificateChain &serverChain, const std::string &serverHostname)
+{
+    ValidationResult validationResult;
+    if (serverChain.empty() || serverHostname.empty())
+    {
+        validationResult.finalTrustDecision = TrustDecision::ShouldBlockConnection;
+        recordValidationMetrics(validationResult);
+        return validationResult;
+    }
+
+    // Retrieve the pinning configuration for this specific domain, if there is one
+    const PinnedDomain *pinnedDomain = _pinningPolicy->findPinnedDomain(serverHostname);
+    if (pinnedDomain == nullptr)
+    {
+        // The domain has no pinning policy: nothing to do/validate
+        validationResult.finalTrustDecision = TrustDecision::DomainNotPinned;
+    }
+    else
+    {
+        const DomainPinningPolicy &domainPolicy = pinnedDomain->policy();
+        validationResult.notedHostname = domainPolicy.domain;
+        validationResult.pinningPolicy = _pinningPolicy;
+        if (!shouldCheckPins(domainPolicy, evaluationTime()))
+        {
+            validationResult.finalTrustDecision = TrustDecision::DomainNotPinned;
+        }
+        else
+        {
+            TrustEvaluationResult evaluationResult = verifyPins(serverChain, serverHostname, *pinnedDomain);
+            validationResult.evaluationResult = evaluationResult;
+            validationResult.finalTrustDecision = trustDecisionForEvaluationResult(evaluationResult, domainPolicy,
+                                                                                   _ignorePinsForUserTrustAnchors);
+        }
+    }
+    recordValidationMetrics(validationResult);
+    return validationResult;
+}
+
+
+ValidationResult PinningValidator::validateVerifiedChain(const DerSlice *verifiedChain,
+                                                        size_t certificateCount,
+                                                        std::string_view serverHostname) const
+{
+    std::shared_ptr<ValidationTraceRecorder> traceRecorder = this->traceRecorder();
+    std::chrono::steady_clock::time_point startTime;
+    if (traceRecorder)
+    {
+        startTime = std::chrono::steady_clock::now();
+    }
+
+    ValidationResult validationResult = validateWithoutTrustBackend(
+        serverHostname, (verifiedChain != nullptr) && (certificateCount > 0),
+        [&](const PinnedDomain &pinnedDomain) { return findPinInVerifiedChain(verifiedChain, certificateCount, pinnedDomain); });
+
+    if (traceRecorder && (verifiedChain != nullptr))
+    {
+        traceRecorder->record(TracedValidationKind::VerifiedChain, _pinningPolicy, verifiedChain, certificateCount,
+                              serverHostname, validationResult, startTime, std::chrono::steady_clock::now());
+    }
+    return validationResult;
+}
+
+
+ValidationResult PinningValidator::validateSpkiHashes(const ChainSpkiHash *spkiHashes,
+                                                     size_t hashCount,
+                                                     std::string_view serverHostname) const
+{
+    return validateWithoutTrustBackend(serverHostname, (spkiHashes != nullptr) && (hashCount > 0),
+                                       [&](const PinnedDomain &pinnedDomain) {
+                                           return findPinInSpkiHashes(spkiHashes, hashCount, pinnedDomain);
+                                       });
+}
+
+
+// The same steps as validate() for chains that the caller already validated, with findPin() looking for the pins
+template <typename FindPin>
+ValidationResult PinningValidator::validateWithoutTrustBackend(std::string_view serverHostname,
+                                                               bool hasChain,
+                                                               FindPin findPin) const
+{
+    ValidationResult validationResult;
+    if (!hasChain || serverHostname.empty())
+    {
+        validationResult.finalTrustDecision = TrustDecision::ShouldBlockConnection;
+        recordValidationMetrics(validationResult);
+        return validationResult;
+    }
+
+    const PinnedDomain *pinnedDomain = _pinningPolicy->findPinnedDomain(serverHostname);
+    if (pinnedDomain == nullptr)
+    {
+        validationResult.finalTrustDecision = TrustDecision::DomainNotPinned;
+    }
+    else
+    {
+        const DomainPinningPolicy &domainPolicy = pinnedDomain->policy();
+        validationResult.notedHostname = domainPolicy.domain;
+        validationResult.pinningPolicy = _pinningPolicy;
+        if (!shouldCheckPins(domainPolicy, evaluationTime()))
+        {
+            validationResult.finalTrustDecision = TrustDecision::DomainNotPinned;
+        }
+        else
+        {
+            TrustEvaluationResult evaluationResult = findPin(*pinnedDomain);
+            validationResult.evaluationResult = evaluationResult;
+            validationResult.finalTrustDecision = trustDecisionForEvaluationResult(evaluationResult, domainPolicy,
+                                                                                   _ignorePinsForUserTrustAnchors);
+        }
+    }
+    recordValidationMetrics(validationResult);
+    return validationResult;
+}
+
+
+void PinningValidator::setTraceRecorder(std::shared_ptr<ValidationTraceRecorder> traceRecorder)
+{
+    bool isRecording = (traceRecorder != nullptr);
+    std::atomic_store(&_traceRecorder, std::move(traceRecorder));
+    _isRecording.store(isRecording, std::memory_order_release);
+}
+
+// The validations only pay for the shared_ptr's atomic load when they are being recorded
+std::shared_ptr<ValidationTraceRecorder> PinningValidator::traceRecorder() const
+{
+    if (!_isRecording.load(std::memory_order_acquire))
+    {
+        return nullptr;
+    }
+    return std::atomic_load(&_traceRecorder);
+}
+
+
+// Look for one the configured public key pins in the server's certificate chain, unless the same chain is already
+// being evaluated for the same hostname, in which case wait for that evaluation and use its result
+TrustEvaluationResult PinningValidator::verifyPins(const CertificateChain &serverChain,
+                                                   const std::string &serverHostname,
+                                                   const PinnedDomain &pinnedDomain)
+{
+    ChainDigest chainDigest = digestForCertificateChain(serverChain);
+    std::string key;
+    key.reserve(chainDigest.size() + serverHostname.size());
+    key.append(reinterpret_cast<const char *>(chainDigest.data()), chainDigest.size());
+    std::transform(serverHostname.begin(), serverHostname.end(), std::back_inserter(key),
+                   [](unsigned char character) { return static_cast<char>(std::tolower(character)); });
+
+    std::shared_ptr<InFlightEvaluation> evaluation;
+    bool isLeader = false;
+    {
+        std::lock_guard<ContentionCountingMutex> lock(_inFlightMutex);
+        std::shared_ptr<InFlightEvaluation> &inFlightEvaluation = _inFlightEvaluations[key];
+        if (!inFlightEvaluation)
+        {
+            inFlightEvaluation = std::make_shared<InFlightEvaluation>();
+            isLeader = true;
+        }
+        evaluation = inFlightEvaluation;
+    }
+
+    if (!isLeader)
+    {
+        _coalescedPinValidationCount.fetch_add(1, std::memory_order_relaxed);
+        TSKMetricsIncrement(TSKMetricCoalescedPinValidations);
+        std::unique_lock<std::mutex> lock(evaluation->mutex);
+        evaluation->condition.wait(lock, [&evaluation] { return evaluation->isDone; });
+        return evaluation->result;
+    }
+
+    _pinValidationCount.fetch_add(1, std::memory_order_relaxed);
+    TSKMetricsIncrement(TSKMetricPinValidations);
+    TrustEvaluationResult result;
+    try
+    {
+        result = verifyPublicKeyPin(serverChain, serverHostname, pinnedDomain, *_trustBackend);
+    }
+    catch (...)
+    {
+        // Do not leave the other threads waiting forever
+        result = TrustEvaluationResult::ErrorInvalidParameters;
+    }
+
+    // Only the evaluations that started while this one was running use its result; later ones run again
+    {
+        std::lock_guard<ContentionCountingMutex> lock(_inFlightMutex);
+        _inFlightEvaluations.erase(key);
+    }
+    {
+        std::lock_guard<std::mutex> lock(evaluation->mutex);
+        evaluation->result = result;
+        evaluation->isDone = true;
+    }
+    evaluation->condition.notify_all();
+    return result;
+}
+
+} // namespace trustkit
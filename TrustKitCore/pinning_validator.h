@@ -0,0 +1,125 @@
+/*
+
+ pinning_validator.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_pinning_validator_h
+#define TrustKit_pinning_validator_h
+
+#include "contention_counting_mutex.h"
+#include "der_certificate.h"
+#include "pinning_policy.h"
+#include "trust_backend.h"
+#include "validation_trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+namespace trustkit {
+
+// Evaluates server certificate chains against a pinning policy, with the same decisions as TSKPinningValidator.
+// It is safe to use from multiple threads; evaluations of the same chain for the same hostname that run at the
+// same time are coalesced, so that only one of them validates the chain and checks the pins
+class PinningValidator
+{
+public:
+    // ignorePinsForUserTrustAnchors: allow the connections to pinned domains whose chain has no pin but ends with a
+    // user-defined trust anchor, such as a corporate proxy's; the same as kTSKIgnorePinningForUserDefinedTrustAnchors
+    PinningValidator(std::shared_ptr<const PinningPolicy> pinningPolicy,
+                     std::shared_ptr<TrustBackend> trustBackend,
+                     bool ignorePinsForUserTrustAnchors = true);
+
+    PinningValidator(const PinningValidator &) = delete;
+    PinningValidator &operator=(const PinningValidator &) = delete;
+
+    // The server's certificate chain starts with its leaf certificate
+    ValidationResult validate(const CertificateChain &serverChain, const std::string &serverHostname);
+
+    TrustDecision evaluateTrust(const CertificateChain &serverChain, const std::string &serverHostname)
+    {
+        return validate(serverChain, serverHostname).finalTrustDecision;
+    }
+
+    // For TLS stacks that validate the server's chain themselves: only look for the pins in the chain they built,
+    // which starts with the leaf certificate and ends with the trust anchor. The trust backend is not used and the
+    // certificates are not copied; user-defined trust anchors cannot be detected
+    ValidationResult validateVerifiedChain(const DerSlice *verifiedChain,
+                                           size_t certificateCount,
+                                           std::string_view serverHostname) const;
+
+    // For TLS stacks that also hash the subject public key info of the certificates while validating the server's
+    // chain, or cache these hashes: only look for the pins among them, without hashing anything
+    ValidationResult validateSpkiHashes(const ChainSpkiHash *spkiHashes,
+                                        size_t hashCount,
+                                        std::string_view serverHostname) const;
+
+    // The number of chains whose pins were checked, and of evaluations that used the result of an identical check
+    // running at the same time instead
+    uint64_t pinValidationCount() const { return _pinValidationCount.load(std::memory_order_relaxed); }
+    uint64_t coalescedPinValidationCount() const { return _coalescedPinValidationCount.load(std::memory_order_relaxed); }
+
+    // How much the threads validating chains wait for each other to look up and register the evaluations in flight
+    LockContention inFlightLockContention() const { return _inFlightMutex.contention(); }
+
+    const PinningPolicy &pinningPolicy() const { return *_pinningPolicy; }
+
+    // Check the expiration dates of the domain policies as of the supplied time instead of the current time, such as
+    // when replaying a trace; this must be set before the validator is used from multiple threads
+    void setEvaluationTime(std::time_t evaluationTime)
+    {
+        _evaluationTime = std::chrono::system_clock::from_time_t(evaluationTime);
+    }
+
+    // Record the validations of validate() and validateVerifiedChain() to a trace, until it is set to null; nothing
+    // gets recorded by default, and checking for a recorder is all it costs then
+    void setTraceRecorder(std::shared_ptr<ValidationTraceRecorder> traceRecorder);
+
+private:
+    struct InFlightEvaluation;
+
+    ValidationResult validateChain(const CertificateChain &serverChain, const std::string &serverHostname);
+
+    std::shared_ptr<ValidationTraceRecorder> traceRecorder() const;
+
+    std::chrono::system_clock::time_point evaluationTime() const
+    {
+        return _evaluationTime ? *_evaluationTime : std::chrono::system_clock::now();
+    }
+
+    TrustEvaluationResult verifyPins(const CertificateChain &serverChain,
+                                     const std::string &serverHostname,
+                                     const PinnedDomain &pinnedDomain);
+
+    template <typename FindPin>
+    ValidationResult validateWithoutTrustBackend(std::string_view serverHostname, bool hasChain, FindPin findPin) const;
+
+    std::shared_ptr<const PinningPolicy> _pinningPolicy;
+    std::shared_ptr<TrustBackend> _trustBackend;
+    bool _ignorePinsForUserTrustAnchors;
+    std::optional<std::chrono::system_clock::time_point> _evaluationTime;
+
+    ContentionCountingMutex _inFlightMutex;
+    std::unordered_map<std::string, std::shared_ptr<InFlightEvaluation>> _inFlightEvaluations;
+
+    std::atomic<bool> _isRecording{false};
+    std::shared_ptr<ValidationTraceRecorder> _traceRecorder;
+
+    std::atomic<uint64_t> _pinValidationCount{0};
+    std::atomic<uint64_t> _coalescedPinValidationCount{0};
+};
+
+} // namespace trustkit
+
+#endif /* TrustKit_pinning_validator_h */
@@ -0,0 +1,57 @@
+/*
+
+ trust_backend.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_trust_backend_h
+#define TrustKit_trust_backend_h
+
+#include "trust_decision.h"
+
+#include <string>
+
+namespace trustkit {
+
+// The outcome of the platform's validation of a server's certificate chain
+struct ChainEvaluation
+{
+    bool isTrusted = false;
+
+    // The chain that was built and validated, starting with the leaf certificate and ending with the trust anchor;
+    // pins are looked for in this chain rather than in the certificates sent by the server
+    CertificateChain verifiedChain;
+
+    // Why the chain is not trusted, for logging
+    std::string errorDescription;
+};
+
+// Validates certificate chains against a trust store, the same way the platform's TLS stack does; the pinning logic
+// only runs once a chain was validated. Implementations must be safe to call from multiple threads at once
+class TrustBackend
+{
+public:
+    virtual ~TrustBackend() = default;
+
+    // Build a chain from the certificates sent by the server, starting with its leaf certificate, and validate it
+    // for the hostname
+    virtual ChainEvaluation evaluateChain(const CertificateChain &serverChain, const std::string &hostname) = 0;
+
+    // Whether a certificate of a verified chain is a trust anchor that was added to the platform's trust store by the
+    // user or an administrator; only platforms that have such anchors, like macOS, implement it. This is only called
+    // when no pin was found in the chain, as it can be costly
+    virtual bool containsUserDefinedTrustAnchor(const CertificateChain &verifiedChain)
+    {
+        (void)verifiedChain;
+        return false;
+    }
+};
+
+} // namespace trustkit
+
+#endif /* TrustKit_trust_backend_h */
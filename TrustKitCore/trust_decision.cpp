@@ -0,0 +1,50 @@
+/*
+
+ trust_decision.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "trust_decision.h"
+
+namespace trustkit {
+
+const char *trustEvaluationResultName(TrustEvaluationResult result)
+{
+    switch (result)
+    {
+        case TrustEvaluationResult::Success:
+            return "success";
+        case TrustEvaluationResult::FailedNoMatchingPin:
+            return "no_matching_pin";
+        case TrustEvaluationResult::FailedInvalidCertificateChain:
+            return "invalid_certificate_chain";
+        case TrustEvaluationResult::ErrorInvalidParameters:
+            return "invalid_parameters";
+        case TrustEvaluationResult::FailedUserDefinedTrustAnchor:
+            return "user_defined_trust_anchor";
+        case TrustEvaluationResult::ErrorCouldNotGenerateSpkiHash:
+            return "could_not_generate_spki_hash";
+    }
+    return "unknown";
+}
+
+const char *trustDecisionName(TrustDecision decision)
+{
+    switch (decision)
+    {
+        case TrustDecision::ShouldAllowConnection:
+            return "allow";
+        case TrustDecision::ShouldBlockConnection:
+            return "block";
+        case TrustDecision::DomainNotPinned:
+            return "not_pinned";
+    }
+    return "unknown";
+}
+
+} // namespace trustkit
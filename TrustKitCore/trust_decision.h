@@ -0,0 +1,84 @@
+/*
+
+ trust_decision.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_trust_decision_h
+#define TrustKit_trust_decision_h
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace trustkit {
+
+class PinningPolicy;
+
+// The same values, in the same order, as TSKTrustEvaluationResult
+enum class TrustEvaluationResult
+{
+    Success,
+    FailedNoMatchingPin,
+    FailedInvalidCertificateChain,
+    ErrorInvalidParameters,
+    FailedUserDefinedTrustAnchor,
+    ErrorCouldNotGenerateSpkiHash,
+};
+
+// The same values, in the same order, as TSKTrustDecision
+enum class TrustDecision
+{
+    ShouldAllowConnection,
+    ShouldBlockConnection,
+    DomainNotPinned,
+};
+
+// The SHA-256 digest of a certificate's DER-encoded subject public key info
+using Pin = std::array<uint8_t, 32>;
+
+// The pin of a certificate of a validated chain, as computed by the TLS stack; the leaf certificate is at index 0
+struct ChainSpkiHash
+{
+    size_t chainIndex = 0;
+    Pin spkiHash{};
+};
+
+// The SHA-256 digest of the digests of the certificates of a chain
+using ChainDigest = std::array<uint8_t, 32>;
+
+// DER-encoded certificates, starting with the server's leaf certificate
+using CertificateChain = std::vector<std::vector<uint8_t>>;
+
+// The outcome of the evaluation of a server's certificate chain for a hostname
+struct ValidationResult
+{
+    TrustDecision finalTrustDecision = TrustDecision::ShouldBlockConnection;
+
+    // Only set if the pins were checked: the domain is pinned, and its policy did not expire
+    std::optional<TrustEvaluationResult> evaluationResult;
+
+    // The configured domain whose policy applied, if any; it points into pinningPolicy, so that no string gets copied
+    std::string_view notedHostname;
+
+    // The pinning policy that notedHostname belongs to, kept alive along with the result
+    std::shared_ptr<const PinningPolicy> pinningPolicy;
+};
+
+const char *trustEvaluationResultName(TrustEvaluationResult result);
+
+const char *trustDecisionName(TrustDecision decision);
+
+} // namespace trustkit
+
+#endif /* TrustKit_trust_decision_h */
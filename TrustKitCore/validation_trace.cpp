@@ -0,0 +1,614 @@
+/*
+
+ validation_trace.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "validation_trace.h"
+
+#include "../TrustKit/Dependencies/domain_registry/domain_registry.h"
+#include "../TrustKit/Pinning/sha256_engine.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+namespace trustkit {
+
+namespace {
+
+const char kTraceMagic[8] = { 'T', 'S', 'K', 'T', 'R', 'A', 'C', 'E' };
+const uint8_t kTraceVersion = 1;
+
+// Entry types
+const uint8_t kPolicyEntry = 'P';
+const uint8_t kHostnameEntry = 'H';
+const uint8_t kChainEntry = 'C';
+const uint8_t kValidationEntry = 'V';
+
+// DomainPinningPolicy flags
+const uint8_t kEnforcePinningFlag = 1 << 0;
+const uint8_t kIncludeSubdomainsFlag = 1 << 1;
+const uint8_t kExcludeSubdomainFlag = 1 << 2;
+const uint8_t kExpirationDateFlag = 1 << 3;
+
+const uint8_t kNoEvaluationResult = 0xff;
+
+// Hand the buffered entries to the writing thread once there are that many bytes
+const size_t kFlushThreshold = 64 * 1024;
+
+// Stop recording when that many bytes are waiting to be written
+const size_t kMaxQueuedByteCount = 16 * 1024 * 1024;
+
+// Thrown when the trace ends in the middle of an entry
+class TruncatedTraceError : public std::runtime_error
+{
+public:
+    TruncatedTraceError() : std::runtime_error("Truncated trace") {}
+};
+
+void appendInteger(std::string &buffer, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        buffer.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<char>(value));
+}
+
+// Signed integers are zigzag-encoded, so that small negative values stay short
+void appendSignedInteger(std::string &buffer, int64_t value)
+{
+    appendInteger(buffer, (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+void appendBytes(std::string &buffer, const void *bytes, size_t length)
+{
+    appendInteger(buffer, length);
+    buffer.append(static_cast<const char *>(bytes), length);
+}
+
+const size_t kHmacBlockLength = 64;
+
+// Hex digits of the HMAC-SHA256 of an anonymized label that are kept, which is plenty to tell the labels apart
+const size_t kAnonymizedLabelLength = 16;
+
+// The first kAnonymizedLabelLength hex digits of HMAC-SHA256(key, label); the key is already padded to a block
+void appendAnonymizedLabel(std::string &hostname, const std::vector<uint8_t> &paddedKey, std::string_view label)
+{
+    std::vector<uint8_t> message(kHmacBlockLength + std::max(label.size(), size_t(TSK_SHA256_DIGEST_LENGTH)));
+    for (size_t i = 0; i < kHmacBlockLength; i++)
+    {
+        message[i] = paddedKey[i] ^ 0x36;
+    }
+    std::memcpy(message.data() + kHmacBlockLength, label.data(), label.size());
+    uint8_t digest[TSK_SHA256_DIGEST_LENGTH];
+    TSKSHA256Hash(message.data(), kHmacBlockLength + label.size(), digest);
+
+    for (size_t i = 0; i < kHmacBlockLength; i++)
+    {
+        message[i] = paddedKey[i] ^ 0x5c;
+    }
+    std::memcpy(message.data() + kHmacBlockLength, digest, sizeof(digest));
+    TSKSHA256Hash(message.data(), kHmacBlockLength + sizeof(digest), digest);
+
+    const char *hexDigits = "0123456789abcdef";
+    for (size_t i = 0; i < kAnonymizedLabelLength / 2; i++)
+    {
+        hostname.push_back(hexDigits[digest[i] >> 4]);
+        hostname.push_back(hexDigits[digest[i] & 0xf]);
+    }
+}
+
+} // namespace
+
+
+// ValidationTraceRecorder
+
+ValidationTraceRecorder::ValidationTraceRecorder(const std::string &path, bool recordsCertificates)
+    : _recordsCertificates(recordsCertificates),
+      _recordingStart(std::chrono::steady_clock::now()),
+      _file(path, std::ios::binary | std::ios::trunc)
+{
+    if (!_file)
+    {
+        throw std::runtime_error("Could not create the trace file " + path);
+    }
+    _buffer.append(kTraceMagic, sizeof(kTraceMagic));
+    _buffer.push_back(static_cast<char>(kTraceVersion));
+    appendSignedInteger(_buffer, std::chrono::duration_cast<std::chrono::seconds>(
+                                     std::chrono::system_clock::now().time_since_epoch()).count());
+    _thread = std::thread(&ValidationTraceRecorder::writeBuffers, this);
+}
+
+ValidationTraceRecorder::ValidationTraceRecorder(const std::string &path, const std::vector<uint8_t> &hostnameKey)
+    : ValidationTraceRecorder(path, false)
+{
+    if (hostnameKey.empty())
+    {
+        throw std::invalid_argument("An empty key would not anonymize the hostnames");
+    }
+    // Keys longer than a block are hashed first, as for any HMAC
+    _hostnameKey.assign(kHmacBlockLength, 0);
+    if (hostnameKey.size() > kHmacBlockLength)
+    {
+        TSKSHA256Hash(hostnameKey.data(), hostnameKey.size(), _hostnameKey.data());
+    }
+    else
+    {
+        std::copy(hostnameKey.begin(), hostnameKey.end(), _hostnameKey.begin());
+    }
+}
+
+ValidationTraceRecorder::~ValidationTraceRecorder()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        queueBufferLocked();
+        _isStopping = true;
+    }
+    _bufferQueued.notify_one();
+    _thread.join();
+}
+
+
+void ValidationTraceRecorder::record(TracedValidationKind kind,
+                                     const std::shared_ptr<const PinningPolicy> &pinningPolicy,
+                                     const DerSlice *serverChain,
+                                     size_t certificateCount,
+                                     std::string_view serverHostname,
+                                     const ValidationResult &result,
+                                     std::chrono::steady_clock::time_point startTime,
+                                     std::chrono::steady_clock::time_point endTime) noexcept
+{
+    std::unique_lock<std::mutex> lock(_mutex, std::defer_lock);
+    size_t bufferSize = 0;
+    try
+    {
+        // Hash the chain before taking the lock
+        ChainDigest chainDigest = digestForCertificateChain(serverChain, certificateCount);
+
+        lock.lock();
+        if (_hasStopped)
+        {
+            return;
+        }
+        bufferSize = _buffer.size();
+
+        auto policyIndex = _policyIndexes.find(pinningPolicy.get());
+        if (policyIndex == _policyIndexes.end())
+        {
+            writePolicy(*pinningPolicy);
+            policyIndex = _policyIndexes.emplace(pinningPolicy.get(), _policies.size()).first;
+            _policies.push_back(pinningPolicy);
+        }
+
+        std::string hostname(serverHostname);
+        auto hostnameIndex = _hostnameIndexes.find(hostname);
+        if (hostnameIndex == _hostnameIndexes.end())
+        {
+            _buffer.push_back(static_cast<char>(kHostnameEntry));
+            if (_hostnameKey.empty())
+            {
+                appendBytes(_buffer, hostname.data(), hostname.size());
+            }
+            else
+            {
+                std::string anonymizedHostname = this->anonymizedHostname(hostname, result.notedHostname);
+                appendBytes(_buffer, anonymizedHostname.data(), anonymizedHostname.size());
+            }
+            hostnameIndex = _hostnameIndexes.emplace(std::move(hostname), _hostnameIndexes.size()).first;
+        }
+
+        auto chainIndex = _chainIndexes.find(chainDigest);
+        if (chainIndex == _chainIndexes.end())
+        {
+            _buffer.push_back(static_cast<char>(kChainEntry));
+            _buffer.append(reinterpret_cast<const char *>(chainDigest.data()), chainDigest.size());
+            appendInteger(_buffer, _recordsCertificates ? certificateCount : 0);
+            for (size_t i = 0; _recordsCertificates && (i < certificateCount); i++)
+            {
+                appendBytes(_buffer, serverChain[i].data, serverChain[i].length);
+            }
+            chainIndex = _chainIndexes.emplace(chainDigest, _chainIndexes.size()).first;
+        }
+
+        // The validations are written in the order they finish, so the start times are not always increasing
+        auto relativeStartTime = std::chrono::duration_cast<std::chrono::nanoseconds>(startTime - _recordingStart);
+        _buffer.push_back(static_cast<char>(kValidationEntry));
+        _buffer.push_back(static_cast<char>(kind));
+        appendSignedInteger(_buffer, (relativeStartTime - _previousStartTime).count());
+        appendInteger(_buffer, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(endTime - startTime).count()));
+        appendInteger(_buffer, policyIndex->second);
+        appendInteger(_buffer, hostnameIndex->second);
+        appendInteger(_buffer, chainIndex->second);
+        _buffer.push_back(static_cast<char>(result.finalTrustDecision));
+        _buffer.push_back(static_cast<char>(result.evaluationResult ? static_cast<uint8_t>(*result.evaluationResult) : kNoEvaluationResult));
+        _previousStartTime = relativeStartTime;
+        _recordedValidationCount++;
+
+        if (_buffer.size() < kFlushThreshold)
+        {
+            return;
+        }
+        queueBufferLocked();
+    }
+    catch (...)
+    {
+        // Out of memory: drop the entries of this validation, as the ones it refers to may be missing, and stop
+        if (lock.owns_lock())
+        {
+            _buffer.resize(bufferSize);
+        }
+        else
+        {
+            lock.lock();
+        }
+        _hasStopped = true;
+        return;
+    }
+    lock.unlock();
+    _bufferQueued.notify_one();
+}
+
+
+void ValidationTraceRecorder::writePolicy(const PinningPolicy &pinningPolicy)
+{
+    std::vector<DomainPinningPolicy> domainPolicies = pinningPolicy.domainPolicies();
+    _buffer.push_back(static_cast<char>(kPolicyEntry));
+    appendInteger(_buffer, domainPolicies.size());
+    for (const DomainPinningPolicy &domainPolicy : domainPolicies)
+    {
+        appendBytes(_buffer, domainPolicy.domain.data(), domainPolicy.domain.size());
+        appendInteger(_buffer, domainPolicy.publicKeyHashes.size());
+        for (const Pin &pin : domainPolicy.publicKeyHashes)
+        {
+            _buffer.append(reinterpret_cast<const char *>(pin.data()), pin.size());
+        }
+        uint8_t flags = (domainPolicy.enforcePinning ? kEnforcePinningFlag : 0)
+            | (domainPolicy.includeSubdomains ? kIncludeSubdomainsFlag : 0)
+            | (domainPolicy.excludeSubdomainFromParentPolicy ? kExcludeSubdomainFlag : 0)
+            | (domainPolicy.expirationDate ? kExpirationDateFlag : 0);
+        _buffer.push_back(static_cast<char>(flags));
+        if (domainPolicy.expirationDate)
+        {
+            appendSignedInteger(_buffer, std::chrono::duration_cast<std::chrono::seconds>(
+                                             domainPolicy.expirationDate->time_since_epoch()).count());
+        }
+    }
+}
+
+
+std::string ValidationTraceRecorder::anonymizedHostname(std::string_view serverHostname, std::string_view policyDomain) const
+{
+    // The part of the hostname that is kept: the domain of its policy, or else its public suffix
+    size_t keptLength = 0;
+    if (!policyDomain.empty() && (serverHostname.size() >= policyDomain.size())
+        && (serverHostname.compare(serverHostname.size() - policyDomain.size(), policyDomain.size(), policyDomain) == 0))
+    {
+        keptLength = policyDomain.size();
+    }
+    else
+    {
+        std::string hostname(serverHostname);
+        size_t registryLength = GetRegistryLength(hostname.c_str());
+        keptLength = (registryLength < hostname.size()) ? registryLength : 0;
+    }
+    if (keptLength == serverHostname.size())
+    {
+        return std::string(serverHostname);
+    }
+
+    // Each label is anonymized on its own, so that the subdomains of a domain still have the same labels
+    std::string_view anonymizedPart = serverHostname.substr(0, serverHostname.size() - keptLength);
+    std::string hostname;
+    size_t labelStart = 0;
+    while (labelStart < anonymizedPart.size())
+    {
+        size_t labelEnd = anonymizedPart.find('.', labelStart);
+        if (labelEnd == std::string_view::npos)
+        {
+            labelEnd = anonymizedPart.size();
+        }
+        appendAnonymizedLabel(hostname, _hostnameKey, anonymizedPart.substr(labelStart, labelEnd - labelStart));
+        if (labelEnd < anonymizedPart.size())
+        {
+            hostname.push_back('.');
+        }
+        labelStart = labelEnd + 1;
+    }
+    hostname.append(serverHostname.substr(serverHostname.size() - keptLength));
+    return hostname;
+}
+
+
+void ValidationTraceRecorder::flush()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    queueBufferLocked();
+    _bufferQueued.notify_one();
+    _buffersWritten.wait(lock, [this] { return _queuedBuffers.empty() && !_isWriting; });
+    if (_hasStopped)
+    {
+        throw std::runtime_error("Could not write the whole trace");
+    }
+}
+
+
+void ValidationTraceRecorder::queueBufferLocked()
+{
+    if (_buffer.empty() || _hasStopped)
+    {
+        return;
+    }
+    _queuedByteCount += _buffer.size();
+    _queuedBuffers.push_back(std::move(_buffer));
+    _buffer.clear();
+    if (_queuedByteCount > kMaxQueuedByteCount)
+    {
+        // The file cannot keep up; the entries queued so far still get written
+        _hasStopped = true;
+    }
+}
+
+
+void ValidationTraceRecorder::writeBuffers()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true)
+    {
+        _bufferQueued.wait(lock, [this] { return _isStopping || !_queuedBuffers.empty(); });
+        if (_queuedBuffers.empty())
+        {
+            // Stopping, and everything was written
+            return;
+        }
+
+        std::string buffer = std::move(_queuedBuffers.front());
+        _queuedBuffers.pop_front();
+        _queuedByteCount -= buffer.size();
+        _isWriting = true;
+        lock.unlock();
+
+        _file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        _file.flush();
+        bool hasFailed = !_file;
+
+        lock.lock();
+        _isWriting = false;
+        if (hasFailed)
+        {
+            // Whatever comes next could not be read back anyway
+            _hasStopped = true;
+            _queuedBuffers.clear();
+            _queuedByteCount = 0;
+            _buffer.clear();
+        }
+        if (_queuedBuffers.empty())
+        {
+            _buffersWritten.notify_all();
+        }
+    }
+}
+
+
+bool ValidationTraceRecorder::isRecording() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return !_hasStopped;
+}
+
+
+uint64_t ValidationTraceRecorder::recordedValidationCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _recordedValidationCount;
+}
+
+
+// ValidationTraceReader
+
+ValidationTraceReader::ValidationTraceReader(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Could not open the trace file " + path);
+    }
+    _trace.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if ((_trace.size() < sizeof(kTraceMagic) + 1) || (std::memcmp(_trace.data(), kTraceMagic, sizeof(kTraceMagic)) != 0))
+    {
+        throw std::runtime_error("Not a trace file: " + path);
+    }
+    _offset = sizeof(kTraceMagic);
+    if (readByte() != kTraceVersion)
+    {
+        throw std::runtime_error("Unsupported trace version in " + path);
+    }
+    _recordingTime = static_cast<std::time_t>(readSignedInteger());
+}
+
+
+bool ValidationTraceReader::readValidation(TracedValidation &validation)
+{
+    try
+    {
+        return readNextValidation(validation);
+    }
+    catch (const TruncatedTraceError &)
+    {
+        // The validations before the incomplete entry were all returned already
+        _offset = _trace.size();
+        _isTruncated = true;
+        return false;
+    }
+}
+
+bool ValidationTraceReader::readNextValidation(TracedValidation &validation)
+{
+    while (_offset < _trace.size())
+    {
+        uint8_t entryType = readByte();
+        if (entryType == kPolicyEntry)
+        {
+            readPolicy();
+        }
+        else if (entryType == kHostnameEntry)
+        {
+            _hostnames.push_back(readString());
+        }
+        else if (entryType == kChainEntry)
+        {
+            readChain();
+        }
+        else if (entryType == kValidationEntry)
+        {
+            uint8_t kind = readByte();
+            int64_t startTimeDelta = readSignedInteger();
+            uint64_t duration = readInteger();
+            uint64_t policyIndex = readInteger();
+            uint64_t hostnameIndex = readInteger();
+            uint64_t chainIndex = readInteger();
+            uint8_t finalTrustDecision = readByte();
+            uint8_t evaluationResult = readByte();
+            if ((kind > static_cast<uint8_t>(TracedValidationKind::VerifiedChain)) || (policyIndex >= _policies.size())
+                || (hostnameIndex >= _hostnames.size()) || (chainIndex >= _chains.size())
+                || (finalTrustDecision > static_cast<uint8_t>(TrustDecision::DomainNotPinned))
+                || ((evaluationResult != kNoEvaluationResult)
+                    && (evaluationResult > static_cast<uint8_t>(TrustEvaluationResult::ErrorCouldNotGenerateSpkiHash))))
+            {
+                throw std::runtime_error("Malformed validation in the trace");
+            }
+
+            _previousStartTime += std::chrono::nanoseconds(startTimeDelta);
+            validation.kind = static_cast<TracedValidationKind>(kind);
+            validation.startTime = _previousStartTime;
+            validation.duration = std::chrono::nanoseconds(duration);
+            validation.policyIndex = policyIndex;
+            validation.serverHostname = &_hostnames[hostnameIndex];
+            validation.serverChain = &_chains[chainIndex];
+            validation.chainDigest = _chainDigests[chainIndex];
+            validation.finalTrustDecision = static_cast<TrustDecision>(finalTrustDecision);
+            validation.evaluationResult = (evaluationResult != kNoEvaluationResult)
+                ? std::optional<TrustEvaluationResult>(static_cast<TrustEvaluationResult>(evaluationResult))
+                : std::nullopt;
+            return true;
+        }
+        else
+        {
+            throw std::runtime_error("Unknown entry in the trace");
+        }
+    }
+    return false;
+}
+
+
+uint8_t ValidationTraceReader::readByte()
+{
+    if (_offset >= _trace.size())
+    {
+        throw TruncatedTraceError();
+    }
+    return _trace[_offset++];
+}
+
+uint64_t ValidationTraceReader::readInteger()
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        uint8_t byte = readByte();
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return value;
+        }
+    }
+    throw std::runtime_error("Malformed integer in the trace");
+}
+
+int64_t ValidationTraceReader::readSignedInteger()
+{
+    uint64_t value = readInteger();
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+std::string ValidationTraceReader::readString()
+{
+    uint64_t length = readInteger();
+    if (length > _trace.size() - _offset)
+    {
+        throw TruncatedTraceError();
+    }
+    std::string string(reinterpret_cast<const char *>(_trace.data() + _offset), static_cast<size_t>(length));
+    _offset += static_cast<size_t>(length);
+    return string;
+}
+
+
+void ValidationTraceReader::readPolicy()
+{
+    uint64_t domainCount = readInteger();
+    std::vector<DomainPinningPolicy> domainPolicies;
+    for (uint64_t i = 0; i < domainCount; i++)
+    {
+        DomainPinningPolicy domainPolicy;
+        domainPolicy.domain = readString();
+        uint64_t pinCount = readInteger();
+        for (uint64_t j = 0; j < pinCount; j++)
+        {
+            Pin pin;
+            for (uint8_t &byte : pin)
+            {
+                byte = readByte();
+            }
+            domainPolicy.publicKeyHashes.push_back(pin);
+        }
+        uint8_t flags = readByte();
+        domainPolicy.enforcePinning = (flags & kEnforcePinningFlag) != 0;
+        domainPolicy.includeSubdomains = (flags & kIncludeSubdomainsFlag) != 0;
+        domainPolicy.excludeSubdomainFromParentPolicy = (flags & kExcludeSubdomainFlag) != 0;
+        if (flags & kExpirationDateFlag)
+        {
+            domainPolicy.expirationDate = std::chrono::system_clock::time_point(
+                std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::seconds(readSignedInteger())));
+        }
+        domainPolicies.push_back(std::move(domainPolicy));
+    }
+
+    try
+    {
+        _policies.push_back(std::make_shared<PinningPolicy>(std::move(domainPolicies)));
+    }
+    catch (const ConfigurationError &error)
+    {
+        throw std::runtime_error(std::string("Invalid policy in the trace: ") + error.what());
+    }
+}
+
+void ValidationTraceReader::readChain()
+{
+    ChainDigest chainDigest;
+    for (uint8_t &byte : chainDigest)
+    {
+        byte = readByte();
+    }
+    uint64_t certificateCount = readInteger();
+    CertificateChain chain;
+    for (uint64_t i = 0; i < certificateCount; i++)
+    {
+        std::string certificate = readString();
+        chain.emplace_back(certificate.begin(), certificate.end());
+    }
+    _chainDigests.push_back(chainDigest);
+    _chains.push_back(std::move(chain));
+}
+
+} // namespace trustkit
@@ -0,0 +1,198 @@
+/*
+
+ validation_trace.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_validation_trace_h
+#define TrustKit_validation_trace_h
+
+#include "der_certificate.h"
+#include "pinning_policy.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace trustkit {
+
+// Traces of the validations run by a PinningValidator, so that a real workload can be replayed against another build
+// or policy and its decisions compared. A trace only holds what the validations need: the hostnames, the certificate
+// chains sent by the servers, the pinning policies, the decisions, and the times relative to the start of the trace.
+// These are production data: the hostnames and policies are written as they are unless the hostnames are anonymized,
+// and replaying requires the certificates, which name the servers.
+//
+// The trace is a binary file starting with "TSKTRACE", a version byte and the time the recording started; it is then
+// a sequence of entries starting with their type. Each distinct policy, hostname and chain is only written once,
+// before the first validation that uses it, and validations refer to them by index; integers are LEB128-encoded.
+
+// The PinningValidator method that ran a validation
+enum class TracedValidationKind : uint8_t
+{
+    // validate(), with the trust backend
+    TrustBackend,
+    // validateVerifiedChain()
+    VerifiedChain,
+};
+
+// A validation read from a trace; the hostname and the chain belong to the reader
+struct TracedValidation
+{
+    TracedValidationKind kind = TracedValidationKind::TrustBackend;
+
+    // When the validation started, since the recording started, and how long it took
+    std::chrono::nanoseconds startTime{0};
+    std::chrono::nanoseconds duration{0};
+
+    // Index of the policy in ValidationTraceReader::pinningPolicies()
+    size_t policyIndex = 0;
+
+    const std::string *serverHostname = nullptr;
+
+    // Empty if only the digests of the chains were recorded
+    const CertificateChain *serverChain = nullptr;
+    ChainDigest chainDigest{};
+
+    TrustDecision finalTrustDecision = TrustDecision::ShouldBlockConnection;
+    std::optional<TrustEvaluationResult> evaluationResult;
+};
+
+
+// Writes the validations of one or more PinningValidators to a trace file; see PinningValidator::setTraceRecorder().
+// It is safe to use from multiple threads. The validations are encoded into a buffer, and the full buffers are written
+// to the file by a dedicated thread, so that recording never waits for the file. Recording stops for good, without
+// affecting the validations, if the trace cannot be written or if the writes fall too far behind; the trace then
+// holds the validations that were written until then
+class ValidationTraceRecorder
+{
+public:
+    // Create or truncate the trace file; throw std::runtime_error if it cannot be opened. Without recordsCertificates,
+    // only the digests of the chains are written, which makes for smaller traces that can be analyzed but not replayed
+    explicit ValidationTraceRecorder(const std::string &path, bool recordsCertificates = false);
+
+    // Only write the digests of the chains, and anonymize the hostnames: the labels below the domain of the policy
+    // that applied, or below the public suffix for the domains that are not pinned, are replaced with their keyed
+    // hash, so that the same policies still apply to them and the same hostnames still get the same label
+    ValidationTraceRecorder(const std::string &path, const std::vector<uint8_t> &hostnameKey);
+
+    // Write the buffered entries, then stop the thread
+    ~ValidationTraceRecorder();
+
+    ValidationTraceRecorder(const ValidationTraceRecorder &) = delete;
+    ValidationTraceRecorder &operator=(const ValidationTraceRecorder &) = delete;
+
+    void record(TracedValidationKind kind,
+                const std::shared_ptr<const PinningPolicy> &pinningPolicy,
+                const DerSlice *serverChain,
+                size_t certificateCount,
+                std::string_view serverHostname,
+                const ValidationResult &result,
+                std::chrono::steady_clock::time_point startTime,
+                std::chrono::steady_clock::time_point endTime) noexcept;
+
+    // Write the buffered entries to the file and wait until they were written; throw std::runtime_error if recording
+    // stopped, as the trace is then incomplete
+    void flush();
+
+    // False once recording stopped
+    bool isRecording() const;
+
+    uint64_t recordedValidationCount() const;
+
+private:
+    void writePolicy(const PinningPolicy &pinningPolicy);
+    std::string anonymizedHostname(std::string_view serverHostname, std::string_view policyDomain) const;
+    void queueBufferLocked();
+    void writeBuffers();
+
+    const bool _recordsCertificates;
+    // The HMAC key padded to the SHA-256 block size, if the hostnames are anonymized
+    std::vector<uint8_t> _hostnameKey;
+    const std::chrono::steady_clock::time_point _recordingStart;
+
+    // Only used by the writing thread
+    std::ofstream _file;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _bufferQueued;
+    std::condition_variable _buffersWritten;
+    std::string _buffer;
+    std::deque<std::string> _queuedBuffers;
+    size_t _queuedByteCount = 0;
+    bool _isWriting = false;
+    bool _isStopping = false;
+    bool _hasStopped = false;
+    std::chrono::nanoseconds _previousStartTime{0};
+    uint64_t _recordedValidationCount = 0;
+
+    // The policies are retained so that their addresses do not get reused by other policies
+    std::map<const PinningPolicy *, uint64_t> _policyIndexes;
+    std::vector<std::shared_ptr<const PinningPolicy>> _policies;
+    std::unordered_map<std::string, uint64_t> _hostnameIndexes;
+    std::map<ChainDigest, uint64_t> _chainIndexes;
+
+    // Started last, once the other members are initialized
+    std::thread _thread;
+};
+
+
+// Reads a trace file written by ValidationTraceRecorder
+class ValidationTraceReader
+{
+public:
+    // Throw std::runtime_error if the file cannot be read or is not a trace
+    explicit ValidationTraceReader(const std::string &path);
+
+    // Read the next validation; return false at the end of the trace, and throw std::runtime_error if it is malformed.
+    // A trace whose last entry was cut short, such as when the recording process crashed, ends before that entry
+    bool readValidation(TracedValidation &validation);
+
+    // Whether the trace ended with an incomplete entry, which was ignored
+    bool isTruncated() const { return _isTruncated; }
+
+    // The time the recording started, which the chains can be validated as of
+    std::time_t recordingTime() const { return _recordingTime; }
+
+    // The policies read so far
+    const std::vector<std::shared_ptr<const PinningPolicy>> &pinningPolicies() const { return _policies; }
+
+private:
+    bool readNextValidation(TracedValidation &validation);
+    uint8_t readByte();
+    uint64_t readInteger();
+    int64_t readSignedInteger();
+    std::string readString();
+    void readPolicy();
+    void readChain();
+
+    std::vector<uint8_t> _trace;
+    size_t _offset = 0;
+    bool _isTruncated = false;
+    std::time_t _recordingTime = 0;
+    std::chrono::nanoseconds _previousStartTime{0};
+
+    // Deques, so that the validations that were read can keep pointing to them
+    std::vector<std::shared_ptr<const PinningPolicy>> _policies;
+    std::deque<std::string> _hostnames;
+    std::deque<CertificateChain> _chains;
+    std::deque<ChainDigest> _chainDigests;
+};
+
+} // namespace trustkit
+
+#endif /* TrustKit_validation_trace_h */
@@ -0,0 +1,103 @@
+#!/usr/bin/env python
+"""Compare the JSON output of a TrustKitCore benchmark run with a baseline, such as the checked-in baseline.json.
+
+Both files are written by Google Benchmark with --benchmark_out=<file> --benchmark_out_format=json. When the runs
+have repetitions, their medians are compared. Exits with status 1 if a benchmark got slower than the threshold.
+
+The default threshold depends on how the baseline was recorded: 10% on a machine with several CPUs and a release build
+of Google Benchmark, but 75% otherwise, as the timings of a single-CPU VM drift that much between runs.
+"""
+from __future__ import print_function
+import argparse
+import json
+import sys
+
+
+TIME_UNIT_NANOSECONDS = {'ns': 1.0, 'us': 1e3, 'ms': 1e6, 's': 1e9}
+
+DEFAULT_THRESHOLD = 10.0
+NOISY_BASELINE_THRESHOLD = 75.0
+
+
+def load_benchmark_times(path, metric):
+    """Return the time of each benchmark of a run in nanoseconds, keyed by name."""
+    with open(path) as benchmark_file:
+        benchmarks = json.load(benchmark_file)['benchmarks']
+
+    medians = [b for b in benchmarks if b.get('run_type') == 'aggregate' and b.get('aggregate_name') == 'median']
+    if medians:
+        benchmarks = medians
+    else:
+        benchmarks = [b for b in benchmarks if b.get('run_type', 'iteration') == 'iteration' and not b.get('error_occurred')]
+
+    times = {}
+    for benchmark in benchmarks:
+        name = benchmark.get('run_name', benchmark['name'])
+        times[name] = benchmark[metric] * TIME_UNIT_NANOSECONDS[benchmark.get('time_unit', 'ns')]
+    return times
+
+
+def noisy_baseline_reasons(path):
+    """Return why the baseline's timings are too noisy for the default threshold, if they are."""
+    with open(path) as benchmark_file:
+        context = json.load(benchmark_file).get('context', {})
+
+    reasons = []
+    if context.get('num_cpus', 0) < 2:
+        reasons.append('it was recorded on a single CPU')
+    if context.get('library_build_type') == 'debug':
+        reasons.append('Google Benchmark was a debug build')
+    return reasons
+
+
+def format_time(nanoseconds):
+    for unit, factor in (('s', 1e9), ('ms', 1e6), ('us', 1e3)):
+        if nanoseconds >= factor:
+            return '{:.2f} {}'.format(nanoseconds / factor, unit)
+    return '{:.2f} ns'.format(nanoseconds)
+
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Compare TrustKitCore benchmark results with a baseline.')
+    parser.add_argument('baseline', metavar='BASELINE', help='JSON results of the baseline run')
+    parser.add_argument('contender', metavar='CONTENDER', help='JSON results of the run to compare')
+    parser.add_argument('--metric', choices=['cpu_time', 'real_time'], default='cpu_time',
+                        help='Time to compare; "cpu_time" (default) or "real_time".')
+    parser.add_argument('--threshold', type=float,
+                        help='Slowdown, in percent, above which a benchmark is reported as a regression (default: {:.0f}, '
+                             'or {:.0f} if the baseline is noisy).'.format(DEFAULT_THRESHOLD, NOISY_BASELINE_THRESHOLD))
+    args = parser.parse_args()
+
+    if args.threshold is None:
+        reasons = noisy_baseline_reasons(args.baseline)
+        args.threshold = NOISY_BASELINE_THRESHOLD if reasons else DEFAULT_THRESHOLD
+        if reasons:
+            print('Using a {:.0f}% threshold as the baseline is noisy: {}\n'.format(args.threshold, ', '.join(reasons)))
+
+    baseline_times = load_benchmark_times(args.baseline, args.metric)
+    contender_times = load_benchmark_times(args.contender, args.metric)
+
+    name_width = max([len(name) for name in baseline_times] + [len('Benchmark')])
+    print('{:<{}}  {:>12}  {:>12}  {:>8}'.format('Benchmark', name_width, 'Baseline', 'Contender', 'Change'))
+    regressions = []
+    for name, baseline_time in baseline_times.items():
+        if name not in contender_times:
+            print('{:<{}}  {:>12}  {:>12}'.format(name, name_width, format_time(baseline_time), 'missing'))
+            continue
+
+        contender_time = contender_times[name]
+        change = (contender_time - baseline_time) * 100.0 / baseline_time
+        is_regression = change > args.threshold
+        if is_regression:
+            regressions.append(name)
+        print('{:<{}}  {:>12}  {:>12}  {:>+7.1f}%{}'.format(name, name_width, format_time(baseline_time),
+                                                          format_time(contender_time), change,
+                                                          '  REGRESSION' if is_regression else ''))
+
+    for name in contender_times:
+        if name not in baseline_times:
+            print('{:<{}}  {:>12}  {:>12}'.format(name, name_width, 'new', format_time(contender_times[name])))
+
+    if regressions:
+        print('\n{} benchmark(s) slower than the baseline by more than {:.0f}%'.format(len(regressions), args.threshold))
+        sys.exit(1)
@@ -0,0 +1,110 @@
+/*
+
+ curl_benchmarks.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "Integrations/curl_pinning.h"
+#include "test_tls_server.h"
+
+#include <benchmark/benchmark.h>
+
+using namespace trustkit;
+
+namespace {
+
+size_t discardBody(char *data, size_t size, size_t count, void *context)
+{
+    (void)data;
+    (void)context;
+    return size * count;
+}
+
+} // namespace
+
+
+// Batches of concurrent transfers on a curl_multi loop, each on a new connection to a local TLS server, with and
+// without pinning
+static void BM_CurlMultiTransfers(benchmark::State &state)
+{
+    bool isPinningEnabled = state.range(0) != 0;
+    const int concurrentTransferCount = static_cast<int>(state.range(1));
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    TestCertificateAuthority certificateAuthority;
+    TestTLSServer server(certificateAuthority, { "www.good.com" }, 8, true);
+
+    DomainPinningPolicy domainPolicy;
+    domainPolicy.domain = "www.good.com";
+    domainPolicy.publicKeyHashes = { pinFromBase64("K87oWBWM9UZfyddvDfoxL+8lpNyoUB2ptGtn0fv6G2Q="), certificateAuthority.pin() };
+    CurlPinning curlPinning(std::make_shared<PinningPolicy>(std::vector<DomainPinningPolicy>{ domainPolicy }),
+                            [](const std::string &, const ValidationResult &) {});
+
+    std::string url = "https://www.good.com:" + std::to_string(server.port()) + "/";
+    curl_slist *resolvedHosts = curl_slist_append(nullptr, ("www.good.com:" + std::to_string(server.port()) + ":127.0.0.1").c_str());
+    std::string certificateAuthorityPem = certificateAuthority.pem();
+    curl_blob certificateAuthorityBlob = { &certificateAuthorityPem[0], certificateAuthorityPem.size(), CURL_BLOB_COPY };
+
+    CURLM *multiHandle = curl_multi_init();
+    int64_t failedCount = 0;
+    for (auto _ : state)
+    {
+        for (int i = 0; i < concurrentTransferCount; i++)
+        {
+            CURL *handle = curl_easy_init();
+            curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
+            curl_easy_setopt(handle, CURLOPT_RESOLVE, resolvedHosts);
+            curl_easy_setopt(handle, CURLOPT_CAINFO_BLOB, &certificateAuthorityBlob);
+            curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, discardBody);
+            if (isPinningEnabled)
+            {
+                curlPinning.addHandle(multiHandle, handle);
+            }
+            else
+            {
+                curl_multi_add_handle(multiHandle, handle);
+            }
+        }
+
+        int runningCount = 0;
+        curl_multi_perform(multiHandle, &runningCount);
+        while (runningCount > 0)
+        {
+            curl_multi_poll(multiHandle, nullptr, 0, 100, nullptr);
+            curl_multi_perform(multiHandle, &runningCount);
+        }
+
+        int messageCount = 0;
+        while (CURLMsg *message = curl_multi_info_read(multiHandle, &messageCount))
+        {
+            if (message->msg == CURLMSG_DONE)
+            {
+                failedCount += (message->data.result != CURLE_OK);
+                curl_multi_remove_handle(multiHandle, message->easy_handle);
+                curl_easy_cleanup(message->easy_handle);
+            }
+        }
+    }
+    curl_multi_cleanup(multiHandle);
+    curl_slist_free_all(resolvedHosts);
+
+    if (failedCount > 0)
+    {
+        state.SkipWithError("Some transfers failed");
+    }
+    state.SetItemsProcessed(state.iterations() * concurrentTransferCount);
+    state.counters["handshakes"] = static_cast<double>(server.handshakeCount());
+}
+BENCHMARK(BM_CurlMultiTransfers)
+    ->ArgNames({ "pinning", "concurrent" })
+    ->Args({ 0, 1 })
+    ->Args({ 1, 1 })
+    ->Args({ 0, 32 })
+    ->Args({ 1, 32 })
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
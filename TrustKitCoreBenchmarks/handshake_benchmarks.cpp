@@ -0,0 +1,216 @@
+/*
+
+ handshake_benchmarks.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "Backends/openssl_trust_backend.h"
+#include "Integrations/openssl_pinning_verifier.h"
+#include "pinning_validator.h"
+#include "test_tls_server.h"
+
+#include <benchmark/benchmark.h>
+
+#include <openssl/x509_vfy.h>
+#include <openssl/x509v3.h>
+
+using namespace trustkit;
+
+namespace {
+
+const char *kBackupPin = "K87oWBWM9UZfyddvDfoxL+8lpNyoUB2ptGtn0fv6G2Q=";
+
+std::shared_ptr<PinningPolicy> pinningPolicyForCertificateAuthority(const TestCertificateAuthority &certificateAuthority)
+{
+    DomainPinningPolicy domainPolicy;
+    domainPolicy.domain = "www.good.com";
+    domainPolicy.publicKeyHashes = { pinFromBase64(kBackupPin), certificateAuthority.pin() };
+    return std::make_shared<PinningPolicy>(std::vector<DomainPinningPolicy>{ domainPolicy });
+}
+
+// The chain of a server certificate as OpenSSL builds and validates it during a handshake
+class VerifiedChain
+{
+public:
+    explicit VerifiedChain(const TestCertificateAuthority &certificateAuthority)
+    {
+        EVP_PKEY *privateKey = nullptr;
+        certificateAuthority.issueCertificate({ "www.good.com" }, &_certificate, &privateKey);
+        EVP_PKEY_free(privateKey);
+        _store = X509_STORE_new();
+        X509_STORE_add_cert(_store, certificateAuthority.certificate());
+        _storeContext = X509_STORE_CTX_new();
+    }
+
+    ~VerifiedChain()
+    {
+        X509_STORE_CTX_free(_storeContext);
+        X509_STORE_free(_store);
+        X509_free(_certificate);
+    }
+
+    // Build and validate the chain again, the same way the handshake does
+    bool verify()
+    {
+        X509_STORE_CTX_cleanup(_storeContext);
+        X509_STORE_CTX_init(_storeContext, _store, _certificate, nullptr);
+        X509_STORE_CTX_set_purpose(_storeContext, X509_PURPOSE_SSL_SERVER);
+        X509_VERIFY_PARAM_set1_host(X509_STORE_CTX_get0_param(_storeContext), "www.good.com", 0);
+        return X509_verify_cert(_storeContext) == 1;
+    }
+
+    X509_STORE_CTX *storeContext() const { return _storeContext; }
+
+private:
+    X509 *_certificate = nullptr;
+    X509_STORE *_store = nullptr;
+    X509_STORE_CTX *_storeContext = nullptr;
+};
+
+std::vector<uint8_t> derForCertificate(X509 *certificate)
+{
+    std::vector<uint8_t> der(static_cast<size_t>(i2d_X509(certificate, nullptr)));
+    uint8_t *derEnd = der.data();
+    i2d_X509(certificate, &derEnd);
+    return der;
+}
+
+} // namespace
+
+
+// The work added to a handshake by the verifier: finding the policy and hashing the chain's keys
+static void BM_PinCheck(benchmark::State &state)
+{
+    TestCertificateAuthority certificateAuthority;
+    OpenSSLPinningVerifier verifier(pinningPolicyForCertificateAuthority(certificateAuthority));
+    VerifiedChain verifiedChain(certificateAuthority);
+    verifiedChain.verify();
+    for (auto _ : state)
+    {
+        ValidationResult validationResult = verifier.validate(verifiedChain.storeContext(), "www.good.com", true);
+        benchmark::DoNotOptimize(validationResult);
+    }
+}
+BENCHMARK(BM_PinCheck);
+
+
+// A decision for a chain already validated by the caller's TLS stack, hashing its certificates' keys or using the
+// hashes it computed
+static void BM_ValidatedChainDecision(benchmark::State &state)
+{
+    bool hasSpkiHashes = state.range(0) != 0;
+    TestCertificateAuthority certificateAuthority;
+    PinningValidator validator(pinningPolicyForCertificateAuthority(certificateAuthority),
+                               std::make_shared<OpenSSLTrustBackend>());
+    X509 *leafCertificate = nullptr;
+    EVP_PKEY *privateKey = nullptr;
+    certificateAuthority.issueCertificate({ "www.good.com" }, &leafCertificate, &privateKey);
+    std::vector<uint8_t> leafDer = derForCertificate(leafCertificate);
+    std::vector<uint8_t> certificateAuthorityDer = derForCertificate(certificateAuthority.certificate());
+    const DerSlice verifiedChain[] = { { leafDer.data(), leafDer.size() },
+                                       { certificateAuthorityDer.data(), certificateAuthorityDer.size() } };
+    const ChainSpkiHash spkiHashes[] = { { 0, pinForCertificate(leafCertificate) }, { 1, certificateAuthority.pin() } };
+    X509_free(leafCertificate);
+    EVP_PKEY_free(privateKey);
+
+    for (auto _ : state)
+    {
+        ValidationResult validationResult = hasSpkiHashes ? validator.validateSpkiHashes(spkiHashes, 2, "www.good.com")
+                                                          : validator.validateVerifiedChain(verifiedChain, 2, "www.good.com");
+        benchmark::DoNotOptimize(validationResult);
+    }
+}
+BENCHMARK(BM_ValidatedChainDecision)->ArgName("spkiHashes")->Arg(0)->Arg(1);
+
+
+// The chain validation that OpenSSL does for each handshake, with and without the pin check
+static void BM_ChainVerification(benchmark::State &state)
+{
+    bool isPinningEnabled = state.range(0) != 0;
+    TestCertificateAuthority certificateAuthority;
+    OpenSSLPinningVerifier verifier(pinningPolicyForCertificateAuthority(certificateAuthority));
+    VerifiedChain verifiedChain(certificateAuthority);
+    for (auto _ : state)
+    {
+        bool isTrusted = verifiedChain.verify();
+        if (isPinningEnabled)
+        {
+            ValidationResult validationResult = verifier.validate(verifiedChain.storeContext(), "www.good.com", isTrusted);
+            benchmark::DoNotOptimize(validationResult);
+        }
+        benchmark::DoNotOptimize(isTrusted);
+    }
+}
+BENCHMARK(BM_ChainVerification)->ArgName("pinning")->Arg(0)->Arg(1);
+
+
+// Full handshakes with a TLS server on the loopback interface, with and without the verifier attached
+static void BM_LoopbackHandshake(benchmark::State &state)
+{
+    bool isPinningEnabled = state.range(0) != 0;
+    TestCertificateAuthority certificateAuthority;
+    TestTLSServer server(certificateAuthority, { "www.good.com" }, 1);
+    OpenSSLPinningVerifier verifier(pinningPolicyForCertificateAuthority(certificateAuthority));
+    SSL_CTX *clientContext = certificateAuthority.newClientContext();
+    // Full handshakes only
+    SSL_CTX_set_session_cache_mode(clientContext, SSL_SESS_CACHE_OFF);
+    if (isPinningEnabled)
+    {
+        verifier.attach(clientContext);
+    }
+
+    for (auto _ : state)
+    {
+        if (!connectToTestServer(clientContext, server.port(), "www.good.com"))
+        {
+            state.SkipWithError("Handshake failed");
+            break;
+        }
+    }
+    SSL_CTX_free(clientContext);
+}
+BENCHMARK(BM_LoopbackHandshake)->ArgName("pinning")->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
+
+
+// Handshakes resuming the same TLS session with a TLS server on the loopback interface, with and without the verifier
+// attached; the verifier reuses the decision of the full handshake that established the session
+static void BM_LoopbackResumption(benchmark::State &state)
+{
+    bool isPinningEnabled = state.range(0) != 0;
+    TestCertificateAuthority certificateAuthority;
+    TestTLSServer server(certificateAuthority, { "www.good.com" }, 1);
+    OpenSSLPinningVerifier verifier(pinningPolicyForCertificateAuthority(certificateAuthority));
+    SSL_CTX *clientContext = certificateAuthority.newClientContext();
+    if (isPinningEnabled)
+    {
+        verifier.attach(clientContext);
+    }
+
+    SSL_SESSION *session = nullptr;
+    if (!connectToTestServer(clientContext, server.port(), "www.good.com", nullptr, &session))
+    {
+        state.SkipWithError("Handshake failed");
+    }
+    uint64_t initialHandshakeCount = server.handshakeCount();
+    auto resumeSession = [&session](SSL *connection) { SSL_set_session(connection, session); };
+    for (auto _ : state)
+    {
+        if (!connectToTestServer(clientContext, server.port(), "www.good.com", resumeSession))
+        {
+            state.SkipWithError("Handshake failed");
+            break;
+        }
+    }
+    SSL_SESSION_free(session);
+    SSL_CTX_free(clientContext);
+
+    state.SetItemsProcessed(state.iterations());
+    state.counters["reusedDecisions"] = static_cast<double>(verifier.reusedDecisionCount());
+    state.counters["handshakes"] = static_cast<double>(server.handshakeCount() - initialHandshakeCount);
+}
+BENCHMARK(BM_LoopbackResumption)->ArgName("pinning")->Arg(0)->Arg(1)->Unit(benchmark::kMicrosecond);
@@ -0,0 +1,349 @@
+/*
+
+ load_generator.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+// Drives a PinningValidator with OpenSSL chain validation from many threads at an open-loop arrival rate, with a
+// configurable mix of workloads, and reports its throughput, latency percentiles and lock contention. Failed
+// validations are reported through an AsyncValidationReporter, like CurlPinning does.
+//
+// Each thread schedules its validations as a Poisson process and the latency of a validation is measured from the
+// time it was scheduled at, so that the validations delayed by slower ones are accounted for.
+
+#include "Backends/openssl_trust_backend.h"
+#include "async_validation_reporter.h"
+#include "pinning_validator.h"
+#include "test_tls_server.h"
+
+#include "../TrustKit/Pinning/latency_histogram.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <thread>
+
+#include <openssl/x509.h>
+
+using namespace trustkit;
+
+namespace {
+
+struct Options
+{
+    int threadCount = 16;
+    double arrivalRate = 20000;
+    double duration = 5;
+    int domainCount = 100;
+    int chainsPerDomain = 16;
+    int maxSubdomainDepth = 3;
+
+    // Fractions of the validations
+    double unpinnedRatio = 0.2;
+    double subdomainRatio = 0.3;
+    double failureRatio = 0.01;
+    double coldChainRatio = 0.5;
+
+    // Where to record the validations to, if anywhere
+    std::string tracePath;
+};
+
+const char *kUsage =
+    "Usage: TrustKitCoreLoadGenerator [--option=value ...]\n"
+    "  --threads=N          threads running validations (16)\n"
+    "  --rate=N             validations scheduled per second, over all the threads (20000)\n"
+    "  --duration=SECONDS   (5)\n"
+    "  --domains=N          pinned domains, every other one with includeSubdomains (100)\n"
+    "  --chains=N           certificate chains per domain (16)\n"
+    "  --max-depth=N        deepest subdomain validated against an includeSubdomains policy (3)\n"
+    "  --unpinned=RATIO     validations for domains that are not pinned (0.2)\n"
+    "  --subdomains=RATIO   validations of pinned domains that are for a subdomain (0.3)\n"
+    "  --failures=RATIO     validations for domains whose pins do not match (0.01)\n"
+    "  --cold=RATIO         validations with one of the domain's other chains rather than its first one, which\n"
+    "                       concurrent validations share and get coalesced (0.5)\n"
+    "  --record=PATH        record the validations to a trace that TrustKitCoreTraceReplay can replay, with the\n"
+    "                       test CA written to PATH.ca.pem\n";
+
+bool parseOptions(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const char *argument = argv[i];
+        const char *value = std::strchr(argument, '=');
+        if ((std::strncmp(argument, "--", 2) != 0) || (value == nullptr))
+        {
+            return false;
+        }
+        std::string name(argument + 2, value - argument - 2);
+        if (name == "record")
+        {
+            options.tracePath = value + 1;
+            continue;
+        }
+        double number = std::atof(value + 1);
+        if (name == "threads") options.threadCount = static_cast<int>(number);
+        else if (name == "rate") options.arrivalRate = number;
+        else if (name == "duration") options.duration = number;
+        else if (name == "domains") options.domainCount = static_cast<int>(number);
+        else if (name == "chains") options.chainsPerDomain = static_cast<int>(number);
+        else if (name == "max-depth") options.maxSubdomainDepth = static_cast<int>(number);
+        else if (name == "unpinned") options.unpinnedRatio = number;
+        else if (name == "subdomains") options.subdomainRatio = number;
+        else if (name == "failures") options.failureRatio = number;
+        else if (name == "cold") options.coldChainRatio = number;
+        else return false;
+    }
+    return (options.threadCount > 0) && (options.arrivalRate > 0) && (options.duration > 0) &&
+           (options.domainCount > 0) && (options.chainsPerDomain > 1) && (options.maxSubdomainDepth > 0);
+}
+
+// A domain, the hostnames validated for it, and the chains served for them
+struct Domain
+{
+    std::string name;
+    bool includeSubdomains = false;
+    std::vector<std::string> subdomains;
+    std::vector<CertificateChain> chains;
+};
+
+std::vector<uint8_t> derForCertificate(X509 *certificate)
+{
+    std::vector<uint8_t> der(static_cast<size_t>(i2d_X509(certificate, nullptr)));
+    uint8_t *derEnd = der.data();
+    i2d_X509(certificate, &derEnd);
+    return der;
+}
+
+Domain makeDomain(const TestCertificateAuthority &certificateAuthority, const std::string &name,
+                  bool includeSubdomains, const Options &options)
+{
+    Domain domain;
+    domain.name = name;
+    domain.includeSubdomains = includeSubdomains;
+    std::string subdomain = name;
+    for (int depth = 1; includeSubdomains && (depth <= options.maxSubdomainDepth); depth++)
+    {
+        subdomain = "s" + std::to_string(depth) + "." + subdomain;
+        domain.subdomains.push_back(subdomain);
+    }
+
+    std::vector<std::string> hostnames = domain.subdomains;
+    hostnames.push_back(name);
+    for (int i = 0; i < options.chainsPerDomain; i++)
+    {
+        X509 *certificate = nullptr;
+        EVP_PKEY *privateKey = nullptr;
+        certificateAuthority.issueCertificate(hostnames, &certificate, &privateKey);
+        domain.chains.push_back({ derForCertificate(certificate) });
+        X509_free(certificate);
+        EVP_PKEY_free(privateKey);
+    }
+    return domain;
+}
+
+Pin randomPin(std::mt19937 &generator)
+{
+    Pin pin;
+    for (uint8_t &byte : pin)
+    {
+        byte = static_cast<uint8_t>(generator());
+    }
+    return pin;
+}
+
+void printPercentiles(const char *label, const TSKLatencyHistogram *histogram)
+{
+    TSKLatencyHistogramSnapshot snapshot;
+    TSKLatencyHistogramGetSnapshot(histogram, &snapshot);
+    std::printf("%-14s p50 %9.1f us   p99 %9.1f us   p99.9 %9.1f us   max %9.1f us\n", label,
+                TSKLatencyHistogramSnapshotGetValueAtPercentile(&snapshot, 50) / 1e3,
+                TSKLatencyHistogramSnapshotGetValueAtPercentile(&snapshot, 99) / 1e3,
+                TSKLatencyHistogramSnapshotGetValueAtPercentile(&snapshot, 99.9) / 1e3, snapshot.max / 1e3);
+}
+
+void printContention(const char *label, const LockContention &contention)
+{
+    double contendedPercentage = (contention.lockCount > 0)
+        ? (100.0 * static_cast<double>(contention.contendedLockCount) / static_cast<double>(contention.lockCount))
+        : 0;
+    std::printf("%-14s %llu of %llu acquisitions contended (%.2f%%), %.3f ms waited\n", label,
+                static_cast<unsigned long long>(contention.contendedLockCount),
+                static_cast<unsigned long long>(contention.lockCount), contendedPercentage,
+                contention.contendedWaitNanoseconds / 1e6);
+}
+
+} // namespace
+
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        std::fputs(kUsage, stderr);
+        return 1;
+    }
+
+    // Pinned domains, domains pinned to other keys, and domains that are not pinned
+    TestCertificateAuthority certificateAuthority;
+    std::mt19937 generator(1);
+    std::vector<Domain> pinnedDomains;
+    std::vector<Domain> failingDomains;
+    std::vector<Domain> unpinnedDomains;
+    std::vector<DomainPinningPolicy> domainPolicies;
+    for (int i = 0; i < options.domainCount; i++)
+    {
+        pinnedDomains.push_back(makeDomain(certificateAuthority, "pinned" + std::to_string(i) + ".com", i % 2 == 1, options));
+        DomainPinningPolicy domainPolicy;
+        domainPolicy.domain = pinnedDomains.back().name;
+        domainPolicy.includeSubdomains = pinnedDomains.back().includeSubdomains;
+        domainPolicy.publicKeyHashes = { certificateAuthority.pin(), randomPin(generator) };
+        domainPolicies.push_back(domainPolicy);
+    }
+    for (int i = 0; i < std::max(1, options.domainCount / 10); i++)
+    {
+        failingDomains.push_back(makeDomain(certificateAuthority, "failing" + std::to_string(i) + ".com", false, options));
+        DomainPinningPolicy domainPolicy;
+        domainPolicy.domain = failingDomains.back().name;
+        domainPolicy.publicKeyHashes = { randomPin(generator), randomPin(generator) };
+        domainPolicies.push_back(domainPolicy);
+        unpinnedDomains.push_back(makeDomain(certificateAuthority, "unpinned" + std::to_string(i) + ".org", false, options));
+    }
+
+    X509_STORE *store = X509_STORE_new();
+    auto trustBackend = std::make_shared<OpenSSLTrustBackend>(store);
+    X509_STORE_free(store);
+    trustBackend->addTrustAnchor(derForCertificate(certificateAuthority.certificate()));
+    PinningValidator validator(std::make_shared<PinningPolicy>(std::move(domainPolicies)), trustBackend);
+    std::shared_ptr<ValidationTraceRecorder> traceRecorder;
+    if (!options.tracePath.empty())
+    {
+        traceRecorder = std::make_shared<ValidationTraceRecorder>(options.tracePath, true);
+        validator.setTraceRecorder(traceRecorder);
+        std::ofstream(options.tracePath + ".ca.pem") << certificateAuthority.pem();
+    }
+    std::atomic<uint64_t> deliveredReportCount{0};
+    AsyncValidationReporter reporter([&](const std::string &, const ValidationResult &) { deliveredReportCount++; });
+
+    TSKLatencyHistogram *latencies = TSKLatencyHistogramCreate();
+    TSKLatencyHistogram *serviceTimes = TSKLatencyHistogramCreate();
+    std::atomic<uint64_t> validationCount{0};
+    std::atomic<uint64_t> lateValidationCount{0};
+    std::atomic<uint64_t> decisionCounts[3] = {};
+
+    std::printf("%d threads, %.0f validations/s scheduled for %.1f s; %d pinned domains, %d chains each\n",
+                options.threadCount, options.arrivalRate, options.duration, options.domainCount, options.chainsPerDomain);
+
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point startTime = Clock::now() + std::chrono::milliseconds(10);
+    const Clock::time_point endTime = startTime + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(options.duration));
+    std::vector<std::thread> threads;
+    for (int threadIndex = 0; threadIndex < options.threadCount; threadIndex++)
+    {
+        threads.emplace_back([&, threadIndex] {
+            std::mt19937 threadGenerator(static_cast<unsigned>(threadIndex) + 1);
+            std::uniform_real_distribution<double> ratio(0, 1);
+            std::exponential_distribution<double> interarrivalSeconds(options.arrivalRate / options.threadCount);
+            Clock::time_point scheduledTime = startTime;
+            while (true)
+            {
+                scheduledTime += std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(interarrivalSeconds(threadGenerator)));
+                if (scheduledTime >= endTime)
+                {
+                    break;
+                }
+
+                // Pick the hostname and chain of the validation
+                double kind = ratio(threadGenerator);
+                const std::vector<Domain> &domains = (kind < options.failureRatio) ? failingDomains
+                    : (kind < options.failureRatio + options.unpinnedRatio) ? unpinnedDomains : pinnedDomains;
+                const Domain &domain = domains[threadGenerator() % domains.size()];
+                const std::string *hostname = &domain.name;
+                if (!domain.subdomains.empty() && (ratio(threadGenerator) < options.subdomainRatio))
+                {
+                    hostname = &domain.subdomains[threadGenerator() % domain.subdomains.size()];
+                }
+                size_t chainIndex = (ratio(threadGenerator) < options.coldChainRatio)
+                    ? 1 + (threadGenerator() % (domain.chains.size() - 1))
+                    : 0;
+
+                // Sleeping past the scheduled time is not the validator's doing, unlike waiting for a late validation
+                Clock::time_point now = Clock::now();
+                bool isLate = now >= scheduledTime;
+                if (!isLate)
+                {
+                    std::this_thread::sleep_until(scheduledTime);
+                }
+                Clock::time_point validationStart = isLate ? now : Clock::now();
+                ValidationResult result = validator.validate(domain.chains[chainIndex], *hostname);
+                if (result.evaluationResult && (*result.evaluationResult != TrustEvaluationResult::Success))
+                {
+                    reporter.post(*hostname, result);
+                }
+                Clock::time_point validationEnd = Clock::now();
+
+                Clock::time_point latencyStart = isLate ? scheduledTime : validationStart;
+                TSKLatencyHistogramRecord(latencies, static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(validationEnd - latencyStart).count()));
+                TSKLatencyHistogramRecord(serviceTimes, static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(validationEnd - validationStart).count()));
+                validationCount.fetch_add(1, std::memory_order_relaxed);
+                lateValidationCount.fetch_add(isLate ? 1 : 0, std::memory_order_relaxed);
+                decisionCounts[static_cast<int>(result.finalTrustDecision)].fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    double elapsedSeconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+    reporter.flush();
+
+    std::printf("\nThroughput     %.0f validations/s (%llu validations, %.1f%% started late)\n",
+                static_cast<double>(validationCount) / elapsedSeconds, static_cast<unsigned long long>(validationCount.load()),
+                (validationCount > 0) ? (100.0 * static_cast<double>(lateValidationCount) / static_cast<double>(validationCount)) : 0);
+    printPercentiles("Latency", latencies);
+    printPercentiles("Service time", serviceTimes);
+    std::printf("Decisions      %llu allowed, %llu blocked, %llu not pinned\n",
+                static_cast<unsigned long long>(decisionCounts[static_cast<int>(TrustDecision::ShouldAllowConnection)].load()),
+                static_cast<unsigned long long>(decisionCounts[static_cast<int>(TrustDecision::ShouldBlockConnection)].load()),
+                static_cast<unsigned long long>(decisionCounts[static_cast<int>(TrustDecision::DomainNotPinned)].load()));
+    std::printf("Pin checks     %llu, %llu coalesced\n", static_cast<unsigned long long>(validator.pinValidationCount()),
+                static_cast<unsigned long long>(validator.coalescedPinValidationCount()));
+    std::printf("Reports        %llu delivered, %llu dropped\n", static_cast<unsigned long long>(deliveredReportCount.load()),
+                static_cast<unsigned long long>(reporter.droppedReportCount()));
+    std::printf("\nLock contention\n");
+    printContention("In flight", validator.inFlightLockContention());
+    printContention("Report queue", reporter.queueLockContention());
+
+    if (traceRecorder)
+    {
+        validator.setTraceRecorder(nullptr);
+        try
+        {
+            traceRecorder->flush();
+        }
+        catch (const std::exception &error)
+        {
+            std::fprintf(stderr, "%s; the trace only holds the validations recorded until then\n", error.what());
+        }
+        std::printf("\nRecorded %llu validations; replay them with\n  TrustKitCoreTraceReplay --ca-file=%s.ca.pem %s\n",
+                    static_cast<unsigned long long>(traceRecorder->recordedValidationCount()),
+                    options.tracePath.c_str(), options.tracePath.c_str());
+    }
+
+    TSKLatencyHistogramDestroy(serviceTimes);
+    TSKLatencyHistogramDestroy(latencies);
+    return 0;
+}
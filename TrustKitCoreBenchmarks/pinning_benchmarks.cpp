@@ -0,0 +1,306 @@
+/*
+
+ pinning_benchmarks.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "der_certificate.h"
+#include "pin_failure_report.h"
+#include "pinning_policy.h"
+#include "test_certificates.h"
+
+#include "../TrustKit/Dependencies/domain_registry/domain_registry.h"
+#include "../TrustKit/Pinning/base64_codec.h"
+#include "../TrustKit/Pinning/pin_set.h"
+#include "../TrustKit/Pinning/sha256_engine.h"
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+
+using namespace trustkit;
+
+namespace {
+
+// Hostnames of popular websites, mostly under a generic or country TLD
+const std::vector<std::string> kPopularHostnames = {
+    "www.google.com", "youtube.com", "www.facebook.com", "en.wikipedia.org", "www.amazon.co.uk", "www.bbc.co.uk",
+    "news.yahoo.co.jp", "www.baidu.com", "vk.com", "www.reddit.com", "www.netflix.com", "login.microsoftonline.com",
+    "www.apple.com", "t.co", "www.gov.uk", "www.abc.net.au", "www.spiegel.de", "www.lemonde.fr", "g1.globo.com",
+    "api.github.com", "www.instagram.com", "www.linkedin.com", "www.ebay.de", "www.naver.com", "www.yandex.ru",
+};
+
+// Hostnames of services and CDNs, with many labels and private or wildcard registries, and unknown TLDs
+const std::vector<std::string> kServiceHostnames = {
+    "d1a2b3c4d5e6f7.cloudfront.net", "bucket.s3.amazonaws.com", "my-app-1234.herokuapp.com", "user.github.io",
+    "api.v2.service.appspot.com", "tenant.blogspot.co.uk", "a.b.c.d.e.f.example.com", "shop.city.kawasaki.jp",
+    "www.city.kobe.jp", "cdn.assets.static.example.co.uk", "build.internal", "printer.local",
+    "edge-123.region-4.prod.example-cdn.net", "xn--80ak6aa92e.com", "mail.google.com.", "foo.bar",
+};
+
+const std::vector<const std::vector<std::string> *> kHostnameCorpora = { &kPopularHostnames, &kServiceHostnames };
+
+std::vector<Pin> randomPins(size_t pinCount, std::mt19937 &generator)
+{
+    std::vector<Pin> pins(pinCount);
+    for (Pin &pin : pins)
+    {
+        for (uint8_t &byte : pin)
+        {
+            byte = static_cast<uint8_t>(generator());
+        }
+    }
+    return pins;
+}
+
+// Pinned domains named domain<i>.example<i % 10>.com, every other one with includeSubdomains
+std::shared_ptr<PinningPolicy> pinningPolicyWithDomainCount(size_t domainCount)
+{
+    std::mt19937 generator(1);
+    std::vector<DomainPinningPolicy> domainPolicies(domainCount);
+    for (size_t i = 0; i < domainCount; i++)
+    {
+        domainPolicies[i].domain = "domain" + std::to_string(i) + ".example" + std::to_string(i % 10) + ".com";
+        domainPolicies[i].includeSubdomains = (i % 2 == 0);
+        domainPolicies[i].publicKeyHashes = randomPins(2, generator);
+    }
+    return std::make_shared<PinningPolicy>(std::move(domainPolicies));
+}
+
+// Selects a SHA-256 backend for the duration of a benchmark, or skips the benchmark if the CPU does not support it
+class SHA256BackendSelection
+{
+public:
+    SHA256BackendSelection(benchmark::State &state, TSKSHA256Backend backend, bool isMultiBufferEnabled)
+        : _previousBackend(TSKSHA256GetBackend()), _wasMultiBufferEnabled(TSKSHA256IsMultiBufferEnabled())
+    {
+        _isSelected = TSKSHA256SetBackend(backend) && TSKSHA256SetMultiBufferEnabled(isMultiBufferEnabled);
+        if (!_isSelected)
+        {
+            state.SkipWithError("Backend not supported by this CPU");
+            return;
+        }
+        state.SetLabel(std::string(TSKSHA256GetBackendName(backend)) + (isMultiBufferEnabled ? "+avx2" : ""));
+    }
+
+    ~SHA256BackendSelection()
+    {
+        TSKSHA256SetBackend(_previousBackend);
+        TSKSHA256SetMultiBufferEnabled(_wasMultiBufferEnabled);
+    }
+
+    bool isSelected() const { return _isSelected; }
+
+private:
+    TSKSHA256Backend _previousBackend;
+    bool _wasMultiBufferEnabled;
+    bool _isSelected = false;
+};
+
+} // namespace
+
+
+// Registry lookups, as done twice for each candidate parent domain when looking for an includeSubdomains policy
+static void BM_GetRegistryLength(benchmark::State &state)
+{
+    InitializeDomainRegistry();
+    const std::vector<std::string> &hostnames = *kHostnameCorpora[static_cast<size_t>(state.range(0))];
+    for (auto _ : state)
+    {
+        for (const std::string &hostname : hostnames)
+        {
+            benchmark::DoNotOptimize(GetRegistryLength(hostname.c_str()));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(hostnames.size()));
+}
+BENCHMARK(BM_GetRegistryLength)->ArgName("corpus")->Arg(0)->Arg(1);
+
+
+// Finding the policy of a hostname: configured as is, a subdomain of an includeSubdomains domain, or not pinned
+static void BM_PolicyLookup(benchmark::State &state)
+{
+    size_t domainCount = static_cast<size_t>(state.range(0));
+    std::shared_ptr<PinningPolicy> pinningPolicy = pinningPolicyWithDomainCount(domainCount);
+    std::string lastDomain = "domain" + std::to_string(domainCount - 2) + ".example" + std::to_string((domainCount - 2) % 10) + ".com";
+    const std::string hostnames[] = { lastDomain, "www." + lastDomain, "www.notpinned.org" };
+    const std::string &hostname = hostnames[state.range(1)];
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(pinningPolicy->findPinnedDomain(hostname));
+    }
+}
+BENCHMARK(BM_PolicyLookup)->ArgNames({ "domains", "match" })->ArgsProduct({ { 10, 100, 1000, 10000 }, { 0, 1, 2 } });
+
+
+// Locating the subjectPublicKeyInfo of a certificate, then hashing it, for each key type of the test certificates
+static void BM_SubjectPublicKeyInfoExtraction(benchmark::State &state, const char *certificatePath)
+{
+    std::vector<uint8_t> certificate = loadTestCertificate(certificatePath);
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(findSubjectPublicKeyInfo({ certificate.data(), certificate.size() }));
+    }
+}
+BENCHMARK_CAPTURE(BM_SubjectPublicKeyInfoExtraction, RSA_2048, "RSA_2048/www.globalsign.com.der");
+BENCHMARK_CAPTURE(BM_SubjectPublicKeyInfoExtraction, RSA_4096, "RSA_4096/www.good.com.der");
+BENCHMARK_CAPTURE(BM_SubjectPublicKeyInfoExtraction, ECDSA_secp256r1, "ECDSA_sec256r1/www.cloudflare.com.der");
+BENCHMARK_CAPTURE(BM_SubjectPublicKeyInfoExtraction, ECDSA_secp384r1, "ECDSA_sec384r1/GeoTrust_Primary_CA_G2_ECC.der");
+
+static void BM_SubjectPublicKeyInfoHash(benchmark::State &state, const char *certificatePath)
+{
+    std::vector<uint8_t> certificate = loadTestCertificate(certificatePath);
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(hashSubjectPublicKeyInfo({ certificate.data(), certificate.size() }));
+    }
+}
+BENCHMARK_CAPTURE(BM_SubjectPublicKeyInfoHash, RSA_2048, "RSA_2048/www.globalsign.com.der");
+BENCHMARK_CAPTURE(BM_SubjectPublicKeyInfoHash, RSA_4096, "RSA_4096/www.good.com.der");
+BENCHMARK_CAPTURE(BM_SubjectPublicKeyInfoHash, ECDSA_secp256r1, "ECDSA_sec256r1/www.cloudflare.com.der");
+BENCHMARK_CAPTURE(BM_SubjectPublicKeyInfoHash, ECDSA_secp384r1, "ECDSA_sec384r1/GeoTrust_Primary_CA_G2_ECC.der");
+
+
+// Hashing a message with each SHA-256 backend, from the size of an SPKI to that of a long certificate chain
+static void BM_SHA256Hash(benchmark::State &state)
+{
+    SHA256BackendSelection selection(state, static_cast<TSKSHA256Backend>(state.range(0)), false);
+    if (!selection.isSelected())
+    {
+        return;
+    }
+    std::vector<uint8_t> message(static_cast<size_t>(state.range(1)), 0x5a);
+    uint8_t digest[TSK_SHA256_DIGEST_LENGTH];
+    for (auto _ : state)
+    {
+        TSKSHA256Hash(message.data(), message.size(), digest);
+        benchmark::DoNotOptimize(digest);
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(1));
+}
+BENCHMARK(BM_SHA256Hash)->ArgNames({ "backend", "bytes" })->ArgsProduct({
+    { TSKSHA256BackendPortable, TSKSHA256BackendSHAExtensions, TSKSHA256BackendARMv8 }, { 64, 294, 1500, 16384 } });
+
+// Hashing the certificates of a chain together, with each backend and with or without the AVX2 multi-buffer backend
+static void BM_SHA256HashMany(benchmark::State &state)
+{
+    SHA256BackendSelection selection(state, static_cast<TSKSHA256Backend>(state.range(0)), state.range(1) != 0);
+    if (!selection.isSelected())
+    {
+        return;
+    }
+    size_t messageCount = static_cast<size_t>(state.range(2));
+    std::vector<std::vector<uint8_t>> messageData(messageCount, std::vector<uint8_t>(static_cast<size_t>(state.range(3)), 0x5a));
+    std::vector<TSKSHA256Message> messages(messageCount);
+    for (size_t i = 0; i < messageCount; i++)
+    {
+        messages[i] = { messageData[i].data(), messageData[i].size() };
+    }
+    std::vector<uint8_t> digests(messageCount * TSK_SHA256_DIGEST_LENGTH);
+    for (auto _ : state)
+    {
+        TSKSHA256HashMany(messages.data(), messageCount, reinterpret_cast<uint8_t (*)[TSK_SHA256_DIGEST_LENGTH]>(digests.data()));
+        benchmark::DoNotOptimize(digests.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(2) * state.range(3));
+}
+BENCHMARK(BM_SHA256HashMany)->ArgNames({ "backend", "avx2", "messages", "bytes" })->ArgsProduct({
+    { TSKSHA256BackendPortable, TSKSHA256BackendSHAExtensions, TSKSHA256BackendARMv8 }, { 0, 1 }, { 3, 8 }, { 294, 1500 } });
+
+
+// Looking for a hash in pin sets of the sizes that use a scan, a binary search, and a filter
+static void BM_PinSetContains(benchmark::State &state)
+{
+    std::mt19937 generator(1);
+    std::vector<Pin> pins = randomPins(static_cast<size_t>(state.range(0)), generator);
+    TSKPinSet *pinSet = TSKPinSetCreate(reinterpret_cast<const uint8_t (*)[TSK_PIN_LENGTH]>(pins.data()), pins.size());
+    Pin pin = (state.range(1) != 0) ? pins[pins.size() / 2] : randomPins(1, generator)[0];
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(TSKPinSetContains(pinSet, pin.data()));
+    }
+    TSKPinSetDestroy(pinSet);
+}
+BENCHMARK(BM_PinSetContains)->ArgNames({ "pins", "match" })->ArgsProduct({ { 2, 16, 256, 4096 }, { 0, 1 } });
+
+
+// Encoding and decoding pins, as in the configuration and the reports, and certificates as PEM, as in the reports,
+// with and without the AVX2 or NEON paths
+static std::vector<uint8_t> base64BenchmarkInput(benchmark::State &state)
+{
+    if (!TSKBase64SetSIMDEnabled(state.range(1) != 0))
+    {
+        state.SkipWithError("SIMD path not supported by this CPU");
+        return {};
+    }
+    return (state.range(0) == 0) ? std::vector<uint8_t>(32, 0xa5) : loadTestCertificate("RSA_4096/www.good.com.der");
+}
+
+static void BM_Base64Encode(benchmark::State &state)
+{
+    bool wasSIMDEnabled = TSKBase64IsSIMDEnabled();
+    std::vector<uint8_t> data = base64BenchmarkInput(state);
+    size_t lineLength = (state.range(0) == 0) ? 0 : TSK_BASE64_PEM_LINE_LENGTH;
+    std::vector<char> encoded(TSKBase64EncodedLength(data.size(), lineLength));
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(TSKBase64Encode(data.data(), data.size(), lineLength, encoded.data()));
+    }
+    TSKBase64SetSIMDEnabled(wasSIMDEnabled);
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(data.size()));
+}
+BENCHMARK(BM_Base64Encode)->ArgNames({ "certificate", "simd" })->ArgsProduct({ { 0, 1 }, { 0, 1 } });
+
+static void BM_Base64Decode(benchmark::State &state)
+{
+    bool wasSIMDEnabled = TSKBase64IsSIMDEnabled();
+    std::vector<uint8_t> data = base64BenchmarkInput(state);
+    std::vector<char> encoded(TSKBase64EncodedLength(data.size(), 0));
+    TSKBase64Encode(data.data(), data.size(), 0, encoded.data());
+    std::vector<uint8_t> decoded(TSKBase64DecodedMaxLength(encoded.size()));
+    size_t decodedLength = 0;
+    for (auto _ : state)
+    {
+        benchmark::DoNotOptimize(TSKBase64Decode(encoded.data(), encoded.size(), decoded.data(), &decodedLength));
+    }
+    TSKBase64SetSIMDEnabled(wasSIMDEnabled);
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(data.size()));
+}
+BENCHMARK(BM_Base64Decode)->ArgNames({ "certificate", "simd" })->ArgsProduct({ { 0, 1 }, { 0, 1 } });
+
+
+// Serializing the report of a failed validation, with the server's chain of two RSA 4096 certificates
+static void BM_PinFailureReportJson(benchmark::State &state)
+{
+    PinFailureReport report;
+    report.appBundleId = "com.example.app";
+    report.appVersion = "1.0";
+    report.appPlatform = "LINUX";
+    report.appPlatformVersion = "6.1";
+    report.appVendorId = "00000000-0000-0000-0000-000000000000";
+    report.trustkitVersion = "3.0.0";
+    report.hostname = "www.good.com";
+    report.port = 443;
+    report.dateTime = std::chrono::system_clock::now();
+    report.notedHostname = "good.com";
+    report.includeSubdomains = true;
+    report.enforcePinning = true;
+    report.validatedCertificateChain = { loadTestCertificate("RSA_4096/www.good.com.der"),
+                                         loadTestCertificate("RSA_4096/GoodRootCA.der") };
+    report.knownPins = { pinFromBase64("K87oWBWM9UZfyddvDfoxL+8lpNyoUB2ptGtn0fv6G2Q="),
+                         pinFromBase64("naw8JswG9YvBkitP4iGuyEgbFxssEMM/v4m7MglIzEw=") };
+    int64_t byteCount = 0;
+    for (auto _ : state)
+    {
+        std::string json = pinFailureReportJson(report);
+        byteCount += static_cast<int64_t>(json.size());
+        benchmark::DoNotOptimize(json);
+    }
+    state.SetBytesProcessed(byteCount);
+}
+BENCHMARK(BM_PinFailureReportJson);
@@ -0,0 +1,252 @@
+/*
+
+ replay_trace.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+// Replays the validations of a trace recorded with PinningValidator::setTraceRecorder(), with the policies of the
+// trace and the OpenSSL backend, as fast as possible or at the pace they were recorded at. It reports the throughput
+// and latencies of the replay next to the recorded ones, and every validation whose decision changed; it exits with 1
+// if there was any, so that it can gate changes to the engine on a real workload.
+
+#include "Backends/openssl_trust_backend.h"
+#include "pinning_validator.h"
+#include "validation_trace.h"
+
+#include "../TrustKit/Pinning/latency_histogram.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include <openssl/x509.h>
+
+using namespace trustkit;
+
+namespace {
+
+struct Options
+{
+    std::string tracePath;
+    int threadCount = 1;
+    bool isPacedAsRecorded = false;
+    std::string certificateAuthorityPath;
+    bool usesCurrentTime = false;
+    int maxPrintedDifferenceCount = 10;
+};
+
+const char *kUsage =
+    "Usage: TrustKitCoreTraceReplay [--option=value ...] TRACE\n"
+    "  --threads=N          threads replaying the validations (1)\n"
+    "  --pacing=max|recorded\n"
+    "                       replay as fast as possible, or start each validation when it started in the recording (max)\n"
+    "  --ca-file=PATH       PEM file of the trust anchors, instead of the system's trust store\n"
+    "  --current-time       validate the chains and policy expiration dates as of now rather than as of the recording\n"
+    "  --differences=N      number of changed decisions to print (10)\n";
+
+bool parseOptions(int argc, char **argv, Options &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        if (argument.compare(0, 2, "--") != 0)
+        {
+            if (!options.tracePath.empty())
+            {
+                return false;
+            }
+            options.tracePath = argument;
+            continue;
+        }
+
+        size_t separator = argument.find('=');
+        std::string name = argument.substr(2, separator - 2);
+        std::string value = (separator != std::string::npos) ? argument.substr(separator + 1) : "";
+        if (name == "threads") options.threadCount = std::atoi(value.c_str());
+        else if (name == "pacing" && (value == "max" || value == "recorded")) options.isPacedAsRecorded = (value == "recorded");
+        else if (name == "ca-file") options.certificateAuthorityPath = value;
+        else if (name == "current-time") options.usesCurrentTime = true;
+        else if (name == "differences") options.maxPrintedDifferenceCount = std::atoi(value.c_str());
+        else return false;
+    }
+    return !options.tracePath.empty() && (options.threadCount > 0);
+}
+
+std::string decisionDescription(TrustDecision decision, const std::optional<TrustEvaluationResult> &evaluationResult)
+{
+    std::string description = trustDecisionName(decision);
+    if (evaluationResult)
+    {
+        description += std::string(" (") + trustEvaluationResultName(*evaluationResult) + ")";
+    }
+    return description;
+}
+
+void printPercentiles(const char *label, const TSKLatencyHistogram *histogram)
+{
+    TSKLatencyHistogramSnapshot snapshot;
+    TSKLatencyHistogramGetSnapshot(histogram, &snapshot);
+    std::printf("%-16s p50 %9.1f us   p99 %9.1f us   p99.9 %9.1f us   max %9.1f us\n", label,
+                TSKLatencyHistogramSnapshotGetValueAtPercentile(&snapshot, 50) / 1e3,
+                TSKLatencyHistogramSnapshotGetValueAtPercentile(&snapshot, 99) / 1e3,
+                TSKLatencyHistogramSnapshotGetValueAtPercentile(&snapshot, 99.9) / 1e3, snapshot.max / 1e3);
+}
+
+} // namespace
+
+
+int main(int argc, char **argv)
+{
+    Options options;
+    if (!parseOptions(argc, argv, options))
+    {
+        std::fputs(kUsage, stderr);
+        return 2;
+    }
+
+    // Load the whole trace first, so that reading it is not part of the replay
+    std::vector<TracedValidation> validations;
+    std::unique_ptr<ValidationTraceReader> reader;
+    try
+    {
+        reader = std::make_unique<ValidationTraceReader>(options.tracePath);
+        TracedValidation validation;
+        while (reader->readValidation(validation))
+        {
+            validations.push_back(validation);
+        }
+    }
+    catch (const std::exception &error)
+    {
+        std::fprintf(stderr, "%s\n", error.what());
+        return 2;
+    }
+    if (reader->isTruncated())
+    {
+        std::fprintf(stderr, "The trace was cut short; replaying the %zu validations before that\n", validations.size());
+    }
+
+    X509_STORE *store = X509_STORE_new();
+    bool isStoreLoaded = options.certificateAuthorityPath.empty()
+        ? (X509_STORE_set_default_paths(store) == 1)
+        : (X509_STORE_load_locations(store, options.certificateAuthorityPath.c_str(), nullptr) == 1);
+    auto trustBackend = std::make_shared<OpenSSLTrustBackend>(store);
+    X509_STORE_free(store);
+    if (!isStoreLoaded)
+    {
+        std::fprintf(stderr, "Could not load the trust anchors\n");
+        return 2;
+    }
+    if (!options.usesCurrentTime)
+    {
+        trustBackend->setVerificationTime(reader->recordingTime());
+    }
+
+    std::vector<std::unique_ptr<PinningValidator>> validators;
+    for (const std::shared_ptr<const PinningPolicy> &pinningPolicy : reader->pinningPolicies())
+    {
+        validators.push_back(std::make_unique<PinningValidator>(pinningPolicy, trustBackend));
+        if (!options.usesCurrentTime)
+        {
+            validators.back()->setEvaluationTime(reader->recordingTime());
+        }
+    }
+
+    // Replay; each thread replays every threadCount-th validation and records its outcome at the same index
+    TSKLatencyHistogram *recordedDurations = TSKLatencyHistogramCreate();
+    TSKLatencyHistogram *replayedDurations = TSKLatencyHistogramCreate();
+    std::vector<ValidationResult> results(validations.size());
+    std::vector<uint8_t> isReplayed(validations.size(), 0);
+    using Clock = std::chrono::steady_clock;
+    const Clock::time_point replayStart = Clock::now();
+    std::vector<std::thread> threads;
+    for (int threadIndex = 0; threadIndex < options.threadCount; threadIndex++)
+    {
+        threads.emplace_back([&, threadIndex] {
+            std::vector<DerSlice> chainSlices;
+            for (size_t i = static_cast<size_t>(threadIndex); i < validations.size(); i += static_cast<size_t>(options.threadCount))
+            {
+                const TracedValidation &validation = validations[i];
+                if (validation.serverChain->empty())
+                {
+                    continue;
+                }
+                if (options.isPacedAsRecorded)
+                {
+                    std::this_thread::sleep_until(replayStart + validation.startTime);
+                }
+
+                PinningValidator &validator = *validators[validation.policyIndex];
+                Clock::time_point startTime = Clock::now();
+                if (validation.kind == TracedValidationKind::VerifiedChain)
+                {
+                    chainSlices.clear();
+                    for (const std::vector<uint8_t> &certificate : *validation.serverChain)
+                    {
+                        chainSlices.push_back({ certificate.data(), certificate.size() });
+                    }
+                    results[i] = validator.validateVerifiedChain(chainSlices.data(), chainSlices.size(), *validation.serverHostname);
+                }
+                else
+                {
+                    results[i] = validator.validate(*validation.serverChain, *validation.serverHostname);
+                }
+                TSKLatencyHistogramRecord(replayedDurations, static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - startTime).count()));
+                TSKLatencyHistogramRecord(recordedDurations, static_cast<uint64_t>(validation.duration.count()));
+                isReplayed[i] = 1;
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    double elapsedSeconds = std::chrono::duration<double>(Clock::now() - replayStart).count();
+
+    size_t replayedCount = 0;
+    size_t differenceCount = 0;
+    for (size_t i = 0; i < validations.size(); i++)
+    {
+        if (!isReplayed[i])
+        {
+            continue;
+        }
+        replayedCount++;
+        const TracedValidation &validation = validations[i];
+        if ((results[i].finalTrustDecision == validation.finalTrustDecision)
+            && (results[i].evaluationResult == validation.evaluationResult))
+        {
+            continue;
+        }
+        if (static_cast<int>(differenceCount) < options.maxPrintedDifferenceCount)
+        {
+            std::printf("Changed decision for %s: %s, now %s\n", validation.serverHostname->c_str(),
+                        decisionDescription(validation.finalTrustDecision, validation.evaluationResult).c_str(),
+                        decisionDescription(results[i].finalTrustDecision, results[i].evaluationResult).c_str());
+        }
+        differenceCount++;
+    }
+
+    std::printf("Replayed %zu of %zu validations with %zu policies on %d threads",
+                replayedCount, validations.size(), validators.size(), options.threadCount);
+    if (replayedCount < validations.size())
+    {
+        std::printf("; the others only have the digests of their chains");
+    }
+    std::printf("\nThroughput       %.0f validations/s\n", static_cast<double>(replayedCount) / elapsedSeconds);
+    printPercentiles("Recorded", recordedDurations);
+    printPercentiles("Replayed", replayedDurations);
+    std::printf("Decisions        %zu identical, %zu changed\n", replayedCount - differenceCount, differenceCount);
+
+    TSKLatencyHistogramDestroy(replayedDurations);
+    TSKLatencyHistogramDestroy(recordedDurations);
+    return (differenceCount > 0) ? 1 : 0;
+}
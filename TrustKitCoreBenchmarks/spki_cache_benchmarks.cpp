@@ -0,0 +1,126 @@
+/*
+
+ spki_cache_benchmarks.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+// Persistence of the SPKI cache in the temporary directory: appending the entries of a burst of misses to the
+// journal, compacting the journal into a new snapshot, and opening and probing the snapshot at launch
+
+#include "../TrustKit/Pinning/spki_cache_file.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<TSKSPKICacheRecord> randomRecords(size_t recordCount)
+{
+    std::mt19937 generator(1);
+    std::vector<TSKSPKICacheRecord> records(recordCount);
+    for (TSKSPKICacheRecord &record : records)
+    {
+        uint8_t certificateDigest[TSK_SPKI_CACHE_DIGEST_LENGTH];
+        uint8_t spkiHash[TSK_SPKI_CACHE_DIGEST_LENGTH];
+        for (size_t i = 0; i < TSK_SPKI_CACHE_DIGEST_LENGTH; i++)
+        {
+            certificateDigest[i] = static_cast<uint8_t>(generator());
+            spkiHash[i] = static_cast<uint8_t>(generator());
+        }
+        TSKSPKICacheRecordInit(&record, certificateDigest, spkiHash);
+    }
+    return records;
+}
+
+std::string temporaryPath(const char *name)
+{
+    const char *directory = std::getenv("TMPDIR");
+    return std::string((directory != nullptr) ? directory : "/tmp") + "/" + name;
+}
+
+} // namespace
+
+
+// Appending the entries of one flush to the journal; it gets reset every so often as a compaction would
+static void BM_SPKICacheJournalAppend(benchmark::State &state)
+{
+    std::vector<TSKSPKICacheRecord> records = randomRecords(static_cast<size_t>(state.range(0)));
+    std::string journalPath = temporaryPath("trustkit_benchmark_spki_cache.journal");
+    std::remove(journalPath.c_str());
+    int64_t appendCount = 0;
+    for (auto _ : state)
+    {
+        if (!TSKSPKICacheJournalAppend(journalPath.c_str(), records.data(), records.size()))
+        {
+            state.SkipWithError("Could not append to the journal");
+            break;
+        }
+        if (++appendCount % 1024 == 0)
+        {
+            state.PauseTiming();
+            std::remove(journalPath.c_str());
+            state.ResumeTiming();
+        }
+    }
+    std::remove(journalPath.c_str());
+    state.SetItemsProcessed(appendCount * state.range(0));
+    state.SetBytesProcessed(appendCount * state.range(0) * static_cast<int64_t>(sizeof(TSKSPKICacheRecord)));
+}
+BENCHMARK(BM_SPKICacheJournalAppend)->ArgName("records")->Arg(1)->Arg(16)->Arg(128);
+
+
+// Writing a snapshot of the supplied number of records, unsorted as they come from memory, including its fsync()
+static void BM_SPKICacheSnapshotWrite(benchmark::State &state)
+{
+    std::vector<TSKSPKICacheRecord> records = randomRecords(static_cast<size_t>(state.range(0)));
+    std::vector<TSKSPKICacheRecord> unsortedRecords = records;
+    std::string snapshotPath = temporaryPath("trustkit_benchmark_spki_cache");
+    for (auto _ : state)
+    {
+        // The records get sorted in place
+        state.PauseTiming();
+        records = unsortedRecords;
+        state.ResumeTiming();
+        if (!TSKSPKICacheFileWrite(snapshotPath.c_str(), records.data(), records.size()))
+        {
+            state.SkipWithError("Could not write the snapshot");
+            break;
+        }
+    }
+    std::remove(snapshotPath.c_str());
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SPKICacheSnapshotWrite)->ArgName("records")->Arg(32)->Arg(1024)->Arg(16384)->Unit(benchmark::kMicrosecond);
+
+
+// Mapping the snapshot at launch, which should not depend on its size, and probing it once
+static void BM_SPKICacheSnapshotOpen(benchmark::State &state)
+{
+    std::vector<TSKSPKICacheRecord> records = randomRecords(static_cast<size_t>(state.range(0)));
+    TSKSPKICacheRecord probedRecord = records[records.size() / 2];
+    std::string snapshotPath = temporaryPath("trustkit_benchmark_spki_cache");
+    if (!TSKSPKICacheFileWrite(snapshotPath.c_str(), records.data(), records.size()))
+    {
+        state.SkipWithError("Could not write the snapshot");
+        return;
+    }
+    uint8_t spkiHash[TSK_SPKI_CACHE_DIGEST_LENGTH];
+    for (auto _ : state)
+    {
+        TSKSPKICacheFile *snapshot = TSKSPKICacheFileOpen(snapshotPath.c_str());
+        benchmark::DoNotOptimize(TSKSPKICacheFileLookup(snapshot, probedRecord.certificateDigest, spkiHash));
+        TSKSPKICacheFileClose(snapshot);
+    }
+    std::remove(snapshotPath.c_str());
+}
+BENCHMARK(BM_SPKICacheSnapshotOpen)->ArgName("records")->Arg(32)->Arg(1024)->Arg(16384);
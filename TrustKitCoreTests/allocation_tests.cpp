@@ -0,0 +1,269 @@
+/*
+
+ allocation_tests.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+// Counts the heap allocations of the pinning hot path, to keep the validation of an already verified chain free of
+// them. The allocations are counted by interposing glibc's malloc, which operator new and the C engines also go
+// through; this is built as its own test executable so that the other tests do not run on top of it, and the tests
+// are skipped where the interposition is not possible, such as with the sanitizers' allocators.
+
+#include "der_certificate.h"
+#include "pinning_validator.h"
+#include "test_certificates.h"
+
+#include "../TrustKit/Dependencies/domain_registry/domain_registry.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(thread_sanitizer) || __has_feature(memory_sanitizer)
+#define TSK_HAS_SANITIZER_ALLOCATOR 1
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__) || defined(__SANITIZE_THREAD__)
+#define TSK_HAS_SANITIZER_ALLOCATOR 1
+#endif
+
+#if defined(__GLIBC__) && !defined(TSK_HAS_SANITIZER_ALLOCATOR)
+#define TSK_COUNTS_ALLOCATIONS 1
+#else
+#define TSK_COUNTS_ALLOCATIONS 0
+#endif
+
+using namespace trustkit;
+
+namespace {
+
+thread_local bool isCountingAllocations = false;
+thread_local size_t allocationCount = 0;
+
+void countAllocation()
+{
+    if (isCountingAllocations)
+    {
+        allocationCount++;
+    }
+}
+
+// The number of allocations made by the current thread while running the function
+template <typename Function>
+size_t countAllocations(Function function)
+{
+    allocationCount = 0;
+    isCountingAllocations = true;
+    function();
+    isCountingAllocations = false;
+    return allocationCount;
+}
+
+} // namespace
+
+
+#if TSK_COUNTS_ALLOCATIONS
+
+extern "C" {
+
+void *__libc_malloc(size_t size);
+void *__libc_calloc(size_t count, size_t size);
+void *__libc_realloc(void *pointer, size_t size);
+void *__libc_memalign(size_t alignment, size_t size);
+
+void *malloc(size_t size) noexcept
+{
+    countAllocation();
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept
+{
+    countAllocation();
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) noexcept
+{
+    countAllocation();
+    return __libc_realloc(pointer, size);
+}
+
+void *memalign(size_t alignment, size_t size) noexcept
+{
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) noexcept
+{
+    countAllocation();
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **pointer, size_t alignment, size_t size) noexcept
+{
+    countAllocation();
+    *pointer = __libc_memalign(alignment, size);
+    return (*pointer != nullptr) ? 0 : ENOMEM;
+}
+
+} // extern "C"
+
+#endif
+
+
+namespace {
+
+const char *kGoodRootCAPin = "S5z3Fz5ZfZAGJOBZjK6TYBquyLLKO+BndKXBlL3nPjo=";
+const char *kGlobalSignRootPin = "K87oWBWM9UZfyddvDfoxL+8lpNyoUB2ptGtn0fv6G2Q=";
+
+// Rejects every chain without allocating anything, so that only the validator's own allocations get counted
+class RejectingTrustBackend : public TrustBackend
+{
+public:
+    ChainEvaluation evaluateChain(const CertificateChain &serverChain, const std::string &hostname) override
+    {
+        (void)serverChain;
+        (void)hostname;
+        return ChainEvaluation();
+    }
+
+    bool containsUserDefinedTrustAnchor(const CertificateChain &verifiedChain) override
+    {
+        (void)verifiedChain;
+        return false;
+    }
+};
+
+DomainPinningPolicy domainPolicy(const std::string &domain, bool includeSubdomains)
+{
+    DomainPinningPolicy domainPolicy;
+    domainPolicy.domain = domain;
+    domainPolicy.includeSubdomains = includeSubdomains;
+    domainPolicy.publicKeyHashes = { pinFromBase64(kGoodRootCAPin), pinFromBase64(kGlobalSignRootPin) };
+    return domainPolicy;
+}
+
+} // namespace
+
+
+class AllocationTests : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+#if !TSK_COUNTS_ALLOCATIONS
+        GTEST_SKIP() << "Allocations can only be counted with glibc's allocator";
+#endif
+        // The domains are longer than the strings that fit in a std::string without allocating
+        _pinningPolicy = std::make_shared<PinningPolicy>(std::vector<DomainPinningPolicy>{
+            domainPolicy("www.good-example-domain.com", false),
+            domainPolicy("good-example-domain.co.uk", true),
+            domainPolicy("other-example-domain.com", true),
+        });
+        _validator = std::make_unique<PinningValidator>(_pinningPolicy, std::make_shared<RejectingTrustBackend>());
+        _serverChain = { loadTestCertificate("RSA_4096/www.good.com.der"),
+                         loadTestCertificate("RSA_4096/GoodRootCA.der") };
+    }
+
+    std::shared_ptr<PinningPolicy> _pinningPolicy;
+    std::unique_ptr<PinningValidator> _validator;
+    CertificateChain _serverChain;
+};
+
+
+TEST_F(AllocationTests, RegistryLookups)
+{
+    InitializeDomainRegistry();
+
+    // Including the wildcard rules and their exceptions, in both the node and the leaf tables
+    size_t registryLengths[5] = {};
+    size_t allocations = countAllocations([&] {
+        registryLengths[0] = GetRegistryLength("www.good.com");
+        registryLengths[1] = GetRegistryLength("www.good.co.uk");
+        registryLengths[2] = GetRegistryLength("www.ck");
+        registryLengths[3] = GetRegistryLength("a.city.kawasaki.jp");
+        registryLengths[4] = GetRegistryLength("a.b.kawasaki.jp");
+    });
+    EXPECT_EQ(allocations, 0u);
+    EXPECT_EQ(registryLengths[0], 3u);
+    EXPECT_EQ(registryLengths[1], 5u);
+    EXPECT_EQ(registryLengths[2], 2u);
+    EXPECT_EQ(registryLengths[3], 11u);
+    EXPECT_EQ(registryLengths[4], 13u);
+}
+
+
+TEST_F(AllocationTests, PolicyLookups)
+{
+    const PinnedDomain *pinnedDomains[4] = {};
+    size_t allocations = countAllocations([&] {
+        pinnedDomains[0] = _pinningPolicy->findPinnedDomain("www.good-example-domain.com");
+        pinnedDomains[1] = _pinningPolicy->findPinnedDomain("a.b.c.good-example-domain.co.uk");
+        pinnedDomains[2] = _pinningPolicy->findPinnedDomain("api.other-example-domain.com");
+        pinnedDomains[3] = _pinningPolicy->findPinnedDomain("api.unpinned-example-domain.com");
+    });
+    EXPECT_EQ(allocations, 0u);
+    ASSERT_NE(pinnedDomains[1], nullptr);
+    EXPECT_EQ(pinnedDomains[1]->policy().domain, "good-example-domain.co.uk");
+    EXPECT_EQ(pinnedDomains[3], nullptr);
+}
+
+
+// A validation of a chain that the TLS stack already verified, once the lazily initialized state is warm
+TEST_F(AllocationTests, VerifiedChainValidation)
+{
+    DerSlice verifiedChain[2] = { { _serverChain[0].data(), _serverChain[0].size() },
+                                  { _serverChain[1].data(), _serverChain[1].size() } };
+    std::optional<Pin> leafPin = hashSubjectPublicKeyInfo(verifiedChain[0]);
+    std::optional<Pin> rootPin = hashSubjectPublicKeyInfo(verifiedChain[1]);
+    ASSERT_TRUE(leafPin && rootPin);
+    ChainSpkiHash spkiHashes[2] = { { 0, *leafPin }, { 1, *rootPin } };
+    _validator->validateVerifiedChain(verifiedChain, 2, "a.good-example-domain.co.uk");
+
+    ValidationResult results[4];
+    size_t allocations = countAllocations([&] {
+        results[0] = _validator->validateVerifiedChain(verifiedChain, 2, "a.good-example-domain.co.uk");
+        results[1] = _validator->validateSpkiHashes(spkiHashes, 2, "www.good-example-domain.com");
+        results[2] = _validator->validateVerifiedChain(verifiedChain, 1, "www.good-example-domain.com");
+        results[3] = _validator->validateSpkiHashes(spkiHashes, 2, "www.unpinned-example-domain.com");
+    });
+    EXPECT_EQ(allocations, 0u);
+    EXPECT_EQ(results[0].finalTrustDecision, TrustDecision::ShouldAllowConnection);
+    EXPECT_EQ(results[0].notedHostname, "good-example-domain.co.uk");
+    EXPECT_EQ(results[1].finalTrustDecision, TrustDecision::ShouldAllowConnection);
+    EXPECT_EQ(results[2].finalTrustDecision, TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(results[3].finalTrustDecision, TrustDecision::DomainNotPinned);
+}
+
+
+// A validation with the trust backend registers itself for the concurrent evaluations of the same chain to wait for
+TEST_F(AllocationTests, BackendValidation)
+{
+    const std::string pinnedHostname = "www.good-example-domain.com";
+    const std::string unpinnedHostname = "www.unpinned-example-domain.com";
+    _validator->validate(_serverChain, pinnedHostname);
+
+    ValidationResult result;
+    size_t allocations = countAllocations([&] {
+        result = _validator->validate(_serverChain, pinnedHostname);
+    });
+
+    // The key of the chain and hostname, its copy in the node of the map of evaluations, and the evaluation
+    EXPECT_EQ(allocations, 4u);
+    EXPECT_EQ(result.evaluationResult, TrustEvaluationResult::FailedInvalidCertificateChain);
+
+    // Validations of domains that are not pinned do not get that far
+    allocations = countAllocations([&] {
+        result = _validator->validate(_serverChain, unpinnedHostname);
+    });
+    EXPECT_EQ(allocations, 0u);
+    EXPECT_EQ(result.finalTrustDecision, TrustDecision::DomainNotPinned);
+}
@@ -0,0 +1,96 @@
+/*
+
+ async_validation_reporter_tests.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "async_validation_reporter.h"
+
+#include <gtest/gtest.h>
+
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace trustkit;
+
+
+TEST(AsyncValidationReporterTests, DeliversReportsInOrder)
+{
+    std::vector<std::string> reportedHostnames;
+    std::thread::id reportingThread;
+    AsyncValidationReporter reporter([&](const std::string &serverHostname, const ValidationResult &result) {
+        EXPECT_EQ(result.finalTrustDecision, TrustDecision::ShouldBlockConnection);
+        reportedHostnames.push_back(serverHostname);
+        reportingThread = std::this_thread::get_id();
+    });
+
+    ValidationResult result;
+    for (int i = 0; i < 100; i++)
+    {
+        EXPECT_TRUE(reporter.post("www" + std::to_string(i) + ".good.com", result));
+    }
+    reporter.flush();
+    ASSERT_EQ(reportedHostnames.size(), 100u);
+    EXPECT_EQ(reportedHostnames.front(), "www0.good.com");
+    EXPECT_EQ(reportedHostnames.back(), "www99.good.com");
+    EXPECT_NE(reportingThread, std::this_thread::get_id());
+}
+
+
+TEST(AsyncValidationReporterTests, DropsReportsWhenFull)
+{
+    std::mutex blockingMutex;
+    std::unique_lock<std::mutex> blockingLock(blockingMutex);
+    std::promise<void> firstDeliveryStarted;
+    std::atomic<int> deliveredCount{0};
+    AsyncValidationReporter reporter([&](const std::string &, const ValidationResult &) {
+        if (deliveredCount++ == 0)
+        {
+            firstDeliveryStarted.set_value();
+        }
+        std::lock_guard<std::mutex> lock(blockingMutex);
+    }, 2);
+
+    // The first report is being delivered and blocks the thread, the next two are pending
+    ValidationResult result;
+    EXPECT_TRUE(reporter.post("www.good.com", result));
+    firstDeliveryStarted.get_future().wait();
+    EXPECT_TRUE(reporter.post("www.good.com", result));
+    EXPECT_TRUE(reporter.post("www.good.com", result));
+    EXPECT_FALSE(reporter.post("www.good.com", result));
+
+    blockingLock.unlock();
+    reporter.flush();
+    EXPECT_EQ(deliveredCount, 3);
+    EXPECT_EQ(reporter.droppedReportCount(), 1u);
+}
+
+
+TEST(AsyncValidationReporterTests, ThrowingCallback)
+{
+    std::atomic<int> deliveredCount{0};
+    AsyncValidationReporter reporter([&](const std::string &serverHostname, const ValidationResult &) {
+        deliveredCount++;
+        if (serverHostname == "www.bad.com")
+        {
+            throw std::runtime_error("Report failed");
+        }
+    });
+
+    // The reports after the failed one still get delivered
+    ValidationResult result;
+    EXPECT_TRUE(reporter.post("www.good.com", result));
+    EXPECT_TRUE(reporter.post("www.bad.com", result));
+    EXPECT_TRUE(reporter.post("www.good.com", result));
+    reporter.flush();
+    EXPECT_EQ(deliveredCount, 3);
+    EXPECT_EQ(reporter.failedReportCount(), 1u);
+    EXPECT_EQ(reporter.droppedReportCount(), 0u);
+}
@@ -0,0 +1,178 @@
+/*
+
+ base64_codec_tests.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "../TrustKit/Pinning/base64_codec.h"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string encode(const std::vector<uint8_t> &data, size_t lineLength = 0)
+{
+    std::string encoded(TSKBase64EncodedLength(data.size(), lineLength), '\0');
+    size_t encodedLength = TSKBase64Encode(data.data(), data.size(), lineLength, &encoded[0]);
+    EXPECT_EQ(encodedLength, encoded.size());
+    encoded.resize(encodedLength);
+    return encoded;
+}
+
+bool decode(const std::string &encoded, std::vector<uint8_t> &data)
+{
+    data.resize(TSKBase64DecodedMaxLength(encoded.size()));
+    size_t length = 0;
+    bool isValid = TSKBase64Decode(encoded.data(), encoded.size(), data.data(), &length);
+    data.resize(length);
+    return isValid;
+}
+
+std::vector<uint8_t> makeData(size_t length)
+{
+    std::vector<uint8_t> data(length);
+    for (size_t i = 0; i < length; i++)
+    {
+        data[i] = static_cast<uint8_t>(i * 167 + length);
+    }
+    return data;
+}
+
+std::vector<bool> simdSettings()
+{
+    std::vector<bool> settings = { false };
+    if (TSKBase64SetSIMDEnabled(true))
+    {
+        settings.push_back(true);
+    }
+    return settings;
+}
+
+} // namespace
+
+
+// The SIMD setting is global, so each test restores it
+class Base64CodecTests : public ::testing::Test
+{
+protected:
+    void SetUp() override { _isSIMDEnabled = TSKBase64IsSIMDEnabled(); }
+
+    void TearDown() override { TSKBase64SetSIMDEnabled(_isSIMDEnabled); }
+
+    bool _isSIMDEnabled = false;
+};
+
+
+TEST_F(Base64CodecTests, KnownVectors)
+{
+    // RFC 4648 test vectors
+    const char *vectors[][2] = {
+        { "", "" }, { "f", "Zg==" }, { "fo", "Zm8=" }, { "foo", "Zm9v" },
+        { "foob", "Zm9vYg==" }, { "fooba", "Zm9vYmE=" }, { "foobar", "Zm9vYmFy" },
+    };
+    for (bool isSIMDEnabled : simdSettings())
+    {
+        ASSERT_TRUE(TSKBase64SetSIMDEnabled(isSIMDEnabled));
+        for (const auto &vector : vectors)
+        {
+            std::string text = vector[0];
+            EXPECT_EQ(encode(std::vector<uint8_t>(text.begin(), text.end())), vector[1]);
+            std::vector<uint8_t> decoded;
+            EXPECT_TRUE(decode(vector[1], decoded));
+            EXPECT_EQ(std::string(decoded.begin(), decoded.end()), text);
+        }
+    }
+}
+
+
+// Every length around the 24- and 48-byte SIMD blocks round-trips, and gives the same output with and without SIMD
+TEST_F(Base64CodecTests, RoundTrips)
+{
+    ASSERT_TRUE(TSKBase64SetSIMDEnabled(false));
+    std::vector<std::string> expectedEncodings;
+    for (size_t length = 0; length <= 300; length++)
+    {
+        expectedEncodings.push_back(encode(makeData(length)));
+    }
+
+    for (bool isSIMDEnabled : simdSettings())
+    {
+        SCOPED_TRACE(isSIMDEnabled ? "SIMD" : "scalar");
+        ASSERT_TRUE(TSKBase64SetSIMDEnabled(isSIMDEnabled));
+        EXPECT_EQ(TSKBase64IsSIMDEnabled(), isSIMDEnabled);
+        for (size_t length = 0; length <= 300; length++)
+        {
+            std::vector<uint8_t> data = makeData(length);
+            std::string encoded = encode(data);
+            EXPECT_EQ(encoded, expectedEncodings[length]) << "length " << length;
+            std::vector<uint8_t> decoded;
+            EXPECT_TRUE(decode(encoded, decoded)) << "length " << length;
+            EXPECT_EQ(decoded, data) << "length " << length;
+        }
+    }
+}
+
+
+TEST_F(Base64CodecTests, PEMLines)
+{
+    for (bool isSIMDEnabled : simdSettings())
+    {
+        ASSERT_TRUE(TSKBase64SetSIMDEnabled(isSIMDEnabled));
+        std::string encoded = encode(makeData(100), TSK_BASE64_PEM_LINE_LENGTH);
+        std::string unwrapped = encode(makeData(100));
+        ASSERT_EQ(encoded.size(), unwrapped.size() + 4);
+        EXPECT_EQ(encoded.substr(0, 64), unwrapped.substr(0, 64));
+        EXPECT_EQ(encoded.substr(64, 2), "\r\n");
+        EXPECT_EQ(encoded.substr(66, 64), unwrapped.substr(64, 64));
+        EXPECT_EQ(encoded.substr(130, 2), "\r\n");
+        EXPECT_EQ(encoded.substr(132), unwrapped.substr(128));
+
+        // Exactly one line, without a line break after it
+        EXPECT_EQ(encode(makeData(48), TSK_BASE64_PEM_LINE_LENGTH), encode(makeData(48)));
+    }
+}
+
+
+// Decoding is strict whichever path sees the invalid character
+TEST_F(Base64CodecTests, RejectsInvalidInput)
+{
+    std::string valid = encode(makeData(150));
+    for (bool isSIMDEnabled : simdSettings())
+    {
+        SCOPED_TRACE(isSIMDEnabled ? "SIMD" : "scalar");
+        ASSERT_TRUE(TSKBase64SetSIMDEnabled(isSIMDEnabled));
+        std::vector<uint8_t> decoded;
+        for (size_t i = 0; i < valid.size(); i++)
+        {
+            for (char invalidCharacter : { '*', ' ', '\n', '-', '_', '\0', '\x80' })
+            {
+                std::string invalid = valid;
+                invalid[i] = invalidCharacter;
+                EXPECT_FALSE(decode(invalid, decoded)) << "position " << i;
+            }
+
+            // Padding anywhere but at the end
+            if (i < valid.size() - 1)
+            {
+                std::string invalid = valid;
+                invalid[i] = '=';
+                EXPECT_FALSE(decode(invalid, decoded)) << "position " << i;
+            }
+        }
+
+        EXPECT_FALSE(decode(valid.substr(0, valid.size() - 1), decoded));
+        EXPECT_FALSE(decode("Zg=", decoded));
+        EXPECT_FALSE(decode("Z===", decoded));
+        EXPECT_FALSE(decode("====", decoded));
+        EXPECT_FALSE(decode("Zg==Zg==", decoded));
+        EXPECT_FALSE(decode(encode(makeData(48), TSK_BASE64_PEM_LINE_LENGTH) + "\r\n" + encode(makeData(3)), decoded));
+    }
+}
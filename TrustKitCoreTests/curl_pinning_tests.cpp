@@ -0,0 +1,186 @@
+/*
+
+ curl_pinning_tests.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "Integrations/curl_pinning.h"
+#include "test_tls_server.h"
+
+#include <gtest/gtest.h>
+
+#include <mutex>
+#include <thread>
+
+using namespace trustkit;
+
+namespace {
+
+const char *kBackupPin = "K87oWBWM9UZfyddvDfoxL+8lpNyoUB2ptGtn0fv6G2Q=";
+const char *kOtherPin = "naw8JswG9YvBkitP4iGuyEgbFxssEMM/v4m7MglIzEw=";
+
+size_t discardBody(char *data, size_t size, size_t count, void *context)
+{
+    (void)data;
+    (void)context;
+    return size * count;
+}
+
+} // namespace
+
+
+class CurlPinningTests : public ::testing::Test
+{
+protected:
+    static void SetUpTestSuite()
+    {
+        curl_global_init(CURL_GLOBAL_DEFAULT);
+        _certificateAuthority = new TestCertificateAuthority();
+        _server = new TestTLSServer(*_certificateAuthority, { "www.good.com", "api.good.com", "report.good.com" }, 8, true);
+    }
+
+    static void TearDownTestSuite()
+    {
+        delete _server;
+        delete _certificateAuthority;
+        curl_global_cleanup();
+    }
+
+    void SetUp() override
+    {
+        DomainPinningPolicy goodPolicy;
+        goodPolicy.domain = "www.good.com";
+        goodPolicy.publicKeyHashes = { _certificateAuthority->pin(), pinFromBase64(kBackupPin) };
+        DomainPinningPolicy apiPolicy;
+        apiPolicy.domain = "api.good.com";
+        apiPolicy.publicKeyHashes = { pinFromBase64(kOtherPin), pinFromBase64(kBackupPin) };
+        DomainPinningPolicy reportOnlyPolicy = apiPolicy;
+        reportOnlyPolicy.domain = "report.good.com";
+        reportOnlyPolicy.enforcePinning = false;
+        _pinningPolicy = std::make_shared<PinningPolicy>(std::vector<DomainPinningPolicy>{ goodPolicy, apiPolicy, reportOnlyPolicy });
+
+        std::string port = std::to_string(_server->port());
+        for (const char *hostname : { "www.good.com", "api.good.com", "report.good.com" })
+        {
+            _resolvedHosts = curl_slist_append(_resolvedHosts, (std::string(hostname) + ":" + port + ":127.0.0.1").c_str());
+        }
+    }
+
+    void TearDown() override
+    {
+        curl_slist_free_all(_resolvedHosts);
+    }
+
+    // An easy handle for the test server, which trusts the test CA
+    CURL *newHandle(const std::string &hostname)
+    {
+        std::string certificateAuthorityPem = _certificateAuthority->pem();
+        curl_blob certificateAuthorityBlob = { &certificateAuthorityPem[0], certificateAuthorityPem.size(), CURL_BLOB_COPY };
+
+        CURL *handle = curl_easy_init();
+        curl_easy_setopt(handle, CURLOPT_URL, ("https://" + hostname + ":" + std::to_string(_server->port()) + "/").c_str());
+        curl_easy_setopt(handle, CURLOPT_RESOLVE, _resolvedHosts);
+        curl_easy_setopt(handle, CURLOPT_CAINFO_BLOB, &certificateAuthorityBlob);
+        curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, discardBody);
+        return handle;
+    }
+
+    CURLcode perform(CurlPinning *curlPinning, const std::string &hostname)
+    {
+        CURL *handle = newHandle(hostname);
+        if (curlPinning != nullptr)
+        {
+            curlPinning->attach(handle);
+        }
+        CURLcode result = curl_easy_perform(handle);
+        curl_easy_cleanup(handle);
+        return result;
+    }
+
+    static TestCertificateAuthority *_certificateAuthority;
+    static TestTLSServer *_server;
+
+    std::shared_ptr<PinningPolicy> _pinningPolicy;
+    curl_slist *_resolvedHosts = nullptr;
+};
+
+TestCertificateAuthority *CurlPinningTests::_certificateAuthority = nullptr;
+TestTLSServer *CurlPinningTests::_server = nullptr;
+
+
+TEST_F(CurlPinningTests, EasyHandles)
+{
+    std::mutex reportsMutex;
+    std::vector<std::string> reportedHostnames;
+    std::thread::id reportingThread;
+    CurlPinning curlPinning(_pinningPolicy, [&](const std::string &serverHostname, const ValidationResult &result) {
+        std::lock_guard<std::mutex> lock(reportsMutex);
+        EXPECT_EQ(result.evaluationResult, TrustEvaluationResult::FailedNoMatchingPin);
+        reportedHostnames.push_back(serverHostname);
+        reportingThread = std::this_thread::get_id();
+    });
+
+    // Without pinning, all the transfers succeed
+    EXPECT_EQ(perform(nullptr, "api.good.com"), CURLE_OK);
+
+    EXPECT_EQ(perform(&curlPinning, "www.good.com"), CURLE_OK);
+    EXPECT_NE(perform(&curlPinning, "api.good.com"), CURLE_OK);
+    EXPECT_EQ(perform(&curlPinning, "report.good.com"), CURLE_OK);
+
+    curlPinning.flushReports();
+    std::lock_guard<std::mutex> lock(reportsMutex);
+    EXPECT_EQ(reportedHostnames, (std::vector<std::string>{ "api.good.com", "report.good.com" }));
+    EXPECT_NE(reportingThread, std::this_thread::get_id());
+    EXPECT_EQ(curlPinning.droppedReportCount(), 0u);
+}
+
+
+TEST_F(CurlPinningTests, MultiHandle)
+{
+    const int transferCount = 64;
+    std::atomic<int> reportCount{0};
+    CurlPinning curlPinning(_pinningPolicy, [&](const std::string &, const ValidationResult &) { reportCount++; });
+
+    // Concurrent transfers on one multi handle, every fourth one to a domain whose pins do not match
+    CURLM *multiHandle = curl_multi_init();
+    for (int i = 0; i < transferCount; i++)
+    {
+        CURL *handle = newHandle((i % 4 == 3) ? "api.good.com" : "www.good.com");
+        ASSERT_EQ(curlPinning.addHandle(multiHandle, handle), CURLM_OK);
+    }
+
+    int runningCount = 0;
+    curl_multi_perform(multiHandle, &runningCount);
+    while (runningCount > 0)
+    {
+        curl_multi_poll(multiHandle, nullptr, 0, 100, nullptr);
+        curl_multi_perform(multiHandle, &runningCount);
+    }
+
+    int succeededCount = 0;
+    int failedCount = 0;
+    int messageCount = 0;
+    while (CURLMsg *message = curl_multi_info_read(multiHandle, &messageCount))
+    {
+        if (message->msg != CURLMSG_DONE)
+        {
+            continue;
+        }
+        (message->data.result == CURLE_OK) ? succeededCount++ : failedCount++;
+        CURL *handle = message->easy_handle;
+        curl_multi_remove_handle(multiHandle, handle);
+        curl_easy_cleanup(handle);
+    }
+    curl_multi_cleanup(multiHandle);
+
+    EXPECT_EQ(succeededCount, transferCount * 3 / 4);
+    EXPECT_EQ(failedCount, transferCount / 4);
+    curlPinning.flushReports();
+    EXPECT_EQ(reportCount, transferCount / 4);
+}
+
@@ -0,0 +1,84 @@
+/*
+
+ der_certificate_tests.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "der_certificate.h"
+#include "pinning_policy.h"
+#include "test_certificates.h"
+
+#include <gtest/gtest.h>
+
+using namespace trustkit;
+
+namespace {
+
+Pin pinForCertificate(const std::vector<uint8_t> &certificate)
+{
+    std::optional<Pin> pin = hashSubjectPublicKeyInfo({ certificate.data(), certificate.size() });
+    EXPECT_TRUE(pin.has_value());
+    return pin.value_or(Pin{});
+}
+
+} // namespace
+
+
+TEST(DerCertificateTests, SubjectPublicKeyInfoPins)
+{
+    // The pins generated by get_pin_from_certificate.py for the test certificates
+    EXPECT_EQ(pinForCertificate(loadTestCertificate("RSA_4096/GoodRootCA.der")),
+              pinFromBase64("S5z3Fz5ZfZAGJOBZjK6TYBquyLLKO+BndKXBlL3nPjo="));
+    EXPECT_EQ(pinForCertificate(loadTestCertificate("RSA_4096/www.good.com.der")),
+              pinFromBase64("TwyNzy19zZi7cKfPsucs1E+h8ODOCPMrT8681sFWJvw="));
+    EXPECT_EQ(pinForCertificate(loadTestCertificate("RSA_2048/GlobalSignRootCA.der")),
+              pinFromBase64("K87oWBWM9UZfyddvDfoxL+8lpNyoUB2ptGtn0fv6G2Q="));
+    EXPECT_EQ(pinForCertificate(loadTestCertificate("RSA_2048/www.globalsign.com.der")),
+              pinFromBase64("NDCIt6TrQnfOk+lquunrmlPQB3K/7CLOCmSS5kW+KCc="));
+}
+
+
+TEST(DerCertificateTests, MalformedCertificates)
+{
+    std::vector<uint8_t> certificate = loadTestCertificate("RSA_4096/www.good.com.der");
+
+    EXPECT_FALSE(hashSubjectPublicKeyInfo({ nullptr, 0 }));
+    EXPECT_FALSE(hashSubjectPublicKeyInfo({ certificate.data(), 0 }));
+
+    // Truncated before the end of the subjectPublicKeyInfo
+    EXPECT_FALSE(hashSubjectPublicKeyInfo({ certificate.data(), 200 }));
+
+    // Not a SEQUENCE
+    std::vector<uint8_t> wrongTag = certificate;
+    wrongTag[0] = 0x31;
+    EXPECT_FALSE(hashSubjectPublicKeyInfo({ wrongTag.data(), wrongTag.size() }));
+
+    // Indefinite length
+    std::vector<uint8_t> indefiniteLength = certificate;
+    indefiniteLength[1] = 0x80;
+    EXPECT_FALSE(hashSubjectPublicKeyInfo({ indefiniteLength.data(), indefiniteLength.size() }));
+}
+
+
+TEST(DerCertificateTests, ChainDigest)
+{
+    CertificateChain chain = {
+        loadTestCertificate("RSA_4096/www.good.com.der"),
+        loadTestCertificate("RSA_4096/GoodRootCA.der"),
+    };
+    CertificateChain reversedChain = { chain[1], chain[0] };
+    CertificateChain leafOnly = { chain[0] };
+
+    EXPECT_EQ(digestForCertificateChain(chain), digestForCertificateChain(chain));
+    EXPECT_NE(digestForCertificateChain(chain), digestForCertificateChain(reversedChain));
+    EXPECT_NE(digestForCertificateChain(chain), digestForCertificateChain(leafOnly));
+
+    // The same digest for the slices of the chain
+    DerSlice slices[2] = { { chain[0].data(), chain[0].size() }, { chain[1].data(), chain[1].size() } };
+    EXPECT_EQ(digestForCertificateChain(slices, 2), digestForCertificateChain(chain));
+}
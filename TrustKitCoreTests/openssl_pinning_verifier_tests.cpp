@@ -0,0 +1,280 @@
+/*
+
+ openssl_pinning_verifier_tests.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "Integrations/openssl_pinning_verifier.h"
+#include "test_tls_server.h"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <openssl/err.h>
+
+using namespace trustkit;
+
+namespace {
+
+// Pins that match none of the test server's certificates
+const char *kBackupPin = "K87oWBWM9UZfyddvDfoxL+8lpNyoUB2ptGtn0fv6G2Q=";
+const char *kOtherPin = "naw8JswG9YvBkitP4iGuyEgbFxssEMM/v4m7MglIzEw=";
+
+DomainPinningPolicy domainPolicy(const std::string &domain, const Pin &pin)
+{
+    DomainPinningPolicy domainPolicy;
+    domainPolicy.domain = domain;
+    domainPolicy.publicKeyHashes = { pin, pinFromBase64(kBackupPin) };
+    return domainPolicy;
+}
+
+} // namespace
+
+
+class OpenSSLPinningVerifierTests : public ::testing::Test
+{
+protected:
+    static void SetUpTestSuite()
+    {
+        _certificateAuthority = new TestCertificateAuthority();
+        _server = new TestTLSServer(*_certificateAuthority,
+                                    { "www.good.com", "api.good.com", "report.good.com", "expired.good.com", "www.notpinned.com" });
+    }
+
+    static void TearDownTestSuite()
+    {
+        delete _server;
+        delete _certificateAuthority;
+    }
+
+    void SetUp() override
+    {
+        _clientContext = _certificateAuthority->newClientContext();
+
+        DomainPinningPolicy reportOnlyPolicy = domainPolicy("report.good.com", pinFromBase64(kOtherPin));
+        reportOnlyPolicy.enforcePinning = false;
+        DomainPinningPolicy expiredPolicy = domainPolicy("expired.good.com", pinFromBase64(kOtherPin));
+        expiredPolicy.expirationDate = expirationDateFromString("2015-01-01");
+        auto pinningPolicy = std::make_shared<PinningPolicy>(std::vector<DomainPinningPolicy>{
+            domainPolicy("www.good.com", _certificateAuthority->pin()),
+            domainPolicy("www.wrong.com", _certificateAuthority->pin()),
+            domainPolicy("api.good.com", pinFromBase64(kOtherPin)),
+            reportOnlyPolicy,
+            expiredPolicy,
+        });
+        _verifier = std::make_unique<OpenSSLPinningVerifier>(pinningPolicy);
+        _verifier->setValidationCallback([this](const std::string &serverHostname, const ValidationResult &result) {
+            std::lock_guard<std::mutex> lock(_resultsMutex);
+            _results.emplace_back(serverHostname, result);
+        });
+    }
+
+    void TearDown() override
+    {
+        SSL_CTX_free(_clientContext);
+    }
+
+    bool connect(const std::string &serverHostname)
+    {
+        return connectToTestServer(_clientContext, _server->port(), serverHostname);
+    }
+
+    static TestCertificateAuthority *_certificateAuthority;
+    static TestTLSServer *_server;
+
+    SSL_CTX *_clientContext = nullptr;
+    std::unique_ptr<OpenSSLPinningVerifier> _verifier;
+    std::mutex _resultsMutex;
+    std::vector<std::pair<std::string, ValidationResult>> _results;
+};
+
+TestCertificateAuthority *OpenSSLPinningVerifierTests::_certificateAuthority = nullptr;
+TestTLSServer *OpenSSLPinningVerifierTests::_server = nullptr;
+
+
+TEST_F(OpenSSLPinningVerifierTests, ContextVerifier)
+{
+    _verifier->attach(_clientContext);
+
+    // The CA is pinned
+    EXPECT_TRUE(connect("www.good.com"));
+    ASSERT_EQ(_results.size(), 1u);
+    EXPECT_EQ(_results[0].first, "www.good.com");
+    EXPECT_EQ(_results[0].second.finalTrustDecision, TrustDecision::ShouldAllowConnection);
+    EXPECT_EQ(_results[0].second.evaluationResult, TrustEvaluationResult::Success);
+
+    // No matching pin
+    EXPECT_FALSE(connect("api.good.com"));
+    ASSERT_EQ(_results.size(), 2u);
+    EXPECT_EQ(_results[1].second.finalTrustDecision, TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(_results[1].second.evaluationResult, TrustEvaluationResult::FailedNoMatchingPin);
+
+    // No matching pin, but pinning is not enforced
+    EXPECT_TRUE(connect("report.good.com"));
+    ASSERT_EQ(_results.size(), 3u);
+    EXPECT_EQ(_results[2].second.finalTrustDecision, TrustDecision::ShouldAllowConnection);
+    EXPECT_EQ(_results[2].second.evaluationResult, TrustEvaluationResult::FailedNoMatchingPin);
+
+    // Expired policy and domain that is not pinned: not reported
+    EXPECT_TRUE(connect("expired.good.com"));
+    EXPECT_TRUE(connect("www.notpinned.com"));
+    EXPECT_EQ(_results.size(), 3u);
+}
+
+
+TEST_F(OpenSSLPinningVerifierTests, InvalidChain)
+{
+    _verifier->attach(_clientContext);
+
+    // The certificate is not valid for this hostname; pinning must not make it valid
+    EXPECT_FALSE(connect("www.other.com"));
+    EXPECT_TRUE(_results.empty());
+
+    // A pinned domain whose chain is not trusted
+    SSL_CTX *untrustingContext = SSL_CTX_new(TLS_client_method());
+    _verifier->attach(untrustingContext);
+    EXPECT_FALSE(connectToTestServer(untrustingContext, _server->port(), "www.good.com"));
+    SSL_CTX_free(untrustingContext);
+    ASSERT_EQ(_results.size(), 1u);
+    EXPECT_EQ(_results[0].second.finalTrustDecision, TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(_results[0].second.evaluationResult, TrustEvaluationResult::FailedInvalidCertificateChain);
+}
+
+
+TEST_F(OpenSSLPinningVerifierTests, ConnectionVerifier)
+{
+    auto attachVerifier = [this](SSL *connection) { _verifier->attach(connection); };
+
+    EXPECT_TRUE(connectToTestServer(_clientContext, _server->port(), "www.good.com", attachVerifier));
+    EXPECT_FALSE(connectToTestServer(_clientContext, _server->port(), "api.good.com", attachVerifier));
+    EXPECT_TRUE(connectToTestServer(_clientContext, _server->port(), "report.good.com", attachVerifier));
+    EXPECT_FALSE(connectToTestServer(_clientContext, _server->port(), "www.other.com", attachVerifier));
+
+    // Pins are checked once per handshake
+    ASSERT_EQ(_results.size(), 3u);
+    EXPECT_EQ(_results[0].second.finalTrustDecision, TrustDecision::ShouldAllowConnection);
+    EXPECT_EQ(_results[1].second.finalTrustDecision, TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(_results[2].second.finalTrustDecision, TrustDecision::ShouldAllowConnection);
+
+    // Other connections of the context are not verified
+    EXPECT_TRUE(connect("api.good.com"));
+    EXPECT_EQ(_results.size(), 3u);
+}
+
+
+TEST_F(OpenSSLPinningVerifierTests, NoHostname)
+{
+    _verifier->attach(_clientContext);
+    auto clearHostname = [](SSL *connection) {
+        SSL_set_tlsext_host_name(connection, nullptr);
+        SSL_set1_host(connection, nullptr);
+    };
+    EXPECT_FALSE(connectToTestServer(_clientContext, _server->port(), "www.good.com", clearHostname));
+}
+
+
+TEST_F(OpenSSLPinningVerifierTests, SNIHostnameOnly)
+{
+    // Without SSL_set1_host(), the certificate is still checked against the SNI hostname: the pinned CA issued the
+    // server's certificate, but not for www.wrong.com
+    auto connectWithConnectionVerifier = [this](const std::string &serverHostname) {
+        return connectToTestServer(_clientContext, _server->port(), serverHostname, [this](SSL *connection) {
+            SSL_set1_host(connection, nullptr);
+            _verifier->attach(connection);
+        });
+    };
+    EXPECT_TRUE(connectWithConnectionVerifier("www.good.com"));
+    EXPECT_FALSE(connectWithConnectionVerifier("www.wrong.com"));
+    ASSERT_EQ(_results.size(), 2u);
+    EXPECT_EQ(_results[1].second.finalTrustDecision, TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(_results[1].second.evaluationResult, TrustEvaluationResult::FailedInvalidCertificateChain);
+
+    // Same with the context verifier
+    _verifier->attach(_clientContext);
+    auto connectWithContextVerifier = [this](const std::string &serverHostname) {
+        return connectToTestServer(_clientContext, _server->port(), serverHostname,
+                                   [](SSL *connection) { SSL_set1_host(connection, nullptr); });
+    };
+    EXPECT_TRUE(connectWithContextVerifier("www.good.com"));
+    EXPECT_FALSE(connectWithContextVerifier("www.wrong.com"));
+    ASSERT_EQ(_results.size(), 4u);
+    EXPECT_EQ(_results[3].second.finalTrustDecision, TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(_results[3].second.evaluationResult, TrustEvaluationResult::FailedInvalidCertificateChain);
+}
+
+
+TEST_F(OpenSSLPinningVerifierTests, ThrowingValidationCallback)
+{
+    // The exception does not unwind through OpenSSL, and the connection is blocked even though the pins matched
+    _verifier->setValidationCallback([](const std::string &, const ValidationResult &) {
+        throw std::runtime_error("Validation callback failure");
+    });
+    _verifier->attach(_clientContext);
+    EXPECT_FALSE(connect("www.good.com"));
+    EXPECT_TRUE(connect("www.notpinned.com"));
+
+    SSL_CTX *connectionContext = _certificateAuthority->newClientContext();
+    EXPECT_FALSE(connectToTestServer(connectionContext, _server->port(), "www.good.com",
+                                     [this](SSL *connection) { _verifier->attach(connection); }));
+    SSL_CTX_free(connectionContext);
+}
+
+
+TEST_F(OpenSSLPinningVerifierTests, ResumedSessions)
+{
+    _verifier->attach(_clientContext);
+    SSL_SESSION *session = nullptr;
+    ASSERT_TRUE(connectToTestServer(_clientContext, _server->port(), "www.good.com", nullptr, &session));
+    ASSERT_NE(session, nullptr);
+    auto resume = [this, &session](const std::string &serverHostname) {
+        return connectToTestServer(_clientContext, _server->port(), serverHostname,
+                                   [&session](SSL *connection) { SSL_set_session(connection, session); });
+    };
+
+    // The decision of the full handshake is reused
+    EXPECT_TRUE(resume("www.good.com"));
+    EXPECT_TRUE(resume("www.good.com"));
+    EXPECT_EQ(_verifier->reusedDecisionCount(), 2u);
+    EXPECT_EQ(_results.size(), 1u);
+
+    // Once the policy is replaced, the session is not offered anymore and the full handshake itself fails
+    _verifier->setPinningPolicy(std::make_shared<PinningPolicy>(
+        std::vector<DomainPinningPolicy>{ domainPolicy("www.good.com", pinFromBase64(kOtherPin)) }));
+    ERR_clear_error();
+    EXPECT_FALSE(resume("www.good.com"));
+    EXPECT_EQ(ERR_GET_REASON(ERR_peek_error()), SSL_R_CERTIFICATE_VERIFY_FAILED);
+    EXPECT_EQ(_verifier->reusedDecisionCount(), 2u);
+    ASSERT_EQ(_results.size(), 2u);
+    EXPECT_EQ(_results[1].second.finalTrustDecision, TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(_results[1].second.evaluationResult, TrustEvaluationResult::FailedNoMatchingPin);
+
+    _verifier->setPinningPolicy(std::make_shared<PinningPolicy>(
+        std::vector<DomainPinningPolicy>{ domainPolicy("www.good.com", _certificateAuthority->pin()) }));
+    EXPECT_TRUE(resume("www.good.com"));
+    ASSERT_EQ(_results.size(), 3u);
+    EXPECT_EQ(_results[2].second.finalTrustDecision, TrustDecision::ShouldAllowConnection);
+    EXPECT_EQ(_verifier->reusedDecisionCount(), 2u);
+    SSL_SESSION_free(session);
+
+    // Once the domain's policy expires, the pins are not checked anymore
+    DomainPinningPolicy expiringPolicy = domainPolicy("www.good.com", _certificateAuthority->pin());
+    expiringPolicy.expirationDate = std::chrono::system_clock::now() + std::chrono::milliseconds(200);
+    _verifier->setPinningPolicy(std::make_shared<PinningPolicy>(std::vector<DomainPinningPolicy>{ expiringPolicy }));
+    ASSERT_TRUE(connectToTestServer(_clientContext, _server->port(), "www.good.com", nullptr, &session));
+    EXPECT_TRUE(resume("www.good.com"));
+    EXPECT_EQ(_verifier->reusedDecisionCount(), 3u);
+    EXPECT_EQ(_results.size(), 4u);
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    EXPECT_TRUE(resume("www.good.com"));
+    EXPECT_EQ(_verifier->reusedDecisionCount(), 3u);
+    EXPECT_EQ(_results.size(), 4u);
+    SSL_SESSION_free(session);
+}
@@ -0,0 +1,117 @@
+/*
+
+ openssl_trust_backend_tests.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "Backends/openssl_trust_backend.h"
+#include "pinning_validator.h"
+#include "test_certificates.h"
+
+#include <gtest/gtest.h>
+
+#include <openssl/x509_vfy.h>
+
+using namespace trustkit;
+
+class OpenSSLTrustBackendTests : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        _rootCertificate = loadTestCertificate("RSA_4096/GoodRootCA.der");
+        _leafCertificate = loadTestCertificate("RSA_4096/www.good.com.der");
+
+        // An empty store so that the results do not depend on the system's trust store
+        X509_STORE *store = X509_STORE_new();
+        _backend = std::make_shared<OpenSSLTrustBackend>(store);
+        X509_STORE_free(store);
+        _backend->addTrustAnchor(_rootCertificate);
+        _backend->setVerificationTime(kTestCertificatesVerificationTime);
+    }
+
+    std::vector<uint8_t> _rootCertificate;
+    std::vector<uint8_t> _leafCertificate;
+    std::shared_ptr<OpenSSLTrustBackend> _backend;
+};
+
+
+TEST_F(OpenSSLTrustBackendTests, ValidChain)
+{
+    ChainEvaluation chainEvaluation = _backend->evaluateChain({ _leafCertificate }, "www.good.com");
+    EXPECT_TRUE(chainEvaluation.isTrusted) << chainEvaluation.errorDescription;
+
+    // The verified chain goes up to the trust anchor
+    ASSERT_EQ(chainEvaluation.verifiedChain.size(), 2u);
+    EXPECT_EQ(chainEvaluation.verifiedChain[0], _leafCertificate);
+    EXPECT_EQ(chainEvaluation.verifiedChain[1], _rootCertificate);
+}
+
+
+TEST_F(OpenSSLTrustBackendTests, InvalidChains)
+{
+    // Wrong hostname
+    ChainEvaluation chainEvaluation = _backend->evaluateChain({ _leafCertificate }, "www.other.com");
+    EXPECT_FALSE(chainEvaluation.isTrusted);
+    EXPECT_FALSE(chainEvaluation.errorDescription.empty());
+
+    // A hostname that OpenSSL cannot check does not disable the hostname check
+    chainEvaluation = _backend->evaluateChain({ _leafCertificate }, std::string("www.good.com\0.evil.com", 21));
+    EXPECT_FALSE(chainEvaluation.isTrusted);
+    EXPECT_EQ(chainEvaluation.errorDescription, "Invalid hostname");
+
+    // Expired
+    _backend->setVerificationTime(2208988800); // 2040-01-01
+    EXPECT_FALSE(_backend->evaluateChain({ _leafCertificate }, "www.good.com").isTrusted);
+    _backend->setVerificationTime(kTestCertificatesVerificationTime);
+
+    // Self-signed certificate that is not a trust anchor
+    std::vector<uint8_t> selfSignedCertificate = loadTestCertificate("RSA_4096/www.good.com.selfsigned.der");
+    EXPECT_FALSE(_backend->evaluateChain({ selfSignedCertificate }, "www.good.com").isTrusted);
+
+    // Not a certificate, or with trailing data
+    EXPECT_FALSE(_backend->evaluateChain({ { 0x30, 0x00 } }, "www.good.com").isTrusted);
+    std::vector<uint8_t> trailingData = _leafCertificate;
+    trailingData.push_back(0);
+    EXPECT_FALSE(_backend->evaluateChain({ trailingData }, "www.good.com").isTrusted);
+
+    // Not trusted by an empty store
+    X509_STORE *emptyStore = X509_STORE_new();
+    OpenSSLTrustBackend emptyBackend(emptyStore);
+    X509_STORE_free(emptyStore);
+    emptyBackend.setVerificationTime(kTestCertificatesVerificationTime);
+    EXPECT_FALSE(emptyBackend.evaluateChain({ _leafCertificate }, "www.good.com").isTrusted);
+}
+
+
+TEST_F(OpenSSLTrustBackendTests, InvalidTrustAnchor)
+{
+    EXPECT_THROW(_backend->addTrustAnchor({ 0x30, 0x03, 0x02, 0x01, 0x00 }), std::invalid_argument);
+}
+
+
+TEST_F(OpenSSLTrustBackendTests, PinningValidation)
+{
+    DomainPinningPolicy rootPinned;
+    rootPinned.domain = "www.good.com";
+    rootPinned.publicKeyHashes = { pinFromBase64("S5z3Fz5ZfZAGJOBZjK6TYBquyLLKO+BndKXBlL3nPjo="),
+                                   pinFromBase64("naw8JswG9YvBkitP4iGuyEgbFxssEMM/v4m7MglIzEw=") };
+    PinningValidator validator(std::make_shared<PinningPolicy>(std::vector<DomainPinningPolicy>{ rootPinned }), _backend);
+    ValidationResult validationResult = validator.validate({ _leafCertificate }, "www.good.com");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::ShouldAllowConnection);
+    EXPECT_EQ(validationResult.evaluationResult, TrustEvaluationResult::Success);
+
+    DomainPinningPolicy otherPins;
+    otherPins.domain = "www.good.com";
+    otherPins.publicKeyHashes = { pinFromBase64("K87oWBWM9UZfyddvDfoxL+8lpNyoUB2ptGtn0fv6G2Q="),
+                                  pinFromBase64("naw8JswG9YvBkitP4iGuyEgbFxssEMM/v4m7MglIzEw=") };
+    PinningValidator blockingValidator(std::make_shared<PinningPolicy>(std::vector<DomainPinningPolicy>{ otherPins }), _backend);
+    validationResult = blockingValidator.validate({ _leafCertificate }, "www.good.com");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(validationResult.evaluationResult, TrustEvaluationResult::FailedNoMatchingPin);
+}
@@ -0,0 +1,81 @@
+/*
+
+ pin_failure_report_tests.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "pin_failure_report.h"
+#include "pinning_policy.h"
+#include "test_certificates.h"
+
+#include <gtest/gtest.h>
+
+using namespace trustkit;
+
+namespace {
+
+PinFailureReport testReport()
+{
+    PinFailureReport report;
+    report.appBundleId = "com.example.app";
+    report.appVersion = "1.0";
+    report.appPlatform = "LINUX";
+    report.appPlatformVersion = "6.1";
+    report.appVendorId = "vendor";
+    report.trustkitVersion = "3.0.0";
+    report.hostname = "www.good.com";
+    report.port = 443;
+    report.dateTime = std::chrono::system_clock::from_time_t(kTestCertificatesVerificationTime);
+    report.notedHostname = "good.com";
+    report.includeSubdomains = true;
+    report.enforcePinning = true;
+    report.knownPins = { pinFromBase64("S5z3Fz5ZfZAGJOBZjK6TYBquyLLKO+BndKXBlL3nPjo="),
+                         pinFromBase64("K87oWBWM9UZfyddvDfoxL+8lpNyoUB2ptGtn0fv6G2Q=") };
+    report.validationResult = TrustEvaluationResult::FailedNoMatchingPin;
+    return report;
+}
+
+} // namespace
+
+
+TEST(PinFailureReportTests, Json)
+{
+    PinFailureReport report = testReport();
+    report.knownPinsExpirationDate = expirationDateFromString("2030-06-15");
+    EXPECT_EQ(pinFailureReportJson(report),
+              "{\"app-bundle-id\":\"com.example.app\",\"app-version\":\"1.0\",\"app-platform\":\"LINUX\","
+              "\"app-platform-version\":\"6.1\",\"app-vendor-id\":\"vendor\",\"trustkit-version\":\"3.0.0\","
+              "\"date-time\":\"2024-01-01T00:00:00Z\",\"hostname\":\"www.good.com\",\"port\":443,"
+              "\"noted-hostname\":\"good.com\",\"include-subdomains\":true,\"enforce-pinning\":true,"
+              "\"validated-certificate-chain\":[],"
+              "\"known-pins\":[\"pin-sha256=\\\"S5z3Fz5ZfZAGJOBZjK6TYBquyLLKO+BndKXBlL3nPjo=\\\"\","
+              "\"pin-sha256=\\\"K87oWBWM9UZfyddvDfoxL+8lpNyoUB2ptGtn0fv6G2Q=\\\"\"],"
+              "\"validation-result\":1,\"known-pins-expiration-date\":\"2030-06-15\"}");
+}
+
+
+TEST(PinFailureReportTests, CertificateChainAndEscaping)
+{
+    PinFailureReport report = testReport();
+    report.hostname = "a\"b\\c\n";
+    report.validatedCertificateChain = { loadTestCertificate("RSA_4096/www.good.com.der"),
+                                         loadTestCertificate("RSA_4096/GoodRootCA.der") };
+    std::string json = pinFailureReportJson(report);
+
+    EXPECT_NE(json.find("\"hostname\":\"a\\\"b\\\\c\\n\""), std::string::npos);
+    EXPECT_NE(json.find("\"known-pins-expiration-date\":null"), std::string::npos);
+
+    // Two PEM certificates, with 64-character lines separated by CRLF
+    size_t chainStart = json.find("\"validated-certificate-chain\":[\"-----BEGIN CERTIFICATE-----\\n");
+    ASSERT_NE(chainStart, std::string::npos);
+    size_t secondCertificate = json.find("\\n-----END CERTIFICATE-----\",\"-----BEGIN CERTIFICATE-----\\n", chainStart);
+    ASSERT_NE(secondCertificate, std::string::npos);
+    size_t firstLineBreak = json.find("\\r\\n", chainStart);
+    EXPECT_EQ(firstLineBreak - chainStart, std::string("\"validated-certificate-chain\":[\"-----BEGIN CERTIFICATE-----\\n").size() + 64);
+    EXPECT_NE(json.find("\\n-----END CERTIFICATE-----\"],\"known-pins\"", secondCertificate + 1), std::string::npos);
+}
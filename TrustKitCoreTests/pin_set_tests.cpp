@@ -0,0 +1,140 @@
+/*
+
+ pin_set_tests.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "../TrustKit/Pinning/pin_set.h"
+#include "../TrustKit/Pinning/sha256_engine.h"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <vector>
+
+namespace {
+
+using Pin = std::array<uint8_t, TSK_PIN_LENGTH>;
+
+// Pins are SHA-256 hashes, so the test pins are too
+Pin makePin(uint32_t seed)
+{
+    Pin pin;
+    TSKSHA256Hash(&seed, sizeof(seed), pin.data());
+    return pin;
+}
+
+std::vector<Pin> makePins(uint32_t firstSeed, size_t count)
+{
+    std::vector<Pin> pins;
+    for (size_t i = 0; i < count; i++)
+    {
+        pins.push_back(makePin(firstSeed + static_cast<uint32_t>(i)));
+    }
+    return pins;
+}
+
+TSKPinSet *createPinSet(const std::vector<Pin> &pins)
+{
+    return TSKPinSetCreate(reinterpret_cast<const uint8_t(*)[TSK_PIN_LENGTH]>(pins.data()), pins.size());
+}
+
+// Check every configured pin, pins that differ from them by one byte, and pins that are not configured
+void checkPinSet(const std::vector<Pin> &pins)
+{
+    TSKPinSet *pinSet = createPinSet(pins);
+    ASSERT_NE(pinSet, nullptr);
+    EXPECT_EQ(TSKPinSetGetCount(pinSet), pins.size());
+    EXPECT_EQ(TSKPinSetHasFilter(pinSet), pins.size() >= TSK_PIN_SET_MIN_FILTERED_PINS);
+    EXPECT_GE(TSKPinSetGetMemorySize(pinSet), pins.size() * TSK_PIN_LENGTH);
+
+    // No false negatives
+    size_t missingCount = 0;
+    for (const Pin &pin : pins)
+    {
+        missingCount += TSKPinSetContains(pinSet, pin.data()) ? 0 : 1;
+    }
+    EXPECT_EQ(missingCount, 0u);
+
+    // Near misses, including ones that the filter, which only looks at the first bytes, lets through
+    for (size_t i = 0; i < TSK_PIN_LENGTH; i++)
+    {
+        Pin nearMiss = pins[i % pins.size()];
+        nearMiss[i] ^= 0x01;
+        EXPECT_FALSE(TSKPinSetContains(pinSet, nearMiss.data())) << "byte " << i;
+    }
+
+    size_t falsePositiveCount = 0;
+    for (const Pin &pin : makePins(0x80000000, 2000))
+    {
+        falsePositiveCount += TSKPinSetContains(pinSet, pin.data()) ? 1 : 0;
+    }
+    EXPECT_EQ(falsePositiveCount, 0u);
+    TSKPinSetDestroy(pinSet);
+}
+
+} // namespace
+
+
+TEST(PinSetTests, ScannedSets)
+{
+    for (size_t pinCount : { 1, 2, 3, 7, 8, 9, TSK_PIN_SET_MAX_SCANNED_PINS })
+    {
+        SCOPED_TRACE(pinCount);
+        checkPinSet(makePins(0, pinCount));
+    }
+}
+
+
+TEST(PinSetTests, SortedSets)
+{
+    for (size_t pinCount : { TSK_PIN_SET_MAX_SCANNED_PINS + 1, 500, TSK_PIN_SET_MIN_FILTERED_PINS - 1 })
+    {
+        SCOPED_TRACE(pinCount);
+        checkPinSet(makePins(0, pinCount));
+    }
+}
+
+
+TEST(PinSetTests, FilteredSets)
+{
+    for (size_t pinCount : { TSK_PIN_SET_MIN_FILTERED_PINS, 5000, 100000 })
+    {
+        SCOPED_TRACE(pinCount);
+        checkPinSet(makePins(0, pinCount));
+    }
+
+    // The filter is part of the set's size
+    std::vector<Pin> pins = makePins(0, TSK_PIN_SET_MIN_FILTERED_PINS);
+    TSKPinSet *pinSet = createPinSet(pins);
+    EXPECT_GT(TSKPinSetGetMemorySize(pinSet), pins.size() * TSK_PIN_LENGTH + pins.size());
+    TSKPinSetDestroy(pinSet);
+}
+
+
+TEST(PinSetTests, DuplicatesAndEmptySets)
+{
+    // Duplicates are dropped, whichever path the set ends up using
+    for (size_t pinCount : { 4, TSK_PIN_SET_MAX_SCANNED_PINS, TSK_PIN_SET_MIN_FILTERED_PINS })
+    {
+        std::vector<Pin> pins = makePins(0, pinCount);
+        std::vector<Pin> duplicatedPins = pins;
+        duplicatedPins.insert(duplicatedPins.end(), pins.begin(), pins.end());
+        TSKPinSet *pinSet = createPinSet(duplicatedPins);
+        EXPECT_EQ(TSKPinSetGetCount(pinSet), pinCount);
+        EXPECT_TRUE(TSKPinSetContains(pinSet, pins.back().data()));
+        TSKPinSetDestroy(pinSet);
+    }
+
+    TSKPinSet *emptySet = TSKPinSetCreate(nullptr, 0);
+    ASSERT_NE(emptySet, nullptr);
+    EXPECT_EQ(TSKPinSetGetCount(emptySet), 0u);
+    EXPECT_FALSE(TSKPinSetContains(emptySet, makePin(0).data()));
+    TSKPinSetDestroy(emptySet);
+    EXPECT_FALSE(TSKPinSetContains(nullptr, makePin(0).data()));
+}
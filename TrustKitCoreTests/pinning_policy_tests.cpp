@@ -0,0 +1,147 @@
+/*
+
+ pinning_policy_tests.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "pinning_policy.h"
+
+#include <gtest/gtest.h>
+
+using namespace trustkit;
+
+namespace {
+
+const char *kGoodRootCAPin = "S5z3Fz5ZfZAGJOBZjK6TYBquyLLKO+BndKXBlL3nPjo=";
+const char *kGoodLeafPin = "TwyNzy19zZi7cKfPsucs1E+h8ODOCPMrT8681sFWJvw=";
+
+DomainPinningPolicy pinnedDomainPolicy(const std::string &domain, bool includeSubdomains = false)
+{
+    DomainPinningPolicy domainPolicy;
+    domainPolicy.domain = domain;
+    domainPolicy.publicKeyHashes = { pinFromBase64(kGoodRootCAPin), pinFromBase64(kGoodLeafPin) };
+    domainPolicy.includeSubdomains = includeSubdomains;
+    return domainPolicy;
+}
+
+DomainPinningPolicy excludedDomainPolicy(const std::string &domain)
+{
+    DomainPinningPolicy domainPolicy;
+    domainPolicy.domain = domain;
+    domainPolicy.excludeSubdomainFromParentPolicy = true;
+    return domainPolicy;
+}
+
+std::string findPinnedDomainName(const PinningPolicy &pinningPolicy, const std::string &hostname)
+{
+    const PinnedDomain *pinnedDomain = pinningPolicy.findPinnedDomain(hostname);
+    return (pinnedDomain != nullptr) ? pinnedDomain->policy().domain : "";
+}
+
+} // namespace
+
+
+TEST(PinningPolicyTests, PinFromBase64)
+{
+    Pin pin = pinFromBase64(kGoodRootCAPin);
+    EXPECT_EQ(pin[0], 0x4b);
+    EXPECT_EQ(pin[31], 0x3a);
+
+    EXPECT_THROW(pinFromBase64(""), ConfigurationError);
+    EXPECT_THROW(pinFromBase64("S5z3Fz5ZfZAGJOBZjK6TYBquyLLKO+BndKXBlL3nPj"), ConfigurationError);
+    EXPECT_THROW(pinFromBase64("S5z3Fz5ZfZAGJOBZjK6TYBquyLLKO+BndKXBlL3nPjo=S5z3"), ConfigurationError);
+    EXPECT_THROW(pinFromBase64("S5z3Fz5ZfZAGJOBZjK6TYBquyLLKO+BndKXBlL3nP!o="), ConfigurationError);
+}
+
+
+TEST(PinningPolicyTests, ExpirationDateFromString)
+{
+    auto expirationDate = expirationDateFromString("2018-01-02");
+    EXPECT_EQ(std::chrono::system_clock::to_time_t(expirationDate), 1514851200);
+    EXPECT_EQ(std::chrono::system_clock::to_time_t(expirationDateFromString("1970-01-01")), 0);
+
+    EXPECT_THROW(expirationDateFromString("2018-1-02"), ConfigurationError);
+    EXPECT_THROW(expirationDateFromString("2018-13-02"), ConfigurationError);
+    EXPECT_THROW(expirationDateFromString("2018/01/02"), ConfigurationError);
+    EXPECT_THROW(expirationDateFromString("20x8-01-02"), ConfigurationError);
+}
+
+
+TEST(PinningPolicyTests, InvalidPolicies)
+{
+    // No domains
+    EXPECT_THROW(PinningPolicy({}), ConfigurationError);
+
+    // Unknown TLD
+    EXPECT_THROW(PinningPolicy({ pinnedDomainPolicy("good.unknowntld") }), ConfigurationError);
+
+    // includeSubdomains on a domain suffix
+    EXPECT_THROW(PinningPolicy({ pinnedDomainPolicy("com", true) }), ConfigurationError);
+    EXPECT_THROW(PinningPolicy({ pinnedDomainPolicy("co.uk", true) }), ConfigurationError);
+
+    // No backup pin
+    DomainPinningPolicy singlePin = pinnedDomainPolicy("www.good.com");
+    singlePin.publicKeyHashes.pop_back();
+    EXPECT_THROW(PinningPolicy({ singlePin }), ConfigurationError);
+
+    // The same pin twice is still only one pin
+    DomainPinningPolicy duplicatePins = pinnedDomainPolicy("www.good.com");
+    duplicatePins.publicKeyHashes[1] = duplicatePins.publicKeyHashes[0];
+    EXPECT_THROW(PinningPolicy({ duplicatePins }), ConfigurationError);
+
+    // A single pin is fine when pinning is not enforced
+    singlePin.enforcePinning = false;
+    EXPECT_NO_THROW(PinningPolicy({ singlePin }));
+
+    // Excluded subdomain without a parent policy
+    EXPECT_THROW(PinningPolicy({ excludedDomainPolicy("unsecured.good.com") }), ConfigurationError);
+    EXPECT_THROW(PinningPolicy({ pinnedDomainPolicy("good.com"), excludedDomainPolicy("unsecured.good.com") }),
+                 ConfigurationError);
+
+    // Excluded subdomain with other settings
+    DomainPinningPolicy excludedWithPins = pinnedDomainPolicy("unsecured.good.com");
+    excludedWithPins.excludeSubdomainFromParentPolicy = true;
+    EXPECT_THROW(PinningPolicy({ pinnedDomainPolicy("good.com", true), excludedWithPins }), ConfigurationError);
+}
+
+
+TEST(PinningPolicyTests, FindPinnedDomain)
+{
+    PinningPolicy pinningPolicy({
+        pinnedDomainPolicy("good.com", true),
+        pinnedDomainPolicy("www.good.com"),
+        pinnedDomainPolicy("sub.sub.good.com", true),
+        pinnedDomainPolicy("good.co.uk", true),
+        excludedDomainPolicy("unsecured.good.com"),
+    });
+    EXPECT_EQ(pinningPolicy.domainCount(), 5u);
+
+    EXPECT_EQ(findPinnedDomainName(pinningPolicy, "good.com"), "good.com");
+    EXPECT_EQ(findPinnedDomainName(pinningPolicy, "www.good.com"), "www.good.com");
+    EXPECT_EQ(findPinnedDomainName(pinningPolicy, "unsecured.good.com"), "unsecured.good.com");
+
+    // includeSubdomains, with the closest parent domain winning
+    EXPECT_EQ(findPinnedDomainName(pinningPolicy, "api.good.com"), "good.com");
+    EXPECT_EQ(findPinnedDomainName(pinningPolicy, "a.b.good.com"), "good.com");
+    EXPECT_EQ(findPinnedDomainName(pinningPolicy, "sub.good.com"), "good.com");
+    EXPECT_EQ(findPinnedDomainName(pinningPolicy, "a.sub.sub.good.com"), "sub.sub.good.com");
+    EXPECT_EQ(findPinnedDomainName(pinningPolicy, "api.www.good.com"), "good.com");
+    EXPECT_EQ(findPinnedDomainName(pinningPolicy, "www.good.co.uk"), "good.co.uk");
+
+    // Not subdomains
+    EXPECT_EQ(findPinnedDomainName(pinningPolicy, "notgood.com"), "");
+    EXPECT_EQ(findPinnedDomainName(pinningPolicy, "good.com.evil.com"), "");
+    EXPECT_EQ(findPinnedDomainName(pinningPolicy, "www.good.org"), "");
+    EXPECT_EQ(findPinnedDomainName(pinningPolicy, "www.good.uk"), "");
+    EXPECT_EQ(findPinnedDomainName(pinningPolicy, "com"), "");
+
+    // Without includeSubdomains
+    PinningPolicy exactPolicy({ pinnedDomainPolicy("www.good.com") });
+    EXPECT_EQ(findPinnedDomainName(exactPolicy, "www.good.com"), "www.good.com");
+    EXPECT_EQ(findPinnedDomainName(exactPolicy, "api.www.good.com"), "");
+}
@@ -0,0 +1,356 @@
+/*
+
+ pinning_validator_tests.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "pinning_validator.h"
+#include "test_certificates.h"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using namespace trustkit;
+
+namespace {
+
+const char *kGoodRootCAPin = "S5z3Fz5ZfZAGJOBZjK6TYBquyLLKO+BndKXBlL3nPjo=";
+const char *kGoodLeafPin = "TwyNzy19zZi7cKfPsucs1E+h8ODOCPMrT8681sFWJvw=";
+const char *kGlobalSignRootPin = "K87oWBWM9UZfyddvDfoxL+8lpNyoUB2ptGtn0fv6G2Q=";
+const char *kGlobalSignLeafPin = "NDCIt6TrQnfOk+lquunrmlPQB3K/7CLOCmSS5kW+KCc=";
+
+// Trusts every chain, and returns the server's chain with the supplied certificate appended as the verified chain
+class FakeTrustBackend : public TrustBackend
+{
+public:
+    std::vector<uint8_t> trustAnchor;
+    bool isTrusted = true;
+    bool isUserDefinedTrustAnchor = false;
+    std::chrono::milliseconds evaluationDelay{0};
+    std::atomic<int> evaluationCount{0};
+
+    ChainEvaluation evaluateChain(const CertificateChain &serverChain, const std::string &hostname) override
+    {
+        (void)hostname;
+        evaluationCount++;
+        std::this_thread::sleep_for(evaluationDelay);
+        ChainEvaluation chainEvaluation;
+        chainEvaluation.isTrusted = isTrusted;
+        if (isTrusted)
+        {
+            chainEvaluation.verifiedChain = serverChain;
+            chainEvaluation.verifiedChain.push_back(trustAnchor);
+        }
+        return chainEvaluation;
+    }
+
+    bool containsUserDefinedTrustAnchor(const CertificateChain &verifiedChain) override
+    {
+        (void)verifiedChain;
+        return isUserDefinedTrustAnchor;
+    }
+};
+
+DomainPinningPolicy domainPolicy(const std::string &domain, const char *firstPin, const char *secondPin)
+{
+    DomainPinningPolicy domainPolicy;
+    domainPolicy.domain = domain;
+    domainPolicy.publicKeyHashes = { pinFromBase64(firstPin), pinFromBase64(secondPin) };
+    return domainPolicy;
+}
+
+} // namespace
+
+
+class PinningValidatorTests : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        _backend = std::make_shared<FakeTrustBackend>();
+        _backend->trustAnchor = loadTestCertificate("RSA_4096/GoodRootCA.der");
+        _serverChain = { loadTestCertificate("RSA_4096/www.good.com.der") };
+    }
+
+    std::unique_ptr<PinningValidator> validatorForPolicies(std::vector<DomainPinningPolicy> domainPolicies,
+                                                           bool ignorePinsForUserTrustAnchors = true)
+    {
+        return std::make_unique<PinningValidator>(std::make_shared<PinningPolicy>(std::move(domainPolicies)), _backend,
+                                                  ignorePinsForUserTrustAnchors);
+    }
+
+    std::shared_ptr<FakeTrustBackend> _backend;
+    CertificateChain _serverChain;
+};
+
+
+TEST_F(PinningValidatorTests, PinMatches)
+{
+    // Pin on the root, then on the leaf
+    auto validator = validatorForPolicies({ domainPolicy("www.good.com", kGoodRootCAPin, kGlobalSignRootPin) });
+    ValidationResult validationResult = validator->validate(_serverChain, "www.good.com");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::ShouldAllowConnection);
+    EXPECT_EQ(validationResult.evaluationResult, TrustEvaluationResult::Success);
+    EXPECT_EQ(validationResult.notedHostname, "www.good.com");
+
+    validator = validatorForPolicies({ domainPolicy("www.good.com", kGlobalSignRootPin, kGoodLeafPin) });
+    EXPECT_EQ(validator->evaluateTrust(_serverChain, "www.good.com"), TrustDecision::ShouldAllowConnection);
+}
+
+
+TEST_F(PinningValidatorTests, NoPinMatches)
+{
+    auto validator = validatorForPolicies({ domainPolicy("www.good.com", kGlobalSignRootPin, kGlobalSignLeafPin) });
+    ValidationResult validationResult = validator->validate(_serverChain, "www.good.com");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(validationResult.evaluationResult, TrustEvaluationResult::FailedNoMatchingPin);
+
+    // Not enforced
+    DomainPinningPolicy notEnforced = domainPolicy("www.good.com", kGlobalSignRootPin, kGlobalSignLeafPin);
+    notEnforced.enforcePinning = false;
+    validator = validatorForPolicies({ notEnforced });
+    validationResult = validator->validate(_serverChain, "www.good.com");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::ShouldAllowConnection);
+    EXPECT_EQ(validationResult.evaluationResult, TrustEvaluationResult::FailedNoMatchingPin);
+}
+
+
+TEST_F(PinningValidatorTests, InvalidChain)
+{
+    _backend->isTrusted = false;
+    auto validator = validatorForPolicies({ domainPolicy("www.good.com", kGoodRootCAPin, kGoodLeafPin) });
+    ValidationResult validationResult = validator->validate(_serverChain, "www.good.com");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(validationResult.evaluationResult, TrustEvaluationResult::FailedInvalidCertificateChain);
+
+    // A certificate whose SPKI cannot be found
+    _backend->isTrusted = true;
+    _backend->trustAnchor = { 0x30, 0x00 };
+    validationResult = validator->validate(_serverChain, "www.good.com");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(validationResult.evaluationResult, TrustEvaluationResult::ErrorCouldNotGenerateSpkiHash);
+
+    // Empty parameters
+    EXPECT_EQ(validator->evaluateTrust({}, "www.good.com"), TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(validator->evaluateTrust(_serverChain, ""), TrustDecision::ShouldBlockConnection);
+}
+
+
+TEST_F(PinningValidatorTests, UserDefinedTrustAnchor)
+{
+    _backend->isUserDefinedTrustAnchor = true;
+    auto validator = validatorForPolicies({ domainPolicy("www.good.com", kGlobalSignRootPin, kGlobalSignLeafPin) });
+    ValidationResult validationResult = validator->validate(_serverChain, "www.good.com");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::ShouldAllowConnection);
+    EXPECT_EQ(validationResult.evaluationResult, TrustEvaluationResult::FailedUserDefinedTrustAnchor);
+
+    validator = validatorForPolicies({ domainPolicy("www.good.com", kGlobalSignRootPin, kGlobalSignLeafPin) }, false);
+    EXPECT_EQ(validator->evaluateTrust(_serverChain, "www.good.com"), TrustDecision::ShouldBlockConnection);
+}
+
+
+TEST_F(PinningValidatorTests, DomainNotPinned)
+{
+    DomainPinningPolicy parentPolicy = domainPolicy("good.com", kGlobalSignRootPin, kGlobalSignLeafPin);
+    parentPolicy.includeSubdomains = true;
+    DomainPinningPolicy excludedPolicy;
+    excludedPolicy.domain = "unsecured.good.com";
+    excludedPolicy.excludeSubdomainFromParentPolicy = true;
+    DomainPinningPolicy expiredPolicy = domainPolicy("expired.com", kGlobalSignRootPin, kGlobalSignLeafPin);
+    expiredPolicy.expirationDate = expirationDateFromString("2015-01-01");
+    auto validator = validatorForPolicies({ parentPolicy, excludedPolicy, expiredPolicy });
+
+    ValidationResult validationResult = validator->validate(_serverChain, "www.other.org");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::DomainNotPinned);
+    EXPECT_FALSE(validationResult.evaluationResult.has_value());
+    EXPECT_TRUE(validationResult.notedHostname.empty());
+
+    validationResult = validator->validate(_serverChain, "unsecured.good.com");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::DomainNotPinned);
+    EXPECT_EQ(validationResult.notedHostname, "unsecured.good.com");
+
+    validationResult = validator->validate(_serverChain, "expired.com");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::DomainNotPinned);
+    EXPECT_FALSE(validationResult.evaluationResult.has_value());
+
+    // The parent policy still applies to the other subdomains
+    validationResult = validator->validate(_serverChain, "secured.good.com");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(validationResult.notedHostname, "good.com");
+    EXPECT_EQ(_backend->evaluationCount, 1);
+}
+
+
+TEST_F(PinningValidatorTests, EvaluationTime)
+{
+    std::vector<uint8_t> goodRootCA = loadTestCertificate("RSA_4096/GoodRootCA.der");
+    const DerSlice verifiedChain[] = { { _serverChain[0].data(), _serverChain[0].size() },
+                                       { goodRootCA.data(), goodRootCA.size() } };
+    DomainPinningPolicy expiredPolicy = domainPolicy("expired.good.com", kGoodRootCAPin, kGlobalSignLeafPin);
+    expiredPolicy.expirationDate = expirationDateFromString("2015-01-01");
+    DomainPinningPolicy blockedPolicy = domainPolicy("blocked.good.com", kGlobalSignRootPin, kGlobalSignLeafPin);
+    blockedPolicy.expirationDate = expirationDateFromString("2015-01-01");
+    auto validator = validatorForPolicies({ expiredPolicy, blockedPolicy });
+    EXPECT_EQ(validator->validate(_serverChain, "blocked.good.com").finalTrustDecision, TrustDecision::DomainNotPinned);
+
+    // The policies did not expire yet as of the evaluation time
+    validator->setEvaluationTime(1388534400); // 2014-01-01
+    ValidationResult validationResult = validator->validate(_serverChain, "blocked.good.com");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(validationResult.evaluationResult, TrustEvaluationResult::FailedNoMatchingPin);
+    EXPECT_EQ(validator->validateVerifiedChain(verifiedChain, 2, "expired.good.com").finalTrustDecision,
+              TrustDecision::ShouldAllowConnection);
+
+    validator->setEvaluationTime(1451606400); // 2016-01-01
+    EXPECT_EQ(validator->validate(_serverChain, "blocked.good.com").finalTrustDecision, TrustDecision::DomainNotPinned);
+    EXPECT_EQ(validator->validateVerifiedChain(verifiedChain, 2, "expired.good.com").finalTrustDecision,
+              TrustDecision::DomainNotPinned);
+}
+
+
+TEST_F(PinningValidatorTests, CoalescedEvaluations)
+{
+    const int threadCount = 16;
+    _backend->evaluationDelay = std::chrono::milliseconds(200);
+    auto validator = validatorForPolicies({ domainPolicy("www.good.com", kGoodRootCAPin, kGoodLeafPin) });
+
+    // All the threads evaluate the same chain for the same hostname at the same time
+    std::atomic<int> allowedCount{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadCount; i++)
+    {
+        threads.emplace_back([&] {
+            if (validator->evaluateTrust(_serverChain, "www.good.com") == TrustDecision::ShouldAllowConnection)
+            {
+                allowedCount++;
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+
+    EXPECT_EQ(allowedCount, threadCount);
+    EXPECT_EQ(validator->pinValidationCount() + validator->coalescedPinValidationCount(), static_cast<uint64_t>(threadCount));
+    EXPECT_EQ(static_cast<uint64_t>(_backend->evaluationCount), validator->pinValidationCount());
+    EXPECT_LT(validator->pinValidationCount(), static_cast<uint64_t>(threadCount));
+
+    // Once done, the next evaluation runs again
+    _backend->evaluationDelay = std::chrono::milliseconds(0);
+    uint64_t pinValidationCount = validator->pinValidationCount();
+    EXPECT_EQ(validator->evaluateTrust(_serverChain, "www.good.com"), TrustDecision::ShouldAllowConnection);
+    EXPECT_EQ(validator->pinValidationCount(), pinValidationCount + 1);
+
+    // Evaluations for different hostnames are not coalesced
+    EXPECT_EQ(validator->evaluateTrust(_serverChain, "www.other.com"), TrustDecision::DomainNotPinned);
+}
+
+
+TEST_F(PinningValidatorTests, VerifiedChainSlices)
+{
+    std::vector<uint8_t> goodRootCA = loadTestCertificate("RSA_4096/GoodRootCA.der");
+    const DerSlice verifiedChain[] = { { _serverChain[0].data(), _serverChain[0].size() },
+                                       { goodRootCA.data(), goodRootCA.size() } };
+    DomainPinningPolicy reportOnlyPolicy = domainPolicy("report.good.com", kGlobalSignRootPin, kGlobalSignLeafPin);
+    reportOnlyPolicy.enforcePinning = false;
+    DomainPinningPolicy expiredPolicy = domainPolicy("expired.good.com", kGoodRootCAPin, kGlobalSignLeafPin);
+    expiredPolicy.expirationDate = expirationDateFromString("2015-01-01");
+    auto validator = validatorForPolicies({ domainPolicy("www.good.com", kGoodRootCAPin, kGlobalSignRootPin),
+                                            domainPolicy("api.good.com", kGlobalSignRootPin, kGoodLeafPin),
+                                            domainPolicy("blocked.good.com", kGlobalSignRootPin, kGlobalSignLeafPin),
+                                            reportOnlyPolicy, expiredPolicy });
+
+    // Pin on the root, then on the leaf
+    ValidationResult validationResult = validator->validateVerifiedChain(verifiedChain, 2, "www.good.com");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::ShouldAllowConnection);
+    EXPECT_EQ(validationResult.evaluationResult, TrustEvaluationResult::Success);
+    EXPECT_EQ(validationResult.notedHostname, "www.good.com");
+    EXPECT_EQ(validator->validateVerifiedChain(verifiedChain, 1, "api.good.com").finalTrustDecision,
+              TrustDecision::ShouldAllowConnection);
+
+    validationResult = validator->validateVerifiedChain(verifiedChain, 2, "blocked.good.com");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(validationResult.evaluationResult, TrustEvaluationResult::FailedNoMatchingPin);
+
+    validationResult = validator->validateVerifiedChain(verifiedChain, 2, "report.good.com");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::ShouldAllowConnection);
+    EXPECT_EQ(validationResult.evaluationResult, TrustEvaluationResult::FailedNoMatchingPin);
+
+    EXPECT_EQ(validator->validateVerifiedChain(verifiedChain, 2, "expired.good.com").finalTrustDecision,
+              TrustDecision::DomainNotPinned);
+    EXPECT_EQ(validator->validateVerifiedChain(verifiedChain, 2, "www.other.org").finalTrustDecision,
+              TrustDecision::DomainNotPinned);
+
+    // A certificate whose SPKI cannot be found
+    const uint8_t malformedCertificate[] = { 0x30, 0x00 };
+    const DerSlice malformedChain[] = { verifiedChain[0], { malformedCertificate, sizeof(malformedCertificate) } };
+    validationResult = validator->validateVerifiedChain(malformedChain, 2, "www.good.com");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(validationResult.evaluationResult, TrustEvaluationResult::ErrorCouldNotGenerateSpkiHash);
+
+    // Empty parameters
+    EXPECT_EQ(validator->validateVerifiedChain(verifiedChain, 0, "www.good.com").finalTrustDecision,
+              TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(validator->validateVerifiedChain(nullptr, 2, "www.good.com").finalTrustDecision,
+              TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(validator->validateVerifiedChain(verifiedChain, 2, "").finalTrustDecision,
+              TrustDecision::ShouldBlockConnection);
+
+    // The chain was validated by the caller
+    EXPECT_EQ(_backend->evaluationCount, 0);
+}
+
+
+TEST_F(PinningValidatorTests, PrecomputedSpkiHashes)
+{
+    const ChainSpkiHash spkiHashes[] = { { 0, pinFromBase64(kGoodLeafPin) }, { 1, pinFromBase64(kGoodRootCAPin) } };
+    DomainPinningPolicy reportOnlyPolicy = domainPolicy("report.good.com", kGlobalSignRootPin, kGlobalSignLeafPin);
+    reportOnlyPolicy.enforcePinning = false;
+    DomainPinningPolicy expiredPolicy = domainPolicy("expired.good.com", kGoodRootCAPin, kGlobalSignLeafPin);
+    expiredPolicy.expirationDate = expirationDateFromString("2015-01-01");
+    auto validator = validatorForPolicies({ domainPolicy("www.good.com", kGoodRootCAPin, kGlobalSignRootPin),
+                                            domainPolicy("api.good.com", kGlobalSignRootPin, kGoodLeafPin),
+                                            domainPolicy("blocked.good.com", kGlobalSignRootPin, kGlobalSignLeafPin),
+                                            reportOnlyPolicy, expiredPolicy });
+
+    // Pin on the root, then on the leaf
+    ValidationResult validationResult = validator->validateSpkiHashes(spkiHashes, 2, "www.good.com");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::ShouldAllowConnection);
+    EXPECT_EQ(validationResult.evaluationResult, TrustEvaluationResult::Success);
+    EXPECT_EQ(validationResult.notedHostname, "www.good.com");
+    EXPECT_EQ(validator->validateSpkiHashes(spkiHashes, 1, "api.good.com").finalTrustDecision,
+              TrustDecision::ShouldAllowConnection);
+    EXPECT_EQ(validator->validateSpkiHashes(spkiHashes, 1, "www.good.com").finalTrustDecision,
+              TrustDecision::ShouldBlockConnection);
+
+    validationResult = validator->validateSpkiHashes(spkiHashes, 2, "blocked.good.com");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(validationResult.evaluationResult, TrustEvaluationResult::FailedNoMatchingPin);
+
+    validationResult = validator->validateSpkiHashes(spkiHashes, 2, "report.good.com");
+    EXPECT_EQ(validationResult.finalTrustDecision, TrustDecision::ShouldAllowConnection);
+    EXPECT_EQ(validationResult.evaluationResult, TrustEvaluationResult::FailedNoMatchingPin);
+
+    EXPECT_EQ(validator->validateSpkiHashes(spkiHashes, 2, "expired.good.com").finalTrustDecision,
+              TrustDecision::DomainNotPinned);
+    EXPECT_EQ(validator->validateSpkiHashes(spkiHashes, 2, "www.other.org").finalTrustDecision,
+              TrustDecision::DomainNotPinned);
+
+    // Empty parameters
+    EXPECT_EQ(validator->validateSpkiHashes(spkiHashes, 0, "www.good.com").finalTrustDecision,
+              TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(validator->validateSpkiHashes(nullptr, 2, "www.good.com").finalTrustDecision,
+              TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(validator->validateSpkiHashes(spkiHashes, 2, "").finalTrustDecision,
+              TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(_backend->evaluationCount, 0);
+}
@@ -0,0 +1,184 @@
+/*
+
+ sha256_engine_tests.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "../TrustKit/Pinning/sha256_engine.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::string toHex(const uint8_t digest[TSK_SHA256_DIGEST_LENGTH])
+{
+    std::string hex;
+    for (size_t i = 0; i < TSK_SHA256_DIGEST_LENGTH; i++)
+    {
+        char byte[3];
+        std::snprintf(byte, sizeof(byte), "%02x", digest[i]);
+        hex += byte;
+    }
+    return hex;
+}
+
+std::string hashToHex(const std::string &message)
+{
+    uint8_t digest[TSK_SHA256_DIGEST_LENGTH];
+    TSKSHA256Hash(message.data(), message.size(), digest);
+    return toHex(digest);
+}
+
+// Messages of every length around the block boundaries, where the padding changes
+std::vector<std::string> makeMessages(size_t maxLength)
+{
+    std::vector<std::string> messages;
+    for (size_t length = 0; length <= maxLength; length++)
+    {
+        std::string message(length, '\0');
+        for (size_t i = 0; i < length; i++)
+        {
+            message[i] = static_cast<char>((i * 131 + length) & 0xff);
+        }
+        messages.push_back(std::move(message));
+    }
+    return messages;
+}
+
+std::vector<TSKSHA256Backend> availableBackends()
+{
+    std::vector<TSKSHA256Backend> backends;
+    for (int backend = 0; backend < TSKSHA256BackendCount; backend++)
+    {
+        if (TSKSHA256IsBackendAvailable(static_cast<TSKSHA256Backend>(backend)))
+        {
+            backends.push_back(static_cast<TSKSHA256Backend>(backend));
+        }
+    }
+    return backends;
+}
+
+} // namespace
+
+
+// The backend selection is global, so each test restores it
+class SHA256EngineTests : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        _backend = TSKSHA256GetBackend();
+        _isMultiBufferEnabled = TSKSHA256IsMultiBufferEnabled();
+    }
+
+    void TearDown() override
+    {
+        TSKSHA256SetBackend(_backend);
+        TSKSHA256SetMultiBufferEnabled(_isMultiBufferEnabled);
+    }
+
+    TSKSHA256Backend _backend = TSKSHA256BackendPortable;
+    bool _isMultiBufferEnabled = false;
+};
+
+
+TEST_F(SHA256EngineTests, KnownVectors)
+{
+    EXPECT_TRUE(TSKSHA256IsBackendAvailable(TSKSHA256BackendPortable));
+    EXPECT_TRUE(TSKSHA256SelfTest());
+    for (TSKSHA256Backend backend : availableBackends())
+    {
+        SCOPED_TRACE(TSKSHA256GetBackendName(backend));
+        ASSERT_TRUE(TSKSHA256SetBackend(backend));
+        EXPECT_EQ(TSKSHA256GetBackend(), backend);
+
+        // FIPS 180-2 vectors
+        EXPECT_EQ(hashToHex(""), "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855");
+        EXPECT_EQ(hashToHex("abc"), "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad");
+        EXPECT_EQ(hashToHex("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"),
+                  "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1");
+        EXPECT_EQ(hashToHex(std::string(1000000, 'a')),
+                  "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+    }
+    EXPECT_FALSE(TSKSHA256SetBackend(TSKSHA256BackendCount));
+}
+
+
+TEST_F(SHA256EngineTests, BackendsAgree)
+{
+    std::vector<std::string> messages = makeMessages(300);
+    ASSERT_TRUE(TSKSHA256SetBackend(TSKSHA256BackendPortable));
+    std::vector<std::string> expectedDigests;
+    for (const std::string &message : messages)
+    {
+        expectedDigests.push_back(hashToHex(message));
+    }
+
+    for (TSKSHA256Backend backend : availableBackends())
+    {
+        SCOPED_TRACE(TSKSHA256GetBackendName(backend));
+        ASSERT_TRUE(TSKSHA256SetBackend(backend));
+        for (size_t i = 0; i < messages.size(); i++)
+        {
+            EXPECT_EQ(hashToHex(messages[i]), expectedDigests[i]) << "length " << messages[i].size();
+        }
+    }
+}
+
+
+// TSKSHA256HashMany() gives the same digests as hashing each message, whatever the number of messages and with the
+// multi-buffer backend on and off
+TEST_F(SHA256EngineTests, HashMany)
+{
+    std::vector<std::string> messages = makeMessages(200);
+    std::vector<std::string> expectedDigests;
+    for (const std::string &message : messages)
+    {
+        expectedDigests.push_back(hashToHex(message));
+    }
+
+    std::vector<bool> multiBufferSettings = { false };
+    if (TSKSHA256SetMultiBufferEnabled(true))
+    {
+        multiBufferSettings.push_back(true);
+    }
+    for (TSKSHA256Backend backend : availableBackends())
+    {
+        ASSERT_TRUE(TSKSHA256SetBackend(backend));
+        for (bool isMultiBufferEnabled : multiBufferSettings)
+        {
+            SCOPED_TRACE(std::string(TSKSHA256GetBackendName(backend)) + (isMultiBufferEnabled ? " with AVX2" : ""));
+            ASSERT_TRUE(TSKSHA256SetMultiBufferEnabled(isMultiBufferEnabled));
+            EXPECT_EQ(TSKSHA256IsMultiBufferEnabled(), isMultiBufferEnabled);
+
+            // Batches of every size up to more than two full sets of lanes, over messages of various lengths
+            for (size_t messageCount = 1; messageCount <= 2 * TSK_SHA256_MAX_LANES + 3; messageCount++)
+            {
+                for (size_t first = 0; first + messageCount <= messages.size(); first += 37)
+                {
+                    std::vector<TSKSHA256Message> batch;
+                    for (size_t i = first; i < first + messageCount; i++)
+                    {
+                        batch.push_back({ messages[i].data(), messages[i].size() });
+                    }
+                    std::vector<uint8_t> digests(messageCount * TSK_SHA256_DIGEST_LENGTH);
+                    TSKSHA256HashMany(batch.data(), batch.size(), reinterpret_cast<uint8_t(*)[TSK_SHA256_DIGEST_LENGTH]>(digests.data()));
+                    for (size_t i = 0; i < messageCount; i++)
+                    {
+                        EXPECT_EQ(toHex(digests.data() + i * TSK_SHA256_DIGEST_LENGTH), expectedDigests[first + i])
+                            << messageCount << " messages, length " << messages[first + i].size();
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,373 @@
+/*
+
+ spki_cache_file_tests.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "../TrustKit/Pinning/spki_cache_file.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+// A record whose digest and hash are derived from the supplied seed
+TSKSPKICacheRecord makeRecord(uint8_t seed)
+{
+    uint8_t certificateDigest[TSK_SPKI_CACHE_DIGEST_LENGTH];
+    uint8_t spkiHash[TSK_SPKI_CACHE_DIGEST_LENGTH];
+    for (size_t i = 0; i < TSK_SPKI_CACHE_DIGEST_LENGTH; i++)
+    {
+        certificateDigest[i] = static_cast<uint8_t>(seed * 31 + i);
+        spkiHash[i] = static_cast<uint8_t>(seed ^ (i * 7));
+    }
+    TSKSPKICacheRecord record;
+    TSKSPKICacheRecordInit(&record, certificateDigest, spkiHash);
+    return record;
+}
+
+std::vector<TSKSPKICacheRecord> makeRecords(uint8_t firstSeed, size_t count)
+{
+    std::vector<TSKSPKICacheRecord> records;
+    for (size_t i = 0; i < count; i++)
+    {
+        records.push_back(makeRecord(static_cast<uint8_t>(firstSeed + i)));
+    }
+    return records;
+}
+
+std::vector<char> readFile(const std::string &path)
+{
+    std::ifstream file(path, std::ios::binary);
+    return std::vector<char>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+void writeFile(const std::string &path, const std::vector<char> &bytes)
+{
+    std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+}
+
+// Whether the snapshot maps the record's digest to the record's hash
+bool snapshotContains(const TSKSPKICacheFile *snapshot, const TSKSPKICacheRecord &record)
+{
+    uint8_t spkiHash[TSK_SPKI_CACHE_DIGEST_LENGTH];
+    return TSKSPKICacheFileLookup(snapshot, record.certificateDigest, spkiHash)
+        && (memcmp(spkiHash, record.spkiHash, sizeof(spkiHash)) == 0);
+}
+
+std::vector<TSKSPKICacheRecord> readJournal(const std::string &path)
+{
+    TSKSPKICacheRecord *records = nullptr;
+    size_t recordCount = TSKSPKICacheJournalRead(path.c_str(), &records);
+    std::vector<TSKSPKICacheRecord> journal(records, records + recordCount);
+    free(records);
+    return journal;
+}
+
+} // namespace
+
+
+class SPKICacheFileTests : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        _snapshotPath = ::testing::TempDir() + "spki_cache_file_tests.cache";
+        _journalPath = _snapshotPath + ".journal";
+        TearDown();
+    }
+
+    void TearDown() override
+    {
+        std::remove(_snapshotPath.c_str());
+        std::remove((_snapshotPath + ".tmp").c_str());
+        std::remove(_journalPath.c_str());
+    }
+
+    std::string _snapshotPath;
+    std::string _journalPath;
+};
+
+
+TEST_F(SPKICacheFileTests, Snapshot)
+{
+    // Unsorted, with a duplicate and an invalid record
+    std::vector<TSKSPKICacheRecord> records = makeRecords(0, 100);
+    std::vector<TSKSPKICacheRecord> expectedRecords = records;
+    std::swap(records[3], records[70]);
+    records.push_back(records[10]);
+    TSKSPKICacheRecord invalidRecord = makeRecord(200);
+    invalidRecord.spkiHash[0] ^= 1;
+    records.push_back(invalidRecord);
+    ASSERT_TRUE(TSKSPKICacheFileWrite(_snapshotPath.c_str(), records.data(), records.size()));
+
+    TSKSPKICacheFile *snapshot = TSKSPKICacheFileOpen(_snapshotPath.c_str());
+    ASSERT_NE(snapshot, nullptr);
+    EXPECT_EQ(TSKSPKICacheFileGetRecordCount(snapshot), expectedRecords.size());
+    for (const TSKSPKICacheRecord &record : expectedRecords)
+    {
+        EXPECT_TRUE(snapshotContains(snapshot, record));
+    }
+    EXPECT_FALSE(snapshotContains(snapshot, invalidRecord));
+    EXPECT_FALSE(snapshotContains(snapshot, makeRecord(150)));
+    TSKSPKICacheFileClose(snapshot);
+
+    EXPECT_EQ(TSKSPKICacheFileOpen((_snapshotPath + ".missing").c_str()), nullptr);
+}
+
+
+TEST_F(SPKICacheFileTests, CorruptSnapshot)
+{
+    std::vector<TSKSPKICacheRecord> records = makeRecords(0, 10);
+    ASSERT_TRUE(TSKSPKICacheFileWrite(_snapshotPath.c_str(), records.data(), records.size()));
+    std::vector<char> snapshotBytes = readFile(_snapshotPath);
+
+    // A corrupt record is a miss, and the others can still be looked up
+    TSKSPKICacheFile *snapshot = TSKSPKICacheFileOpen(_snapshotPath.c_str());
+    ASSERT_NE(snapshot, nullptr);
+    size_t corruptIndex = 4;
+    const TSKSPKICacheRecord *corruptRecord = TSKSPKICacheFileGetRecord(snapshot, corruptIndex);
+    ASSERT_NE(corruptRecord, nullptr);
+    TSKSPKICacheRecord expectedCorruptRecord = *corruptRecord;
+    TSKSPKICacheFileClose(snapshot);
+
+    std::vector<char> corruptRecordBytes = snapshotBytes;
+    corruptRecordBytes[32 + corruptIndex * sizeof(TSKSPKICacheRecord) + 40] ^= 1;
+    writeFile(_snapshotPath, corruptRecordBytes);
+    snapshot = TSKSPKICacheFileOpen(_snapshotPath.c_str());
+    ASSERT_NE(snapshot, nullptr);
+    EXPECT_EQ(TSKSPKICacheFileGetRecord(snapshot, corruptIndex), nullptr);
+    EXPECT_FALSE(snapshotContains(snapshot, expectedCorruptRecord));
+    size_t foundCount = 0;
+    for (const TSKSPKICacheRecord &record : records)
+    {
+        foundCount += snapshotContains(snapshot, record) ? 1 : 0;
+    }
+    EXPECT_EQ(foundCount, records.size() - 1);
+    TSKSPKICacheFileClose(snapshot);
+
+    // A corrupt header rejects the whole snapshot
+    std::vector<char> corruptHeader = snapshotBytes;
+    corruptHeader[17] ^= 1;
+    writeFile(_snapshotPath, corruptHeader);
+    EXPECT_EQ(TSKSPKICacheFileOpen(_snapshotPath.c_str()), nullptr);
+}
+
+
+TEST_F(SPKICacheFileTests, ForeignFiles)
+{
+    std::vector<TSKSPKICacheRecord> records = makeRecords(0, 10);
+    ASSERT_TRUE(TSKSPKICacheFileWrite(_snapshotPath.c_str(), records.data(), records.size()));
+    std::vector<char> snapshotBytes = readFile(_snapshotPath);
+
+    // Empty, shorter than a header, and a binary plist such as the caches written by NSKeyedArchiver
+    writeFile(_snapshotPath, {});
+    EXPECT_EQ(TSKSPKICacheFileOpen(_snapshotPath.c_str()), nullptr);
+    writeFile(_snapshotPath, std::vector<char>(snapshotBytes.begin(), snapshotBytes.begin() + 20));
+    EXPECT_EQ(TSKSPKICacheFileOpen(_snapshotPath.c_str()), nullptr);
+    std::string plist = "bplist00\xd4\x01\x02\x03\x04\x05\x06\x07\x0aX$versionY$archiverT$topX$objects";
+    plist.resize(snapshotBytes.size(), '\0');
+    writeFile(_snapshotPath, std::vector<char>(plist.begin(), plist.end()));
+    EXPECT_EQ(TSKSPKICacheFileOpen(_snapshotPath.c_str()), nullptr);
+
+    // Another version of the format
+    std::vector<char> otherVersion = snapshotBytes;
+    otherVersion[8] = 2;
+    writeFile(_snapshotPath, otherVersion);
+    EXPECT_EQ(TSKSPKICacheFileOpen(_snapshotPath.c_str()), nullptr);
+}
+
+
+TEST_F(SPKICacheFileTests, Journal)
+{
+    EXPECT_TRUE(readJournal(_journalPath).empty());
+
+    std::vector<TSKSPKICacheRecord> records = makeRecords(0, 5);
+    ASSERT_TRUE(TSKSPKICacheJournalAppend(_journalPath.c_str(), records.data(), 3));
+    ASSERT_TRUE(TSKSPKICacheJournalAppend(_journalPath.c_str(), records.data() + 3, 2));
+    std::vector<TSKSPKICacheRecord> journal = readJournal(_journalPath);
+    ASSERT_EQ(journal.size(), records.size());
+    EXPECT_EQ(memcmp(journal.data(), records.data(), records.size() * sizeof(TSKSPKICacheRecord)), 0);
+}
+
+
+TEST_F(SPKICacheFileTests, TornJournal)
+{
+    std::vector<TSKSPKICacheRecord> records = makeRecords(0, 4);
+    ASSERT_TRUE(TSKSPKICacheJournalAppend(_journalPath.c_str(), records.data(), records.size()));
+    std::vector<char> journalBytes = readFile(_journalPath);
+
+    // Nothing but a partial record gets truncated away
+    writeFile(_journalPath, std::vector<char>(journalBytes.begin(), journalBytes.begin() + 10));
+    EXPECT_TRUE(readJournal(_journalPath).empty());
+    EXPECT_TRUE(readFile(_journalPath).empty());
+
+    // A record that fails its checksum ends the journal, and is truncated away with what follows it
+    std::vector<char> corruptRecord = journalBytes;
+    corruptRecord[2 * sizeof(TSKSPKICacheRecord) + 5] ^= 1;
+    writeFile(_journalPath, corruptRecord);
+    EXPECT_EQ(readJournal(_journalPath).size(), 2u);
+    EXPECT_EQ(readFile(_journalPath).size(), 2 * sizeof(TSKSPKICacheRecord));
+
+    // The records appended after the recovery follow the valid ones
+    ASSERT_TRUE(TSKSPKICacheJournalAppend(_journalPath.c_str(), &records[3], 1));
+    std::vector<TSKSPKICacheRecord> journal = readJournal(_journalPath);
+    ASSERT_EQ(journal.size(), 3u);
+    EXPECT_EQ(memcmp(&journal[2], &records[3], sizeof(TSKSPKICacheRecord)), 0);
+}
+
+
+// Crash consistency: the cache is loaded the way TSKSPKIHashCache does it, from the snapshot and then the journal, in
+// the states that a crash at each step of persisting it can leave the files in
+
+namespace {
+
+using CacheEntries = std::map<std::vector<uint8_t>, std::vector<uint8_t>>;
+
+void addRecord(CacheEntries &entries, const TSKSPKICacheRecord &record)
+{
+    entries[std::vector<uint8_t>(record.certificateDigest, record.certificateDigest + TSK_SPKI_CACHE_DIGEST_LENGTH)] =
+        std::vector<uint8_t>(record.spkiHash, record.spkiHash + TSK_SPKI_CACHE_DIGEST_LENGTH);
+}
+
+CacheEntries loadCache(const std::string &snapshotPath, const std::string &journalPath)
+{
+    CacheEntries entries;
+    TSKSPKICacheFile *snapshot = TSKSPKICacheFileOpen(snapshotPath.c_str());
+    for (size_t i = 0; i < TSKSPKICacheFileGetRecordCount(snapshot); i++)
+    {
+        const TSKSPKICacheRecord *record = TSKSPKICacheFileGetRecord(snapshot, i);
+        if (record != nullptr)
+        {
+            addRecord(entries, *record);
+        }
+    }
+    TSKSPKICacheFileClose(snapshot);
+    for (const TSKSPKICacheRecord &record : readJournal(journalPath))
+    {
+        addRecord(entries, record);
+    }
+    return entries;
+}
+
+CacheEntries entriesForRecords(const std::vector<TSKSPKICacheRecord> &records)
+{
+    CacheEntries entries;
+    for (const TSKSPKICacheRecord &record : records)
+    {
+        addRecord(entries, record);
+    }
+    return entries;
+}
+
+} // namespace
+
+
+TEST_F(SPKICacheFileTests, CrashDuringJournalAppend)
+{
+    std::vector<TSKSPKICacheRecord> snapshotRecords = makeRecords(0, 8);
+    std::vector<TSKSPKICacheRecord> journaledRecords = makeRecords(100, 3);
+    std::vector<TSKSPKICacheRecord> tornRecords = makeRecords(200, 2);
+    ASSERT_TRUE(TSKSPKICacheFileWrite(_snapshotPath.c_str(), snapshotRecords.data(), snapshotRecords.size()));
+    ASSERT_TRUE(TSKSPKICacheJournalAppend(_journalPath.c_str(), journaledRecords.data(), journaledRecords.size()));
+
+    // Only the first record and a half of the last append made it to the disk
+    std::vector<char> journalBytes = readFile(_journalPath);
+    const char *tornBytes = reinterpret_cast<const char *>(tornRecords.data());
+    journalBytes.insert(journalBytes.end(), tornBytes, tornBytes + sizeof(TSKSPKICacheRecord) * 3 / 2);
+    writeFile(_journalPath, journalBytes);
+
+    std::vector<TSKSPKICacheRecord> expectedRecords = snapshotRecords;
+    expectedRecords.insert(expectedRecords.end(), journaledRecords.begin(), journaledRecords.end());
+    expectedRecords.push_back(tornRecords[0]);
+    EXPECT_EQ(loadCache(_snapshotPath, _journalPath), entriesForRecords(expectedRecords));
+
+    // The lost record gets journaled again on its next miss, and the journal is consistent again
+    ASSERT_TRUE(TSKSPKICacheJournalAppend(_journalPath.c_str(), &tornRecords[1], 1));
+    expectedRecords.push_back(tornRecords[1]);
+    EXPECT_EQ(loadCache(_snapshotPath, _journalPath), entriesForRecords(expectedRecords));
+}
+
+
+TEST_F(SPKICacheFileTests, CrashBeforeSnapshotRename)
+{
+    std::vector<TSKSPKICacheRecord> snapshotRecords = makeRecords(0, 8);
+    std::vector<TSKSPKICacheRecord> journaledRecords = makeRecords(100, 3);
+    ASSERT_TRUE(TSKSPKICacheFileWrite(_snapshotPath.c_str(), snapshotRecords.data(), snapshotRecords.size()));
+    ASSERT_TRUE(TSKSPKICacheJournalAppend(_journalPath.c_str(), journaledRecords.data(), journaledRecords.size()));
+    CacheEntries expectedEntries = loadCache(_snapshotPath, _journalPath);
+
+    // A compaction left a partial temporary snapshot behind, which is neither read nor in the way of the next one
+    writeFile(_snapshotPath + ".tmp", std::vector<char>(100, 'x'));
+    EXPECT_EQ(loadCache(_snapshotPath, _journalPath), expectedEntries);
+
+    std::vector<TSKSPKICacheRecord> compactedRecords = snapshotRecords;
+    compactedRecords.insert(compactedRecords.end(), journaledRecords.begin(), journaledRecords.end());
+    ASSERT_TRUE(TSKSPKICacheFileWrite(_snapshotPath.c_str(), compactedRecords.data(), compactedRecords.size()));
+    std::remove(_journalPath.c_str());
+    EXPECT_EQ(loadCache(_snapshotPath, _journalPath), expectedEntries);
+}
+
+
+TEST_F(SPKICacheFileTests, CrashBetweenSnapshotRenameAndJournalRemoval)
+{
+    std::vector<TSKSPKICacheRecord> snapshotRecords = makeRecords(0, 8);
+    std::vector<TSKSPKICacheRecord> journaledRecords = makeRecords(100, 3);
+    ASSERT_TRUE(TSKSPKICacheFileWrite(_snapshotPath.c_str(), snapshotRecords.data(), snapshotRecords.size()));
+    ASSERT_TRUE(TSKSPKICacheJournalAppend(_journalPath.c_str(), journaledRecords.data(), journaledRecords.size()));
+    CacheEntries expectedEntries = loadCache(_snapshotPath, _journalPath);
+
+    // The new snapshot holds the journaled records, but the journal was not removed
+    std::vector<TSKSPKICacheRecord> compactedRecords = snapshotRecords;
+    compactedRecords.insert(compactedRecords.end(), journaledRecords.begin(), journaledRecords.end());
+    ASSERT_TRUE(TSKSPKICacheFileWrite(_snapshotPath.c_str(), compactedRecords.data(), compactedRecords.size()));
+    EXPECT_EQ(loadCache(_snapshotPath, _journalPath), expectedEntries);
+
+    // Compacting again writes the records that are in both only once
+    std::vector<TSKSPKICacheRecord> recompactedRecords = compactedRecords;
+    std::vector<TSKSPKICacheRecord> journal = readJournal(_journalPath);
+    recompactedRecords.insert(recompactedRecords.end(), journal.begin(), journal.end());
+    ASSERT_TRUE(TSKSPKICacheFileWrite(_snapshotPath.c_str(), recompactedRecords.data(), recompactedRecords.size()));
+    std::remove(_journalPath.c_str());
+    TSKSPKICacheFile *snapshot = TSKSPKICacheFileOpen(_snapshotPath.c_str());
+    EXPECT_EQ(TSKSPKICacheFileGetRecordCount(snapshot), expectedEntries.size());
+    TSKSPKICacheFileClose(snapshot);
+    EXPECT_EQ(loadCache(_snapshotPath, _journalPath), expectedEntries);
+}
+
+
+TEST_F(SPKICacheFileTests, TruncatedSnapshot)
+{
+    std::vector<TSKSPKICacheRecord> snapshotRecords = makeRecords(0, 8);
+    std::vector<TSKSPKICacheRecord> journaledRecords = makeRecords(100, 3);
+    ASSERT_TRUE(TSKSPKICacheFileWrite(_snapshotPath.c_str(), snapshotRecords.data(), snapshotRecords.size()));
+    ASSERT_TRUE(TSKSPKICacheJournalAppend(_journalPath.c_str(), journaledRecords.data(), journaledRecords.size()));
+    std::vector<char> snapshotBytes = readFile(_snapshotPath);
+
+    // Truncated within a record, at a record boundary, and within the header: the snapshot is ignored rather than
+    // partially trusted, and the journal still gets replayed
+    for (size_t length : { snapshotBytes.size() - 10, snapshotBytes.size() - sizeof(TSKSPKICacheRecord), size_t(16) })
+    {
+        writeFile(_snapshotPath, std::vector<char>(snapshotBytes.begin(), snapshotBytes.begin() + static_cast<long>(length)));
+        EXPECT_EQ(TSKSPKICacheFileOpen(_snapshotPath.c_str()), nullptr) << length;
+        EXPECT_EQ(loadCache(_snapshotPath, _journalPath), entriesForRecords(journaledRecords)) << length;
+    }
+
+    // The next compaction replaces it
+    ASSERT_TRUE(TSKSPKICacheFileWrite(_snapshotPath.c_str(), journaledRecords.data(), journaledRecords.size()));
+    std::remove(_journalPath.c_str());
+    EXPECT_EQ(loadCache(_snapshotPath, _journalPath), entriesForRecords(journaledRecords));
+}
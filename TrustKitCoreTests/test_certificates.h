@@ -0,0 +1,38 @@
+/*
+
+ test_certificates.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_test_certificates_h
+#define TrustKit_test_certificates_h
+
+#include "trust_decision.h"
+
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Load a DER certificate from TrustKitTests/Certificates, such as "RSA_4096/www.good.com.der"
+inline std::vector<uint8_t> loadTestCertificate(const std::string &path)
+{
+    std::ifstream file(std::string(TSK_TEST_CERTIFICATES_DIR) + "/" + path, std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Could not open test certificate " + path);
+    }
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+// The validity period of the RSA_4096 certificates is 2000 to 2038; 2024-01-01
+const std::time_t kTestCertificatesVerificationTime = 1704067200;
+
+#endif /* TrustKit_test_certificates_h */
@@ -0,0 +1,308 @@
+/*
+
+ test_tls_server.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "test_tls_server.h"
+
+#include "der_certificate.h"
+
+#include <csignal>
+#include <stdexcept>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+
+namespace {
+
+EVP_PKEY *generatePrivateKey()
+{
+    EVP_PKEY *privateKey = nullptr;
+    EVP_PKEY_CTX *keyContext = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    if ((keyContext == nullptr)
+        || (EVP_PKEY_keygen_init(keyContext) != 1)
+        || (EVP_PKEY_CTX_set_ec_paramgen_curve_nid(keyContext, NID_X9_62_prime256v1) != 1)
+        || (EVP_PKEY_keygen(keyContext, &privateKey) != 1))
+    {
+        EVP_PKEY_CTX_free(keyContext);
+        throw std::runtime_error("Could not generate a key");
+    }
+    EVP_PKEY_CTX_free(keyContext);
+    return privateKey;
+}
+
+void addExtension(X509 *certificate, X509 *issuer, int nid, const std::string &value)
+{
+    X509V3_CTX extensionContext;
+    X509V3_set_ctx_nodb(&extensionContext);
+    X509V3_set_ctx(&extensionContext, issuer, certificate, nullptr, nullptr, 0);
+    X509_EXTENSION *extension = X509V3_EXT_conf_nid(nullptr, &extensionContext, nid, value.c_str());
+    if ((extension == nullptr) || (X509_add_ext(certificate, extension, -1) != 1))
+    {
+        X509_EXTENSION_free(extension);
+        throw std::runtime_error("Could not add a certificate extension");
+    }
+    X509_EXTENSION_free(extension);
+}
+
+// Create a certificate valid from yesterday for a year; it is self-signed if there is no issuer
+X509 *createCertificate(const std::string &commonName, EVP_PKEY *publicKey, X509 *issuer, long serialNumber)
+{
+    X509 *certificate = X509_new();
+    X509_set_version(certificate, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(certificate), serialNumber);
+    X509_gmtime_adj(X509_getm_notBefore(certificate), -24 * 3600);
+    X509_gmtime_adj(X509_getm_notAfter(certificate), 365 * 24 * 3600);
+    X509_set_pubkey(certificate, publicKey);
+
+    X509_NAME *subject = X509_get_subject_name(certificate);
+    X509_NAME_add_entry_by_txt(subject, "O", MBSTRING_ASC, reinterpret_cast<const unsigned char *>("TrustKit tests"), -1, -1, 0);
+    X509_NAME_add_entry_by_txt(subject, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>(commonName.c_str()), -1, -1, 0);
+    X509_set_issuer_name(certificate, (issuer != nullptr) ? X509_get_subject_name(issuer) : subject);
+    return certificate;
+}
+
+void signCertificate(X509 *certificate, EVP_PKEY *issuerKey)
+{
+    if (X509_sign(certificate, issuerKey, EVP_sha256()) <= 0)
+    {
+        throw std::runtime_error("Could not sign a certificate");
+    }
+}
+
+} // namespace
+
+
+trustkit::Pin pinForCertificate(X509 *certificate)
+{
+    int length = i2d_X509(certificate, nullptr);
+    std::vector<uint8_t> encodedCertificate(static_cast<size_t>(length));
+    unsigned char *bytes = encodedCertificate.data();
+    i2d_X509(certificate, &bytes);
+    return trustkit::hashSubjectPublicKeyInfo({ encodedCertificate.data(), encodedCertificate.size() }).value();
+}
+
+
+// TestCertificateAuthority
+
+TestCertificateAuthority::TestCertificateAuthority()
+    : _privateKey(generatePrivateKey())
+{
+    _certificate = createCertificate("TrustKit Test CA", _privateKey, nullptr, 1);
+    addExtension(_certificate, _certificate, NID_basic_constraints, "critical,CA:TRUE");
+    addExtension(_certificate, _certificate, NID_key_usage, "critical,keyCertSign,cRLSign");
+    addExtension(_certificate, _certificate, NID_subject_key_identifier, "hash");
+    signCertificate(_certificate, _privateKey);
+}
+
+TestCertificateAuthority::~TestCertificateAuthority()
+{
+    X509_free(_certificate);
+    EVP_PKEY_free(_privateKey);
+}
+
+void TestCertificateAuthority::issueCertificate(const std::vector<std::string> &hostnames, X509 **certificate, EVP_PKEY **privateKey) const
+{
+    static std::atomic<long> serialNumber{2};
+    *privateKey = generatePrivateKey();
+    *certificate = createCertificate(hostnames.front(), *privateKey, _certificate, serialNumber++);
+
+    std::string subjectAlternativeNames;
+    for (const std::string &hostname : hostnames)
+    {
+        subjectAlternativeNames += (subjectAlternativeNames.empty() ? "DNS:" : ",DNS:") + hostname;
+    }
+    addExtension(*certificate, _certificate, NID_subject_alt_name, subjectAlternativeNames);
+    addExtension(*certificate, _certificate, NID_ext_key_usage, "serverAuth");
+    addExtension(*certificate, _certificate, NID_authority_key_identifier, "keyid:always");
+    signCertificate(*certificate, _privateKey);
+}
+
+trustkit::Pin TestCertificateAuthority::pin() const
+{
+    return pinForCertificate(_certificate);
+}
+
+std::string TestCertificateAuthority::pem() const
+{
+    BIO *bio = BIO_new(BIO_s_mem());
+    PEM_write_bio_X509(bio, _certificate);
+    char *bytes = nullptr;
+    long length = BIO_get_mem_data(bio, &bytes);
+    std::string pem(bytes, static_cast<size_t>(length));
+    BIO_free(bio);
+    return pem;
+}
+
+SSL_CTX *TestCertificateAuthority::newClientContext() const
+{
+    SSL_CTX *context = SSL_CTX_new(TLS_client_method());
+    X509_STORE_add_cert(SSL_CTX_get_cert_store(context), _certificate);
+    SSL_CTX_set_verify(context, SSL_VERIFY_PEER, nullptr);
+    return context;
+}
+
+
+// TestTLSServer
+
+TestTLSServer::TestTLSServer(const TestCertificateAuthority &certificateAuthority,
+                             const std::vector<std::string> &hostnames,
+                             int threadCount,
+                             bool respondsWithHttp)
+    : _respondsWithHttp(respondsWithHttp)
+{
+    EVP_PKEY *privateKey = nullptr;
+    certificateAuthority.issueCertificate(hostnames, &_certificate, &privateKey);
+    _context = SSL_CTX_new(TLS_server_method());
+    bool isConfigured = (_context != nullptr)
+        && (SSL_CTX_use_certificate(_context, _certificate) == 1)
+        && (SSL_CTX_use_PrivateKey(_context, privateKey) == 1);
+    EVP_PKEY_free(privateKey);
+    if (!isConfigured)
+    {
+        throw std::runtime_error("Could not configure the test server");
+    }
+
+    // Clients closing their connection early must not kill the test process
+    signal(SIGPIPE, SIG_IGN);
+
+    _listeningSocket = socket(AF_INET, SOCK_STREAM, 0);
+    int reuseAddress = 1;
+    setsockopt(_listeningSocket, SOL_SOCKET, SO_REUSEADDR, &reuseAddress, sizeof(reuseAddress));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressLength = sizeof(address);
+    if ((bind(_listeningSocket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+        || (listen(_listeningSocket, 1024) != 0)
+        || (getsockname(_listeningSocket, reinterpret_cast<sockaddr *>(&address), &addressLength) != 0))
+    {
+        close(_listeningSocket);
+        throw std::runtime_error("Could not listen on the loopback interface");
+    }
+    _port = ntohs(address.sin_port);
+
+    for (int i = 0; i < threadCount; i++)
+    {
+        _threads.emplace_back(&TestTLSServer::serveConnections, this);
+    }
+}
+
+TestTLSServer::~TestTLSServer()
+{
+    _isStopping = true;
+    // Wake up the threads blocked in accept()
+    shutdown(_listeningSocket, SHUT_RDWR);
+    for (std::thread &thread : _threads)
+    {
+        thread.join();
+    }
+    close(_listeningSocket);
+    SSL_CTX_free(_context);
+    X509_free(_certificate);
+}
+
+void TestTLSServer::serveConnections()
+{
+    while (!_isStopping)
+    {
+        int connectionSocket = accept(_listeningSocket, nullptr, nullptr);
+        if (connectionSocket < 0)
+        {
+            continue;
+        }
+        int noDelay = 1;
+        setsockopt(connectionSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        SSL *connection = SSL_new(_context);
+        SSL_set_fd(connection, connectionSocket);
+        if (SSL_accept(connection) == 1)
+        {
+            _handshakeCount++;
+            if (_respondsWithHttp)
+            {
+                respondToHttpRequest(connection);
+            }
+            else
+            {
+                SSL_write(connection, "k", 1);
+            }
+            SSL_shutdown(connection);
+        }
+        SSL_free(connection);
+        close(connectionSocket);
+    }
+}
+
+
+void TestTLSServer::respondToHttpRequest(SSL *connection)
+{
+    // Read the request's headers; there is no body
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos)
+    {
+        int length = SSL_read(connection, buffer, sizeof(buffer));
+        if (length <= 0)
+        {
+            return;
+        }
+        request.append(buffer, static_cast<size_t>(length));
+    }
+    static const char response[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\nok";
+    SSL_write(connection, response, sizeof(response) - 1);
+}
+
+
+bool connectToTestServer(SSL_CTX *context,
+                         uint16_t port,
+                         const std::string &serverHostname,
+                         const std::function<void(SSL *)> &configureConnection,
+                         SSL_SESSION **session)
+{
+    int connectionSocket = socket(AF_INET, SOCK_STREAM, 0);
+    int noDelay = 1;
+    setsockopt(connectionSocket, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(port);
+    if (connect(connectionSocket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        close(connectionSocket);
+        return false;
+    }
+
+    SSL *connection = SSL_new(context);
+    SSL_set_fd(connection, connectionSocket);
+    SSL_set_tlsext_host_name(connection, serverHostname.c_str());
+    SSL_set1_host(connection, serverHostname.c_str());
+    if (configureConnection)
+    {
+        configureConnection(connection);
+    }
+
+    char byte = 0;
+    bool isConnected = (SSL_connect(connection) == 1) && (SSL_read(connection, &byte, 1) == 1);
+    if (isConnected && (session != nullptr))
+    {
+        *session = SSL_get1_session(connection);
+    }
+    SSL_shutdown(connection);
+    SSL_free(connection);
+    close(connectionSocket);
+    return isConnected;
+}
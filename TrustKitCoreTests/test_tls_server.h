@@ -0,0 +1,106 @@
+/*
+
+ test_tls_server.h
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#ifndef TrustKit_test_tls_server_h
+#define TrustKit_test_tls_server_h
+
+#include "trust_decision.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <openssl/ssl.h>
+
+// A certificate authority generated at run time, like the trustme CA used for the certificates of
+// TrustKitTests/Certificates, so that no private key needs to be checked in
+class TestCertificateAuthority
+{
+public:
+    TestCertificateAuthority();
+    ~TestCertificateAuthority();
+
+    TestCertificateAuthority(const TestCertificateAuthority &) = delete;
+    TestCertificateAuthority &operator=(const TestCertificateAuthority &) = delete;
+
+    // Issue a certificate valid for the hostnames, with a new key; the caller owns both
+    void issueCertificate(const std::vector<std::string> &hostnames, X509 **certificate, EVP_PKEY **privateKey) const;
+
+    X509 *certificate() const { return _certificate; }
+
+    // The pin of the CA's key
+    trustkit::Pin pin() const;
+
+    // The PEM encoding of the CA's certificate
+    std::string pem() const;
+
+    // A client context that trusts this CA only
+    SSL_CTX *newClientContext() const;
+
+private:
+    EVP_PKEY *_privateKey = nullptr;
+    X509 *_certificate = nullptr;
+};
+
+// The pin of a certificate's key
+trustkit::Pin pinForCertificate(X509 *certificate);
+
+
+// A TLS server on the loopback interface, serving a certificate issued by a test CA on a few threads; each connection
+// gets a single byte after the handshake, or a response to its HTTP request, and is then closed
+class TestTLSServer
+{
+public:
+    TestTLSServer(const TestCertificateAuthority &certificateAuthority,
+                  const std::vector<std::string> &hostnames,
+                  int threadCount = 4,
+                  bool respondsWithHttp = false);
+    ~TestTLSServer();
+
+    TestTLSServer(const TestTLSServer &) = delete;
+    TestTLSServer &operator=(const TestTLSServer &) = delete;
+
+    uint16_t port() const { return _port; }
+
+    // The pin of the server's leaf certificate
+    trustkit::Pin leafPin() const { return pinForCertificate(_certificate); }
+
+    SSL_CTX *context() const { return _context; }
+
+    // Connections whose handshake completed
+    uint64_t handshakeCount() const { return _handshakeCount.load(); }
+
+private:
+    void serveConnections();
+    void respondToHttpRequest(SSL *connection);
+
+    SSL_CTX *_context = nullptr;
+    X509 *_certificate = nullptr;
+    bool _respondsWithHttp = false;
+    int _listeningSocket = -1;
+    uint16_t _port = 0;
+    std::atomic<bool> _isStopping{false};
+    std::atomic<uint64_t> _handshakeCount{0};
+    std::vector<std::thread> _threads;
+};
+
+// Connect to the server, perform the handshake with the SNI hostname set, check the verification result and read the
+// server's byte; return whether all of it succeeded. The connection can be configured before the handshake, and its session is returned if requested
+bool connectToTestServer(SSL_CTX *context,
+                         uint16_t port,
+                         const std::string &serverHostname,
+                         const std::function<void(SSL *)> &configureConnection = nullptr,
+                         SSL_SESSION **session = nullptr);
+
+#endif /* TrustKit_test_tls_server_h */
@@ -0,0 +1,298 @@
+/*
+
+ validation_trace_tests.cpp
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#include "pinning_validator.h"
+#include "test_certificates.h"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstdlib>
+
+using namespace trustkit;
+
+namespace {
+
+const char *kGoodRootCAPin = "S5z3Fz5ZfZAGJOBZjK6TYBquyLLKO+BndKXBlL3nPjo=";
+const char *kGlobalSignRootPin = "K87oWBWM9UZfyddvDfoxL+8lpNyoUB2ptGtn0fv6G2Q=";
+const char *kGlobalSignLeafPin = "NDCIt6TrQnfOk+lquunrmlPQB3K/7CLOCmSS5kW+KCc=";
+
+// Trusts every chain, and appends the trust anchor to the server's chain to get the verified chain
+class TrustingBackend : public TrustBackend
+{
+public:
+    std::vector<uint8_t> trustAnchor;
+
+    ChainEvaluation evaluateChain(const CertificateChain &serverChain, const std::string &hostname) override
+    {
+        (void)hostname;
+        ChainEvaluation chainEvaluation;
+        chainEvaluation.isTrusted = true;
+        chainEvaluation.verifiedChain = serverChain;
+        chainEvaluation.verifiedChain.push_back(trustAnchor);
+        return chainEvaluation;
+    }
+};
+
+DomainPinningPolicy domainPolicy(const std::string &domain, const char *firstPin, const char *secondPin)
+{
+    DomainPinningPolicy domainPolicy;
+    domainPolicy.domain = domain;
+    domainPolicy.publicKeyHashes = { pinFromBase64(firstPin), pinFromBase64(secondPin) };
+    return domainPolicy;
+}
+
+std::vector<TracedValidation> readTrace(ValidationTraceReader &reader)
+{
+    std::vector<TracedValidation> validations;
+    TracedValidation validation;
+    while (reader.readValidation(validation))
+    {
+        validations.push_back(validation);
+    }
+    return validations;
+}
+
+} // namespace
+
+
+class ValidationTraceTests : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        auto backend = std::make_shared<TrustingBackend>();
+        backend->trustAnchor = loadTestCertificate("RSA_4096/GoodRootCA.der");
+        DomainPinningPolicy reportOnlyPolicy = domainPolicy("report.good.com", kGlobalSignRootPin, kGlobalSignLeafPin);
+        reportOnlyPolicy.enforcePinning = false;
+        reportOnlyPolicy.includeSubdomains = true;
+        reportOnlyPolicy.expirationDate = expirationDateFromString("2100-01-01");
+        _pinningPolicy = std::make_shared<PinningPolicy>(std::vector<DomainPinningPolicy>{
+            domainPolicy("www.good.com", kGoodRootCAPin, kGlobalSignRootPin),
+            domainPolicy("blocked.good.com", kGlobalSignRootPin, kGlobalSignLeafPin),
+            reportOnlyPolicy,
+        });
+        _validator = std::make_unique<PinningValidator>(_pinningPolicy, backend);
+        _serverChain = { loadTestCertificate("RSA_4096/www.good.com.der") };
+        _tracePath = ::testing::TempDir() + "validation_trace_tests.trace";
+    }
+
+    void TearDown() override
+    {
+        std::remove(_tracePath.c_str());
+    }
+
+    std::shared_ptr<PinningPolicy> _pinningPolicy;
+    std::unique_ptr<PinningValidator> _validator;
+    CertificateChain _serverChain;
+    std::string _tracePath;
+};
+
+
+TEST_F(ValidationTraceTests, RecordAndRead)
+{
+    // Not recorded
+    _validator->validate(_serverChain, "www.good.com");
+
+    auto recorder = std::make_shared<ValidationTraceRecorder>(_tracePath, true);
+    _validator->setTraceRecorder(recorder);
+    _validator->validate(_serverChain, "www.good.com");
+    _validator->validate(_serverChain, "blocked.good.com");
+    _validator->validate(_serverChain, "api.report.good.com");
+    _validator->validate(_serverChain, "www.other.org");
+    _validator->validate(_serverChain, "www.good.com");
+    CertificateChain verifiedChain = { _serverChain[0], loadTestCertificate("RSA_4096/GoodRootCA.der") };
+    DerSlice verifiedChainSlices[2] = { { verifiedChain[0].data(), verifiedChain[0].size() },
+                                        { verifiedChain[1].data(), verifiedChain[1].size() } };
+    _validator->validateVerifiedChain(verifiedChainSlices, 2, "www.good.com");
+
+    // Not recorded either
+    _validator->setTraceRecorder(nullptr);
+    _validator->validate(_serverChain, "www.good.com");
+    EXPECT_EQ(recorder->recordedValidationCount(), 6u);
+    recorder.reset();
+
+    ValidationTraceReader reader(_tracePath);
+    std::vector<TracedValidation> validations = readTrace(reader);
+    ASSERT_EQ(validations.size(), 6u);
+    EXPECT_FALSE(reader.isTruncated());
+    EXPECT_LE(std::abs(reader.recordingTime() - std::time(nullptr)), 60);
+
+    const TrustDecision expectedDecisions[] = {
+        TrustDecision::ShouldAllowConnection, TrustDecision::ShouldBlockConnection, TrustDecision::ShouldAllowConnection,
+        TrustDecision::DomainNotPinned, TrustDecision::ShouldAllowConnection, TrustDecision::ShouldAllowConnection,
+    };
+    for (size_t i = 0; i < validations.size(); i++)
+    {
+        EXPECT_EQ(validations[i].finalTrustDecision, expectedDecisions[i]) << i;
+        EXPECT_EQ(validations[i].policyIndex, 0u);
+        EXPECT_GT(validations[i].duration.count(), 0);
+        if (i > 0)
+        {
+            EXPECT_GE(validations[i].startTime, validations[i - 1].startTime + validations[i - 1].duration);
+        }
+    }
+    EXPECT_EQ(*validations[1].serverHostname, "blocked.good.com");
+    EXPECT_EQ(validations[1].evaluationResult, TrustEvaluationResult::FailedNoMatchingPin);
+    EXPECT_EQ(validations[2].evaluationResult, TrustEvaluationResult::FailedNoMatchingPin);
+    EXPECT_FALSE(validations[3].evaluationResult);
+    EXPECT_EQ(*validations[0].serverChain, _serverChain);
+    EXPECT_EQ(validations[0].chainDigest, digestForCertificateChain(_serverChain));
+
+    // Each hostname and chain is only written once
+    EXPECT_EQ(validations[0].serverHostname, validations[4].serverHostname);
+    EXPECT_EQ(validations[0].serverChain, validations[4].serverChain);
+
+    EXPECT_EQ(validations[5].kind, TracedValidationKind::VerifiedChain);
+    EXPECT_EQ(*validations[5].serverChain, verifiedChain);
+
+    // The policy can be used to replay the validations
+    ASSERT_EQ(reader.pinningPolicies().size(), 1u);
+    std::vector<DomainPinningPolicy> domainPolicies = reader.pinningPolicies()[0]->domainPolicies();
+    std::vector<DomainPinningPolicy> expectedDomainPolicies = _pinningPolicy->domainPolicies();
+    ASSERT_EQ(domainPolicies.size(), expectedDomainPolicies.size());
+    for (size_t i = 0; i < domainPolicies.size(); i++)
+    {
+        EXPECT_EQ(domainPolicies[i].domain, expectedDomainPolicies[i].domain);
+        EXPECT_EQ(domainPolicies[i].publicKeyHashes, expectedDomainPolicies[i].publicKeyHashes);
+        EXPECT_EQ(domainPolicies[i].enforcePinning, expectedDomainPolicies[i].enforcePinning);
+        EXPECT_EQ(domainPolicies[i].includeSubdomains, expectedDomainPolicies[i].includeSubdomains);
+        EXPECT_EQ(domainPolicies[i].expirationDate, expectedDomainPolicies[i].expirationDate);
+    }
+}
+
+
+TEST_F(ValidationTraceTests, DigestsOnly)
+{
+    auto recorder = std::make_shared<ValidationTraceRecorder>(_tracePath, false);
+    _validator->setTraceRecorder(recorder);
+    _validator->validate(_serverChain, "www.good.com");
+    _validator->setTraceRecorder(nullptr);
+    recorder.reset();
+
+    ValidationTraceReader reader(_tracePath);
+    std::vector<TracedValidation> validations = readTrace(reader);
+    ASSERT_EQ(validations.size(), 1u);
+    EXPECT_TRUE(validations[0].serverChain->empty());
+    EXPECT_EQ(validations[0].chainDigest, digestForCertificateChain(_serverChain));
+}
+
+
+TEST_F(ValidationTraceTests, AnonymizedHostnames)
+{
+    const std::vector<uint8_t> hostnameKey = { 's', 'e', 'c', 'r', 'e', 't' };
+    EXPECT_THROW(ValidationTraceRecorder(_tracePath, std::vector<uint8_t>()), std::invalid_argument);
+    auto recorder = std::make_shared<ValidationTraceRecorder>(_tracePath, hostnameKey);
+    _validator->setTraceRecorder(recorder);
+    _validator->validate(_serverChain, "www.good.com");
+    _validator->validate(_serverChain, "api.report.good.com");
+    _validator->validate(_serverChain, "v2.api.report.good.com");
+    _validator->validate(_serverChain, "api.other.org");
+    _validator->setTraceRecorder(nullptr);
+    recorder.reset();
+
+    ValidationTraceReader reader(_tracePath);
+    std::vector<TracedValidation> validations = readTrace(reader);
+    ASSERT_EQ(validations.size(), 4u);
+    EXPECT_TRUE(validations[0].serverChain->empty());
+
+    // The domains of the policies and the public suffixes are kept, and each label below them is hashed
+    const std::string &apiHostname = *validations[1].serverHostname;
+    const std::string &v2Hostname = *validations[2].serverHostname;
+    const std::string &otherHostname = *validations[3].serverHostname;
+    EXPECT_EQ(*validations[0].serverHostname, "www.good.com");
+    ASSERT_EQ(apiHostname.size(), 16 + std::string(".report.good.com").size());
+    EXPECT_EQ(apiHostname, "1a126da5a08d45bf.report.good.com"); // HMAC-SHA256("secret", "api")
+    EXPECT_EQ(v2Hostname.substr(17), apiHostname);
+    ASSERT_EQ(otherHostname.size(), 16 + 1 + 16 + std::string(".org").size());
+    EXPECT_EQ(otherHostname.substr(0, 16), apiHostname.substr(0, 16));
+    EXPECT_EQ(otherHostname.substr(33), ".org");
+
+    // The same policies apply to the anonymized hostnames
+    const PinningPolicy &pinningPolicy = *reader.pinningPolicies()[0];
+    ASSERT_NE(pinningPolicy.findPinnedDomain(v2Hostname), nullptr);
+    EXPECT_EQ(pinningPolicy.findPinnedDomain(v2Hostname)->policy().domain, "report.good.com");
+    EXPECT_EQ(pinningPolicy.findPinnedDomain(otherHostname), nullptr);
+
+    // Another key gives other labels
+    recorder = std::make_shared<ValidationTraceRecorder>(_tracePath, std::vector<uint8_t>{ 'o', 't', 'h', 'e', 'r' });
+    _validator->setTraceRecorder(recorder);
+    _validator->validate(_serverChain, "api.report.good.com");
+    _validator->setTraceRecorder(nullptr);
+    recorder.reset();
+    ValidationTraceReader otherKeyReader(_tracePath);
+    validations = readTrace(otherKeyReader);
+    ASSERT_EQ(validations.size(), 1u);
+    EXPECT_NE(*validations[0].serverHostname, apiHostname);
+}
+
+
+TEST_F(ValidationTraceTests, MalformedTraces)
+{
+    EXPECT_THROW(ValidationTraceReader(_tracePath + ".missing"), std::runtime_error);
+
+    {
+        auto recorder = std::make_shared<ValidationTraceRecorder>(_tracePath);
+        _validator->setTraceRecorder(recorder);
+        _validator->validate(_serverChain, "www.good.com");
+        _validator->validate(_serverChain, "blocked.good.com");
+        _validator->setTraceRecorder(nullptr);
+    }
+    std::ifstream file(_tracePath, std::ios::binary);
+    std::vector<char> trace((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+
+    auto writeTrace = [this](const std::vector<char> &bytes) {
+        std::ofstream(_tracePath, std::ios::binary | std::ios::trunc).write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+    };
+
+    // Truncated in the middle of the last validation, as when the recording process crashed: the validations
+    // before it are still read
+    writeTrace(std::vector<char>(trace.begin(), trace.end() - 3));
+    ValidationTraceReader truncatedReader(_tracePath);
+    std::vector<TracedValidation> validations = readTrace(truncatedReader);
+    ASSERT_EQ(validations.size(), 1u);
+    EXPECT_EQ(*validations[0].serverHostname, "www.good.com");
+    EXPECT_TRUE(truncatedReader.isTruncated());
+    TracedValidation validation;
+    EXPECT_FALSE(truncatedReader.readValidation(validation));
+
+    // Not a trace
+    std::vector<char> notATrace = trace;
+    notATrace[0] = 'X';
+    writeTrace(notATrace);
+    EXPECT_THROW(ValidationTraceReader{ _tracePath }, std::runtime_error);
+
+    // A validation referring to a chain that is not in the trace
+    std::vector<char> unknownChain = trace;
+    unknownChain[unknownChain.size() - 3] = 5;
+    writeTrace(unknownChain);
+    ValidationTraceReader unknownChainReader(_tracePath);
+    EXPECT_TRUE(unknownChainReader.readValidation(validation));
+    EXPECT_THROW(unknownChainReader.readValidation(validation), std::runtime_error);
+}
+
+
+TEST_F(ValidationTraceTests, RecordingFailures)
+{
+    // Writing to the file fails, which stops the recording without affecting the validations
+    auto recorder = std::make_shared<ValidationTraceRecorder>("/dev/full");
+    _validator->setTraceRecorder(recorder);
+    EXPECT_EQ(_validator->validate(_serverChain, "www.good.com").finalTrustDecision, TrustDecision::ShouldAllowConnection);
+    EXPECT_TRUE(recorder->isRecording());
+    EXPECT_THROW(recorder->flush(), std::runtime_error);
+    EXPECT_FALSE(recorder->isRecording());
+
+    EXPECT_EQ(_validator->validate(_serverChain, "blocked.good.com").finalTrustDecision, TrustDecision::ShouldBlockConnection);
+    EXPECT_EQ(recorder->recordedValidationCount(), 1u);
+    _validator->setTraceRecorder(nullptr);
+    EXPECT_NO_THROW(recorder.reset());
+}
@@ -0,0 +1,127 @@
+/*
+
+ TSKBase64CodecTests.m
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#import <XCTest/XCTest.h>
+
+#import "../TrustKit/Pinning/base64_codec.h"
+
+
+@interface TSKBase64CodecTests : XCTestCase
+{
+    BOOL defaultSIMDEnabled;
+    NSMutableData *data;
+}
+@end
+
+
+@implementation TSKBase64CodecTests
+
+- (void)setUp
+{
+    [super setUp];
+    defaultSIMDEnabled = TSKBase64IsSIMDEnabled();
+
+    data = [NSMutableData dataWithLength:2048];
+    arc4random_buf(data.mutableBytes, data.length);
+}
+
+- (void)tearDown
+{
+    TSKBase64SetSIMDEnabled(defaultSIMDEnabled);
+    [super tearDown];
+}
+
+
+- (NSString *)encodeBytes:(const void *)bytes length:(NSUInteger)length lineLength:(size_t)lineLength
+{
+    NSMutableData *encoded = [NSMutableData dataWithLength:TSKBase64EncodedLength(length, lineLength)];
+    size_t encodedLength = TSKBase64Encode(bytes, length, lineLength, encoded.mutableBytes);
+    XCTAssertEqual(encodedLength, encoded.length);
+    return [[NSString alloc] initWithData:encoded encoding:NSASCIIStringEncoding];
+}
+
+
+- (NSData *)decodeString:(NSString *)string
+{
+    NSData *encoded = [string dataUsingEncoding:NSUTF8StringEncoding];
+    NSMutableData *decoded = [NSMutableData dataWithLength:TSKBase64DecodedMaxLength(encoded.length)];
+    size_t decodedLength = 0;
+    if (!TSKBase64Decode(encoded.bytes, encoded.length, decoded.mutableBytes, &decodedLength))
+    {
+        return nil;
+    }
+    decoded.length = decodedLength;
+    return decoded;
+}
+
+
+- (void)testMatchesFoundation
+{
+    for (int simd = 0; simd < 2; simd++)
+    {
+        if (!TSKBase64SetSIMDEnabled(simd))
+        {
+            continue;
+        }
+
+        for (NSUInteger length = 0; length < data.length; length++)
+        {
+            NSData *slice = [data subdataWithRange:NSMakeRange(0, length)];
+            NSString *expected = [slice base64EncodedStringWithOptions:(NSDataBase64EncodingOptions)0];
+            XCTAssertEqualObjects([self encodeBytes:slice.bytes length:length lineLength:0], expected);
+            XCTAssertEqualObjects([self decodeString:expected], slice);
+
+            NSString *expectedWrapped = [slice base64EncodedStringWithOptions:NSDataBase64Encoding64CharacterLineLength];
+            XCTAssertEqualObjects([self encodeBytes:slice.bytes length:length lineLength:TSK_BASE64_PEM_LINE_LENGTH],
+                                  expectedWrapped);
+        }
+    }
+}
+
+
+- (void)testRejectsInvalidInput
+{
+    for (int simd = 0; simd < 2; simd++)
+    {
+        if (!TSKBase64SetSIMDEnabled(simd))
+        {
+            continue;
+        }
+
+        // Long enough for the SIMD paths to see the invalid character
+        NSString *valid = [self encodeBytes:data.bytes length:200 lineLength:0];
+        XCTAssertNotNil([self decodeString:valid]);
+        for (NSString *invalidCharacter in @[@"=", @" ", @"\n", @"-", @"_", @"é"])
+        {
+            for (NSUInteger position = 0; position < valid.length - 2; position += 7)
+            {
+                NSString *invalid = [valid stringByReplacingCharactersInRange:NSMakeRange(position, 1)
+                                                                   withString:invalidCharacter];
+                XCTAssertNil([self decodeString:invalid], @"%@", invalid);
+            }
+        }
+
+        XCTAssertNil([self decodeString:@"QUI"]);
+        XCTAssertNil([self decodeString:@"QQ==QUJD"]);
+        XCTAssertNil([self decodeString:@"Q==="]);
+        XCTAssertEqualObjects([self decodeString:@""], [NSData data]);
+    }
+}
+
+
+- (void)testAcceptsUnusedBits
+{
+    // Like Foundation, which the fake pins used throughout the tests rely on
+    NSString *pin = @"BBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBB=";
+    XCTAssertEqualObjects([self decodeString:pin], [[NSData alloc] initWithBase64EncodedString:pin options:(NSDataBase64DecodingOptions)0]);
+}
+
+@end
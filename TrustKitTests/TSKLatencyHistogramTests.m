@@ -0,0 +1,123 @@
+/*
+
+ TSKLatencyHistogramTests.m
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#import <XCTest/XCTest.h>
+
+#import "../TrustKit/Pinning/latency_histogram.h"
+
+
+@interface TSKLatencyHistogramTests : XCTestCase
+{
+    TSKLatencyHistogram *histogram;
+}
+@end
+
+
+@implementation TSKLatencyHistogramTests
+
+- (void)setUp
+{
+    [super setUp];
+    histogram = TSKLatencyHistogramCreate();
+}
+
+- (void)tearDown
+{
+    TSKLatencyHistogramDestroy(histogram);
+    [super tearDown];
+}
+
+
+- (void)testBuckets
+{
+    for (size_t i = 0; i < TSK_LATENCY_HISTOGRAM_BUCKET_COUNT; i++)
+    {
+        uint64_t lowestValue = TSKLatencyHistogramGetBucketLowestValue(i);
+        uint64_t highestValue = TSKLatencyHistogramGetBucketHighestValue(i);
+        XCTAssertEqual(TSKLatencyHistogramGetBucketIndex(lowestValue), i);
+        XCTAssertEqual(TSKLatencyHistogramGetBucketIndex(highestValue), i);
+        if (i > 0)
+        {
+            // The buckets cover all the values without overlapping
+            XCTAssertEqual(TSKLatencyHistogramGetBucketHighestValue(i - 1) + 1, lowestValue);
+        }
+        XCTAssertLessThanOrEqual((double)(highestValue - lowestValue), lowestValue / 32.0);
+    }
+    XCTAssertEqual(TSKLatencyHistogramGetBucketHighestValue(TSK_LATENCY_HISTOGRAM_BUCKET_COUNT - 1), TSK_LATENCY_HISTOGRAM_MAX_VALUE);
+    XCTAssertEqual(TSKLatencyHistogramGetBucketIndex(UINT64_MAX), (size_t)TSK_LATENCY_HISTOGRAM_BUCKET_COUNT - 1);
+}
+
+
+- (void)testEmptySnapshot
+{
+    TSKLatencyHistogramSnapshot snapshot;
+    TSKLatencyHistogramGetSnapshot(histogram, &snapshot);
+    XCTAssertEqual(snapshot.count, 0);
+    XCTAssertEqual(snapshot.min, 0);
+    XCTAssertEqual(snapshot.max, 0);
+    XCTAssertEqual(TSKLatencyHistogramSnapshotGetValueAtPercentile(&snapshot, 99), 0);
+}
+
+
+- (void)testPercentiles
+{
+    for (uint64_t value = 1; value <= 10000; value++)
+    {
+        TSKLatencyHistogramRecord(histogram, value * 1000);
+    }
+
+    TSKLatencyHistogramSnapshot snapshot;
+    TSKLatencyHistogramGetSnapshot(histogram, &snapshot);
+    XCTAssertEqual(snapshot.count, 10000);
+    XCTAssertEqual(snapshot.min, 1000);
+    XCTAssertEqual(snapshot.max, 10000000);
+    XCTAssertEqual(snapshot.sum, (uint64_t)10000 * 10001 / 2 * 1000);
+
+    // Within the width of a bucket
+    XCTAssertEqualWithAccuracy(TSKLatencyHistogramSnapshotGetValueAtPercentile(&snapshot, 50), 5000000, 5000000 / 32);
+    XCTAssertEqualWithAccuracy(TSKLatencyHistogramSnapshotGetValueAtPercentile(&snapshot, 99), 9900000, 9900000 / 32);
+    XCTAssertEqual(TSKLatencyHistogramSnapshotGetValueAtPercentile(&snapshot, 100), snapshot.max);
+    XCTAssertEqual(TSKLatencyHistogramSnapshotGetValueAtPercentile(&snapshot, 0), 1000);
+}
+
+
+- (void)testConcurrentRecording
+{
+    const size_t threadCount = 16;
+    const uint64_t valueCount = 10000;
+    TSKLatencyHistogram *sharedHistogram = histogram;
+    dispatch_apply(threadCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t thread) {
+        for (uint64_t value = 1; value <= valueCount; value++)
+        {
+            TSKLatencyHistogramRecord(sharedHistogram, value);
+        }
+    });
+
+    TSKLatencyHistogramSnapshot snapshot;
+    TSKLatencyHistogramGetSnapshot(histogram, &snapshot);
+    XCTAssertEqual(snapshot.count, threadCount * valueCount);
+    XCTAssertEqual(snapshot.sum, threadCount * valueCount * (valueCount + 1) / 2);
+    XCTAssertEqual(snapshot.min, 1);
+    XCTAssertEqual(snapshot.max, valueCount);
+}
+
+
+- (void)testRecordPerformance
+{
+    [self measureBlock:^{
+        for (uint64_t value = 0; value < 1000000; value++)
+        {
+            TSKLatencyHistogramRecord(self->histogram, value);
+        }
+    }];
+}
+
+@end
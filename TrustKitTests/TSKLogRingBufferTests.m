@@ -0,0 +1,99 @@
+/*
+
+ TSKLogRingBufferTests.m
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#import <XCTest/XCTest.h>
+
+#import "../TrustKit/log_ring_buffer.h"
+
+
+@interface TSKLogRingBufferTests : XCTestCase
+{
+    TSKLogRingBuffer *ringBuffer;
+}
+@end
+
+
+@implementation TSKLogRingBufferTests
+
+- (void)setUp
+{
+    [super setUp];
+    ringBuffer = TSKLogRingBufferCreate(100);
+}
+
+- (void)tearDown
+{
+    TSKLogRingBufferDestroy(ringBuffer);
+    [super tearDown];
+}
+
+
+- (void)testRecordAndCopy
+{
+    XCTAssertEqual(TSKLogRingBufferGetCapacity(ringBuffer), 128);
+
+    TSKLogRecord records[128];
+    XCTAssertEqual(TSKLogRingBufferCopyRecords(ringBuffer, records, 128), 0);
+
+    TSKLogRingBufferRecord(ringBuffer, 1, "first");
+    TSKLogRingBufferRecord(ringBuffer, 2, "second");
+    XCTAssertEqual(TSKLogRingBufferCopyRecords(ringBuffer, records, 128), 2);
+    XCTAssertEqual(records[0].sequence, 0);
+    XCTAssertEqual(records[0].level, 1);
+    XCTAssertEqual(records[0].event, "first");
+    XCTAssertEqual(records[1].event, "second");
+    XCTAssertLessThanOrEqual(records[0].timestamp, records[1].timestamp);
+
+    // Only the most recent records are copied
+    XCTAssertEqual(TSKLogRingBufferCopyRecords(ringBuffer, records, 1), 1);
+    XCTAssertEqual(records[0].event, "second");
+}
+
+
+- (void)testOverwriteOldestRecords
+{
+    for (uintptr_t i = 0; i < 1000; i++)
+    {
+        TSKLogRingBufferRecord(ringBuffer, 0, (const void *)i);
+    }
+
+    TSKLogRecord records[128];
+    XCTAssertEqual(TSKLogRingBufferCopyRecords(ringBuffer, records, 128), 128);
+    for (size_t i = 0; i < 128; i++)
+    {
+        XCTAssertEqual(records[i].sequence, 1000 - 128 + i);
+        XCTAssertEqual((uintptr_t)records[i].event, 1000 - 128 + i);
+    }
+}
+
+
+- (void)testConcurrentRecording
+{
+    const uintptr_t threadCount = 8;
+    TSKLogRingBuffer *sharedRingBuffer = ringBuffer;
+    dispatch_apply(threadCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t thread) {
+        for (uintptr_t i = 0; i < 10000; i++)
+        {
+            TSKLogRingBufferRecord(sharedRingBuffer, (uint32_t)thread, (const void *)(i * threadCount + thread));
+        }
+    });
+
+    // Records are never torn: the level always matches the event
+    TSKLogRecord records[128];
+    size_t recordCount = TSKLogRingBufferCopyRecords(ringBuffer, records, 128);
+    XCTAssertGreaterThan(recordCount, 0);
+    for (size_t i = 0; i < recordCount; i++)
+    {
+        XCTAssertEqual((uintptr_t)records[i].event % threadCount, records[i].level);
+    }
+}
+
+@end
@@ -24,12 +24,14 @@
 
 - (void)tearDown
 {
+    [TrustKit setLogLevel:TSKLogLevelDebug];
+    [TrustKit setLogEventRecordingLevel:TSKLogLevelNone];
     [super tearDown];
 }
 
 - (void)testDefaultLoggerBlock
 {
-    TSKLog(@"test %@", @"test");
+    TSKLogInfo(@"test %@", @"test");
 }
 
 
@@ -43,8 +45,68 @@
     };
     
     [TrustKit setLoggerBlock:loggerBlock];
-    TSKLog(@"test %@", @"test");
+    TSKLogInfo(@"test %@", @"test");
     XCTAssertTrue(wasBlockCalled);
 }
 
+
+- (void)testLogLevel
+{
+    __block NSUInteger messageCount = 0;
+    [TrustKit setLoggerBlock:^void(NSString *message) {
+        messageCount += 1;
+    }];
+    __block NSUInteger evaluationCount = 0;
+    NSString *(^costlyValue)(void) = ^NSString *{
+        evaluationCount += 1;
+        return @"test";
+    };
+    
+    [TrustKit setLogLevel:TSKLogLevelWarning];
+    TSKLogError(@"test %@", costlyValue());
+    TSKLogWarning(@"test %@", costlyValue());
+    XCTAssertEqual(messageCount, 2);
+    XCTAssertEqual(evaluationCount, 2);
+    XCTAssertTrue(TSKLogIsEnabled(TSKLogLevelWarning));
+    
+    // The arguments of the messages that are not logged are not evaluated
+    TSKLogInfo(@"test %@", costlyValue());
+    TSKLogDebug(@"test %@", costlyValue());
+    XCTAssertEqual(messageCount, 2);
+    XCTAssertEqual(evaluationCount, 2);
+    XCTAssertFalse(TSKLogIsEnabled(TSKLogLevelInfo));
+    
+    // Nothing is enabled without a logger block
+    [TrustKit setLoggerBlock:nil];
+    [TrustKit setLogLevel:TSKLogLevelDebug];
+    TSKLogError(@"test %@", costlyValue());
+    XCTAssertEqual(evaluationCount, 2);
+    XCTAssertFalse(TSKLogIsEnabled(TSKLogLevelError));
+}
+
+
+- (void)testLogEventRecording
+{
+    [TrustKit setLoggerBlock:nil];
+    __block NSUInteger evaluationCount = 0;
+    NSString *(^costlyValue)(void) = ^NSString *{
+        evaluationCount += 1;
+        return @"test";
+    };
+    
+    [TrustKit setLogEventRecordingLevel:TSKLogLevelInfo];
+    TSKLogWarning(@"TSKLoggerTests warning %@", costlyValue());
+    TSKLogDebug(@"TSKLoggerTests debug %@", costlyValue());
+    
+    // The events are recorded without evaluating the arguments of the messages
+    XCTAssertEqual(evaluationCount, 0);
+    NSString *lastEvent = [[TrustKit recordedLogEvents] lastObject];
+    XCTAssertTrue([lastEvent hasSuffix:@" Warning: TSKLoggerTests warning %@"]);
+    
+    // Disabling the recording keeps the events
+    [TrustKit setLogEventRecordingLevel:TSKLogLevelNone];
+    TSKLogError(@"TSKLoggerTests error");
+    XCTAssertEqualObjects([[TrustKit recordedLogEvents] lastObject], lastEvent);
+}
+
 @end
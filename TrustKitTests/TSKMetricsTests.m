@@ -0,0 +1,158 @@
+/*
+
+ TSKMetricsTests.m
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#import <XCTest/XCTest.h>
+
+#import "../TrustKit/TrustKit.h"
+#import "../TrustKit/TSKPinningValidator_Private.h"
+#import "../TrustKit/Pinning/TSKSPKIHashCache.h"
+#import "../TrustKit/parse_configuration.h"
+#import "../TrustKit/metrics_registry.h"
+
+#import "TSKCertificateUtils.h"
+
+
+@interface TSKMetricsTests : XCTestCase
+@end
+
+
+@implementation TSKMetricsTests
+
+- (void)setUp
+{
+    [super setUp];
+    TSKMetricsReset();
+}
+
+- (void)tearDown
+{
+    [TrustKit setMetricsEnabled:NO];
+    TSKMetricsReset();
+    [super tearDown];
+}
+
+
+- (void)testDisabledByDefault
+{
+    XCTAssertFalse(TSKMetricsIsEnabled());
+    XCTAssertFalse(TSKMetricsIncrement(TSKMetricReportsGenerated));
+    XCTAssertEqualObjects([TrustKit metricsSnapshot][@"trustkit_reports_generated_total"], @0);
+
+    [TrustKit setMetricsEnabled:YES];
+    XCTAssertTrue(TSKMetricsIncrement(TSKMetricReportsGenerated));
+    XCTAssertEqualObjects([TrustKit metricsSnapshot][@"trustkit_reports_generated_total"], @1);
+
+    // Disabling the metrics keeps their values
+    [TrustKit setMetricsEnabled:NO];
+    XCTAssertFalse(TSKMetricsIncrement(TSKMetricReportsGenerated));
+    XCTAssertEqualObjects([TrustKit metricsSnapshot][@"trustkit_reports_generated_total"], @1);
+}
+
+
+- (void)testOpenMetricsFormat
+{
+    [TrustKit setMetricsEnabled:YES];
+    TSKMetricsIncrement(TSKMetricEvaluationsBlocked);
+    TSKMetricsAdd(TSKMetricSPKICachePersistedBytes, 144);
+
+    NSString *text = [TrustKit metricsInOpenMetricsFormat];
+    XCTAssertTrue([text containsString:@"# TYPE trustkit_evaluations counter\n"]);
+    XCTAssertTrue([text containsString:@"\ntrustkit_evaluations_total{decision=\"block\"} 1\n"]);
+    XCTAssertTrue([text containsString:@"\ntrustkit_evaluations_total{decision=\"allow\"} 0\n"]);
+    XCTAssertTrue([text containsString:@"\ntrustkit_spki_cache_persisted_bytes_total 144\n"]);
+    XCTAssertTrue([text containsString:@"# TYPE trustkit_callback_queue_depth gauge\n"]);
+    XCTAssertTrue([text hasSuffix:@"\n# EOF\n"]);
+
+    // Each metric is rendered once, and each family gets a single TYPE line
+    NSArray<NSString *> *lines = [text componentsSeparatedByString:@"\n"];
+    NSPredicate *isSample = [NSPredicate predicateWithFormat:@"SELF BEGINSWITH 'trustkit_'"];
+    XCTAssertEqual([lines filteredArrayUsingPredicate:isSample].count, (NSUInteger)TSKMetricCount);
+    NSPredicate *isType = [NSPredicate predicateWithFormat:@"SELF BEGINSWITH '# TYPE'"];
+    NSArray<NSString *> *typeLines = [lines filteredArrayUsingPredicate:isType];
+    XCTAssertEqual([NSSet setWithArray:typeLines].count, typeLines.count);
+
+    // The output gets truncated like snprintf()
+    TSKMetricsSnapshot snapshot;
+    TSKMetricsGetSnapshot(&snapshot);
+    char truncated[16];
+    XCTAssertEqual(TSKMetricsRenderOpenMetrics(&snapshot, truncated, sizeof(truncated)), [text lengthOfBytesUsingEncoding:NSUTF8StringEncoding]);
+    XCTAssertEqual(strlen(truncated), sizeof(truncated) - 1);
+}
+
+
+- (void)testValidatorMetrics
+{
+    [TrustKit setMetricsEnabled:YES];
+
+    SecCertificateRef rootCertificate = [TSKCertificateUtils createCertificateFromDer:@"GoodRootCA"];
+    SecCertificateRef leafCertificate = [TSKCertificateUtils createCertificateFromDer:@"www.good.com"];
+    SecCertificateRef certChainArray[1] = {leafCertificate};
+    SecCertificateRef trustStoreArray[1] = {rootCertificate};
+    SecTrustRef trust = [TSKCertificateUtils createTrustWithCertificates:(const void **)certChainArray
+                                                             arrayLength:sizeof(certChainArray)/sizeof(certChainArray[0])
+                                                      anchorCertificates:(const void **)trustStoreArray
+                                                             arrayLength:sizeof(trustStoreArray)/sizeof(trustStoreArray[0])];
+
+    NSDictionary *trustKitConfig = @{kTSKSwizzleNetworkDelegates: @NO,
+                                     kTSKPinnedDomains :
+                                         @{@"www.good.com" : @{
+                                                   kTSKPublicKeyHashes : @[@"TwyNzy19zZi7cKfPsucs1E+h8ODOCPMrT8681sFWJvw=", // Leaf Key
+                                                                           @"BBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBB=", // Fake key
+                                                                           ]},
+                                           @"www.other.com" : @{
+                                                   kTSKPublicKeyHashes : @[@"TwyNzy19zZi7cKfPsucs1E+h8ODOCPMrT8681sFWJvw=", // Leaf Key
+                                                                           @"BBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBB=", // Fake key
+                                                                           ]},
+                                           @"good.com" : @{
+                                                   kTSKIncludeSubdomains : @YES,
+                                                   kTSKPublicKeyHashes : @[@"AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA=", // Fake key
+                                                                           @"BBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBB=", // Fake key
+                                                                           ]}}};
+    NSDictionary *parsedTrustKitConfig = parseTrustKitConfiguration(trustKitConfig);
+    TSKSPKIHashCache *spkiCache = [[TSKSPKIHashCache alloc] initWithIdentifier:@"test"];
+    XCTestExpectation *callbackExpectation = [self expectationWithDescription:@"Callbacks invoked"];
+    callbackExpectation.expectedFulfillmentCount = 2;
+    TSKPinningValidator *validator = [[TSKPinningValidator alloc] initWithDomainPinningPolicies:parsedTrustKitConfig[kTSKPinnedDomains]
+                                                                                   hashCache:spkiCache
+                                                               ignorePinsForUserTrustAnchors:NO
+                                                                     validationCallbackQueue:dispatch_get_main_queue()
+                                                                          validationCallback:^(TSKPinningValidatorResult * _Nonnull result, NSString * _Nonnull notedHostname, NSDictionary<TSKDomainConfigurationKey, id> *_Nonnull notedHostnamePinningPolicy) {
+                                                                              [callbackExpectation fulfill];
+                                                                          }];
+
+    XCTAssertEqual([validator evaluateTrust:trust forHostname:@"www.good.com"], TSKTrustDecisionShouldAllowConnection);
+    // The certificate is not valid for this hostname
+    XCTAssertEqual([validator evaluateTrust:trust forHostname:@"www.other.com"], TSKTrustDecisionShouldBlockConnection);
+    // Checking whether the domain is a subdomain of good.com looks up both domains in the registry
+    XCTAssertEqual([validator evaluateTrust:trust forHostname:@"www.notpinned.com"], TSKTrustDecisionDomainNotPinned);
+
+    NSDictionary<NSString *, NSNumber *> *metrics = [TrustKit metricsSnapshot];
+    XCTAssertEqualObjects(metrics[@"trustkit_evaluations_total{decision=\"allow\"}"], @1);
+    XCTAssertEqualObjects(metrics[@"trustkit_evaluations_total{decision=\"block\"}"], @1);
+    XCTAssertEqualObjects(metrics[@"trustkit_evaluations_total{decision=\"not_pinned\"}"], @1);
+    XCTAssertEqualObjects(metrics[@"trustkit_evaluation_results_total{result=\"success\"}"], @1);
+    XCTAssertEqualObjects(metrics[@"trustkit_evaluation_results_total{result=\"invalid_certificate_chain\"}"], @1);
+    XCTAssertEqualObjects(metrics[@"trustkit_pin_validations_total"], @2);
+    NSUInteger spkiCacheLookupCount = metrics[@"trustkit_spki_cache_hits_total"].unsignedIntegerValue + metrics[@"trustkit_spki_cache_misses_total"].unsignedIntegerValue;
+    XCTAssertGreaterThan(spkiCacheLookupCount, 0UL);
+    XCTAssertEqualObjects(metrics[@"trustkit_registry_lookups_total"], @2);
+
+    // The callbacks are delivered on the main queue, which is blocked by the test until now
+    XCTAssertEqualObjects(metrics[@"trustkit_callback_queue_depth"], @2);
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    XCTAssertEqualObjects([TrustKit metricsSnapshot][@"trustkit_callback_queue_depth"], @0);
+
+    CFRelease(trust);
+    CFRelease(leafCertificate);
+    CFRelease(rootCertificate);
+}
+
+@end
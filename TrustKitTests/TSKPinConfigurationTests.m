@@ -368,6 +368,21 @@
     // Ensure the kTSKSwizzleNetworkDelegates setting was saved
     XCTAssertFalse([trustKitConfig[kTSKSwizzleNetworkDelegates] boolValue],
                    @"kTSKSwizzleNetworkDelegates was not saved in the configuration");
+    
+    // Ensure the trust decision cache is disabled by default
+    XCTAssertEqualObjects(trustKitConfig[kTSKTrustDecisionCacheTimeToLive], @0);
+}
+
+
+- (void)testInvalidTrustDecisionCacheTimeToLive
+{
+    XCTAssertThrows(parseTrustKitConfiguration(@{kTSKTrustDecisionCacheTimeToLive : @-1,
+                                                 kTSKPinnedDomains :
+                                                     @{@"good.com" : @{
+                                                               kTSKPublicKeyHashes : @[@"TQEtdMbmwFgYUifM4LDF+xgEtd0z69mPGmkp014d6ZY=",
+                                                                                       @"AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA=" // Fake key
+                                                                                       ]}}}),
+                    @"A negative time to live must be rejected");
 }
 
 
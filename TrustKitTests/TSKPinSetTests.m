@@ -0,0 +1,227 @@
+/*
+
+ TSKPinSetTests.m
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#import <XCTest/XCTest.h>
+
+#import "../TrustKit/Pinning/pin_set.h"
+#import "../TrustKit/Pinning/ssl_pin_verifier.h"
+
+
+// Number of lookups performed in each iteration of the performance tests
+static const NSUInteger kLookupCount = 100000;
+
+
+@interface TSKPinSetTests : XCTestCase
+@end
+
+
+@implementation TSKPinSetTests
+
+- (NSSet<NSData *> *)randomPinsWithCount:(NSUInteger)pinCount
+{
+    NSMutableSet<NSData *> *pins = [NSMutableSet setWithCapacity:pinCount];
+    while (pins.count < pinCount)
+    {
+        NSMutableData *pin = [NSMutableData dataWithLength:TSK_PIN_LENGTH];
+        arc4random_buf(pin.mutableBytes, pin.length);
+        [pins addObject:pin];
+    }
+    return pins;
+}
+
+
+- (void)checkPinSetWithCount:(NSUInteger)pinCount
+{
+    NSSet<NSData *> *pins = [self randomPinsWithCount:pinCount];
+    TSKPinSet *pinSet = createPinSetFromPins(pins);
+    XCTAssertEqual(TSKPinSetGetCount(pinSet), pinCount);
+
+    for (NSData *pin in pins)
+    {
+        XCTAssertTrue(TSKPinSetContains(pinSet, pin.bytes));
+
+        // Differing in the last byte only
+        NSMutableData *otherPin = [pin mutableCopy];
+        ((uint8_t *)otherPin.mutableBytes)[TSK_PIN_LENGTH - 1] ^= 0x01;
+        XCTAssertEqual(TSKPinSetContains(pinSet, otherPin.bytes), [pins containsObject:otherPin]);
+    }
+    TSKPinSetDestroy(pinSet);
+}
+
+
+- (void)testScannedPinSet
+{
+    for (NSUInteger pinCount = 0; pinCount <= TSK_PIN_SET_MAX_SCANNED_PINS; pinCount++)
+    {
+        [self checkPinSetWithCount:pinCount];
+    }
+}
+
+
+- (void)testSortedPinSet
+{
+    [self checkPinSetWithCount:TSK_PIN_SET_MAX_SCANNED_PINS + 1];
+    [self checkPinSetWithCount:1000];
+}
+
+
+- (void)testFilteredPinSet
+{
+    [self checkPinSetWithCount:TSK_PIN_SET_MIN_FILTERED_PINS];
+    [self checkPinSetWithCount:10000];
+
+    TSKPinSet *pinSet = createPinSetFromPins([self randomPinsWithCount:TSK_PIN_SET_MIN_FILTERED_PINS - 1]);
+    XCTAssertFalse(TSKPinSetHasFilter(pinSet));
+    TSKPinSetDestroy(pinSet);
+
+    pinSet = createPinSetFromPins([self randomPinsWithCount:TSK_PIN_SET_MIN_FILTERED_PINS]);
+    XCTAssertTrue(TSKPinSetHasFilter(pinSet));
+
+    // The filter costs about one byte per pin on top of the pins themselves
+    XCTAssertLessThan(TSKPinSetGetMemorySize(pinSet), (size_t)TSK_PIN_SET_MIN_FILTERED_PINS * (TSK_PIN_LENGTH + 2));
+    TSKPinSetDestroy(pinSet);
+}
+
+
+- (void)testDuplicatePins
+{
+    uint8_t pins[3][TSK_PIN_LENGTH] = { { 1 }, { 2 }, { 1 } };
+    TSKPinSet *pinSet = TSKPinSetCreate((const uint8_t (*)[TSK_PIN_LENGTH])pins, 3);
+    XCTAssertEqual(TSKPinSetGetCount(pinSet), 2UL);
+    XCTAssertTrue(TSKPinSetContains(pinSet, pins[0]));
+    XCTAssertTrue(TSKPinSetContains(pinSet, pins[1]));
+    TSKPinSetDestroy(pinSet);
+}
+
+
+#pragma mark Performance
+
+// Look up a mix of pinned and unknown hashes, as happens when checking a certificate chain
+
+- (NSArray<NSData *> *)lookupsForPins:(NSSet<NSData *> *)pins
+{
+    NSMutableArray<NSData *> *lookups = [NSMutableArray arrayWithArray:[self randomPinsWithCount:4].allObjects];
+    [lookups addObject:pins.anyObject];
+    return lookups;
+}
+
+
+- (void)measureNSSetWithPinCount:(NSUInteger)pinCount
+{
+    NSSet<NSData *> *pins = [self randomPinsWithCount:pinCount];
+    NSArray<NSData *> *lookups = [self lookupsForPins:pins];
+    [self measureBlock:^{
+        NSUInteger foundCount = 0;
+        for (NSUInteger i = 0; i < kLookupCount; i++)
+        {
+            // The SPKI hash cache returns a new NSData for every lookup
+            NSData *hash = [NSData dataWithBytes:lookups[i % lookups.count].bytes length:TSK_PIN_LENGTH];
+            foundCount += [pins containsObject:hash];
+        }
+        XCTAssertEqual(foundCount, kLookupCount / lookups.count);
+    }];
+}
+
+
+- (void)measurePinSetWithPinCount:(NSUInteger)pinCount
+{
+    NSSet<NSData *> *pins = [self randomPinsWithCount:pinCount];
+    NSArray<NSData *> *lookups = [self lookupsForPins:pins];
+    TSKPinSet *pinSet = createPinSetFromPins(pins);
+    [self measureBlock:^{
+        NSUInteger foundCount = 0;
+        for (NSUInteger i = 0; i < kLookupCount; i++)
+        {
+            foundCount += TSKPinSetContains(pinSet, lookups[i % lookups.count].bytes);
+        }
+        XCTAssertEqual(foundCount, kLookupCount / lookups.count);
+    }];
+    TSKPinSetDestroy(pinSet);
+}
+
+
+- (void)measurePinSetCreationWithPinCount:(NSUInteger)pinCount
+{
+    NSSet<NSData *> *pins = [self randomPinsWithCount:pinCount];
+    [self measureBlock:^{
+        TSKPinSet *pinSet = createPinSetFromPins(pins);
+        XCTAssertTrue(TSKPinSetHasFilter(pinSet));
+        TSKPinSetDestroy(pinSet);
+    }];
+
+    TSKPinSet *pinSet = createPinSetFromPins(pins);
+    NSLog(@"%lu pins: %.2f bytes per pin", (unsigned long)pinCount,
+          (double)TSKPinSetGetMemorySize(pinSet) / pinCount);
+    TSKPinSetDestroy(pinSet);
+}
+
+
+- (void)testNSSetPerformanceWith2Pins
+{
+    [self measureNSSetWithPinCount:2];
+}
+
+- (void)testPinSetPerformanceWith2Pins
+{
+    [self measurePinSetWithPinCount:2];
+}
+
+- (void)testNSSetPerformanceWith64Pins
+{
+    [self measureNSSetWithPinCount:64];
+}
+
+- (void)testPinSetPerformanceWith64Pins
+{
+    [self measurePinSetWithPinCount:64];
+}
+
+- (void)testNSSetPerformanceWith1000Pins
+{
+    [self measureNSSetWithPinCount:1000];
+}
+
+- (void)testPinSetPerformanceWith1000Pins
+{
+    [self measurePinSetWithPinCount:1000];
+}
+
+- (void)testNSSetPerformanceWith10000Pins
+{
+    [self measureNSSetWithPinCount:10000];
+}
+
+- (void)testPinSetPerformanceWith10000Pins
+{
+    [self measurePinSetWithPinCount:10000];
+}
+
+- (void)testPinSetCreationPerformanceWith10000Pins
+{
+    [self measurePinSetCreationWithPinCount:10000];
+}
+
+- (void)testNSSetPerformanceWith100000Pins
+{
+    [self measureNSSetWithPinCount:100000];
+}
+
+- (void)testPinSetPerformanceWith100000Pins
+{
+    [self measurePinSetWithPinCount:100000];
+}
+
+- (void)testPinSetCreationPerformanceWith100000Pins
+{
+    [self measurePinSetCreationWithPinCount:100000];
+}
+
+@end
@@ -20,6 +20,7 @@
 
 #import "../TrustKit/Pinning/ssl_pin_verifier.h"
 #import "../TrustKit/Pinning/TSKSPKIHashCache.h"
+#import "../TrustKit/Pinning/TSKTrustDecisionCache.h"
 #import "../TrustKit/Reporting/reporting_utils.h"
 
 
@@ -38,6 +39,11 @@
 - (void)resetSubjectPublicKeyInfoDiskCache;
 - (NSMutableDictionary<NSNumber *, SPKICacheDictionnary *> *)getSubjectPublicKeyInfoHashesCache;
 - (NSMutableDictionary<NSNumber *, SPKICacheDictionnary *> *)loadSPKICacheFromFileSystem;
+- (void)flushPendingSubjectPublicKeyInfoEntries;
+@end
+
+@interface TSKPinningValidator (TestSupport)
+- (void)setMaxPendingEvaluationCount:(NSUInteger)maxPendingEvaluationCount;
 @end
 
 static BOOL AllowsAdditionalTrustAnchors = YES; // toggle in tests if needed
@@ -167,6 +173,7 @@ static BOOL AllowsAdditionalTrustAnchors = YES; // toggle in tests if needed
     [self waitForExpectationsWithTimeout:2.0 handler:nil];
     
     // Ensure the SPKI cache was persisted to the filesystem
+    [spkiCache flushPendingSubjectPublicKeyInfoEntries];
     fsCache = [spkiCache loadSPKICacheFromFileSystem];
     XCTAssertEqual([fsCache count], 1UL, @"SPKI cache for RSA 4096 must be persisted to the file system");
     
@@ -932,6 +939,110 @@ static BOOL AllowsAdditionalTrustAnchors = YES; // toggle in tests if needed
 }
 
 
+-(void) testHandleChallengeAsynchronouslyPinningFailed
+{
+    SecCertificateRef certChainArray[1] = {_leafCertificate};
+    SecCertificateRef trustStoreArray[1] = {_rootCertificate};
+    SecTrustRef trust = [TSKCertificateUtils createTrustWithCertificates:(const void **)certChainArray
+                                                             arrayLength:sizeof(certChainArray)/sizeof(certChainArray[0])
+                                                      anchorCertificates:(const void **)trustStoreArray
+                                                             arrayLength:sizeof(trustStoreArray)/sizeof(trustStoreArray[0])];
+    
+    
+    // Create a configuration
+    NSDictionary *trustKitConfig = @{kTSKSwizzleNetworkDelegates: @NO,
+                                     kTSKPinnedDomains :
+                                         @{@"www.good.com" : @{
+                                                   kTSKEnforcePinning: @YES,
+                                                   kTSKPublicKeyHashes : @[@"AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA=", //Fake Key
+                                                                           @"BBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBB=", // Fake key
+                                                                           ]}}};
+    
+    NSDictionary *parsedTrustKitConfig = parseTrustKitConfiguration(trustKitConfig);
+    
+    TSKPinningValidator *validator = [[TSKPinningValidator alloc] initWithDomainPinningPolicies:parsedTrustKitConfig[kTSKPinnedDomains]
+                                                                                   hashCache:spkiCache
+                                                               ignorePinsForUserTrustAnchors:YES
+                                                                     validationCallbackQueue:dispatch_get_main_queue()
+                                                                          validationCallback:^(TSKPinningValidatorResult * _Nonnull result, NSString * _Nonnull notedHostname, NSDictionary<TSKDomainConfigurationKey, id> *_Nonnull notedHostnamePinningPolicy) {
+                                                                         //
+                                                                     }];
+    
+    // Mock a protection space
+    id protectionSpaceMock = [OCMockObject mockForClass:[NSURLProtectionSpace class]];
+    OCMStub([protectionSpaceMock authenticationMethod]).andReturn(NSURLAuthenticationMethodServerTrust);
+    OCMStub([protectionSpaceMock host]).andReturn(@"www.good.com");
+    OCMStub([protectionSpaceMock serverTrust]).andReturn(trust);
+    
+    // Mock an authentication challenge
+    id challengeMock = [OCMockObject mockForClass:[NSURLAuthenticationChallenge class]];
+    OCMStub([challengeMock protectionSpace]).andReturn(protectionSpaceMock);
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Completion handler called"];
+    void (^completionHandler)(NSURLSessionAuthChallengeDisposition, NSURLCredential * _Nullable) = ^void(NSURLSessionAuthChallengeDisposition disposition, NSURLCredential * _Nullable credential)
+    {
+        // For a pinning failure, we expect the authentication challenge to be cancelled
+        XCTAssertEqual(disposition, NSURLSessionAuthChallengeCancelAuthenticationChallenge);
+        XCTAssertNil(credential);
+        [expectation fulfill];
+    };
+    
+    // Test the helper method
+    BOOL wasChallengeHandled = [validator handleChallengeAsynchronously:challengeMock completionHandler:completionHandler];
+    XCTAssertTrue(wasChallengeHandled);
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    
+    CFRelease(trust);
+}
+
+
+-(void) testEvaluateTrustAsynchronously
+{
+    SecCertificateRef certChainArray[1] = {_leafCertificate};
+    SecCertificateRef trustStoreArray[1] = {_rootCertificate};
+    SecTrustRef trust = [TSKCertificateUtils createTrustWithCertificates:(const void **)certChainArray
+                                                             arrayLength:sizeof(certChainArray)/sizeof(certChainArray[0])
+                                                      anchorCertificates:(const void **)trustStoreArray
+                                                             arrayLength:sizeof(trustStoreArray)/sizeof(trustStoreArray[0])];
+    
+    // Create a configuration
+    NSDictionary *trustKitConfig = @{kTSKSwizzleNetworkDelegates: @NO,
+                                     kTSKPinnedDomains :
+                                         @{@"www.good.com" : @{
+                                                   kTSKPublicKeyHashes : @[@"TwyNzy19zZi7cKfPsucs1E+h8ODOCPMrT8681sFWJvw=", // Leaf Key
+                                                                           @"BBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBB=", // Fake key
+                                                                           ]}}};
+    NSDictionary *parsedTrustKitConfig = parseTrustKitConfiguration(trustKitConfig);
+    
+    TSKPinningValidator *validator = [[TSKPinningValidator alloc] initWithDomainPinningPolicies:parsedTrustKitConfig[kTSKPinnedDomains]
+                                                                                   hashCache:spkiCache
+                                                               ignorePinsForUserTrustAnchors:YES
+                                                                     validationCallbackQueue:dispatch_get_main_queue()
+                                                                          validationCallback:^(TSKPinningValidatorResult * _Nonnull result, NSString * _Nonnull notedHostname, NSDictionary<TSKDomainConfigurationKey, id> *_Nonnull notedHostnamePinningPolicy) {
+                                                                         //
+                                                                     }];
+    
+    XCTestExpectation *expectation = [self expectationWithDescription:@"Completion handler called"];
+    [validator evaluateTrust:trust forHostname:@"www.good.com" completionHandler:^(TSKTrustDecision trustDecision) {
+        XCTAssertEqual(trustDecision, TSKTrustDecisionShouldAllowConnection);
+        XCTAssertFalse([NSThread isMainThread]);
+        [expectation fulfill];
+    }];
+    [self waitForExpectationsWithTimeout:5 handler:nil];
+    
+    // When the pool is full, the trust is evaluated on the calling thread
+    [validator setMaxPendingEvaluationCount:0];
+    __block BOOL wasHandlerCalled = NO;
+    [validator evaluateTrust:trust forHostname:@"www.good.com" completionHandler:^(TSKTrustDecision trustDecision) {
+        XCTAssertEqual(trustDecision, TSKTrustDecisionShouldAllowConnection);
+        wasHandlerCalled = YES;
+    }];
+    XCTAssertTrue(wasHandlerCalled);
+    
+    CFRelease(trust);
+}
+
+
 -(void) testHandleChallengeCompletionHandlerNotServerTrustAuthenticationMethod
 {
     SecCertificateRef certChainArray[1] = {_leafCertificate};
@@ -1010,4 +1121,380 @@ static BOOL AllowsAdditionalTrustAnchors = YES; // toggle in tests if needed
     CFRelease(trust);
 }
 
+
+// Pin the leaf key and ensure the following evaluations start with the leaf instead of the CA
+- (void)testChainPositionPrediction
+{
+    // Create a valid server trust
+    SecCertificateRef certChainArray[1] = {_leafCertificate};
+    SecCertificateRef trustStoreArray[1] = {_rootCertificate};
+    SecTrustRef trust = [TSKCertificateUtils createTrustWithCertificates:(const void **)certChainArray
+                                                             arrayLength:sizeof(certChainArray)/sizeof(certChainArray[0])
+                                                      anchorCertificates:(const void **)trustStoreArray
+                                                             arrayLength:sizeof(trustStoreArray)/sizeof(trustStoreArray[0])];
+    
+    // Create a configuration
+    NSDictionary *trustKitConfig = @{kTSKSwizzleNetworkDelegates: @NO,
+                                     kTSKPinnedDomains :
+                                         @{@"www.good.com" : @{
+                                                   kTSKPublicKeyHashes : @[@"TwyNzy19zZi7cKfPsucs1E+h8ODOCPMrT8681sFWJvw=", // Leaf Key
+                                                                           @"AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA=", // Fake key
+                                                                           ]}}};
+    NSDictionary *parsedTrustKitConfig = parseTrustKitConfiguration(trustKitConfig);
+    TSKPinSet *knownPins = createPinSetFromPins(parsedTrustKitConfig[kTSKPinnedDomains][@"www.good.com"][kTSKPublicKeyHashes]);
+    
+    // First test the verifyPublicKeyPinWithInfo() function: without a preferred index, the CA gets checked first
+    TSKPinVerificationInfo info = { .preferredCertificateIndex = -1 };
+    XCTAssertEqual(verifyPublicKeyPinWithInfo(trust, @"www.good.com", knownPins, spkiCache, &info), TSKTrustEvaluationSuccess);
+    XCTAssertEqual(info.matchedCertificateIndex, 0);
+    XCTAssertEqual(info.checkedHashCount, 2UL);
+    XCTAssertEqual(info.avoidedHashCount, 0UL);
+    
+    info.preferredCertificateIndex = 0;
+    XCTAssertEqual(verifyPublicKeyPinWithInfo(trust, @"www.good.com", knownPins, spkiCache, &info), TSKTrustEvaluationSuccess);
+    XCTAssertEqual(info.matchedCertificateIndex, 0);
+    XCTAssertEqual(info.checkedHashCount, 1UL);
+    XCTAssertEqual(info.avoidedHashCount, 1UL);
+    
+    // A wrong prediction falls back to the full scan
+    info.preferredCertificateIndex = 1;
+    XCTAssertEqual(verifyPublicKeyPinWithInfo(trust, @"www.good.com", knownPins, spkiCache, &info), TSKTrustEvaluationSuccess);
+    XCTAssertEqual(info.matchedCertificateIndex, 0);
+    XCTAssertEqual(info.checkedHashCount, 3UL);
+    XCTAssertEqual(info.avoidedHashCount, 0UL);
+    
+    // Then test TSKPinningValidator
+    TSKPinningValidator *validator;
+    validator = [[TSKPinningValidator alloc] initWithDomainPinningPolicies:parsedTrustKitConfig[kTSKPinnedDomains]
+                                                              hashCache:spkiCache
+                                          ignorePinsForUserTrustAnchors:NO
+                                                validationCallbackQueue:dispatch_get_main_queue()
+                                                     validationCallback:^(TSKPinningValidatorResult * _Nonnull result, NSString * _Nonnull notedHostname, NSDictionary<TSKDomainConfigurationKey, id> *_Nonnull notedHostnamePinningPolicy) {}];
+    
+    XCTAssertEqual([validator evaluateTrust:trust forHostname:@"www.good.com"], TSKTrustDecisionShouldAllowConnection);
+    XCTAssertEqual([validator chainPositionPredictionCount], 0UL);
+    
+    XCTAssertEqual([validator evaluateTrust:trust forHostname:@"www.good.com"], TSKTrustDecisionShouldAllowConnection);
+    XCTAssertEqual([validator evaluateTrust:trust forHostname:@"www.good.com"], TSKTrustDecisionShouldAllowConnection);
+    XCTAssertEqual([validator chainPositionPredictionCount], 2UL);
+    XCTAssertEqual([validator chainPositionPredictionHitCount], 2UL);
+    XCTAssertEqual([validator avoidedSubjectPublicKeyInfoHashCount], 2UL);
+    
+    TSKPinSetDestroy(knownPins);
+    CFRelease(trust);
+}
+
+
+// A CA whose key is not supported fails the verification even when the leaf matches at the predicted position, as
+// scanning the chain from the CA would
+- (void)testChainPositionPredictionWithUnsupportedCAKey
+{
+    // The leaf has the same key as www.good.com, but is issued by a CA with a P-521 key
+    SecCertificateRef leafCertificate = [TSKCertificateUtils createCertificateFromDer:@"www.good.com.unsupportedca"];
+    SecCertificateRef rootCertificate = [TSKCertificateUtils createCertificateFromDer:@"UnsupportedKeyRootCA"];
+    SecCertificateRef certChainArray[1] = {leafCertificate};
+    SecCertificateRef trustStoreArray[1] = {rootCertificate};
+    SecTrustRef trust = [TSKCertificateUtils createTrustWithCertificates:(const void **)certChainArray
+                                                             arrayLength:sizeof(certChainArray)/sizeof(certChainArray[0])
+                                                      anchorCertificates:(const void **)trustStoreArray
+                                                             arrayLength:sizeof(trustStoreArray)/sizeof(trustStoreArray[0])];
+    
+    NSDictionary *trustKitConfig = @{kTSKSwizzleNetworkDelegates: @NO,
+                                     kTSKPinnedDomains :
+                                         @{@"www.good.com" : @{
+                                                   kTSKPublicKeyHashes : @[@"TwyNzy19zZi7cKfPsucs1E+h8ODOCPMrT8681sFWJvw=", // Leaf Key
+                                                                           @"AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA=", // Fake key
+                                                                           ]}}};
+    NSDictionary *parsedTrustKitConfig = parseTrustKitConfiguration(trustKitConfig);
+    TSKPinSet *knownPins = createPinSetFromPins(parsedTrustKitConfig[kTSKPinnedDomains][@"www.good.com"][kTSKPublicKeyHashes]);
+    
+    TSKPinVerificationInfo info = { .preferredCertificateIndex = -1 };
+    XCTAssertEqual(verifyPublicKeyPinWithInfo(trust, @"www.good.com", knownPins, spkiCache, &info),
+                   TSKTrustEvaluationErrorCouldNotGenerateSpkiHash);
+    
+    info.preferredCertificateIndex = 0;
+    XCTAssertEqual(verifyPublicKeyPinWithInfo(trust, @"www.good.com", knownPins, spkiCache, &info),
+                   TSKTrustEvaluationErrorCouldNotGenerateSpkiHash);
+    XCTAssertEqual(info.matchedCertificateIndex, -1);
+    XCTAssertEqual(info.avoidedHashCount, 0UL);
+    
+    TSKPinSetDestroy(knownPins);
+    CFRelease(trust);
+    CFRelease(leafCertificate);
+    CFRelease(rootCertificate);
+}
+
+
+- (void)testTrustDecisionCache
+{
+    // Create a valid server trust
+    SecCertificateRef certChainArray[1] = {_leafCertificate};
+    SecCertificateRef trustStoreArray[1] = {_rootCertificate};
+    SecTrustRef trust = [TSKCertificateUtils createTrustWithCertificates:(const void **)certChainArray
+                                                             arrayLength:sizeof(certChainArray)/sizeof(certChainArray[0])
+                                                      anchorCertificates:(const void **)trustStoreArray
+                                                             arrayLength:sizeof(trustStoreArray)/sizeof(trustStoreArray[0])];
+    
+    // Create a configuration; www.other.com uses the same pins but does not match the certificate's hostname
+    NSDictionary *trustKitConfig = @{kTSKSwizzleNetworkDelegates: @NO,
+                                     kTSKTrustDecisionCacheTimeToLive: @60,
+                                     kTSKPinnedDomains :
+                                         @{@"www.good.com" : @{
+                                                   kTSKPublicKeyHashes : @[@"TwyNzy19zZi7cKfPsucs1E+h8ODOCPMrT8681sFWJvw=", // Leaf Key
+                                                                           @"AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA=", // Fake key
+                                                                           ]},
+                                           @"www.other.com" : @{
+                                                   kTSKPublicKeyHashes : @[@"TwyNzy19zZi7cKfPsucs1E+h8ODOCPMrT8681sFWJvw=", // Leaf Key
+                                                                           @"AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA=", // Fake key
+                                                                           ]}}};
+    NSDictionary *parsedTrustKitConfig = parseTrustKitConfiguration(trustKitConfig);
+    XCTAssertEqualObjects(parsedTrustKitConfig[kTSKTrustDecisionCacheTimeToLive], @60);
+    
+    __block NSUInteger callbackCount = 0;
+    TSKPinningValidator *validator;
+    validator = [[TSKPinningValidator alloc] initWithDomainPinningPolicies:parsedTrustKitConfig[kTSKPinnedDomains]
+                                                              hashCache:spkiCache
+                                          ignorePinsForUserTrustAnchors:NO
+                                                validationCallbackQueue:dispatch_get_main_queue()
+                                                     validationCallback:^(TSKPinningValidatorResult * _Nonnull result, NSString * _Nonnull notedHostname, NSDictionary<TSKDomainConfigurationKey, id> *_Nonnull notedHostnamePinningPolicy) {
+                                                         callbackCount += 1;
+                                                     }];
+    XCTAssertNil(validator.trustDecisionCache);
+    TSKTrustDecisionCache *cache = [[TSKTrustDecisionCache alloc] initWithTimeToLive:60 maximumEntryCount:1];
+    validator.trustDecisionCache = cache;
+    
+    // The second evaluation uses the cached decision, without checking the pins
+    XCTAssertEqual([validator evaluateTrust:trust forHostname:@"www.good.com"], TSKTrustDecisionShouldAllowConnection);
+    XCTAssertEqual([validator evaluateTrust:trust forHostname:@"www.good.com"], TSKTrustDecisionShouldAllowConnection);
+    XCTAssertEqual(cache.missCount, 1UL);
+    XCTAssertEqual(cache.hitCount, 1UL);
+    XCTAssertEqual(cache.entryCount, 1UL);
+    XCTAssertEqual([validator chainPositionPredictionCount], 0UL);
+    
+    // Failures are not cached
+    XCTAssertEqual([validator evaluateTrust:trust forHostname:@"www.other.com"], TSKTrustDecisionShouldBlockConnection);
+    XCTAssertEqual([validator evaluateTrust:trust forHostname:@"www.other.com"], TSKTrustDecisionShouldBlockConnection);
+    XCTAssertEqual(cache.missCount, 3UL);
+    XCTAssertEqual(cache.hitCount, 1UL);
+    XCTAssertEqual(cache.entryCount, 1UL);
+    
+    // The callback is still invoked for every evaluation
+    [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    XCTAssertEqual(callbackCount, 4UL);
+    
+    // The oldest entry gets evicted when the cache is full
+    NSData *chainDigest = [TSKTrustDecisionCache digestForCertificateChain:trust];
+    XCTAssertEqual(chainDigest.length, 32UL);
+    [cache addSuccessfulValidationForHostname:@"www.third.com" chainDigest:chainDigest policyExpirationDate:nil];
+    XCTAssertEqual(cache.evictionCount, 1UL);
+    XCTAssertFalse([cache containsSuccessfulValidationForHostname:@"www.good.com" chainDigest:chainDigest]);
+    XCTAssertTrue([cache containsSuccessfulValidationForHostname:@"www.third.com" chainDigest:chainDigest]);
+    
+    // Entries do not outlive the policy
+    [cache removeAllValidations];
+    [cache addSuccessfulValidationForHostname:@"www.good.com" chainDigest:chainDigest policyExpirationDate:[NSDate dateWithTimeIntervalSinceNow:-1]];
+    XCTAssertEqual(cache.entryCount, 0UL);
+    
+    // Or the time to live
+    cache = [[TSKTrustDecisionCache alloc] initWithTimeToLive:0.1 maximumEntryCount:8];
+    [cache addSuccessfulValidationForHostname:@"www.good.com" chainDigest:chainDigest policyExpirationDate:nil];
+    XCTAssertTrue([cache containsSuccessfulValidationForHostname:@"www.good.com" chainDigest:chainDigest]);
+    [NSThread sleepForTimeInterval:0.2];
+    XCTAssertFalse([cache containsSuccessfulValidationForHostname:@"www.good.com" chainDigest:chainDigest]);
+    XCTAssertEqual(cache.entryCount, 0UL);
+    
+    CFRelease(trust);
+}
+
+
+- (void)testConcurrentEvaluationsAreCoalesced
+{
+    // Create a valid server trust
+    SecCertificateRef certChainArray[1] = {_leafCertificate};
+    SecCertificateRef trustStoreArray[1] = {_rootCertificate};
+    SecTrustRef trust = [TSKCertificateUtils createTrustWithCertificates:(const void **)certChainArray
+                                                             arrayLength:sizeof(certChainArray)/sizeof(certChainArray[0])
+                                                      anchorCertificates:(const void **)trustStoreArray
+                                                             arrayLength:sizeof(trustStoreArray)/sizeof(trustStoreArray[0])];
+    
+    // Create a configuration
+    NSDictionary *trustKitConfig = @{kTSKSwizzleNetworkDelegates: @NO,
+                                     kTSKPinnedDomains :
+                                         @{@"www.good.com" : @{
+                                                   kTSKPublicKeyHashes : @[@"TwyNzy19zZi7cKfPsucs1E+h8ODOCPMrT8681sFWJvw=", // Leaf Key
+                                                                           @"AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA=", // Fake key
+                                                                           ]}}};
+    NSDictionary *parsedTrustKitConfig = parseTrustKitConfiguration(trustKitConfig);
+    
+    TSKPinningValidator *validator;
+    validator = [[TSKPinningValidator alloc] initWithDomainPinningPolicies:parsedTrustKitConfig[kTSKPinnedDomains]
+                                                              hashCache:spkiCache
+                                          ignorePinsForUserTrustAnchors:NO
+                                                validationCallbackQueue:dispatch_get_main_queue()
+                                                     validationCallback:^(TSKPinningValidatorResult * _Nonnull result, NSString * _Nonnull notedHostname, NSDictionary<TSKDomainConfigurationKey, id> *_Nonnull notedHostnamePinningPolicy) {}];
+    
+    // Like the challenges of parallel requests to the same server; each gets its own trust object
+    const size_t evaluationCount = 20;
+    __block NSUInteger allowedCount = 0;
+    dispatch_apply(evaluationCount, dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0), ^(size_t i) {
+        SecTrustRef evaluationTrust = [TSKCertificateUtils createTrustWithCertificates:(const void **)certChainArray
+                                                                           arrayLength:sizeof(certChainArray)/sizeof(certChainArray[0])
+                                                                    anchorCertificates:(const void **)trustStoreArray
+                                                                           arrayLength:sizeof(trustStoreArray)/sizeof(trustStoreArray[0])];
+        TSKTrustDecision decision = [validator evaluateTrust:evaluationTrust forHostname:@"www.good.com"];
+        @synchronized(validator)
+        {
+            allowedCount += (decision == TSKTrustDecisionShouldAllowConnection);
+        }
+        CFRelease(evaluationTrust);
+    });
+    
+    // How many evaluations get coalesced depends on the scheduling, but every one of them is accounted for
+    XCTAssertEqual(allowedCount, (NSUInteger)evaluationCount);
+    XCTAssertEqual([validator pinValidationCount] + [validator coalescedPinValidationCount], (NSUInteger)evaluationCount);
+    XCTAssertGreaterThanOrEqual([validator pinValidationCount], 1UL);
+    
+    // Once they are done, the next evaluation runs again
+    XCTAssertEqual([validator evaluateTrust:trust forHostname:@"www.good.com"], TSKTrustDecisionShouldAllowConnection);
+    XCTAssertEqual([validator pinValidationCount] + [validator coalescedPinValidationCount], (NSUInteger)evaluationCount + 1);
+    
+    CFRelease(trust);
+}
+
+
+- (void)testValidationLatencySnapshots
+{
+    SecCertificateRef certChainArray[1] = {_leafCertificate};
+    SecCertificateRef trustStoreArray[1] = {_rootCertificate};
+    SecTrustRef trust = [TSKCertificateUtils createTrustWithCertificates:(const void **)certChainArray
+                                                             arrayLength:sizeof(certChainArray)/sizeof(certChainArray[0])
+                                                      anchorCertificates:(const void **)trustStoreArray
+                                                             arrayLength:sizeof(trustStoreArray)/sizeof(trustStoreArray[0])];
+    
+    NSDictionary *trustKitConfig = @{kTSKSwizzleNetworkDelegates: @NO,
+                                     kTSKPinnedDomains :
+                                         @{@"www.good.com" : @{
+                                                   kTSKPublicKeyHashes : @[@"TwyNzy19zZi7cKfPsucs1E+h8ODOCPMrT8681sFWJvw=", // Leaf Key
+                                                                           @"BBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBB=", // Fake key
+                                                                           ]}}};
+    NSDictionary *parsedTrustKitConfig = parseTrustKitConfiguration(trustKitConfig);
+    
+    __block TSKPinningValidatorResult *lastResult = nil;
+    TSKPinningValidator *validator = [[TSKPinningValidator alloc] initWithDomainPinningPolicies:parsedTrustKitConfig[kTSKPinnedDomains]
+                                                                                   hashCache:spkiCache
+                                                               ignorePinsForUserTrustAnchors:YES
+                                                                     validationCallbackQueue:dispatch_get_main_queue()
+                                                                          validationCallback:^(TSKPinningValidatorResult * _Nonnull result, NSString * _Nonnull notedHostname, NSDictionary<TSKDomainConfigurationKey, id> *_Nonnull notedHostnamePinningPolicy) {
+                                                                              lastResult = result;
+                                                                          }];
+    XCTAssertEqual([validator validationLatencySnapshots].count, 0UL);
+    
+    // Domains that are not pinned are not measured
+    XCTAssertEqual([validator evaluateTrust:trust forHostname:@"www.notpinned.com"], TSKTrustDecisionDomainNotPinned);
+    XCTAssertEqual([validator validationLatencySnapshots].count, 0UL);
+    
+    for (int i = 0; i < 10; i++)
+    {
+        XCTAssertEqual([validator evaluateTrust:trust forHostname:@"www.good.com"], TSKTrustDecisionShouldAllowConnection);
+    }
+    
+    // Every phase but the decision cache, which is disabled, got recorded for each validation
+    NSDictionary<TSKValidationPhase, TSKValidationLatencySnapshot *> *snapshots = [validator validationLatencySnapshots];
+    NSSet *expectedPhases = [NSSet setWithArray:@[kTSKValidationPhasePolicyLookup, kTSKValidationPhaseChainEvaluation,
+                                                  kTSKValidationPhaseSPKIHashing, kTSKValidationPhasePinMatching,
+                                                  kTSKValidationPhaseTotal]];
+    XCTAssertEqualObjects([NSSet setWithArray:snapshots.allKeys], expectedPhases);
+    for (TSKValidationPhase phase in expectedPhases)
+    {
+        TSKValidationLatencySnapshot *snapshot = snapshots[phase];
+        XCTAssertEqual(snapshot.count, 10UL);
+        XCTAssertLessThanOrEqual(snapshot.minimumDuration, snapshot.meanDuration);
+        XCTAssertLessThanOrEqual(snapshot.meanDuration, snapshot.maximumDuration);
+        XCTAssertLessThanOrEqual([snapshot durationAtPercentile:50], [snapshot durationAtPercentile:99]);
+        XCTAssertLessThanOrEqual([snapshot durationAtPercentile:99], snapshot.maximumDuration);
+    }
+    
+    // Each phase is shorter than the whole validation
+    TSKValidationLatencySnapshot *total = snapshots[kTSKValidationPhaseTotal];
+    XCTAssertGreaterThan(total.maximumDuration, 0);
+    XCTAssertLessThanOrEqual(snapshots[kTSKValidationPhaseChainEvaluation].meanDuration, total.meanDuration);
+    
+    // The result of each validation has the breakdown of its own duration
+    [[NSRunLoop mainRunLoop] runUntilDate:[NSDate dateWithTimeIntervalSinceNow:0.1]];
+    XCTAssertNotNil(lastResult);
+    XCTAssertEqualObjects([NSSet setWithArray:lastResult.phaseDurations.allKeys], expectedPhases);
+    XCTAssertEqualWithAccuracy(lastResult.phaseDurations[kTSKValidationPhaseTotal].doubleValue, lastResult.validationDuration, 1e-9);
+    
+    CFRelease(trust);
+}
+
+
+#pragma mark Delegate queue blocking time
+
+// The time the delegate queue is blocked while handling a burst of challenges, synchronously or not
+- (void)measureChallengeHandlingAsynchronously:(BOOL)asynchronously
+{
+    SecCertificateRef certChainArray[1] = {_leafCertificate};
+    SecCertificateRef trustStoreArray[1] = {_rootCertificate};
+    SecTrustRef trust = [TSKCertificateUtils createTrustWithCertificates:(const void **)certChainArray
+                                                             arrayLength:sizeof(certChainArray)/sizeof(certChainArray[0])
+                                                      anchorCertificates:(const void **)trustStoreArray
+                                                             arrayLength:sizeof(trustStoreArray)/sizeof(trustStoreArray[0])];
+    
+    NSDictionary *trustKitConfig = @{kTSKSwizzleNetworkDelegates: @NO,
+                                     kTSKPinnedDomains :
+                                         @{@"www.good.com" : @{
+                                                   kTSKPublicKeyHashes : @[@"TwyNzy19zZi7cKfPsucs1E+h8ODOCPMrT8681sFWJvw=", // Leaf Key
+                                                                           @"BBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBBB=", // Fake key
+                                                                           ]}}};
+    NSDictionary *parsedTrustKitConfig = parseTrustKitConfiguration(trustKitConfig);
+    TSKPinningValidator *validator = [[TSKPinningValidator alloc] initWithDomainPinningPolicies:parsedTrustKitConfig[kTSKPinnedDomains]
+                                                                                   hashCache:spkiCache
+                                                               ignorePinsForUserTrustAnchors:YES
+                                                                     validationCallbackQueue:dispatch_get_main_queue()
+                                                                          validationCallback:^(TSKPinningValidatorResult * _Nonnull result, NSString * _Nonnull notedHostname, NSDictionary<TSKDomainConfigurationKey, id> *_Nonnull notedHostnamePinningPolicy) {}];
+    
+    id protectionSpaceMock = [OCMockObject mockForClass:[NSURLProtectionSpace class]];
+    OCMStub([protectionSpaceMock authenticationMethod]).andReturn(NSURLAuthenticationMethodServerTrust);
+    OCMStub([protectionSpaceMock host]).andReturn(@"www.good.com");
+    OCMStub([protectionSpaceMock serverTrust]).andReturn(trust);
+    id challengeMock = [OCMockObject mockForClass:[NSURLAuthenticationChallenge class]];
+    OCMStub([challengeMock protectionSpace]).andReturn(protectionSpaceMock);
+    
+    [self measureMetrics:@[XCTPerformanceMetric_WallClockTime] automaticallyStartMeasuring:NO forBlock:^{
+        dispatch_group_t group = dispatch_group_create();
+        void (^completionHandler)(NSURLSessionAuthChallengeDisposition, NSURLCredential * _Nullable) = ^void(NSURLSessionAuthChallengeDisposition disposition, NSURLCredential * _Nullable credential) {
+            dispatch_group_leave(group);
+        };
+        
+        [self startMeasuring];
+        for (int i = 0; i < 20; i++)
+        {
+            dispatch_group_enter(group);
+            if (asynchronously)
+            {
+                [validator handleChallengeAsynchronously:challengeMock completionHandler:completionHandler];
+            }
+            else
+            {
+                [validator handleChallenge:challengeMock completionHandler:completionHandler];
+            }
+        }
+        [self stopMeasuring];
+        dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+    }];
+    
+    CFRelease(trust);
+}
+
+- (void)testHandleChallengeBlockingTime
+{
+    [self measureChallengeHandlingAsynchronously:NO];
+}
+
+- (void)testHandleChallengeAsynchronouslyBlockingTime
+{
+    [self measureChallengeHandlingAsynchronously:YES];
+}
+
 @end
@@ -24,6 +24,8 @@
 @interface TSKSPKIHashCache (TestSupport)
 - (void)resetSubjectPublicKeyInfoDiskCache;
 - (NSMutableDictionary<NSNumber *, SPKICacheDictionnary *> *)getSubjectPublicKeyInfoHashesCache;
+- (SPKICacheDictionnary *)loadSPKICacheFromFileSystem;
+- (void)flushPendingSubjectPublicKeyInfoEntries;
 @end
 
 
@@ -198,4 +200,130 @@
     [self waitForExpectationsWithTimeout:5.0 handler:nil];
 }
 
+- (void)testSPKICacheWriteBehindPersistsAllPendingEntries
+{
+    NSArray<NSString *> *certificateNames = @[@"www.globalsign.com", @"www.good.com", @"GoodRootCA"];
+    for (NSString *certificateName in certificateNames)
+    {
+        SecCertificateRef certificate = [TSKCertificateUtils createCertificateFromDer:certificateName];
+        [spkiCache hashSubjectPublicKeyInfoFromCertificate:certificate];
+        CFRelease(certificate);
+    }
+    
+    // Nothing gets written on the handshake path
+    XCTAssertEqual([spkiCache loadSPKICacheFromFileSystem].count, 0UL);
+    
+    // The entries of the burst of cache misses get persisted together
+    [spkiCache flushPendingSubjectPublicKeyInfoEntries];
+    XCTAssertEqual([spkiCache loadSPKICacheFromFileSystem].count, certificateNames.count);
+    
+    // And get loaded by a new cache instance
+    TSKSPKIHashCache *reloadedCache = [[TSKSPKIHashCache alloc] initWithIdentifier:@"test"];
+    XCTAssertEqual([reloadedCache getSubjectPublicKeyInfoHashesCache].count, certificateNames.count);
+}
+
+
+- (void)testSPKICacheJournalDiscardsTornRecord
+{
+    SecCertificateRef certificate = [TSKCertificateUtils createCertificateFromDer:@"www.globalsign.com"];
+    NSData *spkiHash = [spkiCache hashSubjectPublicKeyInfoFromCertificate:certificate];
+    CFRelease(certificate);
+    [spkiCache flushPendingSubjectPublicKeyInfoEntries];
+    
+    // Simulate a crash in the middle of appending a record to the journal
+    NSURL *cachesDirUrl = [NSFileManager.defaultManager URLsForDirectory:NSCachesDirectory
+                                                               inDomains:NSUserDomainMask].firstObject;
+    NSURL *journalUrl = [cachesDirUrl URLByAppendingPathComponent:@"test.journal"];
+    NSFileHandle *journal = [NSFileHandle fileHandleForWritingToURL:journalUrl error:nil];
+    XCTAssertNotNil(journal);
+    [journal seekToEndOfFile];
+    const uint8_t tornRecord[] = { 0x00, 0x02, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x30, 0x82 };
+    [journal writeData:[NSData dataWithBytes:tornRecord length:sizeof(tornRecord)]];
+    [journal closeFile];
+    
+    // The valid record must still be loaded
+    spkiCache = [[TSKSPKIHashCache alloc] initWithIdentifier:@"test"];
+    SPKICacheDictionnary *cache = [spkiCache getSubjectPublicKeyInfoHashesCache];
+    XCTAssertEqual(cache.count, 1UL);
+    XCTAssertEqualObjects(cache.allValues.firstObject, spkiHash);
+    
+    // And new records must be appended after it rather than after the torn one
+    certificate = [TSKCertificateUtils createCertificateFromDer:@"www.good.com"];
+    [spkiCache hashSubjectPublicKeyInfoFromCertificate:certificate];
+    CFRelease(certificate);
+    [spkiCache flushPendingSubjectPublicKeyInfoEntries];
+    XCTAssertEqual([spkiCache loadSPKICacheFromFileSystem].count, 2UL);
+}
+
+
+- (void)testSPKICacheEnumeratesChainHashesInOrder
+{
+    NSArray<NSString *> *certificateNames = @[@"GlobalSignRootCA", @"GlobalSignDomainValidationCA-SHA256-G2", @"www.globalsign.com"];
+    NSMutableArray *certificates = [NSMutableArray array];
+    for (NSString *certificateName in certificateNames)
+    {
+        SecCertificateRef certificate = [TSKCertificateUtils createCertificateFromDer:certificateName];
+        [certificates addObject:(__bridge_transfer id)certificate];
+    }
+    
+    // Cache one of the hashes so that the chain mixes cached and generated hashes
+    NSData *leafHash = [spkiCache hashSubjectPublicKeyInfoFromCertificate:(__bridge SecCertificateRef)certificates[2]];
+    
+    NSMutableArray<NSNumber *> *indexes = [NSMutableArray array];
+    NSMutableArray<NSData *> *hashes = [NSMutableArray array];
+    [spkiCache enumerateSubjectPublicKeyInfoHashesFromCertificates:certificates
+                                                        usingBlock:^(NSUInteger index, NSData *hash, BOOL *stop) {
+        XCTAssertTrue(NSThread.isMainThread);
+        XCTAssertNotNil(hash);
+        [indexes addObject:@(index)];
+        [hashes addObject:hash];
+    }];
+    XCTAssertEqualObjects(indexes, (@[@0, @1, @2]));
+    XCTAssertEqualObjects(hashes[2], leafHash);
+    
+    // The hashes must be the same as the ones generated one at a time
+    TSKSPKIHashCache *otherCache = [[TSKSPKIHashCache alloc] initWithIdentifier:@""];
+    for (NSUInteger i = 0; i < certificates.count; i++)
+    {
+        XCTAssertEqualObjects(hashes[i], [otherCache hashSubjectPublicKeyInfoFromCertificate:(__bridge SecCertificateRef)certificates[i]]);
+    }
+    
+    // Stopping the enumeration must not deliver any other hash
+    [spkiCache resetSubjectPublicKeyInfoDiskCache];
+    spkiCache = [[TSKSPKIHashCache alloc] initWithIdentifier:@"test"];
+    __block NSUInteger callCount = 0;
+    [spkiCache enumerateSubjectPublicKeyInfoHashesFromCertificates:certificates
+                                                        usingBlock:^(NSUInteger index, NSData *hash, BOOL *stop) {
+        callCount += 1;
+        *stop = YES;
+    }];
+    XCTAssertEqual(callCount, 1UL);
+}
+
+
+- (void)testSPKICacheIgnoresForeignSnapshot
+{
+    // Simulate a cache written in the keyed archive format of previous versions
+    NSURL *cachesDirUrl = [NSFileManager.defaultManager URLsForDirectory:NSCachesDirectory
+                                                               inDomains:NSUserDomainMask].firstObject;
+    NSURL *snapshotUrl = [cachesDirUrl URLByAppendingPathComponent:@"test"];
+    NSData *certificateData = [@"certificate" dataUsingEncoding:NSUTF8StringEncoding];
+    NSData *archivedCache = [NSKeyedArchiver archivedDataWithRootObject:@{certificateData: certificateData}
+                                                  requiringSecureCoding:YES
+                                                                  error:nil];
+    XCTAssertTrue([archivedCache writeToURL:snapshotUrl atomically:YES]);
+    
+    // The cache must start empty and still work
+    spkiCache = [[TSKSPKIHashCache alloc] initWithIdentifier:@"test"];
+    XCTAssertEqual([spkiCache getSubjectPublicKeyInfoHashesCache].count, 0UL);
+    
+    SecCertificateRef certificate = [TSKCertificateUtils createCertificateFromDer:@"www.globalsign.com"];
+    NSData *spkiHash = [spkiCache hashSubjectPublicKeyInfoFromCertificate:certificate];
+    CFRelease(certificate);
+    XCTAssertEqualObjects([spkiHash base64EncodedStringWithOptions:0], @"NDCIt6TrQnfOk+lquunrmlPQB3K/7CLOCmSS5kW+KCc=");
+    
+    [spkiCache flushPendingSubjectPublicKeyInfoEntries];
+    XCTAssertEqual([spkiCache loadSPKICacheFromFileSystem].count, 1UL);
+}
+
 @end
@@ -180,6 +180,28 @@ static NSString * const kTSKDefaultReportUri = @"https://overmind.datatheorem.co
 }
 
 
+- (void)testValidatorResultCertificateChainOutlivesTrust
+{
+    SecCertificateRef certChainArray[1] = { _leafCertificate };
+    SecCertificateRef trustStoreArray[1] = { _rootCertificate };
+    SecTrustRef trust = [TSKCertificateUtils createTrustWithCertificates:(const void **)certChainArray
+                                                             arrayLength:sizeof(certChainArray)/sizeof(certChainArray[0])
+                                                      anchorCertificates:(const void **)trustStoreArray
+                                                             arrayLength:sizeof(trustStoreArray)/sizeof(trustStoreArray[0])];
+    
+    TSKPinningValidatorResult *res = [[TSKPinningValidatorResult alloc] initWithServerHostname:@"www.test.com"
+                                                                                    serverTrust:trust
+                                                                               validationResult:TSKTrustEvaluationSuccess
+                                                                             finalTrustDecision:TSKTrustDecisionShouldAllowConnection
+                                                                             validationDuration:1.0];
+    
+    // The PEM certificates are only generated when first read, which can be after the trust was released
+    CFRelease(trust);
+    XCTAssertEqualObjects(res.certificateChain, _testCertificateChain);
+    XCTAssertEqual(res.certificateChain, res.certificateChain);
+}
+
+
 - (void)testReporter
 {
     // Just try a simple valid case to see if we can post this to the default report URL
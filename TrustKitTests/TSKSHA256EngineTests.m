@@ -0,0 +1,126 @@
+/*
+
+ TSKSHA256EngineTests.m
+ TrustKit
+
+ Copyright 2024 The TrustKit Project Authors
+ Licensed under the MIT license, see associated LICENSE file for terms.
+ See AUTHORS file for the list of project authors.
+
+ */
+
+#import <XCTest/XCTest.h>
+#import <CommonCrypto/CommonDigest.h>
+
+#import "../TrustKit/Pinning/sha256_engine.h"
+
+
+@interface TSKSHA256EngineTests : XCTestCase
+{
+    TSKSHA256Backend defaultBackend;
+    BOOL defaultMultiBufferEnabled;
+    NSMutableData *message;
+}
+@end
+
+
+@implementation TSKSHA256EngineTests
+
+- (void)setUp
+{
+    [super setUp];
+    defaultBackend = TSKSHA256GetBackend();
+    defaultMultiBufferEnabled = TSKSHA256IsMultiBufferEnabled();
+
+    message = [NSMutableData dataWithLength:4096];
+    uint8_t *bytes = message.mutableBytes;
+    for (NSUInteger i = 0; i < message.length; i++)
+    {
+        bytes[i] = (uint8_t)(i * 13 + 5);
+    }
+}
+
+- (void)tearDown
+{
+    TSKSHA256SetBackend(defaultBackend);
+    TSKSHA256SetMultiBufferEnabled(defaultMultiBufferEnabled);
+    [super tearDown];
+}
+
+
+- (void)testSelfTest
+{
+    XCTAssertTrue(TSKSHA256SelfTest());
+    XCTAssertTrue(TSKSHA256IsBackendAvailable(TSKSHA256BackendPortable));
+
+#if defined(__arm64__)
+    // Every Apple arm64 CPU has the cryptography extensions
+    XCTAssertEqual(TSKSHA256GetBackend(), TSKSHA256BackendARMv8);
+#endif
+}
+
+
+- (void)testEveryBackendMatchesCommonCrypto
+{
+    for (int backend = 0; backend < TSKSHA256BackendCount; backend++)
+    {
+        if (!TSKSHA256SetBackend(backend))
+        {
+            continue;
+        }
+
+        for (NSUInteger length = 0; length < 1100; length++)
+        {
+            uint8_t expectedDigest[CC_SHA256_DIGEST_LENGTH];
+            uint8_t digest[TSK_SHA256_DIGEST_LENGTH];
+            CC_SHA256(message.bytes, (CC_LONG)length, expectedDigest);
+            TSKSHA256Hash(message.bytes, length, digest);
+            XCTAssertEqual(memcmp(digest, expectedDigest, sizeof(digest)), 0, @"Backend %s, length %lu",
+                           TSKSHA256GetBackendName(backend), (unsigned long)length);
+        }
+    }
+}
+
+
+- (void)testHashManyMatchesCommonCrypto
+{
+    // Typical SPKI and certificate sizes, so that the lanes finish after a different number of blocks
+    const size_t lengths[] = { 91, 120, 294, 422, 550, 1250, 0, 64, 55, 56, 1800, 2000, 3 };
+    const size_t messageCount = sizeof(lengths) / sizeof(lengths[0]);
+    TSKSHA256Message messages[messageCount];
+    for (size_t i = 0; i < messageCount; i++)
+    {
+        messages[i].data = (const uint8_t *)message.bytes + i;
+        messages[i].length = lengths[i];
+    }
+
+    for (int backend = 0; backend < TSKSHA256BackendCount; backend++)
+    {
+        if (!TSKSHA256SetBackend(backend))
+        {
+            continue;
+        }
+        for (int multiBuffer = 0; multiBuffer < 2; multiBuffer++)
+        {
+            if (!TSKSHA256SetMultiBufferEnabled(multiBuffer))
+            {
+                continue;
+            }
+
+            // Also check partial batches
+            for (size_t batchCount = 1; batchCount <= messageCount; batchCount++)
+            {
+                uint8_t digests[messageCount][TSK_SHA256_DIGEST_LENGTH];
+                TSKSHA256HashMany(messages, batchCount, digests);
+                for (size_t i = 0; i < batchCount; i++)
+                {
+                    uint8_t expectedDigest[CC_SHA256_DIGEST_LENGTH];
+                    CC_SHA256(messages[i].data, (CC_LONG)messages[i].length, expectedDigest);
+                    XCTAssertEqual(memcmp(digests[i], expectedDigest, sizeof(expectedDigest)), 0);
+                }
+            }
+        }
+    }
+}
+
+@end